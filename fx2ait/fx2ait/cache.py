@@ -14,8 +14,15 @@
 #
 import os.path as path
 
+from aitemplate.backend.profiler_cache_tools import merge_profile_caches
+
 
 def save_profile_cache(remote_cache_file_path, cache_path):
+    if path.isfile(remote_cache_file_path):
+        # Keep the entries that were added to the remote cache since it was
+        # loaded, e.g. by other machines.
+        merge_profile_caches(remote_cache_file_path, [cache_path])
+        return
     with open(cache_path, "rb") as f:
         with open(remote_cache_file_path, "wb") as target:
             target.write(f.read())
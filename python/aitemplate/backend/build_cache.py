@@ -23,14 +23,17 @@ to this file which allows to instantiate build caches
 with Meta-internal backing infrastructure.
 """
 
+from typing import Optional
+
 from aitemplate.backend.build_cache_base import (
     BuildCache,
     FileBasedBuildCache,
     NoBuildCache,
+    ObjectCache,
 )
 from aitemplate.utils import environ as aitemplate_env
 
-__all__ = ["BUILD_CACHE", "BuildCache"]
+__all__ = ["BUILD_CACHE", "BuildCache", "OBJECT_CACHE", "ObjectCache"]
 
 
 def create_build_cache() -> BuildCache:
@@ -42,3 +45,14 @@ def create_build_cache() -> BuildCache:
 
 
 BUILD_CACHE: BuildCache = create_build_cache()
+
+
+def create_object_cache() -> Optional[ObjectCache]:
+    object_cache_dir = aitemplate_env.ait_object_cache_dir()
+    if object_cache_dir is None or object_cache_dir == "":
+        return None
+    else:
+        return ObjectCache(object_cache_dir)
+
+
+OBJECT_CACHE: Optional[ObjectCache] = create_object_cache()
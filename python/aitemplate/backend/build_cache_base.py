@@ -26,7 +26,7 @@ import tempfile
 from abc import ABC, abstractmethod
 from datetime import datetime, timedelta
 from pathlib import Path
-from typing import Callable, List, Optional, Tuple
+from typing import Callable, Dict, List, Optional, Tuple
 
 from aitemplate.backend.target import Target
 
@@ -274,6 +274,77 @@ def write_binhash_file(
         f.write(binhash)
 
 
+def include_path_replacements(
+    compile_options: List[str], memo: Optional[Dict[str, str]] = None
+) -> Dict[str, str]:
+    """Map the include directories in compile_options that live in the temp
+    directory (and so have a different path on every machine) to a hash of
+    their contents, so that compile commands can be compared across machines.
+
+    Args:
+        compile_options (List[str]): Compiler arguments, split shell-style
+        memo (Optional[Dict[str, str]], optional): Include directory hashes computed so far. Updated in place. Defaults to None.
+
+    Returns:
+        Dict[str, str]: Include directory -> hash of its source files
+    """
+    tmpdir = tempfile.gettempdir()
+    replacements = {}
+    for i in range(len(compile_options)):
+        if compile_options[i] == "-I":
+            if i < len(compile_options) - 1:
+                inc_path = compile_options[i + 1]
+
+        elif compile_options[i].startswith("-I"):
+            inc_path = compile_options[i][2:]
+        else:
+            continue
+        # We are creating hashes of all include directories in a temp dir
+        if inc_path.startswith(tmpdir):
+            if memo is not None and inc_path in memo:
+                inc_path_hash = memo[inc_path]
+            else:
+                inc_path_hash = create_dir_hash([], inc_path, is_source)
+                if memo is not None:
+                    memo[inc_path] = inc_path_hash
+            replacements[inc_path] = inc_path_hash
+    return replacements
+
+
+_INCLUDE_RE = re.compile(rb'^\s*#\s*include\s*"([^"]+)"', re.M)
+
+
+def local_include_closure(src_path: str, build_dir: str) -> List[Path]:
+    """The source file and all the files it (transitively) includes with
+    #include "..." that live in the build directory, e.g. model-generated.h
+    and the runtime headers copied there. Headers found on the include path
+    instead are covered by the compile command.
+
+    Args:
+        src_path (str): Path to the source file
+        build_dir (str): Path to the build directory
+
+    Returns:
+        List[Path]: Paths of the files, relative to build_dir, sorted
+    """
+    basepath = Path(build_dir).resolve()
+    seen = set()
+    pending = [Path(src_path).resolve()]
+    while pending:
+        path = pending.pop()
+        if path in seen:
+            continue
+        seen.add(path)
+        for include in _INCLUDE_RE.findall(path.read_bytes()):
+            include = include.decode("utf-8")
+            for candidate in [path.parent / include, basepath / include]:
+                candidate = candidate.resolve()
+                if candidate.is_file() and basepath in candidate.parents:
+                    pending.append(candidate)
+                    break
+    return sorted(p.relative_to(basepath) for p in seen)
+
+
 class BuildCache(ABC):
     """
     Abstract base class for build cache implementations
@@ -369,26 +440,10 @@ class BuildCache(ABC):
             self._include_path_hash_cache = {}
         makefile_content = makefile_content_orig.decode("utf-8")
         compile_options = list(shlex.split(target._compile_options))
-        tmpdir = tempfile.gettempdir()
-        replacements = {}
-        for i in range(len(compile_options)):
-            if compile_options[i] == "-I":
-                if i < len(compile_options) - 1:
-                    inc_path = compile_options[i + 1]
-
-            elif compile_options[i].startswith("-I"):
-                inc_path = compile_options[i][2:]
-            else:
-                continue
-            # We are creating hashes of all include directories in a temp dir
-            if inc_path.startswith(tmpdir):
-                if memoize_replacements and inc_path in self._include_path_hash_cache:
-                    inc_path_hash = self._include_path_hash_cache[inc_path]
-                else:
-                    inc_path_hash = create_dir_hash([], inc_path, is_source)
-                    if memoize_replacements:
-                        self._include_path_hash_cache[inc_path] = inc_path_hash
-                replacements[inc_path] = inc_path_hash
+        replacements = include_path_replacements(
+            compile_options,
+            self._include_path_hash_cache if memoize_replacements else None,
+        )
 
         for search, replace in replacements.items():
             makefile_content = makefile_content.replace(search, replace)
@@ -592,3 +647,123 @@ class FileBasedBuildCache(BuildCache):
                     if now - modification_time > age_limit:
                         _LOGGER.info(f"CACHE: Deleting {dirpath}")
                         shutil.rmtree(dirpath)
+
+
+class ObjectCache:
+    def __init__(
+        self,
+        cache_dir,
+        lru_retention_hours=72,
+        cleanup_max_age_seconds=3600,
+    ):
+        """Content-addressed cache of the object files of single translation
+        units, shared by all models and working directories.
+
+        Unlike the build caches above, which key on a whole build directory
+        (so that changing one op, or a constant, misses for the entire
+        model), every object is keyed by the contents of its source file and
+        of the local headers it includes, the compile command and the compiler
+        version files written into the build directory. Restored objects are
+        newer than their sources, so make skips compiling them.
+
+        Args:
+            cache_dir (str): Directory to store the objects in. Will be written to and deleted in!
+            lru_retention_hours (int, optional): Retention time for *unused* objects. Defaults to 72.
+            cleanup_max_age_seconds (int, optional): Minimum time between cache cleanups in seconds. Defaults to 3600.
+        """
+        self.cache_dir = cache_dir
+        self.lru_retention_hours = lru_retention_hours
+        self.cleanup_max_age_seconds = cleanup_max_age_seconds
+        self._include_path_hash_cache = {}
+        _LOGGER.info(f"Using object cache, cache directory = {self.cache_dir}")
+
+    def object_key(self, src: str, build_dir: str, compile_cmd: str) -> str:
+        """
+        Args:
+            src (str): Path to the source file, inside build_dir
+            build_dir (str): Path to the build directory
+            compile_cmd (str): Command used to compile src
+
+        Returns:
+            str: SHA256 hexdigest identifying the object file built from src
+        """
+        hash_object = hashlib.sha256(b"ait_object_cache_v1\n")
+        compile_cmd = compile_cmd.replace(build_dir, "${BUILD_DIR}")
+        replacements = include_path_replacements(
+            shlex.split(compile_cmd), self._include_path_hash_cache
+        )
+        for search, replace in replacements.items():
+            compile_cmd = compile_cmd.replace(search, replace)
+        hash_object.update(compile_cmd.encode("utf-8"))
+        basepath = Path(build_dir)
+        for version_file in sorted(basepath.glob("*.version")):
+            hash_object.update(version_file.name.encode("utf-8"))
+            hash_object.update(version_file.read_bytes())
+        for fpath in local_include_closure(src, build_dir):
+            hash_object.update(str(fpath).encode("utf-8"))
+            hash_object.update((basepath / fpath).read_bytes())
+        return hash_object.hexdigest().lower()
+
+    def _object_path(self, key: str) -> str:
+        return os.path.join(self.cache_dir, key[:2], key + ".obj")
+
+    def restore_objects(
+        self,
+        build_dir: str,
+        file_pairs: List[Tuple[str, str]],
+        compile_cmd: str,
+    ) -> Dict[str, str]:
+        """Copy the cached object files for the given (source, object) pairs
+        into the build directory.
+
+        Returns:
+            Dict[str, str]: Object path -> key of the objects that were not in
+            the cache, to be passed to store_objects once they are built
+        """
+        self.maybe_cleanup()
+        misses = {}
+        num_hits = 0
+        skip = should_skip_build_cache()
+        for src, obj in file_pairs:
+            key = self.object_key(src, build_dir, compile_cmd)
+            cached_path = self._object_path(key)
+            if not skip and os.path.exists(cached_path):
+                # Using shutil.copy, so the object is newer than its source.
+                shutil.copy(cached_path, obj)
+                os.utime(cached_path)
+                num_hits += 1
+            else:
+                misses[obj] = key
+        _LOGGER.info(
+            f"CACHE: restored {num_hits} of {len(file_pairs)} objects for {build_dir}"
+        )
+        return misses
+
+    def store_objects(self, misses: Dict[str, str]) -> None:
+        """Store the objects returned by restore_objects, once built."""
+        for obj, key in misses.items():
+            if not os.path.exists(obj):
+                continue
+            cached_path = self._object_path(key)
+            os.makedirs(os.path.dirname(cached_path), exist_ok=True)
+            # Write to a temporary file first, for an atomic update.
+            temp_path = cached_path + f".{secrets.token_hex(16)}.tmp"
+            shutil.copy2(obj, temp_path)
+            os.replace(temp_path, cached_path)
+
+    def maybe_cleanup(self):
+        last_cleaned_seconds = file_age(os.path.join(self.cache_dir, ".last_cleaned"))
+        if last_cleaned_seconds > self.cleanup_max_age_seconds:
+            self.cleanup()
+
+    def cleanup(self):
+        """Delete the objects that were not used for lru_retention_hours."""
+        _LOGGER.info(
+            f"CACHE: Cleaning up object cache below {self.cache_dir}. Objects last used more than {self.lru_retention_hours} hours ago will be deleted."
+        )
+        touch(os.path.join(self.cache_dir, ".last_cleaned"))
+        age_limit = timedelta(hours=self.lru_retention_hours).total_seconds()
+        for path in Path(self.cache_dir).glob("*/*.obj"):
+            if file_age(str(path)) > age_limit:
+                _LOGGER.debug(f"CACHE: Deleting {path}")
+                path.unlink(missing_ok=True)
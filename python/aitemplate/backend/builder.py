@@ -35,6 +35,7 @@ from aitemplate.backend.build_cache_base import write_binhash_file
 
 from aitemplate.backend.target import Target
 from aitemplate.backend.task_runner import BaseRunner, Task
+from aitemplate.backend.unity_build import create_unity_build, UnityBuild
 
 from aitemplate.utils import environ
 
@@ -144,7 +145,12 @@ def _log_error_context(
                 _LOGGER.info(f"{path}:\n\n{summary}")
 
 
-def _run_make_cmds(cmds, timeout, build_dir, allow_cache=True):
+def _run_make_cmds(cmds, timeout, build_dir, allow_cache=True, object_cache=None):
+    """
+    object_cache is an optional (ObjectCache, file_pairs, compile_cmd) tuple:
+    the objects of file_pairs are restored from it before running cmds, and
+    stored into it afterwards. cmds must not delete them (i.e. make clean).
+    """
     _LOGGER.debug(f"make {cmds=}")
     if allow_cache:
         (
@@ -154,6 +160,12 @@ def _run_make_cmds(cmds, timeout, build_dir, allow_cache=True):
     else:
         cached_results_available, store_cache_key = False, None
     if not cached_results_available:
+        object_cache_misses = None
+        if object_cache is not None:
+            cache, file_pairs, compile_cmd = object_cache
+            object_cache_misses = cache.restore_objects(
+                build_dir, file_pairs, compile_cmd
+            )
         proc = subprocess.Popen(  # noqa: P204
             [" && ".join(cmds)],
             shell=True,
@@ -163,6 +175,8 @@ def _run_make_cmds(cmds, timeout, build_dir, allow_cache=True):
         )
         try:
             out, err = proc.communicate(timeout)
+            if proc.returncode == 0 and object_cache_misses:
+                object_cache[0].store_objects(object_cache_misses)
             if proc.returncode == 0 and store_cache_key is not None:
                 build_cache.BUILD_CACHE.store_build_cache(
                     cmds, build_dir, store_cache_key
@@ -255,7 +269,13 @@ class Runner(BaseRunner):
         self._ftask_proc = process_task
         self._fret_proc = process_return
 
-    def push(self, idx: Union[int, str], cmd: str, target: Target) -> None:
+    def push(
+        self,
+        idx: Union[int, str],
+        cmd: str,
+        target: Target,
+        key: Optional[str] = None,
+    ) -> None:
         """Push a building task into runner
 
         Parameters
@@ -266,8 +286,10 @@ class Runner(BaseRunner):
             bash command for compiling
         target : Target
             Target device type for building
+        key : str, optional
+            identifies the task across builds, see task_runner.TaskTimeStats
         """
-        self._queue.append(Task(idx, cmd, target, shell=True))
+        self._queue.append(Task(idx, cmd, target, shell=True, key=key))
 
     def pull(self) -> List:
         """Pull building results.
@@ -355,7 +377,13 @@ class Builder:
 
             cmd = _time_cmd(cmd)
             _LOGGER.debug(f"The cmd for building {target} is : {cmd}")
-            self._runner.push(idx, cmd, target)
+            # Sources are written to per-model build dirs, key the compile
+            # by the source content to find its time across models.
+            key = None
+            if os.path.isfile(src):
+                with open(src, "rb") as f:
+                    key = sha1(f.read()).hexdigest()
+            self._runner.push(idx, cmd, target, key=key)
         self._runner.join()
         self._runner.pull()
 
@@ -388,7 +416,15 @@ class Builder:
         self._runner.join()
         self._runner.pull()
 
-    def gen_makefile(self, file_pairs, dll_name, workdir, test_name, debug_settings):
+    def gen_makefile(
+        self,
+        file_pairs,
+        dll_name,
+        workdir,
+        test_name,
+        debug_settings,
+        unity_build: Optional[UnityBuild] = None,
+    ):
         makefile_template = jinja2.Template(
             """
 CC = {{cc}}
@@ -402,6 +438,8 @@ obj_files = {{obj_files}}
 %.obj : %.bin
     {{bfile_cmd}}
 
+{{unity_rules}}
+
 .PHONY: all clean clean_constants
 all: {{targets}}
 
@@ -465,7 +503,11 @@ clean_constants:
             bfile_cmd = _augment_for_trace(bfile_cmd)
             build_so_cmd = _augment_for_trace(build_so_cmd)
         else:
-            cfile_cmd = _time_cmd(cfile_cmd)
+            if unity_build is not None:
+                # The compile times size the unity TUs of later builds.
+                cfile_cmd = unity_build.record_times_cmd(cfile_cmd)
+            else:
+                cfile_cmd = _time_cmd(cfile_cmd)
             bfile_cmd = _time_cmd(bfile_cmd)
             build_so_cmd = _time_cmd(build_so_cmd)
 
@@ -501,6 +543,11 @@ clean_constants:
             bfile_cmd=bfile_cmd,
             build_so_cmd=build_so_cmd,
             build_standalone_rules=build_standalone_rules,
+            unity_rules=(
+                unity_build.gen_makefile_rules(Target.current().compile_cmd(False))
+                if unity_build is not None
+                else ""
+            ),
         )
 
         dumpfile = os.path.join(workdir, test_name, "Makefile")
@@ -887,7 +934,18 @@ clean:
         debug_settings=_DEBUG_SETTINGS,
         allow_cache=True,
     ):
-        self.gen_makefile(file_pairs, dll_name, workdir, test_name, debug_settings)
+        unity_build = create_unity_build(os.path.join(workdir, test_name))
+        if unity_build is not None:
+            file_pairs = unity_build.plan(file_pairs, self._n_jobs)
+            unity_build.clear_records()
+        self.gen_makefile(
+            file_pairs,
+            dll_name,
+            workdir,
+            test_name,
+            debug_settings,
+            unity_build=unity_build,
+        )
         self.postprocess_build_dir(workdir, test_name)
 
         # Write compiler version string(s) into build directory, so these can be used as part of cache key
@@ -909,9 +967,31 @@ clean:
         make_all_cmd = f" {make_path} {make_flags} -j{self._n_jobs} all "
         make_clean_constants_cmd = f" {make_path} {make_flags} clean_constants "
         cmds = [make_clean_cmd, make_all_cmd]
+        object_cache = None
+        if build_cache.OBJECT_CACHE is not None and allow_cache:
+            # Clean up front: objects restored from the object cache have to
+            # survive until make all.
+            subprocess.run(make_clean_cmd, shell=True, check=True, capture_output=True)
+            cmds = [make_all_cmd]
+            # Objects of the generated and runtime sources, which all go
+            # through the %.obj rule of the Makefile.
+            compile_cmd = Target.current().compile_cmd(False)
+            object_cache = (
+                build_cache.OBJECT_CACHE,
+                [pair for pair in file_pairs if not pair[0].endswith(".bin")],
+                compile_cmd,
+            )
         if not is_debug():
             cmds.append(make_clean_constants_cmd)
-        _run_make_cmds(cmds, self._timeout, build_dir, allow_cache=allow_cache)
+        _run_make_cmds(
+            cmds,
+            self._timeout,
+            build_dir,
+            allow_cache=allow_cache,
+            object_cache=object_cache,
+        )
+        if unity_build is not None:
+            unity_build.update_stats(file_pairs)
 
 
 def get_compile_engine():
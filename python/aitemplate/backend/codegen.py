@@ -22,6 +22,7 @@ and model driver source code files.
 
 from __future__ import annotations
 
+import hashlib
 import io
 import json
 import logging
@@ -33,6 +34,7 @@ from typing import Any, Dict, List, Optional, Tuple
 import jinja2
 
 from aitemplate.backend import registry
+from aitemplate.backend.kernel_instances import collect_shared_kernel_instances
 
 from aitemplate.backend.main_templates import MODEL_CONTAINER_TEMPLATE, MODEL_TEMPLATE
 from aitemplate.backend.target import Target
@@ -41,7 +43,12 @@ from aitemplate.compiler.base import IntImm, IntVar, IntVarTensor, Operator, Ten
 from aitemplate.compiler.dtype import dtype_to_enumerator, get_dtype_size
 from aitemplate.compiler.tensor_accessor import TensorAccessor
 
-from aitemplate.compiler.transform.memory_planning import Workspace
+from aitemplate.compiler.transform.memory_planning import (
+    MemoryPlan,
+    tensor_lifetimes,
+    Workspace,
+)
+from aitemplate.compiler.transform.specialize_shapes import ShapeSpecialization
 from aitemplate.utils.debug_settings import AITDebugSettings
 from aitemplate.utils.environ import (
     multistream_additional_streams,
@@ -93,7 +100,10 @@ def gen_profiler(sorted_graph: List[Tensor], workdir: str, dynamic_profiling_str
 
 
 def gen_function_src(
-    sorted_graph: List[Tensor], workdir: str, model_name: str = ""
+    sorted_graph: List[Tensor],
+    workdir: str,
+    model_name: str = "",
+    shape_specializations: Optional[List[ShapeSpecialization]] = None,
 ) -> List[Tuple[str, str]]:
     """Generate functions source code files for the given graph
 
@@ -105,6 +115,10 @@ def gen_function_src(
         Target directory for generated C++ source code files
     model_name : str, optional
         Sub working directory in the workdir for the given model, by default ""
+    shape_specializations : List[ShapeSpecialization], optional
+        Static-shape copies of sorted_graph from specialize_shapes. The ops
+        of a copy whose function source differs from the dynamic one are
+        renamed with the copy's suffix and get their own source files.
 
     Returns
     -------
@@ -113,19 +127,53 @@ def gen_function_src(
     """
     target = Target.current()
     file_pairs = []
-    exist_func = set()
+    # function name -> source
+    exist_func = {}
     prefix = os.path.join(workdir, model_name)
-    for node in sorted_graph:
-        for func in node.src_ops():
-            fname = func._attrs["name"]
-            if fname not in exist_func:
-                src_path = os.path.join(prefix, fname + target.src_extension())
-                obj_path = os.path.join(prefix, fname + ".obj")
-                file_pairs.append((src_path, obj_path))
-                with open(src_path, "w") as fo:
-                    fo.write(func.gen_function())
-                exist_func.add(fname)
-    _LOGGER.info(f"generated {len(file_pairs)} function srcs")
+
+    def write_function_src(fname: str, src: str) -> None:
+        src_path = os.path.join(prefix, fname + target.src_extension())
+        obj_path = os.path.join(prefix, fname + ".obj")
+        file_pairs.append((src_path, obj_path))
+        with open(src_path, "w") as fo:
+            fo.write(src)
+        exist_func[fname] = src
+
+    with collect_shared_kernel_instances() as kernel_instances:
+        for node in sorted_graph:
+            for func in node.src_ops():
+                fname = func._attrs["name"]
+                if fname not in exist_func:
+                    write_function_src(fname, func.gen_function())
+        _LOGGER.info(f"generated {len(file_pairs)} function srcs")
+        for spec in shape_specializations or []:
+            num_file_pairs = len(file_pairs)
+            visited = set()
+            # specialized source (with the dynamic function name) -> name
+            spec_names = {}
+            for node in spec.sorted_graph:
+                for func in node.src_ops():
+                    if id(func) in visited:
+                        continue
+                    visited.add(id(func))
+                    fname = func._attrs["name"]
+                    src = func.gen_function()
+                    if src == exist_func.get(fname):
+                        continue
+                    if src not in spec_names:
+                        spec_name = f"{fname}_{spec.suffix}"
+                        while spec_name in exist_func:
+                            spec_name += "_"
+                        func._attrs["name"] = spec_name
+                        write_function_src(spec_name, func.gen_function())
+                        spec_names[src] = spec_name
+                    func._attrs["name"] = spec_names[src]
+            _LOGGER.info(
+                f"generated {len(file_pairs) - num_file_pairs} function srcs "
+                f"specialized for {spec.dim_values}"
+            )
+        if kernel_instances is not None:
+            file_pairs.extend(kernel_instances.write_sources(prefix))
     return file_pairs
 
 
@@ -334,6 +382,8 @@ class ModelContainerGenerator:
         additional_unbound_constants: Optional[List[Tensor]] = None,
         debug_settings: Optional[AITDebugSettings] = None,
         model_dir: Optional[str] = None,
+        memory_plans: Optional[List[MemoryPlan]] = None,
+        shape_specializations: Optional[List[ShapeSpecialization]] = None,
     ):
         self.target = Target.current()
         self.f_var_decl = registry.get(self.target.name() + ".lib.var_decl")
@@ -347,15 +397,26 @@ class ModelContainerGenerator:
         self.exist_funcs = set()
         self.func_decl = []
         self.tensor_slice = []
+        # Internal tensors living in the blob. Only collected when there are
+        # several memory plans; otherwise they go straight to tensor_slice.
+        self.blob_tensors = []
         self.tensor_map_set = []
         self.set_inputs = []
         self.func_name_seq = []
         self.func_seq = []
+        # original_name of the op of each func_seq entry, None for checks.
+        self._func_seq_ops = []
+        # original_name -> RecordOpTraceEvent index of every op
+        self._op_trace_idx = {}
+        # (name, input_sizes, output_sizes) of every op, as C string literals.
+        self._traced_ops = []
         self._input_shape_seq = []
         self._output_shape_seq = []
         self.func_prop_seq = []
         self.tensor_decl = []
         self.dim_decl = []
+        # Names of all int64_t dim variables declared in the model.
+        self.dim_names = []
         self.jagged_decl = []
         self.device_to_device_copies = []
         self.function_state = []
@@ -374,11 +435,14 @@ class ModelContainerGenerator:
 
         self.num_constants = 0
         self.constants_data_size = 0
+        # Hash of the owned constants' data, for the model fingerprint.
+        self.constants_data_hash = hashlib.sha1()
         self.owned_constants_init = []
         self.reset_constants = []
 
         self.set_up_bound_constant_offsets = []
         self.set_up_constant_folding_outputs_offsets = []
+        self.set_up_constant_folding_outputs_sizes = []
 
         self.input_idx = 0
         self.bound_constant_idx = 0
@@ -392,6 +456,10 @@ class ModelContainerGenerator:
         self.max_blob_size = max_blob_size
         self.max_constant_blob_size = max_constant_blob_size
         self.workspace = workspace
+        self.memory_plans = memory_plans if memory_plans else []
+        self.shape_specializations = (
+            shape_specializations if shape_specializations else []
+        )
 
         self.debug_settings = (
             AITDebugSettings() if debug_settings is None else debug_settings
@@ -478,7 +546,9 @@ class ModelContainerGenerator:
             tensor._attrs["offset"] >= 0
         ), f"Constant node '{name}' must have non-negative offset"
         num_bytes = len(data)
-        self.constants_data_file.write(data.to_bytes())
+        data_bytes = data.to_bytes()
+        self.constants_data_file.write(data_bytes)
+        self.constants_data_hash.update(data_bytes)
 
         constant_info = f'ConstantInfo{{"{name}", {self.constants_data_size}, {tensor._attrs["offset"]}, {num_bytes}}}'
         self.owned_constants_init.append(constant_info)
@@ -555,6 +625,12 @@ class ModelContainerGenerator:
                     tensor._attrs["offset"],
                 )
             )
+            self.set_up_constant_folding_outputs_sizes.append(
+                set_value(
+                    f'constant_folding_outputs_sizes_[{tensor._attrs["constant_folding_output_idx"]}]',
+                    tensor.size_bytes(),
+                )
+            )
             self.tensor_slice.append(const_slice)
             if not tensor._attrs.get("is_internal_constant", False):
                 self.reset_constants.append(const_slice)
@@ -696,6 +772,7 @@ class ModelContainerGenerator:
             if len(dim._attrs["values"]) == 1:
                 intimm = dim._attrs["values"][0]
             self.dim_decl.append(self.f_var_decl(dim._attrs["name"], intimm))
+            self.dim_names.append(dim._attrs["name"])
             self.visited_dims.add(dim._attrs["name"])
 
     def _process_jagged_dims(self, node: Tensor) -> None:
@@ -732,6 +809,7 @@ class ModelContainerGenerator:
                 else jagged_int_var.batch_dim().value()
             )
             self.dim_decl.append(self.f_var_decl(batch_dim_name, batch_dim_value))
+            self.dim_names.append(batch_dim_name)
             self.visited_dims.add(batch_dim_name)
 
     def _process_dims_for_tensor(self, node: Tensor) -> None:
@@ -755,27 +833,30 @@ class ModelContainerGenerator:
             return
 
         for func in funcs:
-            f_func_decl = registry.get(
-                ".".join((self.target.name(), func._attrs["op"], "func_decl"))
-            )
-            f_func_call = registry.get(
-                ".".join((self.target.name(), func._attrs["op"], "func_call"))
-            )
-            if func._attrs["name"] not in self.exist_funcs:
-                self.func_decl.append(f_func_decl(func._attrs))
-                self.exist_funcs.add(func._attrs["name"])
+            self._append_func_decl(func)
 
             # Only code gen func once for ops with multiple outputs
             # The func can get renamed during refine_graph pass.
             # We use original_name here because it's unique.
             if func._attrs["original_name"] not in self.visited_func:
                 self.visited_func.add(func._attrs["original_name"])
-                seq = f_func_call(func._attrs, indent="    ")
-                if self.debug_settings.gen_profiler_annotation:
-                    seq = f'  {{\n  RAII_ProfilerRange _raiiOpProfilerRange("{func._attrs["outputs"][0]._attrs["name"]}");\n{seq}\n  }}'
+                input_shape, output_shape = extract_input_output_shapes(func._attrs)
+                op_idx = len(self._traced_ops)
+                self._traced_ops.append(
+                    tuple(
+                        json.dumps(text)
+                        for text in (
+                            func._attrs["original_name"],
+                            json.dumps(input_shape),
+                            json.dumps(output_shape),
+                        )
+                    )
+                )
+                self._op_trace_idx[func._attrs["original_name"]] = op_idx
+                seq = self._render_func_call(func, op_idx)
                 self.func_name_seq.append(func._attrs["original_name"])
                 self.func_seq.append(seq)
-                input_shape, output_shape = extract_input_output_shapes(func._attrs)
+                self._func_seq_ops.append(func._attrs["original_name"])
                 self._input_shape_seq.append(input_shape)
                 self._output_shape_seq.append(output_shape)
                 props = {}
@@ -808,6 +889,30 @@ class ModelContainerGenerator:
         ) and (not isinstance(node, IntVarTensor)):
             self._append_check_outputs(node)
 
+    def _append_func_decl(self, func: Operator) -> None:
+        if func._attrs["name"] in self.exist_funcs:
+            return
+        f_func_decl = registry.get(
+            ".".join((self.target.name(), func._attrs["op"], "func_decl"))
+        )
+        self.func_decl.append(f_func_decl(func._attrs))
+        self.exist_funcs.add(func._attrs["name"])
+
+    def _render_func_call(self, func: Operator, op_idx: int) -> str:
+        f_func_call = registry.get(
+            ".".join((self.target.name(), func._attrs["op"], "func_call"))
+        )
+        seq = f_func_call(func._attrs, indent="    ")
+        if self.debug_settings.gen_profiler_annotation:
+            seq = f'  {{\n  RAII_ProfilerRange _raiiOpProfilerRange("{func._attrs["outputs"][0]._attrs["name"]}");\n{seq}\n  }}'
+        # Bracket the call for sampled per-op tracing (no-ops unless
+        # the run is traced; see ModelBase::RecordOpTraceEvent).
+        return (
+            f"    RecordOpTraceEvent({op_idx}, /*end=*/false, stream);\n"
+            f"{seq}\n"
+            f"    RecordOpTraceEvent({op_idx}, /*end=*/true, stream);"
+        )
+
     def _append_check_nan_and_inf(self, node: Tensor):
         self.debug_header = True
         tensor_name = node._attrs["name"]
@@ -816,6 +921,7 @@ class ModelContainerGenerator:
 
         code_text = f'    InvokeInfAndNanChecker(reinterpret_cast<half*>({tensor_name}), "{tensor_name}", {elem_cnt}, stream);\n'
         self.func_seq.append(code_text)
+        self._func_seq_ops.append(None)
         self._rendered_checks_func_code.append(code_text)
 
     def _append_check_outputs(self, node: Tensor):
@@ -830,6 +936,7 @@ class ModelContainerGenerator:
             f'"{tensor_name}", {elem_cnt}, stream);\n'
         )
         self.func_seq.append(code_text)
+        self._func_seq_ops.append(None)
         self._rendered_checks_func_code.append(code_text)
 
     def append_tensor(self, node: Tensor) -> None:
@@ -849,6 +956,7 @@ class ModelContainerGenerator:
             else:
                 self.tensor_decl.append(self.f_var_decl(name=name))
             # IntVarTensor could be used as dim too, add to visited to prevent duplicated declaration.
+            self.dim_names.append(name)
             self.visited_dims.add(name)
         else:
             self.tensor_decl.append(self.f_ptr_decl(name=name, dtype=dtype))
@@ -878,7 +986,10 @@ class ModelContainerGenerator:
             assert (
                 node._attrs["offset"] >= 0
             ), f"Non-parameter node '{name}' must have non-negative offset"
-            self.tensor_slice.append(self._tensor_slice_func(node, "blob_ptr"))
+            if len(self.memory_plans) > 1:
+                self.blob_tensors.append(node)
+            else:
+                self.tensor_slice.append(self._tensor_slice_func(node, "blob_ptr"))
         elif not isinstance(node, IntVarTensor):
             # Normal view, point it to the same memory as whatever it
             # aliases
@@ -938,6 +1049,77 @@ class ModelContainerGenerator:
             log_f.write(f"{json.dumps(ops_names)}\n")
         _LOGGER.info(f"Wrote json simple multistream info into {log_filename_json}")
 
+    def _codegen_memory_plans(self) -> List[Dict[str, Any]]:
+        """
+        Render SelectMemoryPlan()/SetUpBlobTensors() inputs for each memory
+        plan. Plans are sorted by blob size, so the first one whose dim
+        bounds fit the current shapes is the smallest usable one.
+        """
+        rendered_plans = []
+        for plan in self.memory_plans:
+            tensor_slice = []
+            for node in self.blob_tensors:
+                name = node._attrs["name"]
+                assert (
+                    name in plan.offsets
+                ), f"Tensor {name} is missing from memory plan {plan.dim_bounds}"
+                tensor_slice.append(
+                    f"          {name} = reinterpret_cast<decltype({name})>(blob_ptr + {plan.offsets[name]});"
+                )
+            condition = " && ".join(
+                f"{dim_name} <= {bound}"
+                for dim_name, bound in sorted(plan.dim_bounds.items())
+            )
+            rendered_plans.append(
+                {
+                    "condition": condition,
+                    "blob_size": plan.blob_size,
+                    "tensor_slice": "\n".join(tensor_slice),
+                }
+            )
+        return rendered_plans
+
+    def _codegen_shape_specializations(self) -> List[Dict[str, Any]]:
+        """
+        Render the RunImpl variant of each shape specialization: the dynamic
+        function sequence with the calls of the specialized ops replaced.
+        Dims derived from the specialized ones are set up front, since the
+        specialized ops may not compute them.
+        """
+        rendered_specs = []
+        for spec in self.shape_specializations:
+            calls = {}
+            for node in spec.sorted_graph:
+                for func in node.src_ops():
+                    name = func._attrs["original_name"]
+                    if name in calls or name not in self._op_trace_idx:
+                        continue
+                    self._append_func_decl(func)
+                    calls[name] = self._render_func_call(
+                        func, self._op_trace_idx[name]
+                    )
+            function_seq = [
+                seq if op is None else calls.get(op, seq)
+                for op, seq in zip(self._func_seq_ops, self.func_seq)
+            ]
+            condition = " && ".join(
+                f"{name} == {value}" for name, value in sorted(spec.dim_values.items())
+            )
+            set_dims = [
+                set_value(name, value, indent="      ")
+                for name, value in sorted(spec.derived_dims.items())
+                if name in self.visited_dims
+            ]
+            rendered_specs.append(
+                {
+                    "condition": condition,
+                    "suffix": spec.suffix,
+                    "set_dims": "\n".join(set_dims),
+                    "function_seq": function_seq,
+                }
+            )
+        return rendered_specs
+
     def generate_model(self) -> str:
         # Disable graph mode on ROCM because the updating operations
         # are not supported
@@ -986,6 +1168,22 @@ class ModelContainerGenerator:
             self._output_shape_seq,
             self.func_prop_seq,
         )
+        shape_specializations = []
+        if self.shape_specializations:
+            if run_impl_mode == 0:
+                shape_specializations = self._codegen_shape_specializations()
+            else:
+                _LOGGER.warning(
+                    "Shape specializations are not supported in multistream "
+                    "mode, only the dynamic RunImpl is generated"
+                )
+        blob_size = self.max_blob_size
+        memory_plans = []
+        if len(self.memory_plans) > 1:
+            memory_plans = self._codegen_memory_plans()
+            # Models start out with the smallest plan and grow the blob on demand.
+            blob_size = self.memory_plans[0].blob_size
+            self.tensor_slice.append("    SetUpBlobTensors(blob_ptr, 0);")
         return MODEL_TEMPLATE.render(
             model_name=self.model_name,
             function_decl="\n".join(self.func_decl),
@@ -996,15 +1194,20 @@ class ModelContainerGenerator:
             device_to_device_copies="\n".join(self.device_to_device_copies),
             set_up_param_dynamic_shapes="\n".join(self.set_up_param_dynamic_shapes),
             function_seq=self.func_seq,
+            shape_specializations=shape_specializations,
             per_op_profiler_seq=per_op_profiler_seq,
+            traced_ops=self._traced_ops,
             tensor_decl="\n".join(self.tensor_decl),
             dim_decl="\n".join(self.dim_decl),
+            dim_names=self.dim_names,
             jagged_decl="\n".join(self.jagged_decl),
             function_state="\n".join(self.function_state),
             target_has_graph_mode=target_has_graph_mode,
             unique_workspace_size=self.workspace.unique_size,
             debug_header=self.debug_header,
-            blob_size=self.max_blob_size,
+            blob_size=blob_size,
+            num_memory_plans=max(len(memory_plans), 1),
+            memory_plans=memory_plans,
             workspace_size=self.workspace.total_size(),
             num_inputs=self.num_inputs,
             num_outputs=self.num_outputs,
@@ -1023,7 +1226,8 @@ class ModelContainerGenerator:
         """
         bound_constant_offsets_ stores a map for each constant to the offset in constant buffer,
         constant_folding_outputs_offsets_ stores a map from each output of constant folding
-        to its offset inside the constant buffer.
+        to its offset inside the constant buffer, and constant_folding_outputs_sizes_ its
+        size in bytes.
 
 
         When the model is loaded, we use these offsets to wire up the constant folding output
@@ -1034,6 +1238,7 @@ class ModelContainerGenerator:
             constant_offsets = jinja2.Template(
                 """
     constant_folding_outputs_offsets_.resize({{num_constant_folding_outputs}});
+    constant_folding_outputs_sizes_.resize({{num_constant_folding_outputs}});
     {{set_up_statements}}
     """
             ).render(
@@ -1042,6 +1247,7 @@ class ModelContainerGenerator:
                 ),
                 set_up_statements="\n".join(
                     self.set_up_constant_folding_outputs_offsets
+                    + self.set_up_constant_folding_outputs_sizes
                 ),
             )
             constant_offsets += "\n"
@@ -1057,6 +1263,49 @@ class ModelContainerGenerator:
             )
         return constant_offsets
 
+    def _codegen_tensor_lifetimes(self) -> List[str]:
+        """
+        Render the AITemplateTensorLifetime initializers of the intermediate
+        tensors, for AITemplateModelContainerGetTensorLifetimes.
+        """
+        records, op_names = tensor_lifetimes(self.graph)
+        return [
+            "AITemplateTensorLifetime{{{}, {}, {}, {}, {}, {}, {}}}".format(
+                json.dumps(tensor._attrs["name"]),
+                tensor._attrs["offset"],
+                size,
+                first_op_idx,
+                last_op_idx,
+                json.dumps(op_names[first_op_idx]),
+                json.dumps(op_names[last_op_idx]),
+            )
+            for tensor, first_op_idx, last_op_idx, size in records
+        ]
+
+    def _model_fingerprint(self, set_up_constant_offsets: str) -> int:
+        """
+        A 64-bit hash of everything that determines the folded constants:
+        the owned constants' data, their layout in the constants buffer, and
+        the constant folding graph. Saved folded constants are only restored
+        into models with the same fingerprint.
+        """
+        fingerprint = self.constants_data_hash.copy()
+        for part in [
+            str(self.max_constant_blob_size + self.extra_owned_constant_size),
+            "\n".join(self.owned_constants_init),
+            set_up_constant_offsets,
+            "\n".join(self.set_up_constant_folding_inputs),
+        ]:
+            fingerprint.update(part.encode())
+        if self.model_dir is not None:
+            constant_folder_header = os.path.join(
+                self.model_dir, "constant_folder-generated.h"
+            )
+            if os.path.exists(constant_folder_header):
+                with open(constant_folder_header, "rb") as f:
+                    fingerprint.update(f.read())
+        return int.from_bytes(fingerprint.digest()[:8], "little")
+
     def generate_source(self) -> Dict[str, str]:
         """
         Perform the codegen after adding all tensors.
@@ -1071,6 +1320,8 @@ class ModelContainerGenerator:
         result["model-generated.h"] = self.generate_model()
 
         model_container_src_fname = f"model_container_base{self.target.src_extension()}"
+        tensor_lifetimes_init = self._codegen_tensor_lifetimes()
+        set_up_constant_offsets = self._create_set_up_constant_offsets()
 
         model_container_base_src = MODEL_CONTAINER_TEMPLATE.render(
             num_inputs=self.num_inputs,
@@ -1089,10 +1340,13 @@ class ModelContainerGenerator:
             num_bound_constants=self.bound_constant_idx,
             num_unbound_constants=self.unbound_constant_idx,
             owned_constants_init=",".join(self.owned_constants_init),
-            set_up_constant_offsets=self._create_set_up_constant_offsets(),
+            set_up_constant_offsets=set_up_constant_offsets,
             set_up_constant_folding_inputs="\n".join(
                 self.set_up_constant_folding_inputs
             ),
+            num_tensor_lifetimes=len(tensor_lifetimes_init),
+            tensor_lifetimes_init=",\n  ".join(tensor_lifetimes_init),
+            model_fingerprint=self._model_fingerprint(set_up_constant_offsets),
             # # todo: enable once this feature is fully available
             # is_windows=is_windows(),
         )
@@ -1168,6 +1422,8 @@ def gen_library_src(  # noqa: C901
     model_name: str = "",
     debug_settings: AITDebugSettings = _DEBUG_SETTINGS,
     additional_unbound_constants: Optional[List[Tensor]] = None,
+    memory_plans: Optional[List[MemoryPlan]] = None,
+    shape_specializations: Optional[List[ShapeSpecialization]] = None,
 ) -> List[Tuple[str, str]]:
     """Generate model driver source code files for the given graph
 
@@ -1186,6 +1442,13 @@ def gen_library_src(  # noqa: C901
         Sub working directory in the workdir for the given model, by default ""
     debug_settings : AITDebugSettings
         specify debug settings such as where to dump AITemplate model Python file, etc.
+    memory_plans : List[MemoryPlan], optional
+        Shape-bucketed memory plans from bucketed_memory_planning. The
+        generated model picks the smallest plan that fits its inputs at runtime.
+    shape_specializations : List[ShapeSpecialization], optional
+        Static-shape copies of sorted_graph from specialize_shapes, after
+        gen_function_src. RunImpl dispatches to the copy whose dim values
+        match the current ones, and runs the dynamic graph otherwise.
 
     Returns
     -------
@@ -1211,6 +1474,8 @@ def gen_library_src(  # noqa: C901
         additional_unbound_constants=additional_unbound_constants,
         debug_settings=debug_settings,
         model_dir=prefix,
+        memory_plans=memory_plans,
+        shape_specializations=shape_specializations,
     )
     model_container_generator.append_all_tensors()
     constants_data_file.close()
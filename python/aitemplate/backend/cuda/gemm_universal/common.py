@@ -28,6 +28,7 @@ import jinja2
 from aitemplate.backend.backend_spec import CUDASpec
 
 from aitemplate.backend.common import gemm_common, tensor_accessor_codegen
+from aitemplate.backend.kernel_instances import current_shared_kernel_instances
 from aitemplate.backend.target import Target
 
 from aitemplate.compiler.base import IntImm
@@ -243,6 +244,9 @@ EXEC_TEMPLATE = jinja2.Template(
 {{indent}}};
 {{indent}}}
 
+{% if shared_instance %}
+{{indent}}CUTLASS_CHECK(ait_run_gemm_instance<{{instance}}>(arguments, workspace, stream));
+{% else %}
 {% if is_profiler %}
 {{indent}}size_t workspace_size = gemm_op.get_workspace_size(arguments);
 {{indent}}cutlass::device_memory::allocation<uint8_t> local_workspace(workspace_size);
@@ -257,11 +261,86 @@ EXEC_TEMPLATE = jinja2.Template(
 {{indent}}CUTLASS_CHECK(status);
 {{indent}}status = gemm_op(stream);
 {{indent}}CUTLASS_CHECK(status);
+{% endif %}
 {{indent}}return;
 """
 )
 
 
+# A gemm instance shared by the op sources (see
+# aitemplate.backend.kernel_instances): the op source only declares
+# ait_run_gemm_instance for it, the shared source defines and instantiates
+# it. CUTLASS device ops are header-only with inline members, so the runner
+# wrapper is what lets the kernel be instantiated in one place only.
+RUN_GEMM_INSTANCE_DECL = """
+template <typename GemmInstance>
+cutlass::Status ait_run_gemm_instance(
+    const typename GemmInstance::Arguments& arguments,
+    uint8_t* workspace,
+    cudaStream_t stream);
+"""
+
+
+# The guards let op sources and shared sources be compiled together in a
+# unity build (see aitemplate.backend.unity_build).
+SHARED_INSTANCE_DECL_TEMPLATE = jinja2.Template(
+    """
+#ifndef {{namespace | upper}}
+#define {{namespace | upper}}
+namespace {{namespace}} {
+{{config}}
+using Instance = {{instance_type}};
+} // namespace {{namespace}}
+#endif
+
+extern template cutlass::Status ait_run_gemm_instance<{{namespace}}::Instance>(
+    const {{namespace}}::Instance::Arguments&, uint8_t*, cudaStream_t);
+"""
+)
+
+
+SHARED_INSTANCE_SRC_TEMPLATE = jinja2.Template(
+    """
+{{prologue}}
+
+#ifndef AIT_RUN_GEMM_INSTANCE
+#define AIT_RUN_GEMM_INSTANCE
+template <typename GemmInstance>
+cutlass::Status ait_run_gemm_instance(
+    const typename GemmInstance::Arguments& arguments,
+    uint8_t* workspace,
+    cudaStream_t stream) {
+  GemmInstance gemm_op;
+  cutlass::Status status = gemm_op.can_implement(arguments);
+  if (status != cutlass::Status::kSuccess) {
+    return status;
+  }
+  status = gemm_op.initialize(arguments, workspace, stream);
+  if (status != cutlass::Status::kSuccess) {
+    return status;
+  }
+  return gemm_op(stream);
+}
+#endif
+
+#ifndef {{namespace | upper}}
+#define {{namespace | upper}}
+namespace {{namespace}} {
+{{config}}
+using Instance = {{instance_type}};
+} // namespace {{namespace}}
+#endif
+
+template cutlass::Status ait_run_gemm_instance<{{namespace}}::Instance>(
+    const {{namespace}}::Instance::Arguments&, uint8_t*, cudaStream_t);
+"""
+)
+
+
+# Rendered in place of {{instances}} until the shared instances are known.
+_INSTANCES_MARKER = "// AIT_GEMM_INSTANCES"
+
+
 FUNC_DECL_TEMPLATE = jinja2.Template(
     """
 void {{func_name}}(
@@ -381,6 +460,98 @@ TENSOR_DECL_TEMPLATE = jinja2.Template(
 )
 
 
+# Per-iteration kernel timing shared by the gemm profilers. Rounds of
+# individually timed iterations are added until the 95% confidence interval
+# of the mean is within kProfilerTargetRelCI of it; a candidate whose median
+# is clearly slower than the fastest one of the profiler is discarded early.
+# Every iteration requests fresh tensors from the ProfilerMemoryPool, whose
+# copies rotate through more memory than the L2 cache holds, so the kernels
+# are timed with cold L2 caches.
+PROFILER_TIMER_DECL = """
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+constexpr int kProfilerWarmupIters = 5;
+constexpr int kProfilerRoundIters = 10;
+constexpr int kProfilerMaxIters = 200;
+constexpr float kProfilerMaxMs = 2000.f;
+constexpr float kProfilerTargetRelCI = 0.01f;
+constexpr float kProfilerDiscardRatio = 1.2f;
+
+struct ProfilerStats {
+  float median_ms = 0;
+  float p90_ms = 0;
+  float mean_ms = 0;
+  // half width of the 95% confidence interval of mean_ms
+  float ci_ms = 0;
+  int iters = 0;
+  bool discarded = false;
+};
+
+// median of the fastest candidate profiled so far
+static float g_profiler_best_median_ms = -1;
+
+template <typename Func>
+ProfilerStats ProfileKernel(Func&& func, cudaStream_t stream) {
+  for (int i = 0; i < kProfilerWarmupIters; ++i) {
+    func();
+  }
+  cudaEvent_t events[kProfilerRoundIters + 1];
+  for (auto & event : events) {
+    cudaEventCreate(&event);
+  }
+  std::vector<float> samples;
+  std::vector<float> sorted;
+  ProfilerStats stats;
+  float total_ms = 0;
+  while (true) {
+    for (int i = 0; i < kProfilerRoundIters; ++i) {
+      cudaEventRecord(events[i], stream);
+      func();
+    }
+    cudaEventRecord(events[kProfilerRoundIters], stream);
+    cudaEventSynchronize(events[kProfilerRoundIters]);
+    for (int i = 0; i < kProfilerRoundIters; ++i) {
+      float ms = 0;
+      cudaEventElapsedTime(&ms, events[i], events[i + 1]);
+      samples.push_back(ms);
+      total_ms += ms;
+    }
+    sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    int n = sorted.size();
+    stats.iters = n;
+    stats.median_ms = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    stats.p90_ms = sorted[std::min(n - 1, (int)std::ceil(0.9 * n) - 1)];
+    stats.mean_ms = total_ms / n;
+    double sq_sum = 0;
+    for (float ms : samples) {
+      sq_sum += (ms - stats.mean_ms) * (ms - stats.mean_ms);
+    }
+    stats.ci_ms = 1.96 * std::sqrt(sq_sum / (n - 1) / n);
+    if (g_profiler_best_median_ms > 0 &&
+        stats.median_ms > kProfilerDiscardRatio * g_profiler_best_median_ms) {
+      stats.discarded = true;
+      break;
+    }
+    if (stats.ci_ms <= kProfilerTargetRelCI * stats.mean_ms ||
+        n >= kProfilerMaxIters || total_ms >= kProfilerMaxMs) {
+      break;
+    }
+  }
+  for (auto event : events) {
+    (void)cudaEventDestroy(event);
+  }
+  if (!stats.discarded && (g_profiler_best_median_ms < 0 ||
+                           stats.median_ms < g_profiler_best_median_ms)) {
+    g_profiler_best_median_ms = stats.median_ms;
+  }
+  return stats;
+}
+"""
+
+
 # TODO Merge all alignment into single profiler
 PROFILER_TEMPLATE = jinja2.Template(
     """
@@ -389,7 +560,9 @@ size_t GLOBAL_WORKSPACE_SIZE = 0;
 #include <sstream>
 
 {{op_func}}
-
+"""
+    + PROFILER_TIMER_DECL
+    + """
 template <typename DType>
 struct ProfilerMemoryPool;
 
@@ -439,34 +612,23 @@ int benchmark_{{function_name}} (
     cudaStream_t stream
 {% endif %}
   ) {
-  // warmup
-  for (int i = 0; i < 5; ++i) {
+  ProfilerStats stats = ProfileKernel([&]() {
     {{func_call}}
-  }
-  cudaEvent_t events[2];
-  for (auto & event : events) {
-    cudaEventCreate(&event);
-  }
-  cudaEventRecord(events[0], stream);
-  for (int i = 0; i < 10; ++i) {
-    {{func_call}}
-  }
-  cudaEventRecord(events[1], stream);
-  cudaEventSynchronize(events[1]);
-  float runtime_ms = 0;
-  cudaEventElapsedTime(&runtime_ms, events[0], events[1]);
-  for (auto event : events) {
-    (void)cudaEventDestroy(event);
-  }
+  }, stream);
   // TODO: output workspace
-  if (runtime_ms < 0.00001) {
+  if (stats.mean_ms * stats.iters < 0.00001) {
       throw std::runtime_error(
       "OOB in cutlass."
     );
   }
   std::cout << "OP:" << gemm_op_name << ",";
-  std::cout << "TIME:" << runtime_ms << ",";
-  std::cout << "WS:" << GLOBAL_WORKSPACE_SIZE << std::endl;
+  std::cout << "TIME:" << stats.median_ms << ",";
+  std::cout << "WS:" << GLOBAL_WORKSPACE_SIZE << ",";
+  std::cout << "P90:" << stats.p90_ms << ",";
+  std::cout << "MEAN:" << stats.mean_ms << ",";
+  std::cout << "CI:" << stats.ci_ms << ",";
+  std::cout << "ITERS:" << stats.iters << ",";
+  std::cout << "DISCARDED:" << stats.discarded << std::endl;
   return 0;
 }
 
@@ -485,7 +647,10 @@ struct ProfilerMemoryPool {
   ~ProfilerMemoryPool() {}
 
   int64_t ComputeMemPoolSize(size_t one_copy_sz, size_t ptr_max_sz, size_t l2_cache_bytes) {
-    int times_covers_l2_cache = (int)std::ceil(l2_cache_bytes / sizeof(DType) / ptr_max_sz);
+    // enough copies for the rotation to touch more memory than the L2 cache
+    // holds, so that every iteration reads its inputs from global memory
+    int times_covers_l2_cache =
+        (int)((l2_cache_bytes / sizeof(DType) + ptr_max_sz - 1) / ptr_max_sz) + 1;
     int64_t mem_pool_sz = std::max(2, std::min(512, times_covers_l2_cache));
     size_t free_global_mem = 0;
     size_t total_global_mem = 0;
@@ -881,10 +1046,13 @@ def gen_function(
     func_name = func_attrs["name"]
     exec_path = func_attrs["exec_path"]
     op_instance = func_attrs["op_instance"]
+    kernel_instances = current_shared_kernel_instances()
     inst_def_flag = set()
     instances = {}
     instance_decl = ""
     exec_cond_to_cutlass_3x = {}
+    # algo -> (config, instance type), for kernel_instances
+    shared_configs = OrderedDict()
     for exec_item in exec_path.values():
         fname = "f" + sha1(exec_item.exec_cond.encode()).hexdigest()
         algo = exec_item.algo
@@ -900,6 +1068,17 @@ def gen_function(
             inst_def_flag.add(algo)
         else:
             config = ""
+        if kernel_instances is not None:
+            if config:
+                config_name = extract_config_name(config, cutlass_3x=cutlass_3x)
+                if cutlass_3x:
+                    config_name = (
+                        f"cutlass::gemm::device::GemmUniversalAdapter<{config_name}>"
+                    )
+                shared_configs[algo] = (config, config_name)
+            instances[exec_item.exec_cond] = algo
+            exec_cond_to_cutlass_3x[exec_item.exec_cond] = cutlass_3x
+            continue
         instance_template = (
             INSTANCE_TEMPLATE_CUTLASS_3X if cutlass_3x else INSTANCE_TEMPLATE
         )
@@ -931,6 +1110,7 @@ def gen_function(
             problem_args=(problem_args if not cutlass_3x else ""),
             problem_args_cutlass_3x=(problem_args_cutlass_3x if cutlass_3x else ""),
             support_split_k=support_split_k,
+            shared_instance=kernel_instances is not None,
         )
         exec_inst = exec_cond_template.render(
             indent="  ",
@@ -943,8 +1123,8 @@ def gen_function(
         weight_ndims=weight_ndims,
         output_ndims=output_ndims,
     )
-    return src_template.render(
-        instances=instance_decl,
+    src = src_template.render(
+        instances=instance_decl if kernel_instances is None else _INSTANCES_MARKER,
         function_name=func_name,
         dtype="cutlass::half_t",
         shape_eval=shape_eval_func,
@@ -962,6 +1142,36 @@ def gen_function(
         elem_input_type=elem_input_type,
         elem_output_type=elem_output_type,
     )
+    if kernel_instances is None:
+        return src
+
+    # Everything above the instances (includes, extra_code, ...) is what the
+    # configs may depend on, so it goes into the shared sources as well.
+    prologue = src.split(_INSTANCES_MARKER)[0]
+    namespaces = {}
+    instance_decl = RUN_GEMM_INSTANCE_DECL
+    for algo, (config, instance_type) in shared_configs.items():
+        key = kernel_instances.key(prologue, config, instance_type)
+        namespace = "ait_kernel_" + key
+        kernel_instances.add(
+            key,
+            SHARED_INSTANCE_SRC_TEMPLATE.render(
+                prologue=prologue,
+                namespace=namespace,
+                config=config,
+                instance_type=instance_type,
+            ),
+        )
+        instance_decl += SHARED_INSTANCE_DECL_TEMPLATE.render(
+            namespace=namespace,
+            config=config,
+            instance_type=instance_type,
+        )
+        namespaces[algo] = namespace
+    for exec_cond, algo in instances.items():
+        fname = "f" + sha1(exec_cond.encode()).hexdigest()
+        instance_decl += f"using {fname} = {namespaces[algo]}::Instance;\n"
+    return src.replace(_INSTANCES_MARKER, instance_decl)
 
 
 def build_profiler(file_pairs):
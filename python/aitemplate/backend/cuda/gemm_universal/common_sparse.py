@@ -28,6 +28,7 @@ import jinja2
 from aitemplate.backend.backend_spec import CUDASpec
 
 from aitemplate.backend.common import gemm_sparse_common, tensor_accessor_codegen
+from aitemplate.backend.cuda.gemm_universal import common
 from aitemplate.backend.target import Target
 
 from aitemplate.compiler.base import IntImm, ExecItem
@@ -520,7 +521,9 @@ size_t GLOBAL_WORKSPACE_SIZE = 0;
 #include <sstream>
 
 {{op_func}}
-
+"""
+    + common.PROFILER_TIMER_DECL
+    + """
 template <typename DType>
 struct ProfilerMemoryPool;
 
@@ -583,34 +586,23 @@ void** ptr_C,                // output
     cudaStream_t stream
 {% endif %}
   ) {
-  // warmup
-  for (int i = 0; i < 5; ++i) {
+  ProfilerStats stats = ProfileKernel([&]() {
     {{func_call}}
-  }
-  cudaEvent_t events[2];
-  for (auto & event : events) {
-    cudaEventCreate(&event);
-  }
-  cudaEventRecord(events[0], stream);
-  for (int i = 0; i < 10; ++i) {
-    {{func_call}}
-  }
-  cudaEventRecord(events[1], stream);
-  cudaEventSynchronize(events[1]);
-  float runtime_ms = 0;
-  cudaEventElapsedTime(&runtime_ms, events[0], events[1]);
-  for (auto event : events) {
-    (void)cudaEventDestroy(event);
-  }
+  }, stream);
   // TODO: output workspace
-  if (runtime_ms < 0.00001) {
+  if (stats.mean_ms * stats.iters < 0.00001) {
       throw std::runtime_error(
       "OOB in cutlass."
     );
   }
   std::cout << "OP:" << gemm_op_name << ",";
-  std::cout << "TIME:" << runtime_ms << ",";
-  std::cout << "WS:" << GLOBAL_WORKSPACE_SIZE << std::endl;
+  std::cout << "TIME:" << stats.median_ms << ",";
+  std::cout << "WS:" << GLOBAL_WORKSPACE_SIZE << ",";
+  std::cout << "P90:" << stats.p90_ms << ",";
+  std::cout << "MEAN:" << stats.mean_ms << ",";
+  std::cout << "CI:" << stats.ci_ms << ",";
+  std::cout << "ITERS:" << stats.iters << ",";
+  std::cout << "DISCARDED:" << stats.discarded << std::endl;
   return 0;
 }
 
@@ -629,7 +621,10 @@ struct ProfilerMemoryPool {
   ~ProfilerMemoryPool() {}
 
   int64_t ComputeMemPoolSize(size_t one_copy_sz, size_t ptr_max_sz, size_t l2_cache_bytes) {
-    int times_covers_l2_cache = (int)std::ceil(l2_cache_bytes / sizeof(DType) / ptr_max_sz);
+    // enough copies for the rotation to touch more memory than the L2 cache
+    // holds, so that every iteration reads its inputs from global memory
+    int times_covers_l2_cache =
+        (int)((l2_cache_bytes / sizeof(DType) + ptr_max_sz - 1) / ptr_max_sz) + 1;
     int64_t mem_pool_sz = std::max(2, std::min(512, times_covers_l2_cache));
     size_t free_global_mem = 0;
     size_t total_global_mem = 0;
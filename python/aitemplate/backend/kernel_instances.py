@@ -0,0 +1,109 @@
+#  Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+"""
+Kernel instances shared between the generated op sources.
+
+Many ops of a model (and of its constant folding graph) pick the same
+kernel instance, e.g. the same CUTLASS gemm config. Instantiating the
+kernel in every op source compiles it once per op. While
+collect_shared_kernel_instances() is active, op codegen registers the
+source of each instantiation here instead, keyed by its content, and only
+declares it (extern template) in the op source. Each unique instance is
+then written and compiled once, in its own translation unit.
+"""
+
+import contextlib
+import logging
+import os
+from hashlib import sha1
+from typing import Dict, List, Optional, Tuple
+
+from aitemplate.backend.target import Target
+from aitemplate.utils.environ import share_kernel_instances
+
+
+_LOGGER = logging.getLogger(__name__)
+
+
+class SharedKernelInstances:
+    """Unique kernel instance sources, keyed by their content."""
+
+    def __init__(self):
+        self._sources: Dict[str, str] = {}
+        self._num_uses = 0
+
+    @staticmethod
+    def key(*parts: str) -> str:
+        """A short hash of parts, usable in C++ names and file names."""
+        return sha1("\0".join(parts).encode()).hexdigest()[:16]
+
+    def add(self, key: str, source: str) -> None:
+        """
+        Register the source of the translation unit that instantiates the
+        kernel instance with the given key. Sources registered again under
+        the same key are assumed to be identical.
+        """
+        self._num_uses += 1
+        self._sources.setdefault(key, source)
+
+    def write_sources(self, prefix: str) -> List[Tuple[str, str]]:
+        """Write one source per unique instance below prefix and return the
+        (source file path, object file path) pairs."""
+        target = Target.current()
+        file_pairs = []
+        for key, source in self._sources.items():
+            name = f"kernel_instance_{key}"
+            src_path = os.path.join(prefix, name + target.src_extension())
+            obj_path = os.path.join(prefix, name + ".obj")
+            with open(src_path, "w") as fo:
+                fo.write(source)
+            file_pairs.append((src_path, obj_path))
+        if self._num_uses > 0:
+            _LOGGER.info(
+                f"generated {len(file_pairs)} kernel instance srcs "
+                f"for {self._num_uses} uses"
+            )
+        return file_pairs
+
+
+_current: Optional[SharedKernelInstances] = None
+
+
+def current_shared_kernel_instances() -> Optional[SharedKernelInstances]:
+    """
+    The instances collected by the innermost active
+    collect_shared_kernel_instances(), or None if op codegen should
+    instantiate its kernels inline.
+    """
+    return _current
+
+
+@contextlib.contextmanager
+def collect_shared_kernel_instances():
+    """
+    Collect the kernel instances of the op sources generated in this
+    context. Yields None (instances are generated inline) if
+    AIT_SHARE_KERNEL_INSTANCES is disabled.
+    """
+    global _current
+    if not share_kernel_instances():
+        yield None
+        return
+    prev = _current
+    _current = SharedKernelInstances()
+    try:
+        yield _current
+    finally:
+        _current = prev
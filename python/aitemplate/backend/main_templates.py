@@ -126,8 +126,68 @@ class {{model_name}} : public ModelBase<{{model_name}}> {
          * for the constants to be consumed.
          */
         {{ reset_constants }}
+        ++constants_version_;
     }
 
+    static constexpr size_t kNumDims = {{ dim_names | length }};
+
+    void GetDims(int64_t* dims) const {
+    {% for dim in dim_names %}
+      dims[{{ loop.index0 }}] = {{ dim }};
+    {% endfor %}
+    }
+
+    void SetDims(const int64_t* dims) {
+    {% for dim in dim_names %}
+      {{ dim }} = dims[{{ loop.index0 }}];
+    {% endfor %}
+    }
+
+    static constexpr size_t kNumTracedOps = {{ traced_ops | length }};
+
+    static const OpTraceInfo* TracedOps() {
+      // The last entry is a sentinel so that the array is never empty.
+      static const OpTraceInfo ops[kNumTracedOps + 1] = {
+      {% for name, input_sizes, output_sizes in traced_ops %}
+        {{ "{" }}{{ name }}, {{ input_sizes }}, {{ output_sizes }}{{ "}" }},
+      {% endfor %}
+        {nullptr, nullptr, nullptr}
+      };
+      return ops;
+    }
+
+    static constexpr size_t kNumMemoryPlans = {{ num_memory_plans }};
+{% if num_memory_plans > 1 %}
+    size_t SelectMemoryPlan() const {
+    {% for plan in memory_plans[:-1] %}
+      if ({{ plan.condition }}) {
+        return {{ loop.index0 }};
+      }
+    {% endfor %}
+      return {{ num_memory_plans - 1 }};
+    }
+
+    static size_t MemoryPlanBlobSize(size_t plan_idx) {
+      static constexpr size_t blob_sizes[kNumMemoryPlans] = {
+        {{ memory_plans | map(attribute="blob_size") | join(", ") }}
+      };
+      return blob_sizes[plan_idx];
+    }
+
+    void SetUpBlobTensors(uint8_t* blob_ptr, size_t plan_idx) {
+      switch (plan_idx) {
+      {% for plan in memory_plans %}
+        case {{ loop.index0 }}:
+{{ plan.tensor_slice }}
+          break;
+      {% endfor %}
+        default:
+          throw std::out_of_range(
+              "Invalid memory plan index " + std::to_string(plan_idx));
+      }
+    }
+{% endif %}
+
     void DeviceToDeviceCopies(StreamType stream) {
   {{ device_to_device_copies }}
     }
@@ -139,11 +199,28 @@ class {{model_name}} : public ModelBase<{{model_name}}> {
         {% if profiler_annotation %}
         RAII_ProfilerRange _raiiAITProfilerRange("main_start");
         {% endif %}
+  {% for spec in shape_specializations %}
+      if ({{ spec.condition }}) {
+        RunImpl_{{ spec.suffix }}(stream);
+        return;
+      }
+  {% endfor %}
   {% for func in function_seq %}
   {{ func }}
       DeviceCheckLastError(__FILE__, __LINE__);
   {% endfor %}
     }
+
+  {% for spec in shape_specializations %}
+    // static-shape variant of RunImpl for {{ spec.condition }}
+    void RunImpl_{{ spec.suffix }}(StreamType stream) {
+{{ spec.set_dims }}
+    {% for func in spec.function_seq %}
+    {{ func }}
+      DeviceCheckLastError(__FILE__, __LINE__);
+    {% endfor %}
+    }
+  {% endfor %}
 {% endif %}
 
 {% if run_impl_mode == 1 %}
@@ -334,6 +411,11 @@ namespace {
 constexpr std::array<ConstantInfo, {{ num_constants }}> owned_constants = {
   {{ owned_constants_init }}
 };
+
+// Lifetimes of the intermediate tensors, from memory planning.
+constexpr std::array<AITemplateTensorLifetime, {{ num_tensor_lifetimes }}> tensor_lifetimes = {
+  {{ tensor_lifetimes_init }}
+};
 } // namespace
 
 ModelContainerBase::ModelContainerBase(
@@ -374,6 +456,8 @@ ModelContainerBase::ModelContainerBase(
   }
 {{ set_up_constant_offsets }}
 {{ set_up_constant_folding_inputs }}
+  tensor_lifetimes_.assign(tensor_lifetimes.begin(), tensor_lifetimes.end());
+  model_fingerprint_ = {{ model_fingerprint }}ULL;
 
 {% if is_windows %}
   size_t binary_constants_bin_size = 0;
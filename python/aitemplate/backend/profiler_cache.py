@@ -17,13 +17,22 @@ SQLite backend for conv/gemm profiling cache
 """
 
 import enum
+import json
 import logging
+import math
+import os
+import platform
+import re
 import sqlite3
+import tempfile
+from collections import defaultdict
 
-from typing import Any, Dict, Tuple
+from typing import Any, Callable, Dict, List, Optional, Tuple
 
 import jinja2
 
+from aitemplate.backend.profiler_cache_remote import create_remote_cache_store
+
 # pylint: disable=W0613
 
 
@@ -35,9 +44,10 @@ class CacheMode(enum.Enum):
 
     Profiling cache can be stored locally or remotely.
     For LOCAL mode, the cache is stored in a SQLite database.
-    For REMOTE mode, the profiled results can be queried with RESTFul API.
-
-    REMOTE mode is not implemented yet.
+    For REMOTE mode, the cache is also stored in a SQLite database, which
+    mirrors a remote store (see profiler_cache_remote): the remote entries
+    are merged into it when it is opened, and it is merged back into the
+    remote store by ProfileCacheDB.sync_remote, or when it is closed.
     """
 
     LOCAL = 1
@@ -63,6 +73,10 @@ GEMM_INIT_TEMPLATE = jinja2.Template(
   algo VARCHAR(512) NOT NULL,
   workspace INTEGER DEFAULT 0,
   duration FLOAT DEFAULT -1,
+  duration_p90 FLOAT DEFAULT -1,
+  duration_mean FLOAT DEFAULT -1,
+  duration_ci FLOAT DEFAULT -1,
+  iterations INTEGER DEFAULT 0,
   split_k INTEGER DEFAULT 1,
   pshape VARCHAR(64) NOT NULL,
   template_ver INTEGER NOT NULL DEFAULT 290,
@@ -71,6 +85,15 @@ GEMM_INIT_TEMPLATE = jinja2.Template(
 """
 )
 
+# Timing statistics columns added to the gemm tables after their creation,
+# added to existing tables when opened.
+GEMM_STATS_COLUMNS = {
+    "duration_p90": "FLOAT DEFAULT -1",
+    "duration_mean": "FLOAT DEFAULT -1",
+    "duration_ci": "FLOAT DEFAULT -1",
+    "iterations": "INTEGER DEFAULT 0",
+}
+
 GEMM_QUERY_TEMPLATE = jinja2.Template(
     """
 SELECT algo, workspace, split_k
@@ -108,6 +131,11 @@ INSERT INTO {{dev}}_gemm_{{version}} (
     device,
     algo,
     workspace,
+    duration,
+    duration_p90,
+    duration_mean,
+    duration_ci,
+    iterations,
     split_k,
     pshape
 )
@@ -126,12 +154,158 @@ VALUES (
     '{{device}}',
     '{{algo}}',
     {{workspace}},
+    {{duration | default(-1)}},
+    {{duration_p90 | default(-1)}},
+    {{duration_mean | default(-1)}},
+    {{duration_ci | default(-1)}},
+    {{iterations | default(0)}},
     {{split_k}},
     '{{pshape}}'
 );
 """
 )
 
+# All cached workloads of a gemm, for nearest-shape lookups.
+GEMM_QUERY_CANDIDATES_TEMPLATE = jinja2.Template(
+    """
+SELECT exec_entry, algo, workspace, split_k
+FROM {{dev}}_gemm_{{version}}
+WHERE
+dtype_a={{dtype_a}} AND
+dtype_b={{dtype_b}} AND
+dtype_c={{dtype_c}} AND
+dtype_acc={{dtype_acc}} AND
+major_a={{major_a}} AND
+major_b={{major_b}} AND
+major_c={{major_c}} AND
+op_type='{{op_type}}' AND
+device='{{device}}' AND
+epilogue={{epilogue}} AND
+pshape='{{pshape}}';
+"""
+)
+
+# Workloads that were given the result of a nearby cached workload instead
+# of being profiled. Profiling them again refines them, see
+# ProfileCacheDB.approximate_gemm_entries.
+GEMM_APPROX_INIT_TEMPLATE = jinja2.Template(
+    """
+ CREATE TABLE IF NOT EXISTS {{dev}}_gemm_approx_{{version}} (
+  id INTEGER PRIMARY KEY AUTOINCREMENT,
+  exec_entry VARCHAR(8192) NOT NULL,
+  exec_entry_sha1 VARCHAR(64) NOT NULL,
+  dtype_a INTEGER NOT NULL,
+  dtype_b INTEGER NOT NULL,
+  dtype_c INTEGER NOT NULL,
+  dtype_acc INTEGER NOT NULL,
+  major_a INTEGER NOT NULL,
+  major_b INTEGER NOT NULL,
+  major_c INTEGER NOT NULL,
+  op_type VARCHAR(512) NOT NULL,
+  epilogue VARCHAR(512) NOT NULL,
+  device VARCHAR(16) NOT NULL,
+  pshape VARCHAR(64) NOT NULL,
+  algo VARCHAR(512) NOT NULL,
+  source_exec_entry VARCHAR(8192) NOT NULL,
+  distance FLOAT NOT NULL,
+  confident INTEGER NOT NULL,
+  created_at DATETIME DEFAULT CURRENT_TIMESTAMP NOT NULL
+);
+"""
+)
+
+GEMM_APPROX_QUERY_TEMPLATE = jinja2.Template(
+    """
+SELECT id
+FROM {{dev}}_gemm_approx_{{version}}
+WHERE
+dtype_a={{dtype_a}} AND
+dtype_b={{dtype_b}} AND
+dtype_c={{dtype_c}} AND
+dtype_acc={{dtype_acc}} AND
+major_a={{major_a}} AND
+major_b={{major_b}} AND
+major_c={{major_c}} AND
+op_type='{{op_type}}' AND
+device='{{device}}' AND
+epilogue={{epilogue}} AND
+pshape='{{pshape}}' AND
+exec_entry_sha1='{{exec_entry_sha1}}';
+"""
+)
+
+GEMM_APPROX_DELETE_TEMPLATE = jinja2.Template(
+    """
+DELETE
+FROM {{dev}}_gemm_approx_{{version}}
+WHERE
+dtype_a={{dtype_a}} AND
+dtype_b={{dtype_b}} AND
+dtype_c={{dtype_c}} AND
+dtype_acc={{dtype_acc}} AND
+major_a={{major_a}} AND
+major_b={{major_b}} AND
+major_c={{major_c}} AND
+op_type='{{op_type}}' AND
+device='{{device}}' AND
+epilogue={{epilogue}} AND
+pshape='{{pshape}}' AND
+exec_entry_sha1='{{exec_entry_sha1}}';
+"""
+)
+
+GEMM_APPROX_INSERT_TEMPLATE = jinja2.Template(
+    """
+INSERT INTO {{dev}}_gemm_approx_{{version}} (
+    exec_entry,
+    exec_entry_sha1,
+    dtype_a,
+    dtype_b,
+    dtype_c,
+    dtype_acc,
+    major_a,
+    major_b,
+    major_c,
+    op_type,
+    epilogue,
+    device,
+    pshape,
+    algo,
+    source_exec_entry,
+    distance,
+    confident
+)
+VALUES (
+    '{{exec_entry}}',
+    '{{exec_entry_sha1}}',
+    {{dtype_a}},
+    {{dtype_b}},
+    {{dtype_c}},
+    {{dtype_acc}},
+    {{major_a}},
+    {{major_b}},
+    {{major_c}},
+    '{{op_type}}',
+    {{epilogue}},
+    '{{device}}',
+    '{{pshape}}',
+    '{{algo}}',
+    '{{source_exec_entry}}',
+    {{distance}},
+    {{confident}}
+);
+"""
+)
+
+GEMM_APPROX_QUERY_ALL_TEMPLATE = jinja2.Template(
+    """
+SELECT exec_entry, exec_entry_sha1, dtype_a, dtype_b, dtype_c, dtype_acc,
+major_a, major_b, major_c, op_type, epilogue, device, pshape, algo,
+source_exec_entry, distance, confident
+FROM {{dev}}_gemm_approx_{{version}};
+"""
+)
+
 CONV_INIT_TEMPLATE = jinja2.Template(
     """
  CREATE TABLE IF NOT EXISTS {{dev}}_conv_{{version}} (
@@ -469,14 +643,133 @@ SELECT name FROM sqlite_master WHERE type='table';
 """
 )
 
+# Where the entries merged by ProfileCacheDB.import_entries came from, and
+# which entries they replaced.
+PROVENANCE_INIT_TEMPLATE = jinja2.Template(
+    """
+ CREATE TABLE IF NOT EXISTS {{dev}}_provenance (
+  id INTEGER PRIMARY KEY AUTOINCREMENT,
+  table_name VARCHAR(64) NOT NULL,
+  exec_entry VARCHAR(8192) NOT NULL,
+  algo VARCHAR(512) NOT NULL,
+  duration FLOAT DEFAULT -1,
+  source VARCHAR(1024) NOT NULL,
+  replaced_algo VARCHAR(512),
+  replaced_duration FLOAT,
+  created_at DATETIME DEFAULT CURRENT_TIMESTAMP NOT NULL
+);
+"""
+)
+
 
-__AIT_CACHE_VERSION__ = 3
+# 4: gemm durations are the median of single iterations rather than the
+# total of 10 iterations, so they can't be compared with older entries.
+__AIT_CACHE_VERSION__ = 4
 
 
 def ait_cache_version() -> int:
     return __AIT_CACHE_VERSION__
 
 
+def _parse_exec_entry(exec_entry: str) -> Dict[str, int]:
+    """{"M": 128, "N": 256, "K": 64} for "M == 128 && N == 256 && K == 64"."""
+    return {
+        name: int(value)
+        for name, value in re.findall(r"(\w+)\s*==\s*(\d+)", exec_entry)
+    }
+
+
+def shape_distance(dims: Dict[str, int], other: Dict[str, int]) -> float:
+    """
+    The largest ratio between corresponding dimensions, in log2: 1.0 means
+    that no dimension is more than 2x apart. Infinite for different dims.
+    """
+    if dims.keys() != other.keys():
+        return math.inf
+    return max(
+        (abs(math.log2(max(other[d], 1) / max(dims[d], 1))) for d in dims),
+        default=0.0,
+    )
+
+
+# The portable format of exported profile cache entries, see
+# export_cache_entries.
+PROFILE_CACHE_FORMAT = "aitemplate_profile_cache"
+PROFILE_CACHE_FORMAT_VERSION = 1
+
+# Columns of the cache tables that hold the profiling result of a workload
+# rather than identify it, and columns that are local to a database.
+_RESULT_COLUMNS = (
+    "algo",
+    "workspace",
+    "duration",
+    "split_k",
+    "template_ver",
+    *GEMM_STATS_COLUMNS,
+)
+_LOCAL_COLUMNS = ("id", "created_at")
+
+_CACHE_TABLE_PATTERN = re.compile(
+    r"(?P<dev>[A-Z]+)_(?P<kind>gemm|conv|conv3d|normalization)(_(?P<version>\d+))?"
+)
+
+
+def cache_tables(cur: sqlite3.Cursor) -> Dict[str, Tuple[str, str, Optional[int]]]:
+    """The (target, kind, cache version) of each profile cache table."""
+    cur.execute(QUERY_ALL_TABLES_TEMPLATE.render())
+    tables = {}
+    for (table_name,) in cur.fetchall():
+        match = _CACHE_TABLE_PATTERN.fullmatch(table_name)
+        if match is None:
+            continue
+        version = match.group("version")
+        tables[table_name] = (
+            match.group("dev"),
+            match.group("kind"),
+            None if version is None else int(version),
+        )
+    return tables
+
+
+def export_cache_entries(
+    con: sqlite3.Connection, source: Optional[str] = None
+) -> Dict[str, Any]:
+    """
+    The entries of all profile cache tables of a database, in the portable
+    format that ProfileCacheDB.import_entries merges:
+
+    {"format": ..., "format_version": ..., "source": source,
+     "targets": {target: {kind: {"cache_version": ..., "entries": [...]}}}}
+
+    Approximate results (see ProfileCacheDB.query_gemm_nearest) are not
+    exported.
+    """
+    cur = con.cursor()
+    targets = {}
+    for table_name, (target, kind, version) in sorted(cache_tables(cur).items()):
+        cur.execute(f"SELECT * FROM {table_name};")
+        names = [column[0] for column in cur.description]
+        entries = [
+            {
+                name: value
+                for name, value in zip(names, row)
+                if name not in _LOCAL_COLUMNS
+            }
+            for row in cur.fetchall()
+        ]
+        tables = targets.setdefault(target, {})
+        # Only export the newest version of each table.
+        if kind in tables and (tables[kind]["cache_version"] or 0) > (version or 0):
+            continue
+        tables[kind] = {"cache_version": version, "entries": entries}
+    return {
+        "format": PROFILE_CACHE_FORMAT,
+        "format_version": PROFILE_CACHE_FORMAT_VERSION,
+        "source": source,
+        "targets": targets,
+    }
+
+
 class ProfileCacheDB:
     r"""Local SQLite profile cache database."""
 
@@ -492,9 +785,10 @@ class ProfileCacheDB:
         path : str, optional
             path to the database file. If not specified, a temporary file is created.
         uri : str, optional
-            uri to the RESFul API (Not implemented yet)
+            uri of the remote store, e.g. file:///mnt/ait_cache or
+            http://cache-server/ait_cache, see profiler_cache_remote
         port : str, optional
-            port to the RESFul API (Not implemented yet)
+            port of the remote store, if not part of uri
 
         """
         self._target = target
@@ -519,22 +813,32 @@ class ProfileCacheDB:
         self._gemm_cache_version = ait_cache_version()
         self._conv_cache_version = ait_cache_version()
         self._conv3d_cache_version = ait_cache_version()
+        self._remote = None
+        self._remote_dirty = False
+        self._tmp_path = None
         if uri is not None:
             self._mode = CacheMode.REMOTE
-        if self._mode == CacheMode.LOCAL:
-            assert path is not None
-            self._con = sqlite3.connect(path)
-            self._cur = self._con.cursor()
-            self._init_db()
-        else:
-            raise NotImplementedError
+            self._remote = create_remote_cache_store(uri, port)
+            self._remote_uri = uri
+            if path is None:
+                fd, path = tempfile.mkstemp(suffix=".db")
+                os.close(fd)
+                self._tmp_path = path
+        assert path is not None
+        self._con = sqlite3.connect(path)
+        self._cur = self._con.cursor()
+        self._init_db()
+        if self._mode == CacheMode.REMOTE:
+            self._pull_remote()
 
     def _init_db(self):
         """Creates table in cache."""
         self._create_gemm_table()
+        self._create_gemm_approx_table()
         self._create_conv_table()
         self._create_conv3d_table()
         self._create_norm_table()
+        self._create_provenance_table()
 
     @property
     def gemm_cache_version(self) -> int:
@@ -567,6 +871,23 @@ class ProfileCacheDB:
             )
             self._cur.execute(sql)
             self._con.commit()
+            return
+        table_name = f"{self._target}_gemm_{version}"
+        self._cur.execute(f"PRAGMA table_info({table_name});")
+        columns = {column[1] for column in self._cur.fetchall()}
+        for name, decl in GEMM_STATS_COLUMNS.items():
+            if name not in columns:
+                self._cur.execute(f"ALTER TABLE {table_name} ADD COLUMN {name} {decl};")
+        self._con.commit()
+
+    def _create_gemm_approx_table(self):
+        """Creates the table of approximate gemm results."""
+        sql = GEMM_APPROX_INIT_TEMPLATE.render(
+            dev=self._target,
+            version=self.gemm_cache_version,
+        )
+        self._cur.execute(sql)
+        self._con.commit()
 
     def _create_conv_table(self):
         """Creates conv table."""
@@ -614,6 +935,12 @@ class ProfileCacheDB:
         self._cur.execute(sql)
         self._con.commit()
 
+    def _create_provenance_table(self):
+        """Creates the table of merged entries."""
+        sql = PROVENANCE_INIT_TEMPLATE.render(dev=self._target)
+        self._cur.execute(sql)
+        self._con.commit()
+
     def _table_exists(self, table_kind, cache_version):
         """Check if the table of given kind and cache version exists."""
         table_name = f"{self._target}_{table_kind}_{cache_version}"
@@ -667,17 +994,14 @@ class ProfileCacheDB:
         Tuple
             profiling results
         """
-        if self._mode == CacheMode.LOCAL:
-            if self._db_commit_flag:
-                self._con.commit()
-                self._db_commit_flag = False
-            self._cur.execute(sql)
-            out = self._cur.fetchall()
-            if len(out) == 0:
-                return None
-            return out[0]
-
-        raise NotImplementedError
+        if self._db_commit_flag:
+            self._con.commit()
+            self._db_commit_flag = False
+        self._cur.execute(sql)
+        out = self._cur.fetchall()
+        if len(out) == 0:
+            return None
+        return out[0]
 
     def query_gemm(self, args: Dict[str, Any]) -> Tuple[str, int]:
         """a function to query gemm op epilogue from cache
@@ -699,6 +1023,109 @@ class ProfileCacheDB:
         )
         return self._query(sql)
 
+    def query_gemm_nearest(
+        self,
+        args: Dict[str, Any],
+        exec_entry: str,
+        max_distance: float,
+        is_valid_algo: Optional[Callable[[str], bool]] = None,
+    ) -> Optional[Tuple[str, int, int, bool]]:
+        """a function to query the best gemm op epilogue for a workload
+        without an exact cache entry, from the cached workloads of the same
+        gemm whose shapes are near it
+
+        Every cached workload within max_distance (see shape_distance)
+        votes for its algo, weighted by 1 / (1 + distance). The workload is
+        then recorded as approximate, until insert_gemm adds a profiled
+        result for it.
+
+        Parameters
+        ----------
+        args : Dict
+            gemm query entry
+        exec_entry : str
+            the workload, e.g. "M == 128 && N == 256 && K == 64"
+        max_distance : float
+            largest shape_distance of the cached workloads to consider
+        is_valid_algo : Callable[[str], bool], optional
+            filters the algos the op can run for this workload
+
+        Returns
+        -------
+        Tuple
+            (algo, workspace, split_k, confident) or None, where confident
+            tells if all cached workloads within max_distance (at least
+            two) agree on the algo
+        """
+        dims = _parse_exec_entry(exec_entry)
+        if not dims:
+            return None
+        sql = GEMM_QUERY_CANDIDATES_TEMPLATE.render(
+            dev=self._target,
+            version=self.gemm_cache_version,
+            **args,
+        )
+        if self._db_commit_flag:
+            self._con.commit()
+            self._db_commit_flag = False
+        self._cur.execute(sql)
+        candidates = []
+        for cached_entry, algo, workspace, split_k in self._cur.fetchall():
+            distance = shape_distance(dims, _parse_exec_entry(cached_entry))
+            if distance > max_distance:
+                continue
+            if is_valid_algo is not None and not is_valid_algo(algo):
+                continue
+            candidates.append((distance, cached_entry, algo, workspace, split_k))
+        if not candidates:
+            return None
+
+        votes = defaultdict(float)
+        for distance, _, algo, _, _ in candidates:
+            votes[algo] += 1.0 / (1.0 + distance)
+        best_algo = max(votes, key=votes.get)
+        matches = sorted(c for c in candidates if c[2] == best_algo)
+        distance, source_entry, _, _, split_k = matches[0]
+        workspace = max(c[3] for c in matches)
+        confident = len(candidates) > 1 and len(votes) == 1
+
+        self._insert(
+            GEMM_APPROX_QUERY_TEMPLATE.render(
+                dev=self._target,
+                version=self.gemm_cache_version,
+                **args,
+            ),
+            GEMM_APPROX_INSERT_TEMPLATE.render(
+                dev=self._target,
+                version=self.gemm_cache_version,
+                exec_entry=exec_entry,
+                algo=best_algo,
+                source_exec_entry=source_entry,
+                distance=distance,
+                confident=int(confident),
+                **args,
+            ),
+        )
+        return best_algo, workspace, split_k, confident
+
+    def approximate_gemm_entries(self) -> List[Dict[str, Any]]:
+        """the gemm workloads whose cached result came from a nearby workload
+        (see query_gemm_nearest) and should be profiled again
+
+        Returns
+        -------
+        List
+            one dict per workload, with the gemm query entry fields, plus
+            exec_entry, algo, source_exec_entry, distance and confident
+        """
+        sql = GEMM_APPROX_QUERY_ALL_TEMPLATE.render(
+            dev=self._target,
+            version=self.gemm_cache_version,
+        )
+        self._cur.execute(sql)
+        names = [column[0] for column in self._cur.description]
+        return [dict(zip(names, row)) for row in self._cur.fetchall()]
+
     def query_conv(self, args: Dict[str, Any]) -> Tuple[str, int]:
         """a function to query conv op epilogue from cache,
         here we use the same sql table for conv and gemm
@@ -767,14 +1194,14 @@ class ProfileCacheDB:
         insert_sql: str
             cache insert sql
         """
-        if self._mode == CacheMode.LOCAL:
-            self._cur.execute(query_sql)
-            out = self._cur.fetchall()
-            if len(out) == 0:
-                self._cur.execute(insert_sql)
-                self._db_commit_flag = True
-            else:
-                _LOGGER.info("Ignore repeat profile_record: " + query_sql)
+        self._cur.execute(query_sql)
+        out = self._cur.fetchall()
+        if len(out) == 0:
+            self._cur.execute(insert_sql)
+            self._db_commit_flag = True
+            self._remote_dirty = True
+        else:
+            _LOGGER.info("Ignore repeat profile_record: " + query_sql)
 
     def insert_gemm(self, args: Dict[str, Any]) -> None:
         """a function to insert gemm op epilogue into cache
@@ -807,6 +1234,14 @@ class ProfileCacheDB:
             **args,
         )
         self._insert(query_sql, insert_sql)
+        # The workload is profiled now, it's no longer approximate.
+        delete_sql = GEMM_APPROX_DELETE_TEMPLATE.render(
+            dev=self._target,
+            version=self.gemm_cache_version,
+            **args,
+        )
+        self._cur.execute(delete_sql)
+        self._db_commit_flag = True
 
     def insert_conv(self, args: Dict[str, Any]) -> None:
         """a function to insert conv op epilogue into cache,
@@ -919,6 +1354,248 @@ class ProfileCacheDB:
         insert_sql = NORM_INSERT_TEMPLATE.render(dev=self._target, **args)
         self._insert(query_sql, insert_sql)
 
-    def __del__(self):
+    def _cache_versions(self) -> Dict[str, Optional[int]]:
+        """The cache version of the table of each kind."""
+        return {
+            "gemm": self.gemm_cache_version,
+            "conv": self.conv_cache_version,
+            "conv3d": self.conv3d_cache_version,
+            "normalization": None,
+        }
+
+    def _table_name(self, kind: str) -> str:
+        version = self._cache_versions()[kind]
+        if version is None:
+            return f"{self._target}_{kind}"
+        return f"{self._target}_{kind}_{version}"
+
+    def export_entries(self, source: Optional[str] = None) -> Dict[str, Any]:
+        """a function to export the cache entries in the portable format of
+        export_cache_entries
+
+        Parameters
+        ----------
+        source : str, optional
+            where the entries come from, recorded by import_entries
+
+        Returns
+        -------
+        Dict
+            the exported entries, serializable to json
+        """
+        self._con.commit()
+        self._db_commit_flag = False
+        return export_cache_entries(self._con, source)
+
+    def import_entries(
+        self, data: Dict[str, Any], source: Optional[str] = None
+    ) -> Dict[str, int]:
+        """a function to merge exported cache entries into the cache
+
+        Entries of other targets, and of other cache versions, are skipped.
+        When the cache already has a result for a workload, the faster one
+        (by duration) is kept. An entry without a duration never replaces
+        one. Added and replaced entries are recorded, with source, in
+        the provenance table.
+
+        Parameters
+        ----------
+        data : Dict
+            entries exported by export_entries (or export_cache_entries)
+        source : str, optional
+            where the entries come from, defaults to the source of data
+
+        Returns
+        -------
+        Dict
+            the number of entries "added", "replaced", "kept" and "stale"
+        """
+        if data.get("format") != PROFILE_CACHE_FORMAT:
+            raise ValueError("not an exported AITemplate profile cache")
+        if data.get("format_version", 0) > PROFILE_CACHE_FORMAT_VERSION:
+            raise ValueError(
+                f"unsupported profile cache format version {data['format_version']}"
+            )
+        source = source or data.get("source") or "unknown"
+        stats = {"added": 0, "replaced": 0, "kept": 0, "stale": 0}
+        versions = self._cache_versions()
+        for kind, table in data["targets"].get(self._target, {}).items():
+            if kind not in versions or table["cache_version"] != versions[kind]:
+                _LOGGER.info(
+                    f"skipping {len(table['entries'])} stale {kind} entries "
+                    f"of cache version {table['cache_version']}"
+                )
+                stats["stale"] += len(table["entries"])
+                continue
+            table_name = self._table_name(kind)
+            self._cur.execute(f"PRAGMA table_info({table_name});")
+            columns = [column[1] for column in self._cur.fetchall()]
+            for entry in table["entries"]:
+                self._merge_entry(table_name, columns, entry, source, stats)
+        self._con.commit()
+        self._db_commit_flag = False
+        if stats["added"] or stats["replaced"]:
+            self._remote_dirty = True
+        _LOGGER.info(f"merged profile cache entries from {source}: {stats}")
+        return stats
+
+    def _merge_entry(
+        self,
+        table_name: str,
+        columns: List[str],
+        entry: Dict[str, Any],
+        source: str,
+        stats: Dict[str, int],
+    ) -> None:
+        """Merge a single exported entry into table_name, see import_entries."""
+        entry = {
+            name: value
+            for name, value in entry.items()
+            if name in columns and name not in _LOCAL_COLUMNS
+        }
+        keys = [name for name in entry if name not in _RESULT_COLUMNS]
+        results = [name for name in entry if name in _RESULT_COLUMNS]
+        where = " AND ".join(f"{name}=?" for name in keys)
+        self._cur.execute(
+            f"SELECT id, algo, duration FROM {table_name} WHERE {where};",
+            [entry[name] for name in keys],
+        )
+        existing = self._cur.fetchone()
+        duration = entry.get("duration")
+        duration = -1 if duration is None else duration
+        if existing is None:
+            names = ", ".join(entry)
+            values = ", ".join("?" for _ in entry)
+            self._cur.execute(
+                f"INSERT INTO {table_name} ({names}) VALUES ({values});",
+                list(entry.values()),
+            )
+            replaced_algo, replaced_duration = None, None
+            stats["added"] += 1
+        else:
+            row_id, replaced_algo, replaced_duration = existing
+            if replaced_duration is None:
+                replaced_duration = -1
+            if duration < 0 or 0 <= replaced_duration <= duration:
+                stats["kept"] += 1
+                return
+            assignments = ", ".join(f"{name}=?" for name in results)
+            self._cur.execute(
+                f"UPDATE {table_name} SET {assignments} WHERE id=?;",
+                [entry[name] for name in results] + [row_id],
+            )
+            stats["replaced"] += 1
+        self._cur.execute(
+            f"INSERT INTO {self._target}_provenance (table_name, exec_entry, "
+            "algo, duration, source, replaced_algo, replaced_duration) "
+            "VALUES (?, ?, ?, ?, ?, ?, ?);",
+            [
+                table_name,
+                entry.get("exec_entry", ""),
+                entry.get("algo", ""),
+                duration,
+                source,
+                replaced_algo,
+                replaced_duration,
+            ],
+        )
+
+    def provenance_entries(self) -> List[Dict[str, Any]]:
+        """a function to list where the merged cache entries came from
+
+        Returns
+        -------
+        List
+            one dict per added or replaced entry, with table_name,
+            exec_entry, algo, duration, source, replaced_algo,
+            replaced_duration and created_at
+        """
+        self._cur.execute(
+            f"SELECT table_name, exec_entry, algo, duration, source, "
+            f"replaced_algo, replaced_duration, created_at "
+            f"FROM {self._target}_provenance ORDER BY id;"
+        )
+        names = [column[0] for column in self._cur.description]
+        return [dict(zip(names, row)) for row in self._cur.fetchall()]
+
+    def prune_stale_tables(self) -> List[str]:
+        """a function to drop the tables of this target that belong to other
+        cache versions, which are kept when the cache version changes
+
+        Returns
+        -------
+        List
+            the names of the dropped tables
+        """
+        versions = self._cache_versions()
+        versions["gemm_approx"] = self.gemm_cache_version
+        pattern = re.compile(
+            rf"{self._target}_(?P<kind>gemm_approx|gemm|conv3d|conv)_(?P<version>\d+)"
+        )
+        self._cur.execute(QUERY_ALL_TABLES_TEMPLATE.render())
+        dropped = []
+        for (table_name,) in self._cur.fetchall():
+            match = pattern.fullmatch(table_name)
+            if match is None:
+                continue
+            if int(match.group("version")) != versions[match.group("kind")]:
+                _LOGGER.info(f"dropping stale table {table_name}")
+                self._cur.execute(f"DROP TABLE {table_name};")
+                dropped.append(table_name)
         self._con.commit()
-        self._con.close()
+        return dropped
+
+    def _remote_name(self) -> str:
+        return f"{self._target}_profile_cache.json"
+
+    def _pull_remote(self) -> None:
+        """Merge the entries of the remote store into the local database."""
+        data = self._remote.fetch(self._remote_name())
+        if data is None:
+            _LOGGER.info(f"no remote profile cache at {self._remote_uri} yet")
+            return
+        # Entries pulled from the remote store don't need to be pushed back.
+        dirty = self._remote_dirty
+        self.import_entries(json.loads(data), source=self._remote_uri)
+        self._remote_dirty = dirty
+
+    def sync_remote(self) -> None:
+        """a function to merge the local cache into the remote store, in
+        REMOTE mode
+
+        The remote entries are merged into the local database first, so
+        that entries added remotely since this cache was opened are kept.
+        """
+        if self._mode != CacheMode.REMOTE:
+            raise RuntimeError("sync_remote requires CacheMode.REMOTE")
+        self._pull_remote()
+        data = self.export_entries(source=platform.node())
+        self._remote.store(self._remote_name(), json.dumps(data).encode())
+        self._remote_dirty = False
+
+    def close(self) -> None:
+        """Push the entries added since the last sync to the remote store (in
+        REMOTE mode) and close the database. Errors of the push are raised,
+        after the database has been closed. Does nothing if already closed.
+        """
+        if self._con is None:
+            return
+        try:
+            if self._mode == CacheMode.REMOTE and self._remote_dirty:
+                self.sync_remote()
+        finally:
+            self._con.commit()
+            self._con.close()
+            self._con = None
+            if self._tmp_path is not None:
+                os.remove(self._tmp_path)
+                self._tmp_path = None
+
+    def __del__(self):
+        # Only a safety net for caches that were never closed.
+        if getattr(self, "_con", None) is None:
+            return
+        try:
+            self.close()
+        except Exception as e:
+            _LOGGER.warning(f"failed to sync the remote profile cache: {e}")
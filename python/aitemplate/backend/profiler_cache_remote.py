@@ -0,0 +1,130 @@
+#  Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+"""
+Remote stores for the profile cache, see CacheMode.REMOTE.
+
+A store keeps named blobs, the exported profile cache entries of a target.
+Stores are picked by the scheme of the cache uri: file:// for a shared
+directory and http(s):// for a plain file server that supports GET and
+PUT. Other stores can be added with register_remote_cache_store.
+"""
+
+import logging
+import os
+import tempfile
+import urllib.error
+import urllib.parse
+import urllib.request
+from typing import Callable, Dict, Optional
+
+
+_LOGGER = logging.getLogger(__name__)
+
+
+class RemoteCacheStore:
+    """Interface of the remote profile cache stores."""
+
+    def fetch(self, name: str) -> Optional[bytes]:
+        """The content of the blob name, or None if it doesn't exist."""
+        raise NotImplementedError
+
+    def store(self, name: str, data: bytes) -> None:
+        """Create or replace the blob name."""
+        raise NotImplementedError
+
+
+class FileRemoteCacheStore(RemoteCacheStore):
+    """Blobs are files in a (shared) directory."""
+
+    def __init__(self, root: str):
+        self._root = root
+
+    def fetch(self, name: str) -> Optional[bytes]:
+        path = os.path.join(self._root, name)
+        if not os.path.isfile(path):
+            return None
+        with open(path, "rb") as f:
+            return f.read()
+
+    def store(self, name: str, data: bytes) -> None:
+        os.makedirs(self._root, exist_ok=True)
+        # Write to a temporary file first, so that readers never see a
+        # partially written blob.
+        fd, tmp_path = tempfile.mkstemp(dir=self._root, prefix=f".{name}.")
+        with os.fdopen(fd, "wb") as f:
+            f.write(data)
+        os.replace(tmp_path, os.path.join(self._root, name))
+
+
+class HTTPRemoteCacheStore(RemoteCacheStore):
+    """Blobs are fetched with GET and stored with PUT below a base url."""
+
+    def __init__(self, base_url: str, timeout: float = 30):
+        self._base_url = base_url.rstrip("/")
+        self._timeout = timeout
+
+    def _url(self, name: str) -> str:
+        return f"{self._base_url}/{urllib.parse.quote(name)}"
+
+    def fetch(self, name: str) -> Optional[bytes]:
+        try:
+            with urllib.request.urlopen(
+                self._url(name), timeout=self._timeout
+            ) as response:
+                return response.read()
+        except urllib.error.HTTPError as e:
+            if e.code == 404:
+                return None
+            raise
+
+    def store(self, name: str, data: bytes) -> None:
+        request = urllib.request.Request(self._url(name), data=data, method="PUT")
+        with urllib.request.urlopen(request, timeout=self._timeout):
+            pass
+
+
+_REMOTE_CACHE_STORES: Dict[str, Callable[[str, Optional[str]], RemoteCacheStore]] = {}
+
+
+def register_remote_cache_store(
+    scheme: str, factory: Callable[[str, Optional[str]], RemoteCacheStore]
+) -> None:
+    """Use factory(uri, port) to create the stores of uris with scheme."""
+    _REMOTE_CACHE_STORES[scheme] = factory
+
+
+def _create_file_store(uri: str, port: Optional[str]) -> RemoteCacheStore:
+    return FileRemoteCacheStore(urllib.parse.urlparse(uri).path)
+
+
+def _create_http_store(uri: str, port: Optional[str]) -> RemoteCacheStore:
+    parsed = urllib.parse.urlparse(uri)
+    if port is not None and parsed.port is None:
+        parsed = parsed._replace(netloc=f"{parsed.netloc}:{port}")
+    return HTTPRemoteCacheStore(parsed.geturl())
+
+
+register_remote_cache_store("file", _create_file_store)
+register_remote_cache_store("http", _create_http_store)
+register_remote_cache_store("https", _create_http_store)
+
+
+def create_remote_cache_store(uri: str, port: Optional[str] = None) -> RemoteCacheStore:
+    """The store of the remote profile cache at uri."""
+    scheme = urllib.parse.urlparse(uri).scheme or "file"
+    if scheme not in _REMOTE_CACHE_STORES:
+        raise NotImplementedError(f"no remote profile cache store for {uri=}")
+    _LOGGER.info(f"Using remote profile cache at {uri}")
+    return _REMOTE_CACHE_STORES[scheme](uri, port)
@@ -0,0 +1,155 @@
+#  Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+"""
+Tools to share profile caches between machines:
+
+    python -m aitemplate.backend.profiler_cache_tools export CACHE_DB OUT_JSON
+    python -m aitemplate.backend.profiler_cache_tools merge CACHE_DB IN...
+    python -m aitemplate.backend.profiler_cache_tools prune CACHE_DB
+
+The inputs of merge are exported json files or other cache databases.
+"""
+
+import argparse
+import json
+import logging
+import sqlite3
+from typing import Any, Dict, List, Optional
+
+from aitemplate.backend.profiler_cache import (
+    cache_tables,
+    export_cache_entries,
+    ProfileCacheDB,
+)
+
+_SQLITE_HEADER = b"SQLite format 3\0"
+
+
+def _is_sqlite(path: str) -> bool:
+    with open(path, "rb") as f:
+        return f.read(len(_SQLITE_HEADER)) == _SQLITE_HEADER
+
+
+def load_cache_entries(path: str) -> Dict[str, Any]:
+    """The entries of an exported json file or of a cache database."""
+    if not _is_sqlite(path):
+        with open(path) as f:
+            return json.load(f)
+    # Read-only, opening a ProfileCacheDB would create missing tables.
+    con = sqlite3.connect(f"file:{path}?mode=ro", uri=True)
+    try:
+        return export_cache_entries(con, source=path)
+    finally:
+        con.close()
+
+
+def _targets(path: str) -> List[str]:
+    con = sqlite3.connect(path)
+    try:
+        tables = cache_tables(con.cursor())
+    finally:
+        con.close()
+    return sorted({target for target, _, _ in tables.values()})
+
+
+def export_profile_cache(
+    cache_path: str, out_path: str, source: Optional[str] = None
+) -> None:
+    """Export the entries of the cache database at cache_path to out_path."""
+    data = load_cache_entries(cache_path)
+    data["source"] = source or cache_path
+    with open(out_path, "w") as f:
+        json.dump(data, f)
+
+
+def merge_profile_caches(
+    cache_path: str, inputs: List[str], targets: Optional[List[str]] = None
+) -> Dict[str, Dict[str, int]]:
+    """
+    Merge inputs into the cache database at cache_path, for each of targets
+    (default: the targets found in the inputs), see
+    ProfileCacheDB.import_entries. Returns the merge stats of each target.
+    """
+    datas = [load_cache_entries(path) for path in inputs]
+    if targets is None:
+        targets = sorted({target for data in datas for target in data["targets"]})
+    stats = {}
+    for target in targets:
+        db = ProfileCacheDB(target, path=cache_path)
+        target_stats = {"added": 0, "replaced": 0, "kept": 0, "stale": 0}
+        for path, data in zip(inputs, datas):
+            source = data.get("source") or path
+            for name, count in db.import_entries(data, source=source).items():
+                target_stats[name] += count
+        stats[target] = target_stats
+        db.close()
+    return stats
+
+
+def prune_profile_cache(
+    cache_path: str, targets: Optional[List[str]] = None
+) -> List[str]:
+    """
+    Drop the tables of other cache versions from the cache database at
+    cache_path, for each of targets (default: all). Returns their names.
+    """
+    if targets is None:
+        targets = _targets(cache_path)
+    dropped = []
+    for target in targets:
+        db = ProfileCacheDB(target, path=cache_path)
+        dropped.extend(db.prune_stale_tables())
+        db.close()
+    return dropped
+
+
+def main(argv: Optional[List[str]] = None) -> None:
+    parser = argparse.ArgumentParser(description="AITemplate profile cache tools")
+    parser.add_argument(
+        "--target",
+        action="append",
+        help="target (CUDA or ROCM) to merge or prune, default: all",
+    )
+    subparsers = parser.add_subparsers(dest="command", required=True)
+    export_parser = subparsers.add_parser("export", help="export a cache to json")
+    export_parser.add_argument("cache")
+    export_parser.add_argument("out")
+    export_parser.add_argument("--source", help="recorded as the entries' source")
+    merge_parser = subparsers.add_parser(
+        "merge", help="merge json exports or cache databases into a cache"
+    )
+    merge_parser.add_argument("cache")
+    merge_parser.add_argument("inputs", nargs="+")
+    prune_parser = subparsers.add_parser(
+        "prune", help="drop the tables of other cache versions"
+    )
+    prune_parser.add_argument("cache")
+    args = parser.parse_args(argv)
+
+    logging.basicConfig(level=logging.INFO)
+    if args.command == "export":
+        export_profile_cache(args.cache, args.out, args.source)
+    elif args.command == "merge":
+        for target, stats in merge_profile_caches(
+            args.cache, args.inputs, args.target
+        ).items():
+            print(f"{target}: {stats}")
+    else:
+        for table_name in prune_profile_cache(args.cache, args.target):
+            print(f"dropped {table_name}")
+
+
+if __name__ == "__main__":
+    main()
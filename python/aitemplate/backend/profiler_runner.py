@@ -23,11 +23,10 @@ import logging
 import os
 
 import re
-import subprocess
+import time
 from collections import namedtuple
-from queue import Queue
 from time import sleep
-from typing import Callable, List, Tuple, Union
+from typing import Callable, Dict, List, Tuple, Union
 
 from aitemplate.backend.target import Target
 from aitemplate.backend.task_runner import BaseRunner, Task
@@ -41,6 +40,11 @@ _LOGGER = logging.getLogger(__name__)
 
 
 PROF_RUNTIME_PATTERN = re.compile(r"OP:([a-zA-Z0-9_]+),TIME:([\d\.]+),WS:([\d]+)")
+# timing statistics the gemm profilers print after the workspace
+PROF_STATS_PATTERN = re.compile(
+    r"OP:([a-zA-Z0-9_]+),TIME:[^,]+,WS:[\d]+,P90:([^,]+),MEAN:([^,]+),CI:([^,]+),"
+    r"ITERS:([\d]+),DISCARDED:([01])"
+)
 # FIXME: We will remove the following two patterns once we implement the
 # same profiling mechanism as gemm for conv and amd
 RUNTIME_PATTERN = re.compile(r"TIME:([\d\.]+)")
@@ -49,8 +53,18 @@ WORKSPACE_PATTERN = re.compile(r"WS:([\d]+)")
 PROFILER_RUN_MAX_ATTEMPTS = 3
 PROFILER_RUN_RETRY_DELAY_SECONDS = 5
 
-ProfileResult = namedtuple("ProfileResult", "op_config duration workspace")
-"""Object to store profiling result
+ProfileStats = namedtuple("ProfileStats", "p90 mean ci iterations discarded")
+"""Timing statistics of a profiled kernel: the p90 and mean iteration times,
+the half width of the 95% confidence interval of the mean (all in ms), the
+number of timed iterations and whether the kernel was discarded early for
+being clearly slower than the fastest one
+"""
+
+ProfileResult = namedtuple(
+    "ProfileResult", "op_config duration workspace stats", defaults=(None,)
+)
+"""Object to store profiling result, duration is the median iteration time
+of the profilers that report ProfileStats
 """
 
 
@@ -58,6 +72,22 @@ def optimization_key(result):
     return float(result[1])
 
 
+def extract_profile_stats(stdout) -> Dict[str, ProfileStats]:
+    """The ProfileStats reported in stdout, by op name"""
+    return {
+        op: ProfileStats(
+            p90=float(p90),
+            mean=float(mean),
+            ci=float(ci),
+            iterations=int(iterations),
+            discarded=discarded == "1",
+        )
+        for op, p90, mean, ci, iterations, discarded in PROF_STATS_PATTERN.findall(
+            stdout
+        )
+    }
+
+
 def extract_profile_result(
     stdout,
     return_ops=None,
@@ -65,6 +95,7 @@ def extract_profile_result(
     failed = False
     try:
         runtimes = PROF_RUNTIME_PATTERN.findall(stdout)
+        stats = extract_profile_stats(stdout)
         if len(runtimes) > 0:
             _LOGGER.debug(f"all runtimes (unsorted): {runtimes}")
             # format - OP:xx,TIME:x.xx,WS:xx
@@ -76,6 +107,7 @@ def extract_profile_result(
                         op_config=runtime[0],
                         duration=float(runtime[1]),
                         workspace=int(runtime[2]),
+                        stats=stats.get(runtime[0]),
                     )
                     for runtime in runtimes
                     if runtime[0] in return_ops
@@ -86,6 +118,7 @@ def extract_profile_result(
                     op_config=best_runtime[0],
                     duration=float(best_runtime[1]),
                     workspace=int(best_runtime[2]),
+                    stats=stats.get(best_runtime[0]),
                 )
         else:
             # FIXME: remove it once we unify our profiling mechanism for conv and amd
@@ -104,9 +137,13 @@ def extract_profile_result(
     return result, failed
 
 
-def update_inplace(d, new_d):
-    d.update(new_d)
-    return d
+def _profiler_key(cmd: Union[str, List[str]]) -> str:
+    """TaskTimeStats key of a profiler command. The profilers live in
+    per-model build dirs: key them by name and arguments instead of path,
+    to find their timings across models."""
+    if isinstance(cmd, str):
+        cmd = cmd.split()
+    return " ".join([os.path.basename(cmd[0])] + list(cmd[1:]))
 
 
 def process_task(task: Task) -> None:
@@ -148,7 +185,7 @@ def process_task(task: Task) -> None:
         for result in results:
             _LOGGER.debug(
                 f"Successful: [{task._name}][{task._idx}]: OP: {result.op_config} "
-                f"TIME: {result.duration} WS:{result.workspace}",
+                f"TIME: {result.duration} WS:{result.workspace} {result.stats}",
             )
 
 
@@ -201,6 +238,7 @@ class Runner(BaseRunner):
                 self._tag,
                 dev_flag=self._dev_flag,
                 return_ops=return_ops,
+                key=_profiler_key(cmd),
             )
         )
 
@@ -216,45 +254,11 @@ class Runner(BaseRunner):
         return ret
 
 
-def run_task(cmds, queue, dev_select_flag):
-    # get device or block until one is available
-    device = queue.get()
-    _LOGGER.debug(f"running profiler {cmds=} on GPU #{device}")
-
-    attempts = 0
-    while True:
-        try:
-            completed_process = subprocess.run(
-                cmds,
-                env=update_inplace(os.environ.copy(), {dev_select_flag: device}),
-                stdout=subprocess.PIPE,
-                stderr=subprocess.PIPE,
-                text=True,
-                shell=False,
-            )
-            break
-        except Exception as ex:
-            attempts += 1
-            if attempts >= PROFILER_RUN_MAX_ATTEMPTS:
-                raise
-            _LOGGER.debug(
-                f"[{attempts} / {PROFILER_RUN_MAX_ATTEMPTS}] "
-                f"Failed to run profiler {cmds=} due to exception: {ex}. "
-                f"Will retry in {PROFILER_RUN_RETRY_DELAY_SECONDS} seconds."
-            )
-            sleep(PROFILER_RUN_RETRY_DELAY_SECONDS)
-
-    queue.put(device)
-    return completed_process.stdout, completed_process.stderr
-
-
-class ProfilerRunner:
-    """Another parallel runner to execute profilers on multiple GPUs in parallel
-    It uses a process pool for implementation, avoiding process creation overhead
-    The size of the process pool is equal to the number of provided GPUs,
-    so ~ideally~ each process should execute a profiler on its dedicated GPU.
-    This property hasn't been properly verified yet,
-    however, the results are empirically better compared to the previous runner.
+class ProfilerRunner(BaseRunner):
+    """Another parallel runner to execute profilers on multiple GPUs in parallel.
+    The profilers are scheduled by the event-driven BaseRunner, one at a time
+    per GPU, longest expected first. Their results are processed in a thread
+    pool as soon as they complete, so that the GPUs are kept busy meanwhile.
     """
 
     def __init__(self, devices: List[str], postprocessing_delegate, timeout: int = 500):
@@ -271,17 +275,12 @@ class ProfilerRunner:
         if not devices:
             # devices is either None or empty list: use device 0
             devices = [0]
-        # This queue is used to ensure only one task is executed on a device at a time
-        self._device_queue = Queue()
-        # This queue is used to ensure postprocessing in `join()` happens *after* done_callbacks complete
-        self._done_queue = Queue()
-        for d in devices:
-            self._device_queue.put(str(d))
+        devices = [str(d) for d in devices]
+        super().__init__(devices, "profiler", timeout)
         _LOGGER.info(f"Initialized profiler runner with devices: {devices}")
-        self._timeout = timeout
         self._executor = concurrent.futures.ThreadPoolExecutor(max_workers=len(devices))
         self._futures = []
-        self._cmds = []
+        self._callbacks = {}
         self._postprocessing_delegate = postprocessing_delegate
         try:
             target = Target.current()
@@ -306,53 +305,72 @@ class ProfilerRunner:
             It is also used to propagate the profiler launch context to the aggregation point,
             namely, split_k value for the gemm profilers
         """
-        future = self._executor.submit(
-            run_task, cmds, self._device_queue, self._dev_select_flag
+        idx = len(self._queue)
+        self._queue.append(
+            Task(
+                idx,
+                cmds,
+                self._tag,
+                dev_flag=self._dev_select_flag,
+                key=_profiler_key(cmds),
+            )
         )
+        self._callbacks[idx] = process_result_callback
 
-        # done callbacks are used to collect profiler results for postprocessing
-        # they are launched asynchronously, in a separate thread,
-        # some time after a future holding profiler result completes
-        def callback_when_done(fut):
-            stdout = None
-            stderr = None
+    def _launch(self, task, dev_id, selector):
+        attempts = 0
+        while True:
             try:
-                stdout, stderr = fut.result()
-                profile_result, err = extract_profile_result(stdout)
-                if err:
-                    _LOGGER.error(
-                        f"Profiler failure!\nProfiler stdout: {stdout}\nProfiler stderr: {stderr}",
-                    )
-                    raise RuntimeError(f"Failed to extract profiler result for {cmds}")
-                process_result_callback(profile_result, self._postprocessing_delegate)
-            finally:
-                # unblock one future in `join()`
-                if stdout is not None:
-                    self._done_queue.put(stdout)
+                return super()._launch(task, dev_id, selector)
+            except Exception as ex:
+                attempts += 1
+                if attempts >= PROFILER_RUN_MAX_ATTEMPTS:
+                    raise
+                _LOGGER.debug(
+                    f"[{attempts} / {PROFILER_RUN_MAX_ATTEMPTS}] "
+                    f"Failed to run profiler {task._cmd} due to exception: {ex}. "
+                    f"Will retry in {PROFILER_RUN_RETRY_DELAY_SECONDS} seconds."
+                )
+                sleep(PROFILER_RUN_RETRY_DELAY_SECONDS)
 
-        future.add_done_callback(callback_when_done)
-        self._futures.append(future)
-        self._cmds.append(cmds)
+    def _on_task_finished(self, task: Task) -> None:
+        if task.is_timeout():
+            return
+        task.pull(lambda _: None)
+        process_result_callback = self._callbacks[task._idx]
+        cmds = task._cmd
+
+        def process_result(stdout, stderr):
+            profile_result, err = extract_profile_result(stdout)
+            if err:
+                _LOGGER.error(
+                    f"Profiler failure!\nProfiler stdout: {stdout}\nProfiler stderr: {stderr}",
+                )
+                raise RuntimeError(f"Failed to extract profiler result for {cmds}")
+            process_result_callback(profile_result, self._postprocessing_delegate)
+
+        self._futures.append(
+            self._executor.submit(process_result, task._stdout, task._stderr)
+        )
 
     def join(self):
         """
         Wait for subprocesses completion or timeout; postprocess the profiler results with delegate(s)
         """
-        done, not_done = concurrent.futures.wait(self._futures, self._timeout)
-        for f in not_done:
-            # attempts cancelling, will fail if call is being executed or has finished
-            f.cancel()
-        cancelled_cmds = [
-            cmd for cmd, f in zip(self._cmds, self._futures) if f.cancelled()
-        ]
-        if cancelled_cmds:
+        cancelled = super().join(deadline=time.time() + self._timeout)
+        cancelled.extend(task for task in self._queue if task.is_timeout())
+        if cancelled:
             raise RuntimeError(
                 f"Profiler timed out after {self._timeout} sec. "
                 "Try increasing the timeout. "
-                f"Cancelled profilers: {cancelled_cmds}"
+                f"Cancelled profilers: {[task._cmd for task in cancelled]}"
             )
-        for _ in [f for f in self._futures if f.done() or f.running()]:
-            # sync point between futures and queue.
-            # wait for callbacks to finish
-            self._done_queue.get(timeout=self._timeout)
+        for future in concurrent.futures.as_completed(self._futures):
+            if future.exception() is not None:
+                _LOGGER.error(
+                    f"Failed to process profiler result: {future.exception()}"
+                )
+        self._futures = []
+        self._callbacks = {}
+        self.reset()
         self._postprocessing_delegate.postprocess_results()
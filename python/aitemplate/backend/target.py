@@ -22,10 +22,11 @@ import pathlib
 import shutil
 import tempfile
 from enum import IntEnum
-from typing import Any, Dict, List, Optional, Tuple
+from typing import Any, Callable, Dict, List, Optional, Tuple
 
 from aitemplate.backend import registry
 from aitemplate.backend.profiler_cache import ProfileCacheDB
+from aitemplate.utils.environ import profile_cache_uri
 from aitemplate.utils.misc import is_linux
 
 
@@ -90,10 +91,24 @@ class Target:
         CURRENT_TARGET = self
 
     def __exit__(self, ptype, value, trace):
-        """Exit the target context manager."""
+        """Exit the target context manager.
+
+        This closes the profile cache, which pushes new entries to the remote
+        store if there is one.
+        """
+        profile_cache = self._profile_cache
         self._profile_cache = None
         global CURRENT_TARGET
         CURRENT_TARGET = None
+        if profile_cache is None:
+            return
+        try:
+            profile_cache.close()
+        except Exception:
+            if ptype is None:
+                raise
+            # Don't hide the exception that ended the context.
+            _LOGGER.exception("failed to close the profile cache")
 
     @staticmethod
     def current():
@@ -343,7 +358,9 @@ class Target:
 
         _LOGGER.info(f"Loading profile cache from: {self._cache_path}")
         self._profile_cache = ProfileCacheDB(
-            TargetType(self._target_type).name, path=self._cache_path
+            TargetType(self._target_type).name,
+            path=self._cache_path,
+            uri=profile_cache_uri(),
         )
 
     def get_profile_cache_path(self):
@@ -409,6 +426,48 @@ class Target:
             return self._profile_cache.query_normalization(args)
         raise NotImplementedError
 
+    def query_profile_cache_nearest(
+        self,
+        op_class: str,
+        args: Dict[str, Any],
+        exec_entry: str,
+        max_distance: float,
+        is_valid_algo: Optional[Callable[[str], bool]] = None,
+    ) -> Optional[Tuple[str, int, int, bool]]:
+        """Query the profile cache for the best result of the cached
+        workloads near exec_entry, see ProfileCacheDB.query_gemm_nearest.
+
+        Parameters
+        ----------
+        op_class : str
+            Op class name. Only gemm is supported.
+        args : Dict[str, Any]
+            Op arguments.
+        exec_entry : str
+            The workload to look up.
+        max_distance : float
+            The largest shape distance of the cached workloads to consider.
+        is_valid_algo : Callable[[str], bool], optional
+            Filters the algos the op can run.
+
+        Returns
+        -------
+        Tuple[str, int, int, bool]
+            (algo, workspace, split_k, confident), or None.
+        """
+        if op_class == "gemm":
+            return self._profile_cache.query_gemm_nearest(
+                args, exec_entry, max_distance, is_valid_algo
+            )
+        raise NotImplementedError
+
+    def approximate_profile_cache_entries(self, op_class: str) -> List[Dict[str, Any]]:
+        """The workloads of op_class whose cached results are approximate
+        and should be profiled again."""
+        if op_class == "gemm":
+            return self._profile_cache.approximate_gemm_entries()
+        raise NotImplementedError
+
     def insert_profile_cache(self, op_class: str, args: Dict[str, Any]):
         """Insert the profile cache for the given op class and args."""
         if op_class == "gemm":
@@ -14,16 +14,61 @@
 #
 """
 This module is a general-purpose subprocess-based task runner.
+
+BaseRunner.join is event driven: it waits on the pidfds and the output
+pipes of the running tasks (epoll on Linux) instead of polling them.
+Every device has its own queue of tasks, filled longest-expected-first
+(the expected durations come from earlier runs, see TaskTimeStats), and
+an idle device steals from the most loaded queue once its own is empty.
+With AIT_TASK_TIMINGS_DIR set, the per-task timings of every join are
+exported as a Chrome trace (chrome://tracing, Perfetto).
 """
 
 from __future__ import annotations
 
+import json
+import logging
 import os
+import selectors
 import subprocess
 import time
 import typing
-from collections import OrderedDict
-from typing import List
+from collections import deque, OrderedDict
+from typing import Dict, List, Optional
+
+from aitemplate.backend.timing_stats import cache_path, timing_key, TimingStats
+from aitemplate.utils.environ import task_timings_dir
+
+
+_LOGGER = logging.getLogger(__name__)
+
+_READ_CHUNK_SIZE = 65536
+# How often running tasks are polled if pidfds are not supported.
+_FALLBACK_POLL_INTERVAL = 0.05
+
+
+class TaskTimeStats(TimingStats):
+    """
+    Wall times of tasks in milliseconds, keyed by Task key, from earlier
+    runs.
+    """
+
+    def __init__(self, path: Optional[str]):
+        super().__init__(path, section="tasks")
+
+    def expected_ms(self, key: str) -> Optional[float]:
+        return self.ms(key)
+
+
+_task_time_stats = None
+
+
+def task_time_stats() -> TaskTimeStats:
+    """The TaskTimeStats shared by all runners of the process."""
+    global _task_time_stats
+    if _task_time_stats is None:
+        _task_time_stats = TaskTimeStats(cache_path("task_times.json"))
+    return _task_time_stats
 
 
 # pylint: disable=R1732,R1710,R1721
@@ -45,6 +90,9 @@ class Task:
             bash command for the task
         name : str
             alias name of the task
+        key : str, optional
+            identifies the task across runs for TaskTimeStats,
+            by default a hash of cmd
         """
         self._finished = False
         self._is_timeout = False
@@ -56,9 +104,14 @@ class Task:
         self._assigned_dev = None
         self._proc = None
         self._timestamp = 0
+        self._end_timestamp = 0
         self._stdout = ""
         self._stderr = ""
         self._kwargs = kwargs
+        self._key = kwargs.get("key", None) or timing_key(str(cmd).encode())
+        self._expected_ms = None
+        self._pidfd = None
+        self._output = {}
 
     def __call__(self, dev_id: int) -> None:
         """Execute the bash command with a new subprocess.
@@ -139,12 +192,33 @@ class Task:
             self._finished = True
             self._is_timeout = True
             self._failed = True
+            self._end_timestamp = current_time
             return True
         # handle finished job
         if self._proc.poll() is not None:
             self._finished = True
+            self._end_timestamp = current_time
         return self._finished
 
+    def _read_output(self, pipe) -> typing.Optional[bool]:
+        """Read the available output of the non-blocking pipe. Return
+        whether the pipe is at EOF, or None if no output is available."""
+        try:
+            data = os.read(pipe.fileno(), _READ_CHUNK_SIZE)
+        except BlockingIOError:
+            return None
+        if data:
+            self._output.setdefault(pipe, []).append(data)
+            return False
+        return True
+
+    def _drain_output(self) -> None:
+        """Read the remaining output of the exited process. Pipes that are
+        still held open (e.g. by background children) are not waited for."""
+        for pipe in (self._proc.stdout, self._proc.stderr):
+            while self._read_output(pipe) is False:
+                pass
+
     def pull(self, fproc: typing.Callable) -> None:
         """Pull stdout & stderr from process,
         process stdout & stderr with fproc, and set the output for the task.
@@ -156,8 +230,12 @@ class Task:
         """
         if self._failed:
             return None
-        self._stdout = self._proc.stdout.read().decode("utf-8")
-        self._stderr = self._proc.stderr.read().decode("utf-8")
+        # The output was read by BaseRunner.join while the process ran, so
+        # that it can't block on a full pipe.
+        out = self._output.get(self._proc.stdout, [])
+        err = self._output.get(self._proc.stderr, [])
+        self._stdout = b"".join(out).decode("utf-8")
+        self._stderr = b"".join(err).decode("utf-8")
         fproc(self)
 
     def is_failed(self) -> bool:
@@ -180,8 +258,14 @@ class Task:
         """
         return self._assigned_dev
 
+    def elapsed_ms(self) -> float:
+        """Wall time of the finished task in milliseconds."""
+        return (self._end_timestamp - self._timestamp) * 1000
+
     def __del__(self) -> None:
         """Clean up process resource"""
+        if self._pidfd is not None:
+            os.close(self._pidfd)
         if self._proc:
             if self._proc.stdout:
                 self._proc.stdout.close()
@@ -193,6 +277,11 @@ class DeviceFarm:
     """Device Farm is a stateful object to
     schedule and assigns a task to the available devices.
     Devices are logical devices, can be CPUs or GPUs.
+
+    Every device has its own queue of tasks. Tasks are queued longest
+    expected first, on the device with the least expected work, and an idle
+    device with an empty queue steals the next task of the device with the
+    most expected work left.
     """
 
     def __init__(self, devs: List[int]) -> None:
@@ -210,6 +299,9 @@ class DeviceFarm:
         self._devs = devs
         for dev in devs:
             self._dev_stats[dev] = False
+        self._queues = OrderedDict((dev, deque()) for dev in devs)
+        self._queued_ms = OrderedDict((dev, 0.0) for dev in devs)
+        self._num_steals = 0
 
     def next_idle_dev(self) -> typing.Optional[int]:
         """Return the next idle (available) device id
@@ -240,6 +332,61 @@ class DeviceFarm:
         """Reset all devices to be idle"""
         for dev in self._devs:
             self._dev_stats[dev] = False
+            self._queues[dev].clear()
+            self._queued_ms[dev] = 0.0
+
+    def enqueue(self, tasks: List[Task]) -> None:
+        """Queue tasks on the devices, longest expected first.
+
+        Parameters
+        ----------
+        tasks : List[Task]
+            Tasks with their expected durations set
+        """
+        for task in sorted(tasks, key=lambda t: t._expected_ms, reverse=True):
+            dev = min(
+                self._devs, key=lambda d: (self._queued_ms[d], len(self._queues[d]))
+            )
+            self._queues[dev].append(task)
+            self._queued_ms[dev] += task._expected_ms
+
+    def has_queued(self) -> bool:
+        return any(self._queues.values())
+
+    def idle_devs(self) -> List[int]:
+        return [dev for dev, busy in self._dev_stats.items() if not busy]
+
+    def take(self, dev_id: int) -> typing.Optional[Task]:
+        """Take the next task for the idle device dev_id, stealing it from
+        the most loaded device if the queue of dev_id is empty, and mark
+        dev_id busy. Return None if no task is left.
+
+        Parameters
+        ----------
+        dev_id : int
+            The id of an idle device
+        """
+        victim = dev_id
+        if not self._queues[dev_id]:
+            victims = [dev for dev in self._devs if self._queues[dev]]
+            if not victims:
+                return None
+            victim = max(
+                victims, key=lambda d: (self._queued_ms[d], len(self._queues[d]))
+            )
+            self._num_steals += 1
+        task = self._queues[victim].popleft()
+        self._queued_ms[victim] -= task._expected_ms
+        self._dev_stats[dev_id] = True
+        return task
+
+    def cancel_queued(self) -> List[Task]:
+        """Remove and return the tasks that were not started."""
+        tasks = [task for queue in self._queues.values() for task in queue]
+        for dev in self._devs:
+            self._queues[dev].clear()
+            self._queued_ms[dev] = 0.0
+        return tasks
 
 
 class BaseRunner:
@@ -261,27 +408,179 @@ class BaseRunner:
         self._timeout = timeout
         self._finished_tasks = set()
         self._queue = []
+        self._stats = task_time_stats()
+        self._num_joins = 0
+
+    def _launch(self, task: Task, dev_id, selector: selectors.BaseSelector) -> None:
+        """Start task on dev_id and register its pidfd and pipes."""
+        task(dev_id)
+        for pipe in (task._proc.stdout, task._proc.stderr):
+            os.set_blocking(pipe.fileno(), False)
+            selector.register(pipe, selectors.EVENT_READ, (task, pipe))
+        if hasattr(os, "pidfd_open"):
+            try:
+                task._pidfd = os.pidfd_open(task._proc.pid)
+            except OSError:
+                # E.g. not supported by the kernel.
+                task._pidfd = None
+        if task._pidfd is not None:
+            selector.register(task._pidfd, selectors.EVENT_READ, (task, None))
+
+    def _finish(
+        self, task: Task, selector: selectors.BaseSelector, timed_out: bool = False
+    ) -> None:
+        """Collect the exited (or timed out) task and free its device."""
+        task._end_timestamp = time.time()
+        if timed_out:
+            task._proc.kill()
+            task._is_timeout = True
+            task._failed = True
+        task._proc.wait()
+        for fileobj in (task._pidfd, task._proc.stdout, task._proc.stderr):
+            if fileobj is not None and fileobj in selector.get_map():
+                selector.unregister(fileobj)
+        if task._pidfd is not None:
+            os.close(task._pidfd)
+            task._pidfd = None
+        task._drain_output()
+        task._finished = True
+        self._finished_tasks.add(task._idx)
+        self._devs.reset_dev_state(task.assigned_dev())
+        if not task._is_timeout and task._proc.returncode == 0:
+            self._stats.record(task._key, task.elapsed_ms())
+        self._on_task_finished(task)
+
+    def _on_task_finished(self, task: Task) -> None:
+        """Called in join() as soon as task is finished."""
+
+    def join(self, deadline: Optional[float] = None) -> List[Task]:
+        """Waiting until all tasks are finished.
 
-    def join(self) -> None:
-        """Waiting until all tasks are finished."""
-        while True:
-            all_finished = True
-            current_time = time.time()
-            for task in self._queue:
-                all_finished = all_finished and task.is_finished()
-                if task._idx in self._finished_tasks:
-                    continue
-                if task.is_running() is False:
-                    next_dev = self._devs.next_idle_dev()
-                    if next_dev is None:
-                        continue
-                    task(next_dev)
-                    continue
-                if task.poll(current_time, self._timeout):
-                    self._devs.reset_dev_state(task.assigned_dev())
-                    self._finished_tasks.add(task._idx)
-            if all_finished:
-                break
+        Parameters
+        ----------
+        deadline : float, optional
+            time.time() after which no more tasks are started
+
+        Returns
+        -------
+        List[Task]
+            The tasks that were not started before the deadline
+        """
+        pending = [
+            task for task in self._queue if task._idx not in self._finished_tasks
+        ]
+        known = [
+            self._stats.expected_ms(task._key)
+            for task in pending
+            if self._stats.expected_ms(task._key) is not None
+        ]
+        # Tasks that never ran are assumed to take the average time.
+        default_ms = sum(known) / len(known) if known else 0.0
+        for task in pending:
+            expected_ms = self._stats.expected_ms(task._key)
+            task._expected_ms = default_ms if expected_ms is None else expected_ms
+        self._devs.enqueue(pending)
+
+        start = time.time()
+        cancelled = []
+        running = set()
+        with selectors.DefaultSelector() as selector:
+            while True:
+                now = time.time()
+                if deadline is not None and now > deadline:
+                    cancelled.extend(self._devs.cancel_queued())
+                for dev_id in self._devs.idle_devs():
+                    task = self._devs.take(dev_id)
+                    if task is None:
+                        break
+                    self._launch(task, dev_id, selector)
+                    running.add(task)
+                if not running:
+                    break
+
+                wait = min(task._timestamp + self._timeout for task in running) - now
+                if deadline is not None and self._devs.has_queued():
+                    wait = min(wait, deadline - now)
+                if any(task._pidfd is None for task in running):
+                    wait = min(wait, _FALLBACK_POLL_INTERVAL)
+                exited = set()
+                for key, _ in selector.select(max(wait, 0)):
+                    task, pipe = key.data
+                    if pipe is None:
+                        exited.add(task)
+                    elif task._read_output(pipe):
+                        selector.unregister(pipe)
+                now = time.time()
+                for task in list(running):
+                    if task in exited or (
+                        task._pidfd is None and task._proc.poll() is not None
+                    ):
+                        self._finish(task, selector)
+                        running.remove(task)
+                    elif now - task._timestamp > self._timeout:
+                        self._finish(task, selector, timed_out=True)
+                        running.remove(task)
+
+        self._stats.save()
+        self._report(start, cancelled)
+        return cancelled
+
+    def _report(self, start: float, cancelled: List[Task]) -> None:
+        """Log the utilization of the join and export its task timings."""
+        finished = [task for task in self._queue if task.is_finished()]
+        makespan = time.time() - start
+        busy = sum(task.elapsed_ms() for task in finished) / 1000
+        _LOGGER.debug(
+            f"{self._tag}: ran {len(finished)} tasks in {makespan:.2f} s "
+            f"({busy:.2f} s busy on {len(self._devs._devs)} devices, "
+            f"{self._devs._num_steals} steals, {len(cancelled)} cancelled)"
+        )
+        timings_dir = task_timings_dir()
+        self._num_joins += 1
+        if timings_dir is None:
+            return
+        path = os.path.join(
+            timings_dir,
+            f"task_timings_{self._tag}_{os.getpid()}_{self._num_joins}.json",
+        )
+        try:
+            os.makedirs(timings_dir, exist_ok=True)
+            with open(path, "w") as f:
+                json.dump(self.trace_events(), f)
+        except OSError as e:
+            _LOGGER.warning(f"Failed to export task timings to {path}: {e}")
+
+    def trace_events(self) -> Dict[str, List[Dict]]:
+        """The timings of the finished tasks in the Chrome trace format, one
+        row per device.
+
+        Returns
+        -------
+        Dict
+            {"traceEvents": [...]}, serializable to json
+        """
+        events = []
+        for task in self._queue:
+            if not task.is_finished():
+                continue
+            events.append(
+                {
+                    "name": str(task._idx),
+                    "cat": self._tag,
+                    "ph": "X",
+                    "ts": task._timestamp * 1e6,
+                    "dur": task.elapsed_ms() * 1e3,
+                    "pid": os.getpid(),
+                    "tid": str(task.assigned_dev()),
+                    "args": {
+                        "cmd": str(task._cmd),
+                        "expected_ms": task._expected_ms,
+                        "failed": task.is_failed(),
+                        "timeout": task.is_timeout(),
+                    },
+                }
+            )
+        return {"traceEvents": events}
 
     def reset(self) -> None:
         """Reset runner, clear task queue and device states"""
@@ -0,0 +1,104 @@
+#  Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+"""
+Wall times of build steps from earlier runs, kept in the AIT cache
+directory so that later runs can schedule by them. Used for the profiler
+and build tasks (task_runner.TaskTimeStats) and for the compiles of unity
+builds (unity_build.CompileTimeStats).
+"""
+
+import json
+import logging
+import os
+import time
+from hashlib import sha1
+from typing import Dict, Optional
+
+_LOGGER = logging.getLogger(__name__)
+
+
+def cache_path(file_name: str) -> str:
+    """file_name under CACHE_DIR (~/.aitemplate by default)."""
+    prefix = os.environ.get("CACHE_DIR", None) or os.path.join(
+        os.path.expanduser("~"), ".aitemplate"
+    )
+    return os.path.join(prefix, file_name)
+
+
+def timing_key(data: bytes) -> str:
+    """Key of the step described by data (e.g. its command or source)."""
+    return sha1(data).hexdigest()
+
+
+class TimingStats:
+    """
+    Wall times in milliseconds, plus optional boolean flags, by key.
+    Persisted as JSON under `section`; the least recently updated entries
+    are dropped beyond max_entries. A path of None keeps them in memory
+    only.
+    """
+
+    def __init__(self, path: Optional[str], section: str, max_entries: int = 50000):
+        self._path = path
+        self._section = section
+        self._max_entries = max_entries
+        self._entries: Dict[str, Dict] = {}
+        if path is not None and os.path.exists(path):
+            try:
+                with open(path, "r") as f:
+                    self._entries = json.load(f).get(section, {})
+            except (OSError, ValueError) as e:
+                _LOGGER.warning(f"Ignoring unreadable timing stats {path}: {e}")
+
+    def ms(self, key: str) -> Optional[float]:
+        entry = self._entries.get(key)
+        return None if entry is None else entry.get("ms")
+
+    def flag(self, key: str, name: str) -> bool:
+        entry = self._entries.get(key)
+        return entry is not None and entry.get(name, False)
+
+    def record(
+        self, key: str, ms: Optional[float] = None, flag: Optional[str] = None
+    ) -> None:
+        entry = self._entries.setdefault(key, {})
+        if ms is not None:
+            # Smooth out the noise of a busy machine.
+            prev = entry.get("ms")
+            entry["ms"] = ms if prev is None else 0.5 * (prev + ms)
+        if flag is not None:
+            entry[flag] = True
+        entry["updated"] = time.time()
+
+    def save(self) -> None:
+        """
+        Write the stats back. They only speed up later runs, so failures
+        are logged rather than raised.
+        """
+        if self._path is None:
+            return
+        if len(self._entries) > self._max_entries:
+            keep = sorted(
+                self._entries.items(), key=lambda kv: kv[1].get("updated", 0)
+            )[-self._max_entries :]
+            self._entries = dict(keep)
+        try:
+            os.makedirs(os.path.dirname(self._path), exist_ok=True)
+            tmp_path = f"{self._path}.{os.getpid()}.tmp"
+            with open(tmp_path, "w") as f:
+                json.dump({"version": 1, self._section: self._entries}, f)
+            os.replace(tmp_path, self._path)
+        except OSError as e:
+            _LOGGER.warning(f"Failed to save timing stats {self._path}: {e}")
@@ -0,0 +1,320 @@
+#  Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+"""
+Unity builds for the CUTLASS-heavy generated sources.
+
+Most of the time spent compiling a generated CUTLASS source goes to parsing
+the CUTLASS / CuTe headers it includes, which are the same for all of them.
+In unity build mode (AIT_UNITY_BUILD=1), the sources that start with the
+same set of includes are grouped into unity translation units:
+
+    // unity_<hash>.cu
+    #include "unity_prefix_<include set hash>.h"  // the shared includes
+    #include "gemm_rcr_0.cu"
+    #include "gemm_rcr_1.cu"
+
+so the headers are parsed once per unity TU instead of once per source. The
+groups are sized by the measured compile cost of their sources: every
+compile records its wall time in the build directory, and
+CompileTimeStats keeps the per-source times (keyed by the source content)
+across builds. Sources that can't be compiled together (e.g. they define
+the same helper) make the unity TU fall back to compiling them one by one,
+and are kept out of unity TUs in later builds.
+"""
+
+import logging
+import os
+import re
+from hashlib import sha1
+from typing import Dict, List, Optional, Sequence, Tuple
+
+from aitemplate.backend.timing_stats import cache_path, timing_key, TimingStats
+from aitemplate.utils import environ
+
+_LOGGER = logging.getLogger(__name__)
+
+# Written by the compile commands in the build directory: one
+# "<object> <milliseconds>" line per compiled object, and the unity
+# objects that fell back to separate compilation.
+COMPILE_TIMES_FILE = "compile_times.txt"
+UNITY_FAILURES_FILE = "unity_failures.txt"
+
+_INCLUDE_RE = re.compile(r'^\s*#\s*include\s*([<"][^>"]+[>"])')
+
+
+def include_block(src_path: str) -> Tuple[str, ...]:
+    """
+    The #includes at the top of a source, up to the first line that is not
+    an #include, a comment or blank. Later includes may depend on what the
+    source defines before them, so they are left where they are.
+    """
+    includes = []
+    with open(src_path, "r") as f:
+        for line in f:
+            stripped = line.strip()
+            if not stripped or stripped.startswith("//"):
+                continue
+            match = _INCLUDE_RE.match(line)
+            if match is None:
+                break
+            includes.append(match.group(1))
+    return tuple(includes)
+
+
+def _source_key(src_path: str) -> str:
+    with open(src_path, "rb") as f:
+        return timing_key(f.read())
+
+
+class CompileTimeStats(TimingStats):
+    """
+    Compile wall times of single sources in milliseconds, keyed by source
+    content, plus the sources that failed to compile in a unity TU.
+    """
+
+    def __init__(self, path: Optional[str]):
+        super().__init__(path, section="sources")
+
+    def compile_ms(self, key: str) -> Optional[float]:
+        return self.ms(key)
+
+    def unity_failed(self, key: str) -> bool:
+        return self.flag(key, "unity_failed")
+
+    def record(
+        self, key: str, ms: Optional[float] = None, unity_failed: bool = False
+    ) -> None:
+        super().record(key, ms, flag="unity_failed" if unity_failed else None)
+
+
+def _record_time(cmd: str, target: str) -> str:
+    """Make recipe running cmd and appending target's compile time to
+    COMPILE_TIMES_FILE."""
+    return (
+        f"s=$$(date +%s%N); {cmd} && "
+        f'echo "{target} $$(( ($$(date +%s%N) - s) / 1000000 ))" '
+        f">> {COMPILE_TIMES_FILE}"
+    )
+
+
+class UnityBuild:
+    """
+    Plans the unity TUs of a build directory, generates their Makefile
+    rules, and feeds the compile times of the finished build back into
+    CompileTimeStats.
+    """
+
+    def __init__(self, build_dir: str, stats: CompileTimeStats):
+        self._build_dir = build_dir
+        self._stats = stats
+        # unity object -> member sources, and its prefix header
+        self._unity_members: Dict[str, List[str]] = {}
+        self._unity_prefix: Dict[str, str] = {}
+        # object -> estimated compile cost of its sources, in ms
+        self._estimates: Dict[str, Dict[str, float]] = {}
+        self._keys: Dict[str, str] = {}
+
+    @staticmethod
+    def is_candidate(src_path: str, includes: Sequence[str]) -> bool:
+        """Only CUTLASS sources have enough shared headers to be worth it."""
+        return (
+            src_path.endswith(".cu")
+            and os.path.basename(src_path) not in ("standalone.cu", "windll.cu")
+            and any("cutlass/" in include for include in includes)
+        )
+
+    def _estimate_costs(self, srcs: List[str]) -> Dict[str, float]:
+        """Recorded compile times, or the source size scaled by the
+        recorded time per byte for the sources compiled for the first time."""
+        sizes = {src: max(os.path.getsize(src), 1) for src in srcs}
+        known = {}
+        for src in srcs:
+            self._keys[src] = _source_key(src)
+            ms = self._stats.compile_ms(self._keys[src])
+            if ms is not None:
+                known[src] = ms
+        ms_per_byte = (
+            sum(known.values()) / sum(sizes[src] for src in known) if known else 1.0
+        )
+        return {src: known.get(src, sizes[src] * ms_per_byte) for src in srcs}
+
+    def plan(
+        self, file_pairs: List[Tuple[str, str]], num_jobs: int
+    ) -> List[Tuple[str, str]]:
+        """
+        Group the candidate sources of file_pairs into unity TUs and return
+        the file pairs to build instead. Each include set gets a share of
+        num_jobs TUs proportional to its estimated cost, and its sources
+        are distributed over them longest first, each to the currently
+        cheapest TU.
+        """
+        groups: Dict[Tuple[str, ...], List[str]] = {}
+        result = []
+        for src, obj in file_pairs:
+            includes = include_block(src) if src.endswith(".cu") else ()
+            if not self.is_candidate(src, includes):
+                result.append((src, obj))
+                continue
+            groups.setdefault(includes, []).append(src)
+
+        costs = self._estimate_costs(
+            [src for srcs in groups.values() for src in srcs]
+        )
+        total_cost = sum(costs.values())
+        obj_of = dict(file_pairs)
+        for includes, srcs in groups.items():
+            safe = [
+                src for src in srcs if not self._stats.unity_failed(self._keys[src])
+            ]
+            for src in srcs:
+                if src not in safe:
+                    result.append((src, obj_of[src]))
+            if not safe:
+                continue
+            group_cost = sum(costs[src] for src in safe)
+            num_tus = round(num_jobs * group_cost / max(total_cost, 1e-9))
+            num_tus = min(len(safe), max(1, num_tus))
+            tus = [[] for _ in range(num_tus)]
+            tu_costs = [0.0] * num_tus
+            for src in sorted(safe, key=lambda s: -costs[s]):
+                idx = tu_costs.index(min(tu_costs))
+                tus[idx].append(src)
+                tu_costs[idx] += costs[src]
+
+            prefix = self._write_prefix_header(includes)
+            for members in tus:
+                if len(members) == 1:
+                    result.append((members[0], obj_of[members[0]]))
+                    continue
+                result.append(self._write_unity_source(prefix, members, costs))
+
+        num_unity = len(self._unity_members)
+        num_sources = sum(len(m) for m in self._unity_members.values())
+        _LOGGER.info(f"unity build: {num_sources} sources in {num_unity} unity TUs")
+        return result
+
+    def _write_prefix_header(self, includes: Tuple[str, ...]) -> str:
+        name = "unity_prefix_" + sha1("\n".join(includes).encode()).hexdigest()[:16]
+        path = os.path.join(self._build_dir, name + ".h")
+        with open(path, "w") as f:
+            f.write("#pragma once\n")
+            f.write("".join(f"#include {include}\n" for include in includes))
+        return os.path.basename(path)
+
+    def _write_unity_source(
+        self, prefix: str, members: List[str], costs: Dict[str, float]
+    ) -> Tuple[str, str]:
+        # Kernel instance sources define what the op sources declare
+        # (extern template), so they have to come last.
+        members = sorted(
+            members,
+            key=lambda s: (os.path.basename(s).startswith("kernel_instance_"), s),
+        )
+        names = [os.path.basename(src) for src in members]
+        name = "unity_" + sha1("\n".join(names).encode()).hexdigest()[:16]
+        src_path = os.path.join(self._build_dir, name + ".cu")
+        obj_path = os.path.join(self._build_dir, name + ".obj")
+        with open(src_path, "w") as f:
+            f.write(f'#include "{prefix}"\n')
+            f.write("".join(f'#include "{name}"\n' for name in names))
+        obj = os.path.basename(obj_path)
+        self._unity_members[obj] = members
+        self._unity_prefix[obj] = prefix
+        self._estimates[obj] = {src: costs[src] for src in members}
+        return src_path, obj_path
+
+    def gen_makefile_rules(self, compile_cmd: str) -> str:
+        """
+        Explicit rules for the unity objects. compile_cmd is the
+        Target.compile_cmd(False) template. If the unity TU doesn't
+        compile, its members are compiled separately and merged into the
+        unity object with ld -r.
+        """
+        rules = []
+        for obj, members in self._unity_members.items():
+            src = obj[: -len(".obj")] + ".cu"
+            names = [os.path.basename(m) for m in members]
+            member_objs = [n[: -len(".cu")] + ".obj" for n in names]
+            fallback = " && ".join(
+                _record_time(compile_cmd.format(target=mobj, src=name), mobj)
+                for name, mobj in zip(names, member_objs)
+            )
+            recipe = (
+                _record_time(compile_cmd.format(target="$@", src="$<"), "$@")
+                + f' || {{ echo "$@" >> {UNITY_FAILURES_FILE}; {fallback}'
+                + f' && ld -r -o $@ {" ".join(member_objs)}; }}'
+            )
+            deps = " ".join([src, self._unity_prefix[obj]] + names)
+            rules.append(f"{obj}: {deps}\n    {recipe}\n")
+        return "\n".join(rules)
+
+    @staticmethod
+    def record_times_cmd(cmd: str) -> str:
+        """Make recipe for the %.obj pattern rule."""
+        return _record_time(cmd, "$@")
+
+    def clear_records(self) -> None:
+        for name in (COMPILE_TIMES_FILE, UNITY_FAILURES_FILE):
+            path = os.path.join(self._build_dir, name)
+            if os.path.exists(path):
+                os.remove(path)
+
+    def update_stats(self, file_pairs: List[Tuple[str, str]]) -> None:
+        """Feed the compile times recorded by the last make into the stats."""
+        times_path = os.path.join(self._build_dir, COMPILE_TIMES_FILE)
+        if not os.path.exists(times_path):
+            # Nothing was compiled, e.g. the build cache was hit.
+            return
+        times = {}
+        with open(times_path, "r") as f:
+            for line in f:
+                parts = line.split()
+                if len(parts) == 2:
+                    times[os.path.basename(parts[0])] = float(parts[1])
+        failures = set()
+        failures_path = os.path.join(self._build_dir, UNITY_FAILURES_FILE)
+        if os.path.exists(failures_path):
+            with open(failures_path, "r") as f:
+                failures = {os.path.basename(line.strip()) for line in f}
+
+        src_of = {os.path.basename(obj): src for src, obj in file_pairs}
+        for obj, members in self._unity_members.items():
+            if obj in failures:
+                _LOGGER.info(
+                    f"unity build: {obj} failed, compiled its sources separately"
+                )
+                for src in members:
+                    mobj = os.path.basename(src)[: -len(".cu")] + ".obj"
+                    self._stats.record(
+                        self._keys[src], times.get(mobj), unity_failed=True
+                    )
+            elif obj in times:
+                # Split the unity TU's time by the estimates of its members.
+                estimates = self._estimates[obj]
+                total = sum(estimates.values())
+                for src, estimate in estimates.items():
+                    self._stats.record(self._keys[src], times[obj] * estimate / total)
+        for obj, ms in times.items():
+            src = src_of.get(obj)
+            if src is not None and obj not in self._unity_members:
+                self._stats.record(self._keys.get(src) or _source_key(src), ms)
+        self._stats.save()
+
+
+def create_unity_build(build_dir: str) -> Optional[UnityBuild]:
+    """A UnityBuild for build_dir if AIT_UNITY_BUILD is enabled."""
+    if not environ.unity_build():
+        return None
+    return UnityBuild(build_dir, CompileTimeStats(cache_path("compile_times.json")))
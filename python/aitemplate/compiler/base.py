@@ -28,7 +28,7 @@ from enum import Enum
 from functools import reduce
 from numbers import Number
 from pprint import pformat
-from typing import Any, Dict, Iterable, List, Optional, Set, Union
+from typing import Any, Dict, Iterable, List, Optional, Set, Tuple, Union
 
 import numpy as np
 import sympy
@@ -1236,6 +1236,19 @@ class Operator(Node):
             for tensor in self._attrs["inputs"]
         ]
 
+    def in_place_pairs(self) -> List[Tuple[int, int]]:
+        """Returns the (input index, output index) pairs of tensors that may
+        share memory, because the op reads every element of the input before
+        it writes the same element of the output. Memory planning lets an
+        output reuse the buffer of one such input that this op is the last
+        user of.
+
+        Returns
+        -------
+        List[Tuple[int, int]] : empty by default.
+        """
+        return []
+
     def _get_op_attributes(self) -> Dict[str, Any]:
         """
         Returns a dictionary of the core attributes of the op.
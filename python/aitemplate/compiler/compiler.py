@@ -39,6 +39,7 @@ from aitemplate.compiler.transform.name_graph import reset_name_counters
 from aitemplate.compiler.transform.profile import elapsed_dt_sec
 from aitemplate.utils import graph_utils
 from aitemplate.utils.debug_settings import AITDebugSettings
+from aitemplate.utils.environ import memory_schedule_time_budget, multistream_mode
 from aitemplate.utils.misc import callstack_stats
 from aitemplate.utils.serialization.serdes_code import dump_program
 
@@ -162,6 +163,8 @@ def compile_model(
     debug_settings: AITDebugSettings = _DEBUG_SETTINGS,
     do_optimize_graph: bool = True,
     profile_timeout: int = 500,
+    memory_plan_buckets: Optional[List[Dict[str, int]]] = None,
+    shape_specializations: Optional[Dict[str, List[int]]] = None,
 ) -> Model:
     """Compiles a model and generates a .so file.
 
@@ -198,6 +201,19 @@ def compile_model(
         specify debug settings such as where to dump AITemplate model Python file, etc.
     do_optimize_graph: bool
         Apply full list of graph optimizations. Default: True
+    memory_plan_buckets: List[Dict[str, int]], optional
+        Buckets of dynamic input dims, each mapping IntVar names to an inclusive
+        upper bound, e.g. [{"batch_size": 8}, {"batch_size": 32}]. An extra
+        memory plan with a smaller blob is generated for every bucket, and at
+        runtime the model switches to the smallest plan that fits the current
+        input shapes. By default, a single plan for the dims' upper bounds is used.
+    shape_specializations: Dict[str, List[int]], optional
+        Hot values of dynamic input dims, keyed by IntVar name, e.g.
+        {"batch_size": [1, 8, 32]}. For every combination of them, the ops are
+        generated and profiled again with static shapes, and the generated
+        RunImpl dispatches to these specializations when the current dims
+        match, falling back to the dynamic ops otherwise. Trades binary size
+        and compilation time for speed on the hot shapes.
 
     Returns
     -------
@@ -301,17 +317,62 @@ def compile_model(
                 graph, test_dir, "dedup_symbolic_name"
             )
 
+            if memory_schedule_time_budget() > 0 and multistream_mode() == 0:
+                graph = compiler.transform.schedule_for_memory(
+                    graph, memory_schedule_time_budget()
+                )
+                graph_utils.dump_graph_debug_str_to_file(
+                    graph, test_dir, "schedule_for_memory"
+                )
+
             (
                 max_blob,
                 max_constant_blob,
                 workspace,
             ) = compiler.transform.memory_planning(graph)
+            memory_plans = None
+            if memory_plan_buckets:
+                memory_plans = compiler.transform.bucketed_memory_planning(
+                    graph, memory_plan_buckets
+                )
             _verify_outputs_still_in_graph(graph, output_tensors)
             _mark_isolated_int_vars(graph)
             graph_utils.dump_graph_debug_str_to_file(graph, test_dir, "memory_planning")
 
-            file_pairs = backend.codegen.gen_function_src(graph, workdir, test_name)
-            file_pairs.extend(constant_folding_file_pairs)
+            specializations = None
+            if shape_specializations:
+                start_t = datetime.now()
+                specializations = compiler.transform.specialize_shapes(
+                    graph, shape_specializations
+                )
+                for spec in specializations:
+                    compiler.transform.profile(
+                        spec.sorted_graph,
+                        profile_dir,
+                        profile_devs,
+                        dynamic_profiling_strategy,
+                        profile_timeout,
+                    )
+                    # Kernels picked for the static shapes may need more
+                    # shared workspace than the dynamic ones.
+                    for node in spec.sorted_graph:
+                        for func in node.src_ops():
+                            workspace.shared_size = max(
+                                workspace.shared_size, func._attrs.get("workspace", 0)
+                            )
+                _LOGGER.info(
+                    f"specialized {len(specializations)} shapes elapsed time: "
+                    f"{elapsed_dt_sec(start_t)}"
+                )
+
+            file_pairs = backend.codegen.gen_function_src(
+                graph, workdir, test_name, shape_specializations=specializations
+            )
+            # The constant folder may share kernel instance sources with the
+            # main graph; each must be compiled (and linked) only once.
+            file_pairs.extend(
+                pair for pair in constant_folding_file_pairs if pair not in file_pairs
+            )
 
             # It's possible that the original output tensor has been replaced with a new tensor.
             # Preserve original output tensors' orders but use the new tensors.
@@ -336,6 +397,8 @@ def compile_model(
                 test_name,
                 additional_unbound_constants=constant_folding_inputs,
                 debug_settings=debug_settings,
+                memory_plans=memory_plans,
+                shape_specializations=specializations,
             )
             file_pairs.extend(main_pairs)
 
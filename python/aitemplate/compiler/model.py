@@ -18,6 +18,7 @@ Python bindings to the AIT runtime.
 
 import ctypes
 import enum
+import json
 import logging
 import math
 import struct
@@ -37,6 +38,11 @@ from aitemplate.utils.torch_utils import torch_dtype_to_string, write_tensor_bin
 # effect since Python default arguments only get evaluated once.
 AIT_DEFAULT_NUM_RUNTIMES = 1
 
+# Header of standalone testcase files, see write_standalone_testcase_data.
+_STANDALONE_TESTCASE_MAGIC = b"AITTCASE"
+_STANDALONE_TESTCASE_VERSION = 2
+_STANDALONE_TESTCASE_ALIGNMENT = 64
+
 # Stand-in for torch.Tensor. Use a TypeVar for some APIs since we can't introduce
 # a torch dependency.
 TorchTensor = TypeVar("TorchTensor")
@@ -51,6 +57,7 @@ class AITemplateMemcpyKind(enum.Enum):
 class AITemplateAllocatorKind(enum.Enum):
     DEFAULT = 0
     TRACKING = 1
+    CACHING = 2
 
 
 class AITData(NamedTuple):
@@ -79,6 +86,239 @@ class _CFormatAITData(ctypes.Structure):
     ]
 
 
+class RuntimePoolPolicy(NamedTuple):
+    """
+    Controls how the pool of runtimes inside a Model grows and shrinks.
+    See AITemplateRuntimePoolPolicy in model_interface.h.
+    """
+
+    min_runtimes: int
+    max_runtimes: int
+    idle_timeout_ms: int = 0
+    memory_budget_bytes: int = 0
+
+
+class _CFormatRuntimePoolPolicy(ctypes.Structure):
+    _fields_ = [
+        ("min_runtimes", ctypes.c_size_t),
+        ("max_runtimes", ctypes.c_size_t),
+        ("idle_timeout_ms", ctypes.c_size_t),
+        ("memory_budget_bytes", ctypes.c_size_t),
+    ]
+
+
+class GraphCacheStats(NamedTuple):
+    """
+    Counters of the cache of instantiated graphs used when running with
+    graph_mode=True. See AITemplateGraphCacheStats in model_interface.h.
+    """
+
+    hits: int
+    updates: int
+    misses: int
+    evictions: int
+
+
+class _CFormatGraphCacheStats(ctypes.Structure):
+    _fields_ = [
+        ("hits", ctypes.c_size_t),
+        ("updates", ctypes.c_size_t),
+        ("misses", ctypes.c_size_t),
+        ("evictions", ctypes.c_size_t),
+    ]
+
+
+class CachingAllocatorStats(NamedTuple):
+    """
+    Counters of a CACHING allocator, in bytes. See
+    AITemplateCachingAllocatorStats in model_interface.h.
+    """
+
+    reserved_bytes: int
+    allocated_bytes: int
+    requested_bytes: int
+    cached_bytes: int
+    peak_reserved_bytes: int
+    num_device_mallocs: int
+    num_device_frees: int
+    num_cache_hits: int
+
+
+class _CFormatCachingAllocatorStats(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_size_t) for name in CachingAllocatorStats._fields]
+
+
+class MemoryUsage(NamedTuple):
+    """
+    Device memory held by a model, by category, in bytes. See
+    AITemplateMemoryUsage in model_interface.h.
+    """
+
+    constants_bytes: int
+    secondary_constants_bytes: int
+    constant_folder_bytes: int
+    runtime_blob_bytes: int
+    runtime_workspace_bytes: int
+    num_runtimes: int
+    host_output_staging_device_bytes: int
+    host_output_staging_pinned_bytes: int
+    total_device_bytes: int
+
+
+class _CFormatMemoryUsage(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_size_t) for name in MemoryUsage._fields]
+
+
+class RuntimeMemoryUsage(NamedTuple):
+    """
+    Device memory held by a single runtime, in bytes. See
+    AITemplateRuntimeMemoryUsage in model_interface.h.
+    """
+
+    blob_bytes: int
+    workspace_bytes: int
+    unique_workspace_bytes: int
+    memory_plan_idx: int
+    busy: bool
+
+
+class _CFormatRuntimeMemoryUsage(ctypes.Structure):
+    _fields_ = [
+        ("blob_bytes", ctypes.c_size_t),
+        ("workspace_bytes", ctypes.c_size_t),
+        ("unique_workspace_bytes", ctypes.c_size_t),
+        ("memory_plan_idx", ctypes.c_size_t),
+        ("busy", ctypes.c_bool),
+    ]
+
+
+class TensorLifetime(NamedTuple):
+    """
+    Where and when an intermediate tensor lives in the blob, as planned for
+    the upper bounds of the dynamic dims. See AITemplateTensorLifetime in
+    model_interface.h.
+    """
+
+    name: str
+    offset: int
+    size_bytes: int
+    first_op_idx: int
+    last_op_idx: int
+    first_op: str
+    last_op: str
+
+
+class _CFormatTensorLifetime(ctypes.Structure):
+    _fields_ = [
+        ("name", ctypes.c_char_p),
+        ("offset", ctypes.c_size_t),
+        ("size_bytes", ctypes.c_size_t),
+        ("first_op_idx", ctypes.c_size_t),
+        ("last_op_idx", ctypes.c_size_t),
+        ("first_op", ctypes.c_char_p),
+        ("last_op", ctypes.c_char_p),
+    ]
+
+
+class DynamicBatcherOptions(NamedTuple):
+    """
+    Options for the dynamic batcher that merges concurrent requests into a
+    single run. See AITemplateDynamicBatcherOptions in model_interface.h.
+    """
+
+    batch_dim: int = 0
+    max_batch_size: int = 0
+    max_delay_us: int = 1000
+    graph_mode: bool = False
+
+
+class _CFormatDynamicBatcherOptions(ctypes.Structure):
+    _fields_ = [
+        ("batch_dim", ctypes.c_size_t),
+        ("max_batch_size", ctypes.c_size_t),
+        ("max_delay_us", ctypes.c_size_t),
+        ("graph_mode", ctypes.c_bool),
+    ]
+
+
+# void (*)(void* user_data, AITemplateError status)
+_AsyncRunCallbackType = ctypes.CFUNCTYPE(None, ctypes.c_void_p, ctypes.c_int)
+
+
+class AsyncRun:
+    """
+    Handle to a run started with Model.run_async(). All ctypes buffers that
+    the runtime still reads or writes are owned by this object, so it is kept
+    alive by the Model until the run completes.
+    """
+
+    def __init__(self, model: "Model", outputs, keep_alive, callback):
+        self._model = model
+        self._outputs = outputs
+        self._keep_alive = keep_alive
+        self._user_callback = callback
+        self._status = None
+        self.handle = ctypes.c_void_p()
+        # Owned by this object so that the function pointer stays valid.
+        self._c_callback = _AsyncRunCallbackType(self._on_complete)
+
+    def _on_complete(self, user_data, status):
+        # Called from the runtime's completion thread. Exceptions can't
+        # propagate through ctypes, so log them instead.
+        self._status = status
+        if self._user_callback is not None:
+            try:
+                self._user_callback(self)
+            except Exception:
+                logging.exception("Exception in run_async callback")
+
+    def _free_handle(self):
+        if self.handle:
+            self._model.DLL.AITemplateRunHandleDelete(self.handle)
+            self.handle = ctypes.c_void_p()
+
+    def poll(self) -> bool:
+        """
+        Return True if the run has completed, i.e. the outputs are ready and
+        the callback (if any) has returned.
+        """
+        if not self.handle:
+            return True
+        done = ctypes.c_bool()
+        status = ctypes.c_int()
+        self._model.DLL.AITemplateRunHandlePoll(
+            self.handle, ctypes.byref(done), ctypes.byref(status)
+        )
+        if done.value:
+            self._status = status.value
+            self._free_handle()
+        return done.value
+
+    def wait(self) -> Dict[str, AITData]:
+        """
+        Block until the run has completed and return its outputs. Raises a
+        RuntimeError if the run failed.
+        """
+        if self.handle:
+            try:
+                self._model.DLL.AITemplateRunHandleWait(self.handle)
+            finally:
+                self.poll()
+        return self.outputs()
+
+    def outputs(self) -> Dict[str, AITData]:
+        """
+        The outputs with their actual shapes. Only valid once the run has
+        completed successfully.
+        """
+        if self.handle:
+            raise RuntimeError("The run has not completed yet")
+        if self._status != 0:
+            raise RuntimeError("The async run failed")
+        outputs, c_output_shapes_out = self._outputs
+        return self._model._make_ait_outputs(outputs, c_output_shapes_out)
+
+
 def _dlclose(dll: ctypes.CDLL):
     f_dlclose = None
 
@@ -203,6 +443,7 @@ class Model:
         lib_path: str,
         num_runtimes: int = AIT_DEFAULT_NUM_RUNTIMES,
         allocator_kind: Optional[AITemplateAllocatorKind] = None,
+        max_reserved_bytes: int = 0,
     ):
         """
         Instantiates a wrapper around the C++ model_interface.
@@ -217,6 +458,9 @@ class Model:
             default, set to 1. Must be positive.
         allocator_kind : AITemplateAllocatorKind, optional
             What type of allocator to use when allocating GPU memory.
+        max_reserved_bytes : int, optional
+            Only used with AITemplateAllocatorKind.CACHING. Caps the device
+            memory held by the allocator. 0 (the default) means no cap.
         """
         # Set of pointers allocated with numpy_to_ait_data.
         # If the user forgets to free their data, we use this to
@@ -229,8 +473,16 @@ class Model:
         self.DLL = self._DLLWrapper(lib_path)
         self.lib_path = lib_path
         self.handle = ctypes.c_void_p()
+        self.batcher_handle = ctypes.c_void_p()
+        # AsyncRuns that may still be in flight. See run_async().
+        self._async_runs = set()
         self.allocator_handle = ctypes.c_void_p()
-        if allocator_kind is not None:
+        if allocator_kind == AITemplateAllocatorKind.CACHING:
+            self.DLL.AITemplateCachingAllocatorCreate(
+                ctypes.byref(self.allocator_handle),
+                ctypes.c_size_t(max_reserved_bytes),
+            )
+        elif allocator_kind is not None:
             self.DLL.AITemplateAllocatorCreate(
                 ctypes.byref(self.allocator_handle),
                 ctypes.c_int(allocator_kind.value),
@@ -273,9 +525,14 @@ class Model:
         # Check that it exists since we may have thrown
         # an exception before initializing it.
         if hasattr(self, "DLL"):
+            self.stop_dynamic_batcher()
             if self.handle:
+                # Deleting the container drains all async runs first.
                 self.DLL.AITemplateModelContainerDelete(self.handle)
                 self.handle = ctypes.c_void_p()
+            for run in self._async_runs:
+                run._free_handle()
+            self._async_runs.clear()
 
             if self.allocator_handle:
                 self.DLL.AITemplateAllocatorDelete(self.allocator_handle)
@@ -374,7 +631,9 @@ class Model:
             idx = index_map[name]
             result[idx] = tensor
         for tensor in result:
-            write_tensor_binary(tensor, file_handle)
+            write_tensor_binary(
+                tensor, file_handle, alignment=_STANDALONE_TESTCASE_ALIGNMENT
+            )
 
     def write_standalone_testcase_data(
         self,
@@ -384,13 +643,22 @@ class Model:
         atol=1e-2,
         rtol=1e-2,
     ):
+        """
+        Write a testcase file for the standalone runner (see
+        static/csrc/standalone.cpp for the format). Tensor data is aligned so
+        that the runner can memory map the file and use it in place.
+        """
         with open(filename, "wb") as file_handle:
+            file_handle.write(_STANDALONE_TESTCASE_MAGIC)
+            file_handle.write(struct.pack("II", _STANDALONE_TESTCASE_VERSION, 0))
             file_handle.write(struct.pack("ff", atol, rtol))
             self._write_tensors_for_standalone_testcase(
                 tensor_dict=inputs, file_handle=file_handle
             )
             for out in expected_outputs:
-                write_tensor_binary(out, file_handle)
+                write_tensor_binary(
+                    out, file_handle, alignment=_STANDALONE_TESTCASE_ALIGNMENT
+                )
 
     def _make_ait_outputs(
         self, outputs: List[AITData], c_output_shapes
@@ -497,6 +765,136 @@ class Model:
             inputs, outputs, stream_ptr, sync, graph_mode, outputs_on_host=False
         )
 
+    def run_async(
+        self,
+        inputs: Union[Dict[str, AITData], List[AITData]],
+        outputs: Union[Dict[str, AITData], List[AITData]],
+        stream_ptr: Optional[int] = None,
+        graph_mode: bool = False,
+        callback: Optional[Callable[[AsyncRun], None]] = None,
+    ) -> AsyncRun:
+        """
+        Like run(), but returns immediately without waiting for a runtime to
+        become available. The returned AsyncRun can be polled or waited on.
+        If callback is given, it is called with the AsyncRun from a runtime
+        thread once the outputs are ready; it must not block.
+
+        The memory behind inputs and outputs must stay valid until the run
+        completes.
+        """
+        # Drop completed runs so that the set doesn't grow without bound.
+        self._async_runs = {run for run in self._async_runs if not run.poll()}
+
+        if isinstance(inputs, dict):
+            inputs = self._dict_to_ordered_list(inputs, is_inputs=True)
+        if isinstance(outputs, dict):
+            outputs = self._dict_to_ordered_list(outputs, is_inputs=False)
+        (
+            c_inputs,
+            c_outputs,
+            c_stream,
+            c_output_shapes_out,
+        ) = self._prepare_run(
+            inputs,
+            outputs,
+            stream_ptr,
+        )
+        run = AsyncRun(
+            self,
+            (outputs, c_output_shapes_out),
+            keep_alive=(c_inputs, c_outputs),
+            callback=callback,
+        )
+        self.DLL.AITemplateModelContainerRunAsync(
+            self.handle,
+            c_inputs,
+            ctypes.c_size_t(len(inputs)),
+            c_outputs,
+            ctypes.c_size_t(len(outputs)),
+            c_stream,
+            ctypes.c_bool(graph_mode),
+            c_output_shapes_out,
+            run._c_callback,
+            None,
+            ctypes.byref(run.handle),
+        )
+        self._async_runs.add(run)
+        return run
+
+    def start_dynamic_batcher(
+        self, options: DynamicBatcherOptions = DynamicBatcherOptions()
+    ) -> None:
+        """
+        Start a dynamic batcher that merges concurrent run_batched() calls
+        into single runs along options.batch_dim. See dynamic_batcher.h.
+        """
+        if self.batcher_handle:
+            raise RuntimeError("A dynamic batcher is already running")
+        c_options = _CFormatDynamicBatcherOptions(*options)
+        self.DLL.AITemplateDynamicBatcherCreate(
+            ctypes.byref(self.batcher_handle), self.handle, ctypes.byref(c_options)
+        )
+
+    def stop_dynamic_batcher(self) -> None:
+        """
+        Stop the dynamic batcher after all queued requests have finished.
+        """
+        if self.batcher_handle:
+            self.DLL.AITemplateDynamicBatcherDelete(self.batcher_handle)
+            self.batcher_handle = ctypes.c_void_p()
+
+    def run_batched(
+        self,
+        inputs: Union[Dict[str, AITData], List[AITData]],
+        outputs: Union[Dict[str, AITData], List[AITData]],
+    ) -> Dict[str, AITData]:
+        """
+        Like run(), but the request may be merged with concurrent requests
+        from other threads. Requires start_dynamic_batcher(). Blocks until the
+        outputs are ready; the inputs must be ready when this is called.
+        """
+        if not self.batcher_handle:
+            raise RuntimeError("Call start_dynamic_batcher() before run_batched()")
+        if isinstance(inputs, dict):
+            inputs = self._dict_to_ordered_list(inputs, is_inputs=True)
+        if isinstance(outputs, dict):
+            outputs = self._dict_to_ordered_list(outputs, is_inputs=False)
+        c_inputs, c_outputs, _, c_output_shapes_out = self._prepare_run(
+            inputs, outputs, stream_ptr=None
+        )
+        self.DLL.AITemplateDynamicBatcherRun(
+            self.batcher_handle,
+            c_inputs,
+            ctypes.c_size_t(len(inputs)),
+            c_outputs,
+            ctypes.c_size_t(len(outputs)),
+            c_output_shapes_out,
+        )
+        return self._make_ait_outputs(outputs, c_output_shapes_out)
+
+    def run_batched_with_tensors(
+        self,
+        inputs: Union[List[TorchTensor], Dict[str, TorchTensor]],
+        outputs: Union[List[TorchTensor], Dict[str, TorchTensor]],
+    ) -> Dict[str, TorchTensor]:
+        """
+        Like run_with_tensors(), but goes through the dynamic batcher. See
+        run_batched().
+        """
+        _check_tensors_contiguous_and_on_gpu(
+            inputs,
+            name="inputs",
+        )
+        _check_tensors_contiguous_and_on_gpu(
+            outputs,
+            name="outputs",
+        )
+        outputs_ait = self.run_batched(
+            _convert_tensor_args(inputs),
+            _convert_tensor_args(outputs),
+        )
+        return self._interpret_tensors_as_shapes(outputs, outputs_ait)
+
     def profile(
         self,
         inputs: Union[Dict[str, AITData], List[AITData]],
@@ -1020,6 +1418,217 @@ class Model:
         self.DLL.AITemplateModelContainerGetNumRuntimes(self.handle, ctypes.byref(out))
         return out.value
 
+    def prewarm_runtimes(self, wait: bool = True) -> None:
+        """
+        Create the runtimes up to min_runtimes (num_runtimes by default) on a
+        background thread. Without this, they are created the first time all
+        existing runtimes are busy. If wait, block until they are created.
+        """
+        self.DLL.AITemplateModelContainerPrewarmRuntimes(
+            self.handle, ctypes.c_bool(wait)
+        )
+
+    def set_runtime_pool_policy(self, policy: RuntimePoolPolicy) -> None:
+        """
+        Let the runtime pool grow on demand and release idle runtimes.
+
+        When all runtimes are busy, run() creates a new runtime (up to
+        policy.max_runtimes) instead of blocking. Idle runtimes above
+        policy.min_runtimes are released after policy.idle_timeout_ms, or
+        when the pool exceeds policy.memory_budget_bytes. A value of 0
+        disables the timeout/budget respectively.
+        """
+        c_policy = _CFormatRuntimePoolPolicy(*policy)
+        self.DLL.AITemplateModelContainerSetRuntimePoolPolicy(
+            self.handle, ctypes.byref(c_policy)
+        )
+
+    def get_runtime_pool_policy(self) -> RuntimePoolPolicy:
+        c_policy = _CFormatRuntimePoolPolicy()
+        self.DLL.AITemplateModelContainerGetRuntimePoolPolicy(
+            self.handle, ctypes.byref(c_policy)
+        )
+        return RuntimePoolPolicy(
+            c_policy.min_runtimes,
+            c_policy.max_runtimes,
+            c_policy.idle_timeout_ms,
+            c_policy.memory_budget_bytes,
+        )
+
+    def release_idle_runtimes(self) -> int:
+        """
+        Release the idle runtimes that exceed the pool policy right away,
+        and the idle staging buffers of runs with outputs on the host.
+        Returns the number of runtimes that were released.
+        """
+        out = ctypes.c_size_t()
+        self.DLL.AITemplateModelContainerReleaseIdleRuntimes(
+            self.handle, ctypes.byref(out)
+        )
+        return out.value
+
+    def get_graph_cache_stats(self) -> GraphCacheStats:
+        """
+        Get the graph mode cache counters summed over all runtimes. A high
+        hit rate means graph mode skips stream capture for most runs; the
+        cache size can be tuned with the AIT_GRAPH_CACHE_SIZE environment
+        variable (default 8 graphs per runtime).
+        """
+        c_stats = _CFormatGraphCacheStats()
+        self.DLL.AITemplateModelContainerGetGraphCacheStats(
+            self.handle, ctypes.byref(c_stats)
+        )
+        return GraphCacheStats(
+            c_stats.hits, c_stats.updates, c_stats.misses, c_stats.evictions
+        )
+
+    def set_op_trace_sampling(
+        self, sample_every: int, max_records: int = 1 << 16
+    ) -> None:
+        """
+        Time every op of 1 in sample_every runs (0 disables tracing), keeping
+        the last max_records op timings. Graph mode runs are not traced.
+        Clears the recorded trace.
+        """
+        self.DLL.AITemplateModelContainerSetOpTraceSampling(
+            self.handle, ctypes.c_size_t(sample_every), ctypes.c_size_t(max_records)
+        )
+
+    def write_op_trace(self, filename: str) -> None:
+        """
+        Write the sampled op timings as a Chrome trace JSON file, which can
+        be opened in chrome://tracing or Perfetto. Each event carries the op's
+        input/output shapes and the run it belongs to; each stream is a
+        separate track.
+        """
+        self.DLL.AITemplateModelContainerWriteOpTrace(
+            self.handle, ctypes.c_char_p(filename.encode("utf-8"))
+        )
+
+    def get_metrics(self, as_json: bool = True) -> Union[Dict, str]:
+        """
+        Get a snapshot of the runtime metrics: latency histograms (in
+        microseconds) of each phase of run() - waiting for constants and for
+        a free runtime, launching, device execution - and of graph capture,
+        constant folding and swapping, plus run and graph cache counters.
+
+        Parameters
+        ----------
+        as_json : bool
+            If True (the default), return the metrics parsed into a dict
+            {"counters": {...}, "histograms": {name: {"count", "sum", "mean",
+            "max", "p50", "p90", "p99", "p999", "buckets"}}}. Otherwise
+            return them as Prometheus-like text, one value per line.
+        """
+        size = ctypes.c_size_t()
+        self.DLL.AITemplateModelContainerGetMetrics(
+            self.handle, ctypes.c_bool(as_json), None, 0, ctypes.byref(size)
+        )
+        # The metrics may grow between the two calls.
+        while True:
+            buffer = ctypes.create_string_buffer(size.value + 1024)
+            self.DLL.AITemplateModelContainerGetMetrics(
+                self.handle,
+                ctypes.c_bool(as_json),
+                buffer,
+                ctypes.c_size_t(len(buffer)),
+                ctypes.byref(size),
+            )
+            if size.value < len(buffer):
+                break
+        metrics = buffer.value.decode("utf-8")
+        return json.loads(metrics) if as_json else metrics
+
+    def reset_metrics(self) -> None:
+        """
+        Clear the latency histograms and run counters returned by
+        get_metrics().
+        """
+        self.DLL.AITemplateModelContainerResetMetrics(self.handle)
+
+    def get_memory_usage(self) -> MemoryUsage:
+        """
+        Get the device memory held by the model (constants, constant folding,
+        runtimes and staging buffers), in bytes.
+        """
+        c_usage = _CFormatMemoryUsage()
+        self.DLL.AITemplateModelContainerGetMemoryUsage(
+            self.handle, ctypes.byref(c_usage)
+        )
+        return MemoryUsage(*(getattr(c_usage, name) for name in MemoryUsage._fields))
+
+    def get_runtime_memory_usage(self) -> List[RuntimeMemoryUsage]:
+        """
+        Get the device memory held by each runtime, in bytes.
+        """
+        num_runtimes = ctypes.c_size_t()
+        # The pool may grow between the two calls, so the second one can
+        # report more runtimes than it fills in.
+        self.DLL.AITemplateModelContainerGetRuntimeMemoryUsage(
+            self.handle, None, ctypes.c_size_t(0), ctypes.byref(num_runtimes)
+        )
+        max_runtimes = num_runtimes.value
+        c_usage = (_CFormatRuntimeMemoryUsage * max_runtimes)()
+        self.DLL.AITemplateModelContainerGetRuntimeMemoryUsage(
+            self.handle,
+            c_usage,
+            ctypes.c_size_t(max_runtimes),
+            ctypes.byref(num_runtimes),
+        )
+        return [
+            RuntimeMemoryUsage(
+                usage.blob_bytes,
+                usage.workspace_bytes,
+                usage.unique_workspace_bytes,
+                usage.memory_plan_idx,
+                usage.busy,
+            )
+            for usage in c_usage[: min(max_runtimes, num_runtimes.value)]
+        ]
+
+    def get_tensor_lifetimes(self) -> List[TensorLifetime]:
+        """
+        Get the intermediate tensors in the blob with their offsets, sizes
+        and the range of ops they are live for, as planned by memory
+        planning. Ordered by first op.
+        """
+        c_lifetimes = ctypes.POINTER(_CFormatTensorLifetime)()
+        num_tensors = ctypes.c_size_t()
+        self.DLL.AITemplateModelContainerGetTensorLifetimes(
+            self.handle, ctypes.byref(c_lifetimes), ctypes.byref(num_tensors)
+        )
+        return [
+            TensorLifetime(
+                lifetime.name.decode("utf-8"),
+                lifetime.offset,
+                lifetime.size_bytes,
+                lifetime.first_op_idx,
+                lifetime.last_op_idx,
+                lifetime.first_op.decode("utf-8"),
+                lifetime.last_op.decode("utf-8"),
+            )
+            for lifetime in c_lifetimes[: num_tensors.value]
+        ]
+
+    def get_caching_allocator_stats(self) -> CachingAllocatorStats:
+        """
+        Get the counters of the model's allocator. Requires
+        allocator_kind=AITemplateAllocatorKind.CACHING.
+        """
+        c_stats = _CFormatCachingAllocatorStats()
+        self.DLL.AITemplateCachingAllocatorGetStats(
+            self.allocator_handle, ctypes.byref(c_stats)
+        )
+        return CachingAllocatorStats(
+            *(getattr(c_stats, name) for name in CachingAllocatorStats._fields)
+        )
+
+    def empty_allocator_cache(self) -> None:
+        """
+        Return all memory cached by a CACHING allocator to the device.
+        """
+        self.DLL.AITemplateCachingAllocatorEmptyCache(self.allocator_handle)
+
     def numpy_to_ait_data(
         self, arr: np.ndarray, stream_ptr: Optional[int] = None, sync: bool = True
     ) -> AITData:
@@ -1088,6 +1697,93 @@ class Model:
     def swap_constants(self):
         self.DLL.AITemplateModelContainerSwapConstants(self.handle)
 
+    def update_constants_delta(self, tensors: Dict[str, AITData]):
+        """
+        Stage new values for a subset of the constants in the inactive
+        constants buffer. The upload runs on a background thread: constants
+        not in tensors are carried over from the active buffer, and constant
+        folding only reruns if one of its inputs is in tensors. The memory
+        behind tensors must stay valid until finish_constants_delta_update()
+        returns.
+        """
+        c_names = (ctypes.c_char_p * len(tensors))()
+        c_tensors = (_CFormatAITData * len(tensors))()
+        for i, (name, tensor) in enumerate(tensors.items()):
+            c_names[i] = ctypes.c_char_p(name.encode("utf-8"))
+            c_tensors[i] = self._convert_single_param_to_c_format(tensor)
+        self.DLL.AITemplateModelContainerUpdateConstantsDelta(
+            self.handle, c_names, c_tensors, ctypes.c_size_t(len(tensors))
+        )
+
+    def update_constants_delta_with_tensors(self, tensors: Dict[str, TorchTensor]):
+        ait_tensors = {}
+        for name, tensor in tensors.items():
+            if not tensor.is_contiguous() or not tensor.is_cuda:
+                raise ValueError(f"Constant {name} must be contiguous and on the GPU.")
+            self.torch_constant_tensors[name] = tensor
+            ait_tensors[name] = torch_to_ait_data(tensor)
+        self.update_constants_delta(ait_tensors)
+
+    def finish_constants_delta_update(self, swap: bool = True) -> int:
+        """
+        Wait for the update staged by update_constants_delta() and, if swap,
+        make it active. Returns the new constants version.
+        """
+        version = ctypes.c_uint64()
+        self.DLL.AITemplateModelContainerFinishConstantsDeltaUpdate(
+            self.handle, ctypes.c_bool(swap), ctypes.byref(version)
+        )
+        return version.value
+
+    def get_constants_version(self) -> int:
+        """
+        The number of times the constants buffers have been swapped.
+        """
+        version = ctypes.c_uint64()
+        self.DLL.AITemplateModelContainerGetConstantsVersion(
+            self.handle, ctypes.byref(version)
+        )
+        return version.value
+
+    def save_folded_constants(
+        self, path: str, inputs_key: int = 0, stream_ptr: Optional[int] = None
+    ):
+        """
+        Write the folded constants to path, folding constants first if that
+        has not happened yet. Another process running the same model can
+        restore them with load_folded_constants and skip constant folding.
+
+        inputs_key identifies the values of the constant folding inputs set
+        at runtime (e.g. a checkpoint version). It is not needed if all of
+        them are bound at compile time.
+        """
+        self.DLL.AITemplateModelContainerSaveFoldedConstants(
+            self.handle,
+            ctypes.c_char_p(path.encode("utf-8")),
+            ctypes.c_uint64(inputs_key),
+            ctypes.c_void_p(stream_ptr),
+        )
+
+    def load_folded_constants(
+        self, path: str, inputs_key: int = 0, stream_ptr: Optional[int] = None
+    ) -> bool:
+        """
+        Restore folded constants written by save_folded_constants. Returns
+        False, and leaves the constants alone, if the file does not exist or
+        was saved by another model, with another inputs_key, or with a
+        different set of constant folding inputs set at runtime. Those inputs
+        must be set before calling this.
+        """
+        loaded = ctypes.c_bool()
+        self.DLL.AITemplateModelContainerLoadFoldedConstants(
+            self.handle,
+            ctypes.c_char_p(path.encode("utf-8")),
+            ctypes.c_uint64(inputs_key),
+            ctypes.c_void_p(stream_ptr),
+            ctypes.byref(loaded),
+        )
+        return loaded.value
+
     def _get_constant_names_impl(
         self, unbound_constants_only: bool, constant_folding_only: bool
     ) -> List[str]:
@@ -16,7 +16,7 @@
 Fused elementwise operator definition.
 """
 
-from typing import Iterable, List
+from typing import Iterable, List, Tuple
 
 from aitemplate import backend
 from aitemplate.backend import registry
@@ -27,6 +27,11 @@ from aitemplate.compiler.tensor_accessor import TensorAccessor
 # pylint: disable=C0301,C0103,W0223
 
 
+def _is_dense_accessor(accessor: TensorAccessor) -> bool:
+    """Whether the kernel accesses the tensor itself, not a strided view."""
+    return accessor.stride_dim is None and accessor.actual_shapes is None
+
+
 def _check_shapes_eq(shapes1, shapes2) -> bool:
     if len(shapes1) != len(shapes2):
         return False
@@ -115,6 +120,25 @@ class fused_elementwise(Operator):
             "outputs": self._attrs["outputs"],
         }
 
+    def in_place_pairs(self) -> List[Tuple[int, int]]:
+        # Each thread reads its elements of all inputs before it writes the
+        # same elements of the outputs. Broadcast, jagged and strided
+        # tensors are accessed at other indices.
+        pairs = []
+        for output_idx, output in enumerate(self._attrs["outputs"]):
+            if output.is_jagged() or not _is_dense_accessor(
+                self._attrs["output_accessors"][output_idx]
+            ):
+                continue
+            for input_idx, tensor in enumerate(self._attrs["inputs"]):
+                if (
+                    tensor.dtype() == output.dtype()
+                    and _check_shapes_eq(tensor._attrs["shape"], output._attrs["shape"])
+                    and _is_dense_accessor(self._attrs["input_accessors"][input_idx])
+                ):
+                    pairs.append((input_idx, output_idx))
+        return pairs
+
     def gen_function(self) -> str:
         target = backend.target.Target.current()
         func_key = "{target}.{op}.gen_function".format(
@@ -57,3 +57,10 @@ class GemmRecordEntry:
     algo: str
     workspace: int
     split_k: int
+    # Runtime of algo in ms, -1 if unknown. Used to merge caches.
+    duration: float = -1
+    # Timing statistics of the profiler, see ProfileStats.
+    duration_p90: float = -1
+    duration_mean: float = -1
+    duration_ci: float = -1
+    iterations: int = 0
@@ -418,6 +418,37 @@ class gemm(Operator):
             cache_ver = target.get_profile_cache_version("gemm")
             return f"{op_type}_{encoded_str}_{cache_ver}"
 
+    def _query_nearest_profile_cache(
+        self, query: GemmQueryEntry, exec_key: str, op_instance: OrderedDict
+    ):
+        """
+        If AIT_PROFILE_CACHE_NEAREST_DISTANCE is set, look up the best algo
+        among the cached workloads of this gemm near exec_key, restricted
+        to the algos of op_instance. Returns the (algo, workspace, split_k)
+        cache value, or None.
+        """
+        max_distance = environ.profile_cache_nearest_distance()
+        target = backend.target.Target.current()
+        if max_distance <= 0 or target.force_profile():
+            return None
+        result = target.query_profile_cache_nearest(
+            "gemm",
+            query.__dict__,
+            exec_key,
+            max_distance,
+            is_valid_algo=lambda algo: algo in op_instance,
+        )
+        if result is None:
+            return None
+        algo, workspace, split_k, confident = result
+        if not confident and environ.profile_cache_nearest_confident_only():
+            return None
+        _LOGGER.info(
+            f'Use the profiling result of a nearby workload for {self._attrs["name"]} '
+            f"({exec_key}): {algo}, {confident=}",
+        )
+        return algo, workspace, split_k
+
     def _should_build_profiler(
         self, workloads: List[str], new_op_instance: OrderedDict
     ):
@@ -459,6 +490,10 @@ class gemm(Operator):
                     pshape=self._attrs["permute_shape"],
                 )
                 cache_value = target.query_profile_cache("gemm", query.__dict__)
+                if cache_value is None:
+                    cache_value = self._query_nearest_profile_cache(
+                        query, wkl, new_op_instance
+                    )
                 if cache_value is not None and not target.force_profile():
                     _LOGGER.info(
                         f'Load profiling result for {self._attrs["name"]} '
@@ -656,6 +691,10 @@ class gemm(Operator):
             pshape=self._attrs["permute_shape"],
         )
         cache_value = target.query_profile_cache("gemm", query.__dict__)
+        if cache_value is None:
+            cache_value = self._query_nearest_profile_cache(
+                query, exec_key, self._attrs["op_instance"]
+            )
         if cache_value is not None and not target.force_profile():
             _LOGGER.debug(
                 f'Load profiling result for {self._attrs["name"]} '
@@ -862,7 +901,7 @@ class GemmProfilerPostprocessingDelegate:
         """
         Initialize storage for profiler results
         Instance=(
-            ProfileResult=(best_algo, elapsed_runtime, workspace),
+            ProfileResult=(best_algo, elapsed_runtime, workspace, stats),
             func_attrs,
             profiler_filename,
             exec_key,
@@ -891,7 +930,7 @@ class GemmProfilerPostprocessingDelegate:
         ):
             min_runtime_results = min(group, key=_profiler_group_reduce_min_key)
             (
-                (best_algo, runtime, workspace),
+                (best_algo, runtime, workspace, stats),
                 func_attrs,
                 profiler_filename,
                 exec_key,
@@ -904,7 +943,7 @@ class GemmProfilerPostprocessingDelegate:
 
             _LOGGER.info(
                 f"Profiler ({profiler_filename} {exec_key}) selected kernel: "
-                f"{best_algo=} {workspace=} {split_k=}",
+                f"{best_algo=} {workspace=} {split_k=} {runtime=} {stats=}",
             )
 
             tmp_op = next(iter(func_attrs["op_instance"].values()))
@@ -930,7 +969,13 @@ class GemmProfilerPostprocessingDelegate:
                 workspace=workspace,
                 split_k=split_k,
                 pshape=func_attrs["permute_shape"],
+                duration=runtime,
             )
+            if stats is not None:
+                cache_record.duration_p90 = stats.p90
+                cache_record.duration_mean = stats.mean
+                cache_record.duration_ci = stats.ci
+                cache_record.iterations = stats.iterations
             try:
                 target.insert_profile_cache("gemm", cache_record.__dict__)
             except Exception as e:
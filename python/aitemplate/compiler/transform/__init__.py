@@ -31,7 +31,10 @@ from aitemplate.compiler.transform.mark_param_tensor import (
     mark_param_tensor,
     mark_special_views,
 )
-from aitemplate.compiler.transform.memory_planning import memory_planning
+from aitemplate.compiler.transform.memory_planning import (
+    bucketed_memory_planning,
+    memory_planning,
+)
 from aitemplate.compiler.transform.move_view_ops import move_view_op_before_concat
 from aitemplate.compiler.transform.name_graph import dedup_symbolic_name, name_graph
 from aitemplate.compiler.transform.optimize_graph import optimize_graph
@@ -39,8 +42,13 @@ from aitemplate.compiler.transform.profile import profile
 from aitemplate.compiler.transform.refine_graph import refine_graph
 from aitemplate.compiler.transform.remove_no_ops import remove_no_ops
 from aitemplate.compiler.transform.remove_unused_ops import remove_unused_ops
+from aitemplate.compiler.transform.schedule_for_memory import schedule_for_memory
 from aitemplate.compiler.transform.split_large_concat_ops import split_large_concat_ops
 from aitemplate.compiler.transform.split_large_split_ops import split_large_split_ops
+from aitemplate.compiler.transform.specialize_shapes import (
+    ShapeSpecialization,
+    specialize_shapes,
+)
 from aitemplate.compiler.transform.toposort import toposort
 from aitemplate.compiler.transform.transform_memory_ops import transform_memory_ops
 from aitemplate.compiler.transform.transform_merge_slice_ops import merge_slice_ops
@@ -16,14 +16,20 @@
 Graph pass for memory planning.
 """
 
-import bisect
 import logging
 from collections import defaultdict
-from dataclasses import dataclass
-from typing import List
-
-from aitemplate.compiler.base import Operator, Tensor
-from aitemplate.utils.environ import multistream_max_mem_parallel_ops, multistream_mode
+from dataclasses import dataclass, replace
+from typing import Callable, Dict, List, Optional, Set, Tuple
+
+import sympy
+
+from aitemplate.compiler.base import IntImm, IntVar, Operator, Tensor
+from aitemplate.compiler.dtype import get_dtype_size
+from aitemplate.utils.environ import (
+    in_place_memory_reuse,
+    multistream_max_mem_parallel_ops,
+    multistream_mode,
+)
 from aitemplate.utils.graph_utils import split_simple_multistream_parallel_ops
 
 # pylint: disable=C0103
@@ -56,6 +62,11 @@ class TensorUsageRecord:
         return iter([self.tensor, self.first_op_idx, self.last_op_idx, self.size])
 
 
+def _max_tensor_size(tensor: Tensor) -> int:
+    """The size of a tensor with all of its dynamic dims at their upper bounds."""
+    return tensor.size_bytes(alignment=64)
+
+
 def _find_original_tensor(tensor: Tensor):
     """Find the original tensor of a tensor view recursively."""
     view = tensor._attrs["is_view_of"]
@@ -64,7 +75,12 @@ def _find_original_tensor(tensor: Tensor):
     return _find_original_tensor(view)
 
 
-def _make_tensor_usage_records(sorted_ops: List[Operator]) -> List[TensorUsageRecord]:
+def _make_tensor_usage_records(
+    sorted_ops: List[Operator],
+    size_fn: Optional[Callable[[Tensor], int]] = None,
+) -> List[TensorUsageRecord]:
+    if size_fn is None:
+        size_fn = _max_tensor_size
     num_of_ops = len(sorted_ops)
     tensor_records = defaultdict(
         lambda: TensorUsageRecord(
@@ -98,7 +114,7 @@ def _make_tensor_usage_records(sorted_ops: List[Operator]) -> List[TensorUsageRe
                 tensor_records[name].last_op_idx = num_of_ops - 1
 
             size = tensor_records[name].size
-            tensor_size = tensor.size_bytes(alignment=64)
+            tensor_size = size_fn(tensor)
             if size is None:
                 tensor_records[name].size = tensor_size
             else:
@@ -194,61 +210,205 @@ def _compute_workspace(sorted_graph: List[Tensor]) -> Workspace:
     return Workspace(max_workspace, unique_workspace_size)
 
 
-def _greedy_by_size_memory_planning(
-    sorted_graph: List[Tensor], tensor_usage_records: List[TensorUsageRecord]
-):
+class _LifetimeTree:
+    """
+    A segment tree over op indices that finds the placed tensors whose
+    lifetimes overlap a given one. A lifetime is kept in the O(log n) nodes
+    that its interval decomposes into (covering) and in all of their
+    ancestors (within), so that a query visits O(log n) nodes:
+    the covering lifetimes of every node that partially overlaps the query
+    interval, and the within lifetimes of every node inside it.
+    """
+
+    def __init__(self, num_ops: int):
+        self._size = 1
+        while self._size < num_ops:
+            self._size *= 2
+        self._covering = defaultdict(list)
+        self._within = defaultdict(list)
+
+    def insert(self, first_op_idx: int, last_op_idx: int, item: int) -> None:
+        self._insert(1, 0, self._size - 1, first_op_idx, last_op_idx, item)
+
+    def _insert(self, node, lo, hi, first_op_idx, last_op_idx, item) -> None:
+        self._within[node].append(item)
+        if first_op_idx <= lo and hi <= last_op_idx:
+            self._covering[node].append(item)
+            return
+        mid = (lo + hi) // 2
+        if first_op_idx <= mid:
+            self._insert(2 * node, lo, mid, first_op_idx, last_op_idx, item)
+        if last_op_idx > mid:
+            self._insert(2 * node + 1, mid + 1, hi, first_op_idx, last_op_idx, item)
+
+    def overlapping(self, first_op_idx: int, last_op_idx: int) -> Set[int]:
+        found = set()
+        self._query(1, 0, self._size - 1, first_op_idx, last_op_idx, found)
+        return found
+
+    def _query(self, node, lo, hi, first_op_idx, last_op_idx, found) -> None:
+        if first_op_idx <= lo and hi <= last_op_idx:
+            found.update(self._within.get(node, ()))
+            return
+        found.update(self._covering.get(node, ()))
+        mid = (lo + hi) // 2
+        if first_op_idx <= mid:
+            self._query(2 * node, lo, mid, first_op_idx, last_op_idx, found)
+        if last_op_idx > mid:
+            self._query(2 * node + 1, mid + 1, hi, first_op_idx, last_op_idx, found)
+
+
+def _assign_offsets_greedy_by_size(
+    tensor_usage_records: List[TensorUsageRecord],
+) -> Tuple[int, Dict[str, int]]:
     """
     based on the greedy-by-size algorithm for offset calculation described in
     the following paper:
         Yury Pisarchyk, Juhyun Lee,
         Efficient Memory Management for Deep Neural Net Inference,
         https://arxiv.org/abs/2001.03288
+
+    Returns the blob size and a map from tensor names to their blob offsets.
+    Tensor attributes are left untouched, so the same graph can be planned
+    several times with different tensor sizes.
+
+    The tensors that have been assigned are kept in a _LifetimeTree, so that
+    placing a tensor only looks at the k tensors whose lifetimes overlap
+    with it, sorted by offset. With n tensors, this takes
+    O(n log n + sum(k * (log n + log k))) time instead of the O(n^2) of
+    scanning all assigned tensors. That is O(n log n) only if k is bounded,
+    which is the common case: most intermediate tensors are short-lived.
+    Best fit needs the gaps between all the overlapping tensors, so k can't
+    be avoided without giving up the paper's placement; when all lifetimes
+    overlap (k ~ n), this is O(n^2 log n), though still faster in practice
+    than the quadratic scan.
     """
     # sort tensor usage records in non-increasing order by their sizes
     sorted_tensor_usage_records = sorted(
         tensor_usage_records, key=lambda r: r.size, reverse=True
     )
+    num_ops = 1 + max((r.last_op_idx for r in tensor_usage_records), default=0)
 
     max_blob = 0
-    # For tensors that have been assigned, we keep their tensor usage records
-    # in increasing order by memory offsets
-    sorted_assigned_records = []
+    offsets = {}
+    assigned_offsets = []
+    assigned_tree = _LifetimeTree(num_ops)
     for tensor_record in sorted_tensor_usage_records:
         tensor, first_op_idx, last_op_idx, size = tensor_record
         prev_offset = 0
         best_offset = None
         smallest_gap = pow(2, 63) - 1
-        # Iterate through tensors that have been allocated.
-        # For those whose usage intervals intersect with that of current
-        # tensor, we try to find the smallest valid memory gap between such two
-        # allocated tensors, which is big enough to hold current tensor.
+        # Iterate through the allocated tensors whose usage intervals intersect
+        # with that of current tensor, in increasing order by memory offsets.
+        # We try to find the smallest valid memory gap between two such
+        # tensors, which is big enough to hold current tensor.
         # If such a gap is found, we will place current tensor in the gap.
-        for a_record in sorted_assigned_records:
-            a_tensor, a_first_op_idx, a_last_op_idx, a_size = a_record
-            max_first_op_idx = max(first_op_idx, a_first_op_idx)
-            min_last_op_idx = min(last_op_idx, a_last_op_idx)
-            # current tensor overlaps with this assigned tensor
-            if max_first_op_idx <= min_last_op_idx:
-                a_offset = a_tensor._attrs["offset"]
-                gap = a_offset - prev_offset
-                if size <= gap < smallest_gap:
-                    smallest_gap = gap
-                    best_offset = prev_offset
-                prev_offset = max(prev_offset, a_offset + a_size)
+        overlapping = sorted(
+            assigned_tree.overlapping(first_op_idx, last_op_idx),
+            key=lambda idx: (assigned_offsets[idx][0], idx),
+        )
+        for idx in overlapping:
+            a_offset, a_size = assigned_offsets[idx]
+            gap = a_offset - prev_offset
+            if size <= gap < smallest_gap:
+                smallest_gap = gap
+                best_offset = prev_offset
+            prev_offset = max(prev_offset, a_offset + a_size)
         # If we can't find a valid memory gap between two allocated tensors,
         # we put current tensor to the rightmost tensor whose usage interval
         # intersects with that of the current tensor.
         if best_offset is None:
             best_offset = prev_offset
-        tensor._attrs["offset"] = best_offset
+        offsets[tensor._attrs["name"]] = best_offset
         max_blob = max(max_blob, best_offset + size)
 
-        # bisect from Python <=3.9 doesn't have the key parameter
-        sorted_offsets = [r.tensor._attrs["offset"] for r in sorted_assigned_records]
-        in_pos = bisect.bisect_right(
-            sorted_offsets, tensor_record.tensor._attrs["offset"]
+        assigned_tree.insert(first_op_idx, last_op_idx, len(assigned_offsets))
+        assigned_offsets.append((best_offset, size))
+
+    return (max_blob, offsets)
+
+
+def _merge_in_place_records(
+    ops_seq: List[List[Operator]], tensor_usage_records: List[TensorUsageRecord]
+) -> Tuple[List[TensorUsageRecord], Dict[str, str]]:
+    """
+    Let the outputs of ops that support in-place execution (see
+    Operator.in_place_pairs) reuse the memory of their inputs, if the op is
+    the last user of the input. The records of such tensors are merged into
+    one that spans both lifetimes.
+
+    ops_seq holds the ops of every op index, see
+    _make_tensor_usage_records_simple_multistream. Returns the merged
+    records, and the name of the tensor that each merged-away tensor shares
+    its memory with.
+    """
+    records = {
+        record.tensor._attrs["name"]: replace(record)
+        for record in tensor_usage_records
+    }
+    aliases = {}
+    if not in_place_memory_reuse():
+        return list(records.values()), aliases
+
+    def is_candidate(tensor: Tensor) -> bool:
+        # The memory of inputs and outputs is owned by the user.
+        return (
+            tensor._attrs["name"] in records or tensor._attrs["name"] in aliases
+        ) and not (
+            tensor._attrs["is_input"]
+            or tensor._attrs["is_output"]
+            or tensor._attrs["is_view_of"]
         )
-        sorted_assigned_records.insert(in_pos, tensor_record)
+
+    for op_idx, ops in enumerate(ops_seq):
+        for op in ops:
+            reused = set()
+            for input_idx, output_idx in op.in_place_pairs():
+                tensor = op._attrs["inputs"][input_idx]
+                output = op._attrs["outputs"][output_idx]
+                if tensor in reused or output in reused:
+                    continue
+                if not is_candidate(tensor) or not is_candidate(output):
+                    continue
+                # Any other user of the input would see the overwritten data.
+                if len(tensor.dst_ops()) != 1:
+                    continue
+                name = tensor._attrs["name"]
+                record = records[aliases.get(name, name)]
+                # Views of the input extend its lifetime beyond this op.
+                if record.last_op_idx != op_idx:
+                    continue
+                output_record = records.pop(output._attrs["name"])
+                record.last_op_idx = output_record.last_op_idx
+                record.size = max(record.size, output_record.size)
+                aliases[output._attrs["name"]] = aliases.get(name, name)
+                reused.update([tensor, output])
+    return list(records.values()), aliases
+
+
+def _assign_offsets(
+    ops_seq: List[List[Operator]], tensor_usage_records: List[TensorUsageRecord]
+) -> Tuple[int, Dict[str, int]]:
+    """
+    Greedy-by-size offsets, with in-place reuse. Returns the blob size and a
+    map from tensor names to their blob offsets.
+    """
+    records, aliases = _merge_in_place_records(ops_seq, tensor_usage_records)
+    max_blob, offsets = _assign_offsets_greedy_by_size(records)
+    for name, root_name in aliases.items():
+        offsets[name] = offsets[root_name]
+    return (max_blob, offsets)
+
+
+def _greedy_by_size_memory_planning(
+    sorted_graph: List[Tensor],
+    ops_seq: List[List[Operator]],
+    tensor_usage_records: List[TensorUsageRecord],
+):
+    max_blob, offsets = _assign_offsets(ops_seq, tensor_usage_records)
+    for tensor_record in tensor_usage_records:
+        tensor = tensor_record.tensor
+        tensor._attrs["offset"] = offsets[tensor._attrs["name"]]
 
     # now we assign blobs for weights and inputs
     constant_offset = 0
@@ -284,7 +444,9 @@ def greedy_by_size_memory_planning(sorted_graph: List[Tensor]):  # noqa: C901
         sorted_ops.extend(node.src_ops())
     tensor_usage_records = _make_tensor_usage_records(sorted_ops)
 
-    return _greedy_by_size_memory_planning(sorted_graph, tensor_usage_records)
+    return _greedy_by_size_memory_planning(
+        sorted_graph, [[op] for op in sorted_ops], tensor_usage_records
+    )
 
 
 def naive_memory_planning(sorted_graph: List[Tensor]):
@@ -313,6 +475,7 @@ def naive_memory_planning(sorted_graph: List[Tensor]):
 
 def _make_tensor_usage_records_simple_multistream(
     par_ops_seq: List[List[Operator]],
+    size_fn: Optional[Callable[[Tensor], int]] = None,
 ) -> List[TensorUsageRecord]:
     """
     Generalized version of _make_tensor_usage_records() which
@@ -334,6 +497,8 @@ def _make_tensor_usage_records_simple_multistream(
     This version is kept as a separate one, because multistreaming
     feature is still somewhat experimental.
     """
+    if size_fn is None:
+        size_fn = _max_tensor_size
 
     num_of_ops = len(par_ops_seq)
     tensor_records = defaultdict(
@@ -370,7 +535,7 @@ def _make_tensor_usage_records_simple_multistream(
                     tensor_records[name].last_op_idx = num_of_ops - 1
 
                 size = tensor_records[name].size
-                tensor_size = tensor.size_bytes(alignment=64)
+                tensor_size = size_fn(tensor)
                 if size is None:
                     tensor_records[name].size = tensor_size
                 else:
@@ -410,13 +575,9 @@ def _make_tensor_usage_records_simple_multistream(
     return list(records)
 
 
-def simple_multistream_memory_planning(sorted_graph: List[Tensor]):
-    """
-    A specialized case for simple multi-stream execution.
-    It uses more or slightly more GPU memory than greedy_by_size_memory_planner,
-    depending on the input graph, but still significantly less
-    than naive_memory_planning.
-    """
+def _simple_multistream_par_ops_seq(
+    sorted_graph: List[Tensor],
+) -> List[List[Operator]]:
     from aitemplate.utils.graph_utils import track_graph_timings
 
     # track the sequence
@@ -429,11 +590,81 @@ def simple_multistream_memory_planning(sorted_graph: List[Tensor]):
 
     # convert Dict[int, List[Operator]] into List[List[Operator]]
     max_parallel_ops = multistream_max_mem_parallel_ops()
-    par_ops_seq = split_simple_multistream_parallel_ops(ops_by_order, max_parallel_ops)
+    return split_simple_multistream_parallel_ops(ops_by_order, max_parallel_ops)
+
 
+def simple_multistream_memory_planning(sorted_graph: List[Tensor]):
+    """
+    A specialized case for simple multi-stream execution.
+    It uses more or slightly more GPU memory than greedy_by_size_memory_planner,
+    depending on the input graph, but still significantly less
+    than naive_memory_planning.
+    """
+    par_ops_seq = _simple_multistream_par_ops_seq(sorted_graph)
     tensor_usage_records = _make_tensor_usage_records_simple_multistream(par_ops_seq)
 
-    return _greedy_by_size_memory_planning(sorted_graph, tensor_usage_records)
+    return _greedy_by_size_memory_planning(
+        sorted_graph, par_ops_seq, tensor_usage_records
+    )
+
+
+def tensor_lifetimes(
+    sorted_graph: List[Tensor],
+) -> Tuple[List[TensorUsageRecord], List[str]]:
+    """
+    The usage records that memory planning used for the blob layout (at the
+    upper bounds of all dynamic dims), ordered by first_op_idx, together with
+    the name of each op index. In simple multistream mode, op indices refer
+    to steps of parallel ops, whose names are joined with ",".
+    A tensor that reuses the memory of an op's input in place has the
+    input's offset, and its lifetime starts where the input's ends.
+    """
+    if multistream_mode() == 1:
+        par_ops_seq = _simple_multistream_par_ops_seq(sorted_graph)
+        records = _make_tensor_usage_records_simple_multistream(par_ops_seq)
+        op_names = [
+            ",".join(op._attrs["name"] for op in par_ops) for par_ops in par_ops_seq
+        ]
+    else:
+        sorted_ops = []
+        for node in sorted_graph:
+            sorted_ops.extend(node.src_ops())
+        records = _make_tensor_usage_records(sorted_ops)
+        op_names = [op._attrs["name"] for op in sorted_ops]
+    records.sort(
+        key=lambda record: (record.first_op_idx, record.tensor._attrs["offset"])
+    )
+    return records, op_names
+
+
+def compare_memory_planning(sorted_graph: List[Tensor]) -> Dict[str, int]:
+    """
+    The blob sizes of the naive plan (no reuse), the greedy-by-size plan and
+    the greedy-by-size plan with in-place reuse of the graph. Tensor
+    attributes are left untouched. proxy_memory_planning logs them at
+    DEBUG level, since computing them plans the graph twice more.
+    """
+    if multistream_mode() == 1:
+        ops_seq = _simple_multistream_par_ops_seq(sorted_graph)
+        records = _make_tensor_usage_records_simple_multistream(ops_seq)
+    else:
+        sorted_ops = []
+        for node in sorted_graph:
+            sorted_ops.extend(node.src_ops())
+        ops_seq = [[op] for op in sorted_ops]
+        records = _make_tensor_usage_records(sorted_ops)
+    in_place_records, _ = _merge_in_place_records(ops_seq, records)
+    return {
+        "naive": sum(
+            _max_tensor_size(node)
+            for node in sorted_graph
+            if node._attrs["data"] is None
+            and node._attrs["constant_folding_output_idx"] is None
+            and not node._attrs["is_view_of"]
+        ),
+        "greedy_by_size": _assign_offsets_greedy_by_size(records)[0],
+        "greedy_by_size_in_place": _assign_offsets_greedy_by_size(in_place_records)[0],
+    }
 
 
 def proxy_memory_planning(sorted_graph: List[Tensor]):
@@ -457,11 +688,160 @@ def proxy_memory_planning(sorted_graph: List[Tensor]):
         f"Workspace shared_size={workspace.shared_size} unique_size={workspace.unique_size}"
     )
     _LOGGER.info(f"max_blob={max_blob} constant_offset={constant_offset}")
+    if _LOGGER.isEnabledFor(logging.DEBUG):
+        _LOGGER.debug(f"blob sizes: {compare_memory_planning(sorted_graph)}")
 
     # done
     return (max_blob, constant_offset, workspace)
 
 
+@dataclass
+class MemoryPlan:
+    """
+    A blob layout for a bucket of dynamic dim values, where
+
+    dim_bounds: the inclusive upper bounds of the bucketed input dims, keyed
+                by IntVar name. An empty dict means the plan fits any shape.
+
+    blob_size: the size of the blob required by this plan
+
+    offsets: the blob offsets of the planned (non-view) tensors, keyed by
+             tensor name
+    """
+
+    dim_bounds: Dict[str, int]
+    blob_size: int
+    offsets: Dict[str, int]
+
+
+def _is_monotonic_in(expr: sympy.Expr, symbols) -> bool:
+    """Whether expr is a polynomial in symbols with non-negative coefficients,
+    i.e. an expression that cannot shrink when any of the symbols grows."""
+    if not expr.is_polynomial(*symbols):
+        return False
+    return all(c >= 0 for c in sympy.Poly(expr, *symbols).coeffs())
+
+
+def _make_bucket_size_fn(
+    sorted_graph: List[Tensor], dim_bounds: Dict[str, int]
+) -> Callable[[Tensor], int]:
+    """
+    Returns a size function that evaluates tensor sizes under dim_bounds.
+    A dim that is derived from the bucketed dims through a monotonic
+    expression (e.g. batch_size * seq_len) is evaluated at the bucket bounds;
+    any other dynamic dim stays at its upper bound, which is always safe.
+    """
+    bounds = {}
+    for node in sorted_graph:
+        for dim in node._attrs["shape"]:
+            if isinstance(dim, IntImm) or dim._attrs["name"] not in dim_bounds:
+                continue
+            sym = dim.symbolic_value()
+            if isinstance(sym, sympy.Symbol):
+                bounds[sym] = min(dim_bounds[dim._attrs["name"]], dim.upper_bound())
+
+    def dim_value(dim: IntVar) -> int:
+        if isinstance(dim, IntImm):
+            return dim.value()
+        sym = dim.symbolic_value()
+        if not isinstance(sym, sympy.Expr) or not sym.free_symbols:
+            return dim.upper_bound()
+        if not sym.free_symbols <= set(bounds):
+            return dim.upper_bound()
+        if not _is_monotonic_in(sym, sym.free_symbols):
+            return dim.upper_bound()
+        value = sym.subs(bounds)
+        if not value.is_number:
+            return dim.upper_bound()
+        return min(int(value), dim.upper_bound())
+
+    def size_fn(tensor: Tensor) -> int:
+        size = 1
+        for dim in tensor._attrs["shape"]:
+            size *= dim_value(dim)
+        size *= get_dtype_size(tensor.dtype())
+        if size % 64 != 0:
+            size = (size // 64 + 1) * 64
+        return size
+
+    return size_fn
+
+
+def _validate_memory_plan_buckets(
+    sorted_graph: List[Tensor], buckets: List[Dict[str, int]]
+) -> None:
+    input_dims = {}
+    for node in sorted_graph:
+        if not node._attrs["is_input"]:
+            continue
+        for dim in node._attrs["shape"]:
+            if not isinstance(dim, IntImm):
+                input_dims[dim._attrs["name"]] = dim
+    for bucket in buckets:
+        if not bucket:
+            raise ValueError("Memory plan buckets must not be empty")
+        for name, bound in bucket.items():
+            if name not in input_dims:
+                raise ValueError(
+                    f"Memory plan bucket dim {name} is not a dynamic dim of "
+                    f"any model input. Dynamic input dims: {list(input_dims)}"
+                )
+            dim = input_dims[name]
+            if not dim.lower_bound() <= bound <= dim.upper_bound():
+                raise ValueError(
+                    f"Memory plan bucket bound {name}={bound} is outside of "
+                    f"[{dim.lower_bound()}, {dim.upper_bound()}]"
+                )
+
+
+def bucketed_memory_planning(
+    sorted_graph: List[Tensor], buckets: List[Dict[str, int]]
+) -> List[MemoryPlan]:
+    """
+    Make one blob layout per bucket of input dim values, so that runs with
+    small dynamic dims can use a smaller blob than the one planned for the
+    upper bounds. Must run after memory_planning, whose layout is kept as
+    the last plan and serves any shape that doesn't fit a bucket.
+
+    Plans are returned in increasing order of blob size. Buckets that don't
+    save any memory over the full plan are dropped.
+    """
+    _validate_memory_plan_buckets(sorted_graph, buckets)
+
+    sorted_ops = []
+    for node in sorted_graph:
+        sorted_ops.extend(node.src_ops())
+    full_offsets = {}
+    full_blob_size = 0
+    for tensor, _, _, size in _make_tensor_usage_records(sorted_ops):
+        full_offsets[tensor._attrs["name"]] = tensor._attrs["offset"]
+        full_blob_size = max(full_blob_size, tensor._attrs["offset"] + size)
+    full_plan = MemoryPlan({}, full_blob_size, full_offsets)
+
+    plans = []
+    for bucket in buckets:
+        size_fn = _make_bucket_size_fn(sorted_graph, bucket)
+        if multistream_mode() == 1:
+            ops_seq = _simple_multistream_par_ops_seq(sorted_graph)
+            records = _make_tensor_usage_records_simple_multistream(ops_seq, size_fn)
+        else:
+            ops_seq = [[op] for op in sorted_ops]
+            records = _make_tensor_usage_records(sorted_ops, size_fn)
+        blob_size, offsets = _assign_offsets(ops_seq, records)
+        if blob_size >= full_plan.blob_size:
+            _LOGGER.info(f"memory plan bucket {bucket} doesn't reduce the blob size")
+            continue
+        plans.append(MemoryPlan(dict(bucket), blob_size, offsets))
+
+    plans.sort(key=lambda plan: plan.blob_size)
+    plans.append(full_plan)
+    for plan in plans:
+        _LOGGER.info(
+            f"memory plan {plan.dim_bounds or 'full'}: blob_size={plan.blob_size}"
+        )
+    return plans
+
+
 # memory_planning = greedy_by_size_memory_planning
 # memory_planning = naive_memory_planning
 memory_planning = proxy_memory_planning
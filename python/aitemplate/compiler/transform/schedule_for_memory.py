@@ -0,0 +1,279 @@
+#  Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+"""
+Graph pass to reorder independent ops so that fewer tensors are live at the
+same time, see schedule_for_memory.
+"""
+
+import heapq
+import logging
+import time
+from typing import Dict, List, Set, Tuple
+
+from aitemplate.compiler.base import IntImm, Operator, Tensor
+from aitemplate.compiler.transform.memory_planning import (
+    _assign_offsets,
+    _find_original_tensor,
+    _make_tensor_usage_records,
+    _max_tensor_size,
+)
+
+# pylint: disable=C0103
+
+
+_LOGGER = logging.getLogger(__name__)
+
+# The number of candidates and the number of steps of the greedy rollouts
+# that are compared to pick each op, while within the time budget.
+_LOOKAHEAD_WIDTH = 4
+_LOOKAHEAD_DEPTH = 8
+
+
+class _OpGraph:
+    """
+    The ops of a sorted graph, with the tensors that each op allocates and
+    uses, and the ops that it depends on. Views share the memory of the
+    tensors they view, and extend their lifetimes, like in memory planning.
+    """
+
+    def __init__(self, sorted_graph: List[Tensor]):
+        self.ops: List[Operator] = []
+        op_indices: Dict[Operator, int] = {}
+        for node in sorted_graph:
+            for op in node.src_ops():
+                if op not in op_indices:
+                    op_indices[op] = len(self.ops)
+                    self.ops.append(op)
+
+        num_ops = len(self.ops)
+        self.sizes: Dict[Tensor, int] = {}
+        self.is_output: Set[Tensor] = set()
+        self.num_users: Dict[Tensor, int] = {}
+        self.used: List[List[Tensor]] = [[] for _ in range(num_ops)]
+        self.deps: List[Set[int]] = [set() for _ in range(num_ops)]
+        dim_producers = {}
+        for op_idx, op in enumerate(self.ops):
+            input_dims = set()
+            for tensor in op._attrs["inputs"]:
+                input_dims.update(self._dim_names(tensor))
+                for src_op in tensor.src_ops():
+                    if src_op in op_indices:
+                        self.deps[op_idx].add(op_indices[src_op])
+            # Dynamic dims that first appear in the outputs of an op are
+            # computed at runtime by that op, e.g. the -1 of a reshape.
+            for tensor in op._attrs["outputs"]:
+                for name in self._dim_names(tensor) - input_dims:
+                    dim_producers.setdefault(name, op_idx)
+            for tensor in op._attrs["inputs"] + op._attrs["outputs"]:
+                for name in self._dim_names(tensor):
+                    producer = dim_producers.get(name, op_idx)
+                    if producer != op_idx:
+                        self.deps[op_idx].add(producer)
+                # Weights and inputs are not planned, see memory_planning.
+                if tensor._attrs["is_param"]:
+                    continue
+                orig_tensor = _find_original_tensor(tensor)
+                if orig_tensor._attrs["is_param"]:
+                    continue
+                if orig_tensor not in self.sizes:
+                    self.sizes[orig_tensor] = _max_tensor_size(orig_tensor)
+                    self.num_users[orig_tensor] = 0
+                if orig_tensor not in self.used[op_idx]:
+                    self.used[op_idx].append(orig_tensor)
+                    self.num_users[orig_tensor] += 1
+                if tensor._attrs["is_output"]:
+                    self.is_output.add(orig_tensor)
+            self.deps[op_idx].discard(op_idx)
+
+        self.succs: List[List[int]] = [[] for _ in range(num_ops)]
+        for op_idx, deps in enumerate(self.deps):
+            for dep in deps:
+                self.succs[dep].append(op_idx)
+
+    @staticmethod
+    def _dim_names(tensor: Tensor) -> Set[str]:
+        return {
+            dim._attrs["name"]
+            for dim in tensor._attrs["shape"]
+            if not isinstance(dim, IntImm) and dim._attrs["name"] is not None
+        }
+
+
+class _ScheduleState:
+    """
+    The live tensors and the ready ops of a partial schedule. Only the live
+    tensors and the ops with some of their deps scheduled are stored, so
+    that the state is cheap to copy for lookahead.
+    """
+
+    def __init__(self, graph: _OpGraph):
+        self.graph = graph
+        self.users_left: Dict[Tensor, int] = {}
+        self.deps_left: Dict[int, int] = {}
+        self.ready: List[int] = [
+            op_idx for op_idx, deps in enumerate(graph.deps) if not deps
+        ]
+        self.live = 0
+
+    def copy(self) -> "_ScheduleState":
+        state = _ScheduleState.__new__(_ScheduleState)
+        state.graph = self.graph
+        state.users_left = dict(self.users_left)
+        state.deps_left = dict(self.deps_left)
+        state.ready = list(self.ready)
+        state.live = self.live
+        return state
+
+    def cost(self, op_idx: int) -> Tuple[int, int, int]:
+        """
+        The net change of live bytes of running op_idx next, the live bytes
+        while it runs, and op_idx itself to keep the original order on ties.
+        """
+        graph = self.graph
+        allocated = 0
+        freed = 0
+        for tensor in graph.used[op_idx]:
+            users_left = self.users_left.get(tensor)
+            if users_left is None:
+                allocated += graph.sizes[tensor]
+                users_left = graph.num_users[tensor]
+            if users_left == 1 and tensor not in graph.is_output:
+                freed += graph.sizes[tensor]
+        return (allocated - freed, self.live + allocated, op_idx)
+
+    def run(self, op_idx: int) -> int:
+        """Schedules op_idx, returns the live bytes while it runs."""
+        graph = self.graph
+        for tensor in graph.used[op_idx]:
+            if tensor not in self.users_left:
+                self.users_left[tensor] = graph.num_users[tensor]
+                self.live += graph.sizes[tensor]
+        peak = self.live
+        for tensor in graph.used[op_idx]:
+            self.users_left[tensor] -= 1
+            if self.users_left[tensor] == 0 and tensor not in graph.is_output:
+                del self.users_left[tensor]
+                self.live -= graph.sizes[tensor]
+        self.ready.remove(op_idx)
+        for succ in graph.succs[op_idx]:
+            deps_left = self.deps_left.pop(succ, len(graph.deps[succ])) - 1
+            if deps_left == 0:
+                self.ready.append(succ)
+            else:
+                self.deps_left[succ] = deps_left
+        return peak
+
+    def rollout_peak(self, depth: int) -> int:
+        """The peak live bytes of the next depth greedy steps."""
+        peak = 0
+        for _ in range(depth):
+            if not self.ready:
+                break
+            peak = max(peak, self.run(min(self.ready, key=self.cost)))
+        return peak
+
+
+def _schedule(graph: _OpGraph, deadline: float) -> List[int]:
+    state = _ScheduleState(graph)
+    order = []
+    while state.ready:
+        if len(state.ready) > 1 and time.time() < deadline:
+            best_score = None
+            for op_idx in heapq.nsmallest(
+                _LOOKAHEAD_WIDTH, state.ready, key=state.cost
+            ):
+                lookahead = state.copy()
+                peak = lookahead.run(op_idx)
+                peak = max(peak, lookahead.rollout_peak(_LOOKAHEAD_DEPTH))
+                score = (peak, state.cost(op_idx))
+                if best_score is None or score < best_score:
+                    best, best_score = op_idx, score
+        else:
+            best = min(state.ready, key=state.cost)
+        state.run(best)
+        order.append(best)
+    return order
+
+
+def _sorted_ops(sorted_graph: List[Tensor]) -> List[Operator]:
+    sorted_ops = []
+    for node in sorted_graph:
+        sorted_ops.extend(node.src_ops())
+    return sorted_ops
+
+
+def _blob_size(sorted_graph: List[Tensor]) -> int:
+    sorted_ops = _sorted_ops(sorted_graph)
+    records = _make_tensor_usage_records(sorted_ops)
+    return _assign_offsets([[op] for op in sorted_ops], records)[0]
+
+
+def _reorder_graph(
+    sorted_graph: List[Tensor], graph: _OpGraph, order: List[int]
+) -> List[Tensor]:
+    """
+    Reorder the tensors of the graph by order. Ops run in the order of the
+    first of their outputs in the graph, and a tensor with several src_ops
+    (e.g. a concat that its inputs' ops write into) runs them all, so it
+    goes after the last of them.
+    """
+    nodes = set(sorted_graph)
+    new_graph = [node for node in sorted_graph if not node.src_ops()]
+    added = set(new_graph)
+    producers_left = {}
+    for op_idx in order:
+        for tensor in graph.ops[op_idx]._attrs["outputs"]:
+            if tensor not in nodes or tensor in added:
+                continue
+            left = producers_left.get(tensor, len(tensor.src_ops())) - 1
+            producers_left[tensor] = left
+            if left == 0:
+                new_graph.append(tensor)
+                added.add(tensor)
+    return new_graph
+
+
+def schedule_for_memory(sorted_graph: List[Tensor], time_budget: float) -> List[Tensor]:
+    """
+    Reorder independent ops to reduce the blob size of memory planning.
+    Ops are picked greedily by the bytes that they allocate minus the bytes
+    that they free. While within time_budget seconds, the best few
+    candidates are compared by the peak live bytes of a short greedy
+    rollout after them. The new order is only kept if memory planning then
+    needs a smaller blob.
+
+    Must run right before memory planning, in single stream mode. The
+    relative order of the tensors without src_ops (inputs, constants) is
+    kept.
+    """
+    start = time.time()
+    graph = _OpGraph(sorted_graph)
+    if len(graph.ops) < 3:
+        return sorted_graph
+    order = _schedule(graph, start + time_budget)
+    new_graph = _reorder_graph(sorted_graph, graph, order)
+    if len(new_graph) != len(sorted_graph):
+        _LOGGER.warning("schedule_for_memory couldn't order all ops")
+        return sorted_graph
+
+    old_blob_size = _blob_size(sorted_graph)
+    new_blob_size = _blob_size(new_graph)
+    _LOGGER.info(
+        f"schedule_for_memory: blob size {old_blob_size} -> {new_blob_size}, "
+        f"elapsed time: {time.time() - start:.2f}s"
+    )
+    if new_blob_size >= old_blob_size:
+        return sorted_graph
+    return new_graph
@@ -0,0 +1,228 @@
+#  Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+"""
+Graph pass to make static-shape copies of a graph for hot values of its
+dynamic input dims, see specialize_shapes.
+"""
+
+import copy
+import itertools
+import logging
+from dataclasses import dataclass
+from typing import Any, Dict, Iterator, List
+
+import sympy
+
+from aitemplate.compiler.base import IntImm, IntVar, JaggedIntVar, Operator, Tensor
+from aitemplate.compiler.stable_set import StableSet
+from aitemplate.compiler.tensor_accessor import TensorAccessor
+
+# pylint: disable=C0103
+
+
+_LOGGER = logging.getLogger(__name__)
+
+
+@dataclass
+class ShapeSpecialization:
+    """
+    A static-shape copy of a graph for one combination of hot dim values, where
+
+    dim_values: the values of the specialized input dims, keyed by IntVar name
+
+    derived_dims: the values of the other dims that are determined by
+                  dim_values (e.g. batch_size * seq_len), keyed by IntVar name
+
+    sorted_graph: the copy of the graph, in which all of these dims are
+                  IntImms with the names of the IntVars they replace
+
+    suffix: appended to the names of the functions that differ from the
+            ones of the dynamic graph
+    """
+
+    dim_values: Dict[str, int]
+    derived_dims: Dict[str, int]
+    sorted_graph: List[Tensor]
+    suffix: str
+
+
+def _iter_dims(value: Any) -> Iterator[IntVar]:
+    """The IntVars in an attribute value of a tensor or op."""
+    if isinstance(value, IntVar):
+        yield value
+    elif isinstance(value, (list, tuple)):
+        for item in value:
+            yield from _iter_dims(item)
+    elif isinstance(value, dict):
+        for item in value.values():
+            yield from _iter_dims(item)
+    elif isinstance(value, TensorAccessor):
+        yield from _iter_dims(value.original_shapes)
+        yield from _iter_dims(value.actual_shapes)
+
+
+def _graph_dims(sorted_graph: List[Tensor]) -> List[IntVar]:
+    dims = {}
+    for node in sorted_graph:
+        for dim in _iter_dims(node._attrs):
+            dims[id(dim)] = dim
+        for func in node.src_ops():
+            for dim in _iter_dims(func._attrs):
+                dims[id(dim)] = dim
+    return list(dims.values())
+
+
+def _iter_nodes(value: Any) -> Iterator[Any]:
+    """The tensors and ops in an attribute value of a tensor or op."""
+    if isinstance(value, (Tensor, Operator)):
+        yield value
+    elif isinstance(value, (list, tuple, StableSet)):
+        for item in value:
+            yield from _iter_nodes(item)
+    elif isinstance(value, dict):
+        for item in value.values():
+            yield from _iter_nodes(item)
+
+
+def _copy_graph(sorted_graph: List[Tensor], memo: Dict[int, Any]) -> List[Tensor]:
+    """
+    Deep copy of the graph with memo. Tensor and Operator.__deepcopy__ call
+    the constructors, which add the ops to the dst_ops of the original
+    tensors, so all tensors and ops get an empty copy before their _attrs
+    are copied.
+    """
+    nodes = []
+    stack = list(sorted_graph)
+    while stack:
+        node = stack.pop()
+        if id(node) in memo:
+            continue
+        memo[id(node)] = type(node).__new__(type(node))
+        nodes.append(node)
+        stack.extend(_iter_nodes(node._attrs))
+    for node in nodes:
+        # The other members are templates and settings of the op.
+        memo[id(node)].__dict__.update(node.__dict__)
+        memo[id(node)]._attrs = copy.deepcopy(node._attrs, memo)
+    return [memo[id(node)] for node in sorted_graph]
+
+
+def _validate_hot_dim_values(
+    sorted_graph: List[Tensor], hot_dim_values: Dict[str, List[int]]
+) -> Dict[str, IntVar]:
+    input_dims = {}
+    for node in sorted_graph:
+        if not node._attrs["is_input"]:
+            continue
+        for dim in node._attrs["shape"]:
+            if not isinstance(dim, (IntImm, JaggedIntVar)):
+                input_dims[dim._attrs["name"]] = dim
+    for name, values in hot_dim_values.items():
+        if name not in input_dims:
+            raise ValueError(
+                f"Shape specialization dim {name} is not a dynamic dim of any "
+                f"model input. Dynamic input dims: {list(input_dims)}"
+            )
+        if not values:
+            raise ValueError(f"Shape specialization dim {name} has no values")
+        dim = input_dims[name]
+        for value in values:
+            if not dim.lower_bound() <= value <= dim.upper_bound():
+                raise ValueError(
+                    f"Shape specialization value {name}={value} is outside of "
+                    f"[{dim.lower_bound()}, {dim.upper_bound()}]"
+                )
+        if not isinstance(dim.symbolic_value(), sympy.Symbol):
+            raise ValueError(f"Shape specialization dim {name} is not a symbol")
+    return {name: input_dims[name] for name in hot_dim_values}
+
+
+def _specialize(
+    sorted_graph: List[Tensor],
+    graph_dims: List[IntVar],
+    dim_values: Dict[str, int],
+    input_dims: Dict[str, IntVar],
+    suffix: str,
+) -> ShapeSpecialization:
+    symbols = {
+        input_dims[name].symbolic_value(): value for name, value in dim_values.items()
+    }
+    # The copy replaces every reference to a specialized IntVar with its IntImm.
+    memo = {}
+    derived_dims = {}
+    for dim in graph_dims:
+        if isinstance(dim, (IntImm, JaggedIntVar)) or dim._attrs["name"] is None:
+            continue
+        sym = dim.symbolic_value()
+        if not isinstance(sym, sympy.Expr) or not sym.free_symbols:
+            continue
+        if not sym.free_symbols <= set(symbols):
+            continue
+        value = sym.subs(symbols)
+        if not value.is_integer:
+            continue
+        name = dim._attrs["name"]
+        memo[id(dim)] = IntImm(int(value), name=name)
+        if name not in dim_values:
+            derived_dims[name] = int(value)
+    # Share the attributes that don't depend on shapes instead of copying them.
+    for node in sorted_graph:
+        data = node._attrs.get("data")
+        if data is not None:
+            memo[id(data)] = data
+        for func in node.src_ops():
+            op_instance = func._attrs.get("op_instance")
+            if op_instance is not None:
+                memo[id(op_instance)] = op_instance
+    return ShapeSpecialization(
+        dim_values=dim_values,
+        derived_dims=derived_dims,
+        sorted_graph=_copy_graph(sorted_graph, memo),
+        suffix=suffix,
+    )
+
+
+def specialize_shapes(
+    sorted_graph: List[Tensor], hot_dim_values: Dict[str, List[int]]
+) -> List[ShapeSpecialization]:
+    """
+    Make a static-shape copy of the graph for every combination of the hot
+    values of its dynamic input dims, e.g. {"batch_size": [1, 8, 32]}. Dims
+    that are determined by the hot dims become IntImms as well, so that the
+    backends can fold strides and drop shape checks. The copies keep the
+    names and memory offsets of the graph's tensors; their ops must be
+    profiled again to pick kernels for the static shapes.
+
+    Must run after memory planning, right before codegen.
+    """
+    input_dims = _validate_hot_dim_values(sorted_graph, hot_dim_values)
+    graph_dims = _graph_dims(sorted_graph)
+    names = list(hot_dim_values)
+    specializations = []
+    for values in itertools.product(
+        *(sorted(set(hot_dim_values[name])) for name in names)
+    ):
+        dim_values = dict(zip(names, values))
+        suffix = "spec_" + "_".join(
+            f"{name}_{value}" for name, value in dim_values.items()
+        )
+        specializations.append(
+            _specialize(sorted_graph, graph_dims, dim_values, input_dims, suffix)
+        )
+        _LOGGER.info(
+            f"specialized shapes for {dim_values}, derived dims: "
+            f"{specializations[-1].derived_dims}"
+        )
+    return specializations
@@ -0,0 +1,48 @@
+#  Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+"""
+Runs C++ tests of the runtime code that doesn't touch the device (e.g.
+static/include/caching_allocator.h with a fake device) on the host.
+"""
+
+import os
+import shutil
+import subprocess
+import tempfile
+import unittest
+
+from aitemplate.backend.target import AIT_STATIC_FILES_PATH
+
+
+def run_host_cpp_test(test_case: unittest.TestCase, src: str) -> None:
+    """
+    Build src, a C++ program that includes headers from static/include, with
+    the host compiler ($CXX, g++ or clang++) and run it. test_case fails if
+    the program exits with a non-zero status, and is skipped if there is no
+    host compiler.
+    """
+    cxx = os.environ.get("CXX") or shutil.which("g++") or shutil.which("clang++")
+    if cxx is None:
+        test_case.skipTest("no host C++ compiler found")
+    include = os.path.join(AIT_STATIC_FILES_PATH, "include")
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        exe = os.path.join(tmp_dir, os.path.splitext(os.path.basename(src))[0])
+        subprocess.run(
+            [cxx, "-std=c++17", "-Wall", "-Werror", f"-I{include}", str(src)]
+            + ["-o", exe],
+            check=True,
+        )
+        result = subprocess.run([exe], capture_output=True, text=True)
+        test_case.assertEqual(result.returncode, 0, result.stderr)
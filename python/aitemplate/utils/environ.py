@@ -86,6 +86,37 @@ def force_profiler_cache() -> bool:
     return force_cache
 
 
+def profile_cache_uri() -> Optional[str]:
+    """
+    When set, the profile cache mirrors the remote store at this uri
+    (e.g. file:///mnt/ait_cache or http://cache-server/ait_cache), so that
+    machines of the same GPU share their profiling results.
+    See aitemplate.backend.profiler_cache_remote
+    """
+    return os.environ.get("AIT_PROFILE_CACHE_URI", None) or None
+
+
+def profile_cache_nearest_distance() -> float:
+    """
+    When positive, a gemm workload without an exact profile cache entry
+    takes the best kernel of the cached workloads of the same gemm whose
+    dimensions all are within this distance, in log2 of their ratio (e.g.
+    "1" means within 2x), instead of being profiled. Such workloads are
+    marked as approximate in the cache until they are profiled.
+    Default value is "0" (exact matches only).
+    """
+    return float(os.getenv("AIT_PROFILE_CACHE_NEAREST_DISTANCE", "0"))
+
+
+def profile_cache_nearest_confident_only() -> bool:
+    """
+    Only use the nearest-shape results of the profile cache that all
+    cached workloads within the distance agree on.
+    Default value is "0".
+    """
+    return os.getenv("AIT_PROFILE_CACHE_NEAREST_CONFIDENT_ONLY", "0") == "1"
+
+
 def time_compilation() -> bool:
     """
     When enabled, time each make command at compilation time.
@@ -117,6 +148,21 @@ def ait_build_cache_dir() -> Optional[str]:
     return os.environ.get("AIT_BUILD_CACHE_DIR", None)
 
 
+def ait_object_cache_dir() -> Optional[str]:
+    """
+    When set to a non-empty string, cache the object files of single
+    translation units below this directory, shared by all models. Only the
+    sources that changed are then recompiled.
+
+    See aitemplate.backend.build_cache_base.ObjectCache
+
+    Returns:
+        Optional[str]: Value of AIT_OBJECT_CACHE_DIR environment variable,
+        or None if not set.
+    """
+    return os.environ.get("AIT_OBJECT_CACHE_DIR", None)
+
+
 def ait_build_cache_skip_percentage() -> int:
     """
     When set to a non-empty string, and if AIT_BUILD_CACHE_DIR
@@ -174,6 +220,28 @@ def force_cutlass_sm90_kernels() -> bool:
     return os.getenv("AIT_FORCE_CUTLASS_SM90_KERNELS", "0") == "1"
 
 
+def in_place_memory_reuse() -> bool:
+    """
+    Whether memory planning lets the outputs of ops that support in-place
+    execution (e.g. fused_elementwise) reuse the memory of the inputs they
+    are the last user of. Defaults to True.
+
+    See aitemplate.compiler.transform.memory_planning
+    """
+    return os.getenv("AIT_IN_PLACE_MEMORY_REUSE", "1") == "1"
+
+
+def memory_schedule_time_budget() -> float:
+    """
+    The time budget in seconds of reordering the ops of a model to reduce
+    its blob size, before memory planning. 0 (the default) keeps the
+    topological order. Ignored in multistream mode.
+
+    See aitemplate.compiler.transform.schedule_for_memory
+    """
+    return float(os.getenv("AIT_MEMORY_SCHEDULE_TIME_BUDGET", "0"))
+
+
 def multistream_mode() -> int:
     """
     Multi-stream mode. 0 - no multistream. 1 - simple multistream.
@@ -233,6 +301,40 @@ def multistream_max_mem_parallel_ops() -> int:
     return int(os.getenv("AIT_MULTISTREAM_MAX_MEM_PARALLEL_OPS", "99999999"))
 
 
+def share_kernel_instances() -> bool:
+    """
+    Whether to compile each unique CUTLASS gemm instance once, in its own
+    translation unit shared by all ops that use it, instead of once per op
+    source. Defaults to True.
+
+    See aitemplate.backend.kernel_instances
+    """
+    return os.getenv("AIT_SHARE_KERNEL_INSTANCES", "1") == "1"
+
+
+def task_timings_dir() -> Optional[str]:
+    """
+    When set, the task runners (builds and profilers) export the start
+    time, device and duration of each task of every run to a Chrome trace
+    JSON file in this directory, e.g. for critical-path analysis.
+
+    See aitemplate.backend.task_runner
+    """
+    return os.environ.get("AIT_TASK_TIMINGS_DIR", None) or None
+
+
+def unity_build() -> bool:
+    """
+    Whether to compile the generated CUTLASS sources that share their
+    includes together, in unity translation units sized by the compile
+    times measured in earlier builds. Only supported by the make builder.
+    Defaults to False.
+
+    See aitemplate.backend.unity_build
+    """
+    return os.getenv("AIT_UNITY_BUILD", "0") == "1"
+
+
 def is_cmake_compilation() -> bool:
     """
     When enabled, compiles the model via invoking CMake rather than
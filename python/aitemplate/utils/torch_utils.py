@@ -22,6 +22,7 @@ The functions in this file may assume that
 """
 
 import struct
+from typing import Optional
 
 import torch
 
@@ -66,7 +67,14 @@ def string_to_torch_dtype(string_dtype):
     )
 
 
-def write_tensor_binary(tensor: "torch.Tensor", file_handle) -> None:
+def write_tensor_binary(
+    tensor: "torch.Tensor", file_handle, alignment: Optional[int] = None
+) -> None:
+    """
+    Write tensor metadata and raw data for the standalone runner. If
+    alignment is set, the raw data is preceded by zero padding up to a file
+    offset that is a multiple of alignment (testcase format version 2).
+    """
     tensor = tensor.detach().cpu().contiguous()
     endianness = "@"  # system endianness
     dtype_str = normalize_dtype(torch_dtype_to_string(tensor.dtype))
@@ -81,6 +89,8 @@ def write_tensor_binary(tensor: "torch.Tensor", file_handle) -> None:
         file_handle.write(struct.pack(endianness + "N", dim))  # size_t
         total_size *= dim
     file_handle.write(struct.pack(endianness + "N", total_size))  # size_t
+    if alignment is not None:
+        file_handle.write(b"\0" * (-file_handle.tell() % alignment))
     bytedata = tensor.numpy().tobytes()
     # just as a safety check
     if len(bytedata) != total_size:
@@ -0,0 +1,243 @@
+//  Copyright (c) Meta Platforms, Inc. and affiliates.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+#include "async_runner.h"
+
+#include "device_functions-generated.h"
+#include "logging.h"
+#include "model_container.h"
+
+#include <chrono>
+#include <utility>
+
+namespace ait {
+
+namespace {
+// How often the completion thread polls the events of runs in flight.
+constexpr auto kCompletionPollInterval = std::chrono::microseconds(50);
+} // namespace
+
+bool AsyncRunState::IsDone() {
+  std::lock_guard lk(mutex_);
+  return done_;
+}
+
+AITemplateError AsyncRunState::Wait() {
+  std::unique_lock lk(mutex_);
+  cv_.wait(lk, [this]() { return done_; });
+  return status_;
+}
+
+AITemplateError AsyncRunState::Status() {
+  std::lock_guard lk(mutex_);
+  return status_;
+}
+
+void AsyncRunState::Complete(AITemplateError status) {
+  {
+    std::lock_guard lk(mutex_);
+    status_ = status;
+    done_ = true;
+  }
+  cv_.notify_all();
+}
+
+AsyncRunner::AsyncRunner(ModelContainer& container) : container_(container) {
+  dispatch_thread_ = std::thread([this]() { DispatchLoop(); });
+  completion_thread_ = std::thread([this]() { CompletionLoop(); });
+}
+
+AsyncRunner::~AsyncRunner() {
+  {
+    std::lock_guard lk(mutex_);
+    stop_ = true;
+  }
+  dispatch_cv_.notify_all();
+  completion_cv_.notify_all();
+  dispatch_thread_.join();
+  completion_thread_.join();
+}
+
+std::shared_ptr<AsyncRunState> AsyncRunner::Enqueue(
+    const AITData* inputs,
+    size_t num_inputs,
+    AITData* outputs,
+    size_t num_outputs,
+    StreamType stream,
+    bool graph_mode,
+    int64_t** output_shapes_out,
+    AITemplateRunCallback callback,
+    void* user_data) {
+  auto request = std::make_unique<Request>();
+  // The caller's arrays only have to live until RunAsync returns, so copy
+  // them (and the shapes they point to).
+  request->input_shapes.reserve(num_inputs);
+  for (size_t i = 0; i < num_inputs; ++i) {
+    const auto& shape = inputs[i].shape;
+    request->input_shapes.emplace_back(
+        shape.shape_data, shape.shape_data + shape.size);
+    request->inputs.emplace_back(
+        inputs[i].ptr,
+        AITemplateParamShape(
+            request->input_shapes.back().data(), shape.size),
+        inputs[i].dtype);
+  }
+  request->output_shapes.reserve(num_outputs);
+  for (size_t i = 0; i < num_outputs; ++i) {
+    const auto& shape = outputs[i].shape;
+    request->output_shapes.emplace_back(
+        shape.shape_data, shape.shape_data + shape.size);
+    request->outputs.emplace_back(
+        outputs[i].ptr,
+        AITemplateParamShape(
+            request->output_shapes.back().data(), shape.size),
+        outputs[i].dtype);
+  }
+  request->stream = stream;
+  request->graph_mode = graph_mode;
+  request->output_shapes_out = output_shapes_out;
+  request->callback = callback;
+  request->user_data = user_data;
+  request->state = std::make_shared<AsyncRunState>();
+  auto state = request->state;
+
+  {
+    std::lock_guard lk(mutex_);
+    if (stop_) {
+      throw std::runtime_error("AsyncRunner is shutting down");
+    }
+    dispatch_queue_.push_back(std::move(request));
+  }
+  dispatch_cv_.notify_one();
+  return state;
+}
+
+void AsyncRunner::DispatchLoop() {
+  while (true) {
+    std::unique_ptr<Request> request;
+    {
+      std::unique_lock lk(mutex_);
+      dispatch_cv_.wait(
+          lk, [this]() { return stop_ || !dispatch_queue_.empty(); });
+      if (dispatch_queue_.empty()) {
+        dispatch_done_ = true;
+        break;
+      }
+      request = std::move(dispatch_queue_.front());
+      dispatch_queue_.pop_front();
+    }
+
+    try {
+      // This blocks (on this thread only) if all runtimes are busy.
+      container_.Run(
+          request->inputs.data(),
+          request->inputs.size(),
+          request->outputs.data(),
+          request->outputs.size(),
+          request->stream,
+          /*sync=*/false,
+          request->graph_mode,
+          request->output_shapes_out);
+      request->finished = RAII_CreateEvent();
+      DEVICE_CHECK(EventRecord(request->finished.get(), request->stream));
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "Async run failed: " << e.what();
+      request->dispatch_status = AITemplateError::AITemplateFailure;
+    } catch (...) {
+      LOG(ERROR) << "Async run failed with an unknown exception.";
+      request->dispatch_status = AITemplateError::AITemplateFailure;
+    }
+
+    {
+      std::lock_guard lk(mutex_);
+      completion_queue_.push_back(std::move(request));
+    }
+    completion_cv_.notify_one();
+  }
+  completion_cv_.notify_all();
+}
+
+void AsyncRunner::CompletionLoop() {
+  // Dispatched runs that haven't been finished yet. Runs on different
+  // streams may finish in any order, so their events are polled rather than
+  // waited for one after the other.
+  std::vector<std::unique_ptr<Request>> in_flight;
+  std::vector<std::pair<std::unique_ptr<Request>, AITemplateError>> finished;
+  while (true) {
+    {
+      std::unique_lock lk(mutex_);
+      if (in_flight.empty()) {
+        completion_cv_.wait(lk, [this]() {
+          return dispatch_done_ || !completion_queue_.empty();
+        });
+        if (completion_queue_.empty()) {
+          break;
+        }
+      } else {
+        // New requests wake us up early; finished runs are only polled.
+        completion_cv_.wait_for(lk, kCompletionPollInterval, [this]() {
+          return !completion_queue_.empty();
+        });
+      }
+      while (!completion_queue_.empty()) {
+        in_flight.push_back(std::move(completion_queue_.front()));
+        completion_queue_.pop_front();
+      }
+    }
+
+    bool any_ran = false;
+    for (auto it = in_flight.begin(); it != in_flight.end();) {
+      auto status = (*it)->dispatch_status;
+      // If the dispatch failed, Run() has already put the runtime back into
+      // the pool.
+      if (status == AITemplateError::AITemplateSuccess) {
+        auto query = QueryEvent((*it)->finished.get());
+        if (query == GetDeviceNotReady()) {
+          ++it;
+          continue;
+        }
+        if (query != GetDeviceSuccess()) {
+          LOG(ERROR) << "Async run failed on device: "
+                     << GetErrorString(query);
+          status = AITemplateError::AITemplateFailure;
+        }
+        any_ran = true;
+      }
+      finished.emplace_back(std::move(*it), status);
+      it = in_flight.erase(it);
+    }
+    if (any_ran) {
+      // The runtimes' own run_finished_ events were recorded before ours on
+      // the same streams, so they can be handed back to the pool right away.
+      container_.ReclaimFinishedRuntimes();
+    }
+    for (auto& [request, status] : finished) {
+      Finish(*request, status);
+    }
+    finished.clear();
+  }
+}
+
+void AsyncRunner::Finish(Request& request, AITemplateError status) {
+  if (request.callback != nullptr) {
+    try {
+      request.callback(request.user_data, status);
+    } catch (...) {
+      LOG(ERROR) << "Async run callback threw an exception; ignoring it.";
+    }
+  }
+  request.state->Complete(status);
+}
+
+} // namespace ait
@@ -0,0 +1,375 @@
+//  Copyright (c) Meta Platforms, Inc. and affiliates.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+#include "dynamic_batcher.h"
+
+#include "device_functions-generated.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <limits>
+#include <string>
+
+namespace {
+// Split a shape at batch_dim into (number of outer slices, bytes per row).
+// A tensor's rows for a contiguous range of the batch dim form `outer`
+// strided chunks of rows * row_bytes bytes.
+std::pair<size_t, size_t> OuterAndRowBytes(
+    const int64_t* shape,
+    size_t rank,
+    size_t batch_dim,
+    AITemplateDtype dtype) {
+  size_t outer = 1;
+  for (size_t i = 0; i < batch_dim; ++i) {
+    outer *= shape[i];
+  }
+  size_t row_bytes = AITemplateDtypeSizeBytes(dtype);
+  for (size_t i = batch_dim + 1; i < rank; ++i) {
+    row_bytes *= shape[i];
+  }
+  return {outer, row_bytes};
+}
+} // namespace
+
+namespace ait {
+
+DynamicBatcher::DynamicBatcher(
+    ModelContainer& container,
+    const AITemplateDynamicBatcherOptions& options)
+    : container_(container),
+      options_(options),
+      num_inputs_(container.NumInputs()),
+      num_outputs_(container.NumOutputs()) {
+  if (num_inputs_ == 0) {
+    throw std::runtime_error("Cannot batch a model without inputs");
+  }
+  int64_t max_rows = std::numeric_limits<int64_t>::max();
+  for (size_t i = 0; i < num_inputs_; ++i) {
+    const auto shape = container_.MaxInputShape(i);
+    if (options_.batch_dim >= shape.size) {
+      throw std::runtime_error(
+          "batch_dim " + std::to_string(options_.batch_dim) +
+          " is out of range for input " + container_.InputName(i));
+    }
+    max_rows = std::min(max_rows, shape.shape_data[options_.batch_dim]);
+    batched_input_bytes_.push_back(
+        shape.Numel() * AITemplateDtypeSizeBytes(container_.InputDtype(i)));
+  }
+  for (size_t i = 0; i < num_outputs_; ++i) {
+    const auto shape = container_.MaxOutputShape(i);
+    if (options_.batch_dim >= shape.size) {
+      throw std::runtime_error(
+          "batch_dim " + std::to_string(options_.batch_dim) +
+          " is out of range for output " + container_.OutputName(i));
+    }
+    batched_output_bytes_.push_back(container_.MaxOutputStorageBytes(i));
+  }
+  max_batch_size_ = options_.max_batch_size == 0
+      ? max_rows
+      : std::min<int64_t>(options_.max_batch_size, max_rows);
+
+  // More workers than runtimes would only wait for a free runtime in Run().
+  const size_t num_workers = std::max<size_t>(
+      1, container_.GetRuntimePoolPolicy().max_runtimes);
+  for (size_t i = 0; i < num_workers; ++i) {
+    auto worker = std::make_unique<Worker>();
+    worker->stream = RAII_StreamCreate(/*non_blocking=*/true);
+    workers_.push_back(std::move(worker));
+  }
+  for (auto& worker : workers_) {
+    Worker* w = worker.get();
+    w->thread = std::thread([this, w]() { WorkerLoop(*w); });
+  }
+}
+
+DynamicBatcher::~DynamicBatcher() {
+  {
+    std::lock_guard lk(queue_mutex_);
+    stop_ = true;
+  }
+  queue_cv_.notify_all();
+  for (auto& worker : workers_) {
+    worker->thread.join();
+  }
+}
+
+void DynamicBatcher::Run(
+    const AITData* inputs,
+    size_t num_inputs,
+    AITData* outputs,
+    size_t num_outputs,
+    int64_t** output_shapes_out) {
+  if (num_inputs != num_inputs_ || num_outputs != num_outputs_) {
+    throw std::runtime_error(
+        "DynamicBatcher::Run expected " + std::to_string(num_inputs_) +
+        " inputs and " + std::to_string(num_outputs_) + " outputs, got " +
+        std::to_string(num_inputs) + " and " + std::to_string(num_outputs));
+  }
+
+  Request request;
+  request.inputs = inputs;
+  request.outputs = outputs;
+  request.output_shapes_out = output_shapes_out;
+  request.rows = -1;
+  for (size_t i = 0; i < num_inputs_; ++i) {
+    const auto& shape = inputs[i].shape;
+    if (options_.batch_dim >= shape.size) {
+      throw std::runtime_error(
+          "Input " + std::to_string(i) + " has no batch dimension " +
+          std::to_string(options_.batch_dim));
+    }
+    const int64_t rows = shape.shape_data[options_.batch_dim];
+    if (request.rows != -1 && rows != request.rows) {
+      throw std::runtime_error(
+          "All inputs must have the same batch size, got " +
+          std::to_string(request.rows) + " and " + std::to_string(rows));
+    }
+    request.rows = rows;
+    request.signature.push_back(static_cast<int64_t>(inputs[i].dtype));
+    for (size_t j = 0; j < shape.size; ++j) {
+      request.signature.push_back(
+          j == options_.batch_dim ? 0 : shape.shape_data[j]);
+    }
+  }
+  request.enqueue_time = std::chrono::steady_clock::now();
+  auto done = request.done.get_future();
+
+  {
+    std::lock_guard lk(queue_mutex_);
+    if (stop_) {
+      throw std::runtime_error("DynamicBatcher is shutting down");
+    }
+    queue_.push_back(&request);
+  }
+  queue_cv_.notify_all();
+  // Rethrows the batch's exception, if any.
+  done.get();
+}
+
+int64_t DynamicBatcher::CompatibleQueuedRows(const Request& front) const {
+  int64_t rows = 0;
+  for (const auto* request : queue_) {
+    if (request->signature == front.signature) {
+      rows += request->rows;
+    }
+  }
+  return rows;
+}
+
+std::vector<DynamicBatcher::Request*> DynamicBatcher::TakeBatch() {
+  std::vector<Request*> batch{queue_.front()};
+  queue_.pop_front();
+  int64_t rows = batch.front()->rows;
+  // Take compatible requests in FIFO order while they fit. Requests that
+  // don't fit or have different shapes keep their place in the queue.
+  for (auto it = queue_.begin();
+       it != queue_.end() && rows < max_batch_size_;) {
+    auto* request = *it;
+    if (request->signature == batch.front()->signature &&
+        rows + request->rows <= max_batch_size_) {
+      rows += request->rows;
+      batch.push_back(request);
+      it = queue_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return batch;
+}
+
+void DynamicBatcher::WorkerLoop(Worker& worker) {
+  const auto max_delay = std::chrono::microseconds(options_.max_delay_us);
+  while (true) {
+    std::unique_lock lk(queue_mutex_);
+    queue_cv_.wait(lk, [this]() { return stop_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      // stop_ is set and all requests have been served.
+      return;
+    }
+    // Other workers wait for the same front request; whoever wakes up first
+    // takes it, the others start over with the new front.
+    const auto* front = queue_.front();
+    const auto deadline = front->enqueue_time + max_delay;
+    queue_cv_.wait_until(lk, deadline, [this, front]() {
+      return stop_ || queue_.empty() || queue_.front() != front ||
+          CompatibleQueuedRows(*front) >= max_batch_size_;
+    });
+    if (queue_.empty() || queue_.front() != front) {
+      continue;
+    }
+    auto batch = TakeBatch();
+    lk.unlock();
+    // The next front request's deadline may already have passed, or the
+    // remaining requests may fill a batch on their own.
+    queue_cv_.notify_all();
+    RunBatch(worker, batch);
+  }
+}
+
+void DynamicBatcher::RunBatch(
+    Worker& worker,
+    const std::vector<Request*>& batch) {
+  try {
+    RunBatchImpl(worker, batch);
+  } catch (...) {
+    for (auto* request : batch) {
+      request->done.set_exception(std::current_exception());
+    }
+    return;
+  }
+  for (auto* request : batch) {
+    request->done.set_value();
+  }
+}
+
+void DynamicBatcher::RunBatchImpl(
+    Worker& worker,
+    const std::vector<Request*>& batch) {
+  StreamType stream = worker.stream.get();
+  if (batch.size() == 1) {
+    // Nothing to merge (this includes requests larger than max_batch_size),
+    // so run directly on the caller's buffers.
+    auto* request = batch.front();
+    container_.Run(
+        request->inputs,
+        num_inputs_,
+        request->outputs,
+        num_outputs_,
+        stream,
+        /*sync=*/true,
+        options_.graph_mode,
+        request->output_shapes_out);
+    return;
+  }
+
+  int64_t total_rows = 0;
+  for (auto* request : batch) {
+    total_rows += request->rows;
+  }
+
+  if (worker.batched_inputs.empty()) {
+    std::vector<GPUPtr> batched_inputs;
+    std::vector<GPUPtr> batched_outputs;
+    for (size_t bytes : batched_input_bytes_) {
+      batched_inputs.push_back(
+          RAII_DeviceMalloc(bytes, container_.GetAllocator()));
+    }
+    for (size_t bytes : batched_output_bytes_) {
+      batched_outputs.push_back(
+          RAII_DeviceMalloc(bytes, container_.GetAllocator()));
+    }
+    worker.batched_inputs = std::move(batched_inputs);
+    worker.batched_outputs = std::move(batched_outputs);
+  }
+  auto& batched_inputs = worker.batched_inputs;
+  auto& batched_outputs = worker.batched_outputs;
+
+  // Gather: concatenate every request's inputs along the batch dim.
+  std::vector<std::vector<int64_t>> input_shapes(num_inputs_);
+  std::vector<AITData> inputs(num_inputs_);
+  for (size_t i = 0; i < num_inputs_; ++i) {
+    const auto& first = batch.front()->inputs[i];
+    input_shapes[i].assign(
+        first.shape.shape_data, first.shape.shape_data + first.shape.size);
+    input_shapes[i][options_.batch_dim] = total_rows;
+    auto [outer, row_bytes] = OuterAndRowBytes(
+        input_shapes[i].data(),
+        input_shapes[i].size(),
+        options_.batch_dim,
+        first.dtype);
+    auto* dst = static_cast<uint8_t*>(batched_inputs[i].get());
+    const size_t dst_pitch = total_rows * row_bytes;
+    size_t dst_offset = 0;
+    for (auto* request : batch) {
+      const size_t width = request->rows * row_bytes;
+      if (width > 0 && outer > 0) {
+        DEVICE_CHECK(DeviceToDeviceCopy2D(
+            dst + dst_offset,
+            dst_pitch,
+            request->inputs[i].ptr,
+            width,
+            width,
+            outer,
+            stream));
+      }
+      dst_offset += width;
+    }
+    inputs[i] = AITData(
+        batched_inputs[i].get(),
+        AITemplateParamShape(input_shapes[i].data(), input_shapes[i].size()),
+        first.dtype);
+  }
+
+  std::vector<std::vector<int64_t>> output_shapes(num_outputs_);
+  std::vector<int64_t*> output_shape_ptrs(num_outputs_);
+  std::vector<AITData> outputs(num_outputs_);
+  for (size_t i = 0; i < num_outputs_; ++i) {
+    const auto max_shape = container_.MaxOutputShape(i);
+    output_shapes[i].resize(max_shape.size);
+    output_shape_ptrs[i] = output_shapes[i].data();
+    outputs[i] = AITData(
+        batched_outputs[i].get(), max_shape, container_.OutputDtype(i));
+  }
+
+  container_.Run(
+      inputs.data(),
+      num_inputs_,
+      outputs.data(),
+      num_outputs_,
+      stream,
+      /*sync=*/false,
+      options_.graph_mode,
+      output_shape_ptrs.data());
+
+  // Scatter: copy each request's rows of every output back to the caller.
+  for (size_t i = 0; i < num_outputs_; ++i) {
+    auto& shape = output_shapes[i];
+    if (shape[options_.batch_dim] != total_rows) {
+      throw std::runtime_error(
+          std::string("Output ") + container_.OutputName(i) + " has " +
+          std::to_string(shape[options_.batch_dim]) +
+          " rows along the batch dim, expected " +
+          std::to_string(total_rows) + "; it can't be split between requests");
+    }
+    auto [outer, row_bytes] = OuterAndRowBytes(
+        shape.data(), shape.size(), options_.batch_dim, outputs[i].dtype);
+    const auto* src = static_cast<const uint8_t*>(batched_outputs[i].get());
+    const size_t src_pitch = total_rows * row_bytes;
+    size_t src_offset = 0;
+    for (auto* request : batch) {
+      const size_t width = request->rows * row_bytes;
+      if (width > 0 && outer > 0) {
+        DEVICE_CHECK(DeviceToDeviceCopy2D(
+            request->outputs[i].ptr,
+            width,
+            src + src_offset,
+            src_pitch,
+            width,
+            outer,
+            stream));
+      }
+      src_offset += width;
+      if (request->output_shapes_out != nullptr &&
+          request->output_shapes_out[i] != nullptr) {
+        for (size_t j = 0; j < shape.size(); ++j) {
+          request->output_shapes_out[i][j] =
+              j == options_.batch_dim ? request->rows : shape[j];
+        }
+      }
+    }
+  }
+  DEVICE_CHECK(StreamSynchronize(stream));
+}
+
+} // namespace ait
@@ -17,7 +17,26 @@
 #include "device_functions-generated.h"
 #include "raii_wrapper.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
 namespace {
+// Layout of SaveFoldedConstants() files: the header, then an (offset, size)
+// pair per constant folding output, then the outputs back to back.
+struct FoldedConstantsHeader {
+  char magic[8];
+  uint64_t version;
+  uint64_t model_fingerprint;
+  uint64_t inputs_key;
+  uint64_t constants_size;
+  uint64_t num_outputs;
+};
+constexpr char kFoldedConstantsMagic[8] = "AITFOLD";
+constexpr uint64_t kFoldedConstantsVersion = 1;
+
 std::string GetEnumString(AITemplateDtype dtype) {
   switch (dtype) {
     case AITemplateDtype::kUnset:
@@ -56,6 +75,7 @@ ModelContainer::ModelContainer(
           params_size,
           allocator),
       allocator_(allocator),
+      pool_policy_{num_models, num_models, 0, 0},
       num_inputs_(num_inputs),
       num_outputs_(num_outputs) {
   if (num_models == 0) {
@@ -84,15 +104,31 @@ ModelContainer::ModelContainer(
       << (useDebugLogging ? PrintDebugDeviceProperties(prop)
                           : PrintInfoDeviceProperties(prop));
 
+  if (auto var = std::getenv("AIT_OP_TRACE_SAMPLE_EVERY")) {
+    SetOpTraceSampling(
+        std::strtoull(var, nullptr, 10), /*max_records=*/size_t(1) << 16);
+  }
+
   LOG(INFO) << "Init AITemplate Runtime with " << num_models << " concurrency";
   models_.reserve(num_models);
   available_models_.reserve(num_models);
 
+  // The primary buffer holds the bound constants from the *.so; the
+  // secondary one is allocated lazily and holds nothing yet.
+  bound_constant_generations_[0].assign(bound_constant_offsets_.size(), 0);
+  bound_constant_generations_[1].assign(
+      bound_constant_offsets_.size(), kStaleGeneration);
+
+  // Only one model is created up front (the others are created on demand,
+  // see GetAvailableModel()), so that startup time and memory don't scale
+  // with num_models.
   auto* constants_ptr = static_cast<uint8_t*>(constants_primary_.get());
-  for (size_t i = 0; i < num_models; ++i) {
-    models_.push_back(Model::Create(allocator, constants_ptr));
-    available_models_.push_back(models_.back().get());
-  }
+  models_.push_back(Model::Create(allocator, constants_ptr));
+  available_models_.push_back(models_.back().get());
+  model_last_used_[models_.back().get()] = std::chrono::steady_clock::now();
+  // Models start out with the smallest memory plan's blob, but the budget
+  // must hold them once they have seen the largest inputs.
+  model_footprint_bytes_ = models_.front()->MaxMemoryFootprintBytes();
 
   constant_folder_ = ConstantFolder::Create(allocator, constants_ptr);
 
@@ -101,6 +137,20 @@ ModelContainer::ModelContainer(
   for (auto offset : constant_folding_outputs_offsets_) {
     constant_folder_->SetOutput(constants_ptr + offset, constant_idx++);
   }
+
+  if (auto var = std::getenv("AIT_PREWARM_RUNTIMES")) {
+    if (std::strtoull(var, nullptr, 10) != 0) {
+      PrewarmRuntimes(/*wait=*/false);
+    }
+  }
+}
+
+ModelContainer::~ModelContainer() {
+  stop_prewarm_ = true;
+  std::lock_guard lk(prewarm_mutex_);
+  if (prewarm_.valid()) {
+    prewarm_.wait();
+  }
 }
 
 void ModelContainer::Run(
@@ -112,6 +162,7 @@ void ModelContainer::Run(
     bool sync,
     bool graph_mode,
     int64_t** output_shapes_out) {
+  const auto run_start = std::chrono::steady_clock::now();
   std::shared_lock constants_lk(constants_sync_mutex_);
   if (!constant_folded_once_) {
     // We don't require users to manually call FoldConstants the first time.
@@ -121,20 +172,33 @@ void ModelContainer::Run(
     std::unique_lock constants_unique_lk(constants_sync_mutex_);
     // Check again, another thread may have updated after we unlocked.
     if (!constant_folded_once_) {
-      FoldConstantsImpl(stream);
+      FoldConstantsForFirstRun(stream);
     }
     constants_unique_lk.unlock();
     constants_lk.lock();
   }
+  const auto queue_start = std::chrono::steady_clock::now();
+  constants_wait_us_.Record(MicrosecondsSince(run_start));
   auto* model = GetAvailableModel();
+  const auto launch_start = std::chrono::steady_clock::now();
+  queue_wait_us_.Record(MicrosecondsSince(queue_start));
   try {
     PrepareForRun(model, inputs, num_inputs, outputs, num_outputs);
+    const size_t sample_every =
+        op_trace_sample_every_.load(std::memory_order_relaxed);
+    model->SetTraceNextRun(
+        sample_every != 0 &&
+        op_trace_num_runs_.fetch_add(1, std::memory_order_relaxed) %
+                sample_every ==
+            0);
     model->Run(stream, graph_mode);
   } catch (...) {
+    ++num_failed_runs_;
     std::lock_guard lk(models_mutex_);
     available_models_.push_back(model);
     throw;
   }
+  launch_us_.Record(MicrosecondsSince(launch_start));
 
   if (output_shapes_out) {
     for (size_t i = 0; i < num_outputs; ++i) {
@@ -151,6 +215,38 @@ void ModelContainer::Run(
   if (sync) {
     StreamSynchronize(stream);
   }
+  ++num_runs_;
+  run_us_.Record(MicrosecondsSince(run_start));
+}
+
+std::shared_ptr<AsyncRunState> ModelContainer::RunAsync(
+    const AITData* inputs,
+    size_t num_inputs,
+    AITData* outputs,
+    size_t num_outputs,
+    StreamType stream,
+    bool graph_mode,
+    int64_t** output_shapes_out,
+    AITemplateRunCallback callback,
+    void* user_data) {
+  AsyncRunner* runner;
+  {
+    std::lock_guard lk(async_runner_mutex_);
+    if (!async_runner_) {
+      async_runner_ = std::make_unique<AsyncRunner>(*this);
+    }
+    runner = async_runner_.get();
+  }
+  return runner->Enqueue(
+      inputs,
+      num_inputs,
+      outputs,
+      num_outputs,
+      stream,
+      graph_mode,
+      output_shapes_out,
+      callback,
+      user_data);
 }
 
 void ModelContainer::Profile(
@@ -161,6 +257,8 @@ void ModelContainer::Profile(
     StreamType stream,
     size_t num_iters,
     const char* filename) {
+  // GetAvailableModel() may reclaim and release runtimes.
+  std::shared_lock constants_lk(constants_sync_mutex_);
   auto* model = GetAvailableModel();
   if (filename == nullptr) {
     throw;
@@ -189,37 +287,114 @@ void ModelContainer::RunWithOutputsOnHost(
     StreamType stream,
     bool graph_mode,
     int64_t** output_shapes_out) {
-  std::vector<std::pair<GPUPtr, size_t>> owned_outputs_ptrs;
-  std::vector<AITData> owned_outputs;
-  owned_outputs_ptrs.reserve(num_outputs);
-  owned_outputs.reserve(num_outputs);
+  if (num_outputs != num_outputs_) {
+    throw std::runtime_error(
+        "Expected " + std::to_string(num_outputs_) + " outputs, got " +
+        std::to_string(num_outputs));
+  }
+  // Hands the staging buffers back for reuse however this returns. If it
+  // throws, work writing into them may still be queued on the stream, so
+  // wait for it first (ignoring errors, one is already being thrown).
+  struct StagingGuard {
+    ModelContainer& container;
+    std::unique_ptr<HostOutputStaging> staging;
+    StreamType stream;
+    bool synced = false;
+    ~StagingGuard() {
+      if (!synced) {
+        StreamSynchronize(stream);
+      }
+      container.ReleaseHostOutputStaging(std::move(staging));
+    }
+  } staging_guard{*this, AcquireHostOutputStaging(), stream};
+  auto* staging = staging_guard.staging.get();
+
+  std::vector<AITData> device_outputs;
+  device_outputs.reserve(num_outputs);
   for (size_t i = 0; i < num_outputs; ++i) {
-    size_t num_bytes = MaxOutputStorageBytes(i);
-    owned_outputs_ptrs.emplace_back(
-        RAII_DeviceMalloc(num_bytes, allocator_), num_bytes);
-    owned_outputs.emplace_back(
-        owned_outputs_ptrs.back().first.get(),
-        outputs[i].shape,
-        outputs[i].dtype);
+    device_outputs.emplace_back(
+        staging->device_outputs[i].get(), outputs[i].shape, outputs[i].dtype);
   }
 
+  // Run() hands the runtime back as soon as the work is queued, so another
+  // request can start computing while this one's outputs are copied out.
   Run(inputs,
       num_inputs,
-      owned_outputs.data(),
+      device_outputs.data(),
       num_outputs,
       stream,
       /*sync=*/false,
       graph_mode,
-      output_shapes_out);
+      staging->shape_ptrs.data());
 
+  // Only copy the bytes that were actually produced, into pinned memory so
+  // that the copies are truly asynchronous.
+  std::vector<size_t> num_bytes(num_outputs);
   for (size_t i = 0; i < num_outputs; ++i) {
-    auto& owned_output = owned_outputs_ptrs[i];
-    auto& ptr = owned_output.first;
-    auto num_bytes = owned_output.second;
-    DEVICE_CHECK(CopyToHost(outputs[i].ptr, ptr.get(), num_bytes, stream));
+    const auto& shape = staging->shapes[i];
+    num_bytes[i] = AITemplateParamShape(shape.data(), shape.size()).Numel() *
+        AITemplateDtypeSizeBytes(outputs[i].dtype);
+    if (num_bytes[i] > 0) {
+      DEVICE_CHECK(CopyToHost(
+          staging->host_outputs[i].get(),
+          staging->device_outputs[i].get(),
+          num_bytes[i],
+          stream));
+    }
   }
-
   DEVICE_CHECK(StreamSynchronize(stream));
+  staging_guard.synced = true;
+
+  for (size_t i = 0; i < num_outputs; ++i) {
+    std::memcpy(outputs[i].ptr, staging->host_outputs[i].get(), num_bytes[i]);
+    if (output_shapes_out != nullptr && output_shapes_out[i] != nullptr) {
+      std::copy(
+          staging->shapes[i].begin(),
+          staging->shapes[i].end(),
+          output_shapes_out[i]);
+    }
+  }
+}
+
+std::unique_ptr<ModelContainer::HostOutputStaging>
+ModelContainer::AcquireHostOutputStaging() {
+  {
+    std::lock_guard lk(host_output_staging_mutex_);
+    if (!free_host_output_staging_.empty()) {
+      auto staging = std::move(free_host_output_staging_.back());
+      free_host_output_staging_.pop_back();
+      return staging;
+    }
+  }
+  auto staging = std::make_unique<HostOutputStaging>();
+  for (size_t i = 0; i < num_outputs_; ++i) {
+    const size_t num_bytes = MaxOutputStorageBytes(i);
+    staging->device_outputs.push_back(RAII_DeviceMalloc(num_bytes, allocator_));
+    staging->host_outputs.push_back(RAII_PinnedHostMalloc(num_bytes));
+    staging->shapes.emplace_back(MaxOutputShape(i).size);
+  }
+  for (auto& shape : staging->shapes) {
+    staging->shape_ptrs.push_back(shape.data());
+  }
+  // Only counted once all allocations succeeded.
+  ++num_host_output_staging_;
+  return staging;
+}
+
+void ModelContainer::ReleaseHostOutputStaging(
+    std::unique_ptr<HostOutputStaging> staging) {
+  std::lock_guard lk(host_output_staging_mutex_);
+  free_host_output_staging_.push_back(std::move(staging));
+}
+
+void ModelContainer::FreeIdleHostOutputStaging() {
+  std::vector<std::unique_ptr<HostOutputStaging>> idle;
+  {
+    std::lock_guard lk(host_output_staging_mutex_);
+    idle.swap(free_host_output_staging_);
+    num_host_output_staging_ -= idle.size();
+  }
+  // The buffers are freed outside of the lock.
 }
 
 float ModelContainer::Benchmark(
@@ -243,7 +418,7 @@ float ModelContainer::Benchmark(
     std::unique_lock constants_unique_lk(constants_sync_mutex_);
     // Check again, another thread may have updated after we unlocked.
     if (!constant_folded_once_) {
-      FoldConstantsImpl(stream);
+      FoldConstantsForFirstRun(stream);
     }
     constants_unique_lk.unlock();
     constants_lk.lock();
@@ -363,11 +538,8 @@ float ModelContainer::Benchmark(
   return max_time / total_num_iters;
 }
 
-void ModelContainer::SetConstantImpl(
-    const char* name,
-    const AITData& tensor,
-    bool double_buffer,
-    StreamType stream) {
+void ModelContainer::ValidateConstant(const char* name, const AITData& tensor)
+    const {
   auto unbound_it = unbound_constant_name_to_idx_.find(name);
   auto bound_it = bound_constant_name_to_idx_.find(name);
   if (unbound_it != unbound_constant_name_to_idx_.end()) {
@@ -407,6 +579,16 @@ void ModelContainer::SetConstantImpl(
         std::string("Called SetConstant on ") + name +
         std::string(" but can't find in either bound or unbound constant set"));
   }
+}
+
+void ModelContainer::SetConstantImpl(
+    const char* name,
+    const AITData& tensor,
+    bool double_buffer,
+    StreamType stream) {
+  ValidateConstant(name, tensor);
+  auto unbound_it = unbound_constant_name_to_idx_.find(name);
+  auto bound_it = bound_constant_name_to_idx_.find(name);
 
   auto* src = tensor.ptr;
   bool is_constant_folder_ =
@@ -414,12 +596,21 @@ void ModelContainer::SetConstantImpl(
       constant_folding_optional_inputs_.find(name) !=
           constant_folding_optional_inputs_.end();
 
+  if (is_constant_folder_) {
+    std::lock_guard lk(runtime_constant_folding_inputs_mutex_);
+    runtime_constant_folding_inputs_.insert(name);
+  }
+
   if (!double_buffer) {
     // If we don't use double_buffer, we can just SetConstant.
     if (!is_constant_folder_) {
+      // constants_sync_mutex_ keeps runs off the models, models_mutex_
+      // guards model_constant_values_ against SwapConstants().
+      std::lock_guard models_lk(models_mutex_);
       for (auto& model : models_) {
         model->SetConstant(name, src);
       }
+      model_constant_values_[name] = src;
     } else {
       constant_folder_->SetConstant(name, src);
     }
@@ -443,6 +634,8 @@ void ModelContainer::SetConstantImpl(
           src,
           bound_constant_size_[idx],
           stream));
+      bound_constant_generations_[1 - ActiveConstantsBufferIdx()][idx] =
+          ++constants_generation_;
     }
   }
 
@@ -482,6 +675,7 @@ void ModelContainer::SetManyConstants(
 
 void ModelContainer::SwapConstantFolderBuffer() {
   uint8_t* constants_ptr = GetInactiveConstantsBuffer();
+  constant_folder_buffer_idx_ = 1 - ActiveConstantsBufferIdx();
   constant_folder_->ResetConstants(constants_ptr);
   size_t constant_idx = 0;
   for (auto offset : constant_folding_outputs_offsets_) {
@@ -602,8 +796,9 @@ void ModelContainer::WaitForAllModels(bool include_constant_folder) {
       LOG(WARNING)
           << "Model threw unknown exception when waiting for inference to finish. Ignoring and continuing constant foldng.";
     }
-    available_models_.push_back(model);
+    MakeModelAvailable(model);
   }
+  pending_models_.clear();
 
   if (include_constant_folder) {
     try {
@@ -616,6 +811,7 @@ void ModelContainer::WaitForAllModels(bool include_constant_folder) {
 }
 
 void ModelContainer::FoldConstantsImpl(StreamType stream, bool double_buffer) {
+  const auto start = std::chrono::steady_clock::now();
   if (constant_folded_once_) {
     // We do not set the buffer state if this is the initial constant folding.
     buffer_state_ = BufferState::CONSTANTS_FOLDED;
@@ -637,10 +833,16 @@ void ModelContainer::FoldConstantsImpl(StreamType stream, bool double_buffer) {
   if (double_buffer) {
     std::lock_guard constants_unique_lk(constants_double_buffer_mutex_);
     constant_folder_->Run(stream, /*graph_mode=*/false);
+    folded_constants_generations_[constant_folder_buffer_idx_] =
+        ++constants_generation_;
   } else {
     constant_folder_->Run(stream, /*graph_mode=*/false);
+    std::lock_guard constants_unique_lk(constants_double_buffer_mutex_);
+    folded_constants_generations_[constant_folder_buffer_idx_] =
+        ++constants_generation_;
   }
   constant_folded_once_ = true;
+  constant_folding_us_.Record(MicrosecondsSince(start));
 }
 
 void ModelContainer::FoldConstants(
@@ -663,21 +865,395 @@ void ModelContainer::SwapConstants() {
     LOG(WARNING) << "Called SwapConstants without calling FoldConstants().";
     return;
   }
+  const auto start = std::chrono::steady_clock::now();
   std::unique_lock constants_unique_lk(constants_double_buffer_mutex_);
+  // Runs may concurrently grow or shrink the runtime pool.
+  std::lock_guard models_lk(models_mutex_);
   uint8_t* constants_ptr = GetInactiveConstantsBuffer();
   use_constants_primary_buffer_ = !use_constants_primary_buffer_;
 
   for (auto& model : models_) {
     model->ResetConstants(constants_ptr);
   }
+  // ResetConstants re-points all bound constants into the new buffer, so
+  // any bound constant overrides are gone now.
+  for (auto it = model_constant_values_.begin();
+       it != model_constant_values_.end();) {
+    if (bound_constant_name_to_idx_.count(it->first)) {
+      it = model_constant_values_.erase(it);
+    } else {
+      ++it;
+    }
+  }
   for (auto& [name, src] : model_constants_) {
     for (auto& model : models_) {
       model->SetConstant(name.c_str(), src);
     }
+    model_constant_values_[name] = src;
   }
 
   model_constants_.clear();
   buffer_state_ = BufferState::CLEAN;
+  ++constants_version_;
+  constant_swap_us_.Record(MicrosecondsSince(start));
+}
+
+void ModelContainer::UpdateConstantsDelta(
+    const char** names,
+    const AITData* tensors,
+    size_t num_tensors) {
+  if (num_tensors > 0 && (names == nullptr || tensors == nullptr)) {
+    throw std::runtime_error("Constant names and tensors cannot be null");
+  }
+  // Validate up front, so that errors are reported to the caller. The
+  // names and shapes are copied since they only have to live until we
+  // return.
+  auto delta = std::make_unique<ConstantsDelta>();
+  delta->shapes.reserve(num_tensors);
+  for (size_t i = 0; i < num_tensors; ++i) {
+    if (names[i] == nullptr) {
+      throw std::runtime_error("Constant name cannot be null");
+    }
+    ValidateConstant(names[i], tensors[i]);
+    const auto& shape = tensors[i].shape;
+    delta->names.emplace_back(names[i]);
+    delta->shapes.emplace_back(shape.shape_data, shape.shape_data + shape.size);
+    delta->tensors.emplace_back(
+        tensors[i].ptr,
+        AITemplateParamShape(delta->shapes.back().data(), shape.size),
+        tensors[i].dtype);
+  }
+
+  std::lock_guard lk(constants_update_mutex_);
+  if (pending_constants_update_.valid()) {
+    pending_constants_update_.get();
+  }
+  if (constants_update_stream_ == nullptr) {
+    constants_update_stream_ = RAII_StreamCreate(/*non_blocking=*/true);
+  }
+  pending_constants_update_ = std::async(
+      std::launch::async,
+      [this, delta = std::move(delta)]() { UpdateConstantsDeltaImpl(*delta); });
+}
+
+void ModelContainer::UpdateConstantsDeltaImpl(const ConstantsDelta& delta) {
+  auto stream = constants_update_stream_.get();
+  {
+    // Checked under the lock, so that a concurrent first Run() doesn't fold
+    // as well.
+    std::lock_guard constants_lk(constants_sync_mutex_);
+    if (!constant_folded_once_) {
+      // Fold the active buffer first, so that it can be carried over.
+      FoldConstantsImpl(stream);
+    }
+  }
+
+  bool refold = false;
+  size_t num_carried_over = 0;
+  {
+    std::lock_guard lk(constants_double_buffer_mutex_);
+    const size_t active_idx = ActiveConstantsBufferIdx();
+    const size_t inactive_idx = 1 - active_idx;
+    const uint8_t* active = GetActiveConstantsBuffer();
+    uint8_t* inactive = GetInactiveConstantsBuffer();
+    auto& active_generations = bound_constant_generations_[active_idx];
+    auto& inactive_generations = bound_constant_generations_[inactive_idx];
+
+    std::unordered_set<size_t> changed;
+    for (const auto& name : delta.names) {
+      auto it = bound_constant_name_to_idx_.find(name);
+      if (it != bound_constant_name_to_idx_.end()) {
+        changed.insert(it->second);
+      }
+      refold = refold || constant_folding_inputs_.count(name) ||
+          constant_folding_optional_inputs_.count(name);
+    }
+    for (size_t idx = 0; idx < bound_constant_offsets_.size(); ++idx) {
+      if (changed.count(idx) ||
+          inactive_generations[idx] == active_generations[idx]) {
+        continue;
+      }
+      const size_t offset = bound_constant_offsets_[idx];
+      DEVICE_CHECK(DeviceToDeviceCopy(
+          inactive + offset,
+          active + offset,
+          bound_constant_size_[idx],
+          stream));
+      inactive_generations[idx] = active_generations[idx];
+      ++num_carried_over;
+    }
+    for (size_t i = 0; i < delta.names.size(); ++i) {
+      SetConstantImpl(
+          delta.names[i].c_str(),
+          delta.tensors[i],
+          /*double_buffer=*/true,
+          stream);
+    }
+
+    if (!refold) {
+      // Nothing that constant folding depends on changed, so its outputs can
+      // be carried over as well.
+      if (folded_constants_generations_[inactive_idx] !=
+          folded_constants_generations_[active_idx]) {
+        for (size_t i = 0; i < constant_folding_outputs_offsets_.size(); ++i) {
+          const size_t offset = constant_folding_outputs_offsets_[i];
+          DEVICE_CHECK(DeviceToDeviceCopy(
+              inactive + offset,
+              active + offset,
+              constant_folding_outputs_sizes_[i],
+              stream));
+        }
+        folded_constants_generations_[inactive_idx] =
+            folded_constants_generations_[active_idx];
+      }
+      // Keep the constant folder pointed at the buffer that becomes active.
+      constant_folder_->WaitForCompletion();
+      SwapConstantFolderBuffer();
+      buffer_state_ = BufferState::CONSTANTS_FOLDED;
+    }
+  }
+  if (refold) {
+    FoldConstantsImpl(stream, /*double_buffer=*/true);
+  }
+  DEVICE_CHECK(StreamSynchronize(stream));
+  LOG(INFO) << "Staged constants delta update: " << delta.names.size()
+            << " constant(s) set, " << num_carried_over
+            << " bound constant(s) carried over, "
+            << (refold ? "constants refolded" : "constant folding skipped");
+}
+
+uint64_t ModelContainer::FinishConstantsDeltaUpdate(bool swap) {
+  std::future<void> pending;
+  {
+    std::lock_guard lk(constants_update_mutex_);
+    pending = std::move(pending_constants_update_);
+  }
+  if (pending.valid()) {
+    pending.get();
+  }
+  if (swap) {
+    SwapConstants();
+  }
+  return constants_version_;
+}
+
+void ModelContainer::SaveFoldedConstants(
+    const char* path,
+    uint64_t inputs_key,
+    StreamType stream) {
+  if (path == nullptr) {
+    throw std::runtime_error("Path cannot be null");
+  }
+  std::lock_guard lk(constants_sync_mutex_);
+  if (!constant_folded_once_) {
+    FoldConstantsImpl(stream);
+  }
+  SaveFoldedConstantsImpl(path, inputs_key, stream);
+}
+
+bool ModelContainer::LoadFoldedConstants(
+    const char* path,
+    uint64_t inputs_key,
+    StreamType stream) {
+  if (path == nullptr) {
+    throw std::runtime_error("Path cannot be null");
+  }
+  std::lock_guard lk(constants_sync_mutex_);
+  return LoadFoldedConstantsImpl(path, inputs_key, stream);
+}
+
+void ModelContainer::FoldConstantsForFirstRun(StreamType stream) {
+  const char* cache_dir = std::getenv("AIT_FOLDED_CONSTANTS_CACHE_DIR");
+  if (cache_dir == nullptr || constant_folding_outputs_offsets_.empty()) {
+    FoldConstantsImpl(stream);
+    return;
+  }
+  {
+    std::lock_guard lk(runtime_constant_folding_inputs_mutex_);
+    if (!runtime_constant_folding_inputs_.empty()) {
+      // Without an inputs key, a cached file can't tell these apart.
+      LOG(WARNING) << "Not using AIT_FOLDED_CONSTANTS_CACHE_DIR: constant "
+                   << "folding inputs were set at runtime. Use "
+                   << "SaveFoldedConstants/LoadFoldedConstants instead.";
+      FoldConstantsImpl(stream);
+      return;
+    }
+  }
+  std::ostringstream path;
+  path << cache_dir << "/folded_constants_" << std::hex << std::setw(16)
+       << std::setfill('0') << model_fingerprint_ << ".bin";
+  if (LoadFoldedConstantsImpl(path.str(), /*inputs_key=*/0, stream)) {
+    return;
+  }
+  FoldConstantsImpl(stream);
+  try {
+    SaveFoldedConstantsImpl(path.str(), /*inputs_key=*/0, stream);
+  } catch (std::exception& e) {
+    // The cache is best effort; the constants are folded either way.
+    LOG(WARNING) << "Failed to save folded constants to " << path.str()
+                 << ": " << e.what();
+  }
+}
+
+uint64_t ModelContainer::FoldedConstantsInputsKey(uint64_t inputs_key) {
+  // FNV-1a over the key and the (sorted) names.
+  uint64_t hash = 14695981039346656037ULL;
+  auto mix = [&hash](const void* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      hash ^= static_cast<const uint8_t*>(data)[i];
+      hash *= 1099511628211ULL;
+    }
+  };
+  mix(&inputs_key, sizeof(inputs_key));
+  std::lock_guard lk(runtime_constant_folding_inputs_mutex_);
+  for (const auto& name : runtime_constant_folding_inputs_) {
+    mix(name.c_str(), name.size() + 1);
+  }
+  return hash;
+}
+
+void ModelContainer::SaveFoldedConstantsImpl(
+    const std::string& path,
+    uint64_t inputs_key,
+    StreamType stream) {
+  const auto start = std::chrono::steady_clock::now();
+  constant_folder_->WaitForCompletion();
+  std::shared_lock lk(constants_double_buffer_mutex_);
+  if (folded_constants_generations_[ActiveConstantsBufferIdx()] ==
+      kStaleGeneration) {
+    throw std::runtime_error(
+        "The active constants buffer holds no folded constants");
+  }
+  const uint8_t* constants_ptr = GetActiveConstantsBuffer();
+
+  FoldedConstantsHeader header{};
+  std::copy_n(kFoldedConstantsMagic, sizeof(header.magic), header.magic);
+  header.version = kFoldedConstantsVersion;
+  header.model_fingerprint = model_fingerprint_;
+  header.inputs_key = FoldedConstantsInputsKey(inputs_key);
+  header.constants_size = constants_size_;
+  header.num_outputs = constant_folding_outputs_offsets_.size();
+
+  // Write to a temporary file first, so that a crash never leaves a
+  // truncated file behind under the final name.
+  const std::string tmp_path = path + ".tmp";
+  std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("Could not open " + tmp_path + " for writing");
+  }
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  size_t total_bytes = 0;
+  for (size_t i = 0; i < header.num_outputs; ++i) {
+    const uint64_t entry[2] = {
+        constant_folding_outputs_offsets_[i],
+        constant_folding_outputs_sizes_[i]};
+    file.write(reinterpret_cast<const char*>(entry), sizeof(entry));
+    total_bytes += entry[1];
+  }
+  std::vector<char> host_buffer;
+  for (size_t i = 0; i < header.num_outputs; ++i) {
+    const size_t size = constant_folding_outputs_sizes_[i];
+    host_buffer.resize(size);
+    DEVICE_CHECK(CopyToHost(
+        host_buffer.data(),
+        constants_ptr + constant_folding_outputs_offsets_[i],
+        size,
+        stream));
+    DEVICE_CHECK(StreamSynchronize(stream));
+    file.write(host_buffer.data(), size);
+  }
+  file.close();
+  if (!file || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+    throw std::runtime_error("Failed to write folded constants to " + path);
+  }
+  LOG(INFO) << "Saved " << header.num_outputs << " folded constant(s) ("
+            << total_bytes << " bytes) to " << path << " in "
+            << MicrosecondsSince(start) / 1000 << " ms";
+}
+
+bool ModelContainer::LoadFoldedConstantsImpl(
+    const std::string& path,
+    uint64_t inputs_key,
+    StreamType stream) {
+  const auto start = std::chrono::steady_clock::now();
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    LOG(INFO) << "No folded constants at " << path;
+    return false;
+  }
+  const auto file_size = static_cast<uint64_t>(file.tellg());
+  file.seekg(0);
+
+  FoldedConstantsHeader header{};
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  const size_t num_outputs = constant_folding_outputs_offsets_.size();
+  const char* mismatch = nullptr;
+  if (!file ||
+      !std::equal(
+          header.magic,
+          header.magic + sizeof(header.magic),
+          kFoldedConstantsMagic) ||
+      header.version != kFoldedConstantsVersion) {
+    mismatch = "not a folded constants file";
+  } else if (
+      header.model_fingerprint != model_fingerprint_ ||
+      header.constants_size != constants_size_ ||
+      header.num_outputs != num_outputs) {
+    mismatch = "written by another model";
+  } else if (header.inputs_key != FoldedConstantsInputsKey(inputs_key)) {
+    mismatch = "written with other constant folding inputs";
+  }
+  uint64_t expected_size =
+      sizeof(header) + num_outputs * 2 * sizeof(uint64_t);
+  for (size_t i = 0; mismatch == nullptr && i < num_outputs; ++i) {
+    uint64_t entry[2];
+    file.read(reinterpret_cast<char*>(entry), sizeof(entry));
+    if (!file || entry[0] != constant_folding_outputs_offsets_[i] ||
+        entry[1] != constant_folding_outputs_sizes_[i]) {
+      mismatch = "written by another model";
+    }
+    expected_size += entry[1];
+  }
+  if (mismatch == nullptr && file_size != expected_size) {
+    mismatch = "truncated";
+  }
+  if (mismatch != nullptr) {
+    LOG(WARNING) << "Ignoring folded constants at " << path << ": "
+                 << mismatch;
+    return false;
+  }
+
+  WaitForAllModels(/*include_constant_folder=*/true);
+  std::lock_guard lk(constants_double_buffer_mutex_);
+  uint8_t* constants_ptr = GetActiveConstantsBuffer();
+  std::vector<char> host_buffer;
+  for (size_t i = 0; i < num_outputs; ++i) {
+    const size_t size = constant_folding_outputs_sizes_[i];
+    host_buffer.resize(size);
+    file.read(host_buffer.data(), size);
+    if (!file) {
+      // The active buffer may be partially overwritten by now, so this
+      // can't just return false.
+      folded_constants_generations_[ActiveConstantsBufferIdx()] =
+          kStaleGeneration;
+      constant_folded_once_ = false;
+      throw std::runtime_error("Failed to read folded constants from " + path);
+    }
+    DEVICE_CHECK(CopyToDevice(
+        constants_ptr + constant_folding_outputs_offsets_[i],
+        host_buffer.data(),
+        size,
+        stream));
+    DEVICE_CHECK(StreamSynchronize(stream));
+  }
+  folded_constants_generations_[ActiveConstantsBufferIdx()] =
+      ++constants_generation_;
+  constant_folded_once_ = true;
+  LOG(INFO) << "Restored " << num_outputs << " folded constant(s) ("
+            << expected_size << " byte file) from " << path << " in "
+            << MicrosecondsSince(start) / 1000 << " ms";
+  return true;
 }
 
 size_t ModelContainer::GetNumConstants(bool unbound_constants_only) const {
@@ -791,15 +1367,27 @@ void ModelContainer::PrepareForRun(
 
 Model* ModelContainer::GetAvailableModel() {
   std::unique_lock lk(models_mutex_);
+  Model* result = nullptr;
   if (available_models_.empty()) {
-    ReclaimFinishedModels(lk);
+    // Only block on a busy model if the pool is not allowed to grow.
+    ReclaimFinishedModels(lk, /*block=*/!CanGrowRuntimePool());
+  }
+  if (available_models_.empty()) {
+    result = GrowRuntimePool(lk);
+  } else {
+    result = available_models_.back();
+    available_models_.pop_back();
+  }
+  model_last_used_[result] = std::chrono::steady_clock::now();
+  if (pool_policy_.idle_timeout_ms > 0) {
+    ReleaseIdleRuntimesImpl();
   }
-  auto* result = available_models_.back();
-  available_models_.pop_back();
   return result;
 }
 
-void ModelContainer::ReclaimFinishedModels(std::unique_lock<std::mutex>& lk) {
+void ModelContainer::ReclaimFinishedModels(
+    std::unique_lock<std::mutex>& lk,
+    bool block) {
   // Put any complete models at the end
   auto it = std::stable_partition(
       pending_models_.begin(), pending_models_.end(), [](Model* m) {
@@ -808,14 +1396,24 @@ void ModelContainer::ReclaimFinishedModels(std::unique_lock<std::mutex>& lk) {
 
   if (it != pending_models_.end()) {
     // Move all available models to the pool.
-    available_models_.insert(
-        available_models_.end(), it, pending_models_.end());
+    std::for_each(it, pending_models_.end(), [this](Model* model) {
+      MakeModelAvailable(model);
+    });
     pending_models_.erase(it, pending_models_.end());
     return;
   }
 
-  pending_models_available_.wait(
-      lk, [this]() { return !pending_models_.empty(); });
+  if (!block) {
+    return;
+  }
+
+  pending_models_available_.wait(lk, [this]() {
+    return !pending_models_.empty() || !available_models_.empty();
+  });
+  if (!available_models_.empty()) {
+    // A pre-warmed model was added in the meantime.
+    return;
+  }
   // There are no available workspaces! We have to wait on one.
   auto* model = pending_models_.front();
   pending_models_.pop_front();
@@ -828,9 +1426,384 @@ void ModelContainer::ReclaimFinishedModels(std::unique_lock<std::mutex>& lk) {
     throw;
   }
   lk.lock();
+  MakeModelAvailable(model);
+}
+
+void ModelContainer::MakeModelAvailable(Model* model) {
+  model->CollectOpTrace(op_trace_);
+  uint64_t device_us = 0;
+  if (model->TakeLastRunDeviceTime(&device_us)) {
+    device_run_us_.Record(device_us);
+  }
   available_models_.push_back(model);
 }
 
+void ModelContainer::SetOpTraceSampling(
+    size_t sample_every,
+    size_t max_records) {
+  std::lock_guard lk(models_mutex_);
+  op_trace_.Reset(max_records);
+  op_trace_num_runs_ = 0;
+  op_trace_sample_every_ = sample_every;
+}
+
+void ModelContainer::WriteOpTrace(const char* filename) {
+  std::ofstream os(filename);
+  if (!os) {
+    throw std::runtime_error(std::string("Could not open file ") + filename);
+  }
+  // Collect the traces of finished runs first, see GetMetrics().
+  std::shared_lock constants_lk(constants_sync_mutex_);
+  std::unique_lock lk(models_mutex_);
+  ReclaimFinishedModels(lk, /*block=*/false);
+  op_trace_.WriteChromeTrace(os);
+}
+
+uint8_t* ModelContainer::GetActiveConstantsBuffer() {
+  return static_cast<uint8_t*>(
+      use_constants_primary_buffer_ ? constants_primary_.get()
+                                    : constants_secondary_.get());
+}
+
+bool ModelContainer::CanGrowRuntimePool() const {
+  const size_t num_models = models_.size() + num_models_in_creation_;
+  if (num_models >= pool_policy_.max_runtimes) {
+    return false;
+  }
+  return pool_policy_.memory_budget_bytes == 0 ||
+      (num_models + 1) * model_footprint_bytes_ <=
+      pool_policy_.memory_budget_bytes;
+}
+
+Model* ModelContainer::GrowRuntimePool(std::unique_lock<std::mutex>& lk) {
+  // Allocating a model is slow (device mallocs, stream/event creation), so
+  // don't hold models_mutex_ while doing it. num_models_in_creation_ makes
+  // sure concurrent callers respect max_runtimes.
+  ++num_models_in_creation_;
+  auto* constants_ptr = GetActiveConstantsBuffer();
+  lk.unlock();
+  std::unique_ptr<Model> model;
+  try {
+    model = Model::Create(allocator_, constants_ptr);
+  } catch (std::exception& e) {
+    LOG(WARNING) << "Failed to create an additional runtime: " << e.what()
+                 << ". Waiting for a busy runtime instead.";
+  }
+  lk.lock();
+  --num_models_in_creation_;
+
+  if (model == nullptr) {
+    if (available_models_.empty()) {
+      ReclaimFinishedModels(lk, /*block=*/true);
+    }
+    auto* result = available_models_.back();
+    available_models_.pop_back();
+    return result;
+  }
+
+  // The constants may have been swapped while the lock was released, so
+  // only wire them up now.
+  WireUpRuntimeConstants(model.get());
+  auto* result = model.get();
+  models_.push_back(std::move(model));
+  LOG(INFO) << "Grew runtime pool to " << models_.size() << " runtimes";
+  return result;
+}
+
+void ModelContainer::WireUpRuntimeConstants(Model* model) {
+  model->ResetConstants(GetActiveConstantsBuffer());
+  for (auto& [name, src] : model_constant_values_) {
+    model->SetConstant(name.c_str(), src);
+  }
+}
+
+size_t ModelContainer::ReleaseIdleRuntimesImpl() {
+  const auto now = std::chrono::steady_clock::now();
+  const auto timeout =
+      std::chrono::milliseconds(pool_policy_.idle_timeout_ms);
+  auto over_budget = [this]() {
+    return models_.size() > pool_policy_.max_runtimes ||
+        (pool_policy_.memory_budget_bytes != 0 &&
+         models_.size() * model_footprint_bytes_ >
+             pool_policy_.memory_budget_bytes);
+  };
+
+  size_t num_released = 0;
+  // available_models_ is used as a stack, so the front holds the models
+  // that were used least recently.
+  auto it = available_models_.begin();
+  while (it != available_models_.end() &&
+         models_.size() > pool_policy_.min_runtimes) {
+    auto* model = *it;
+    const bool timed_out = pool_policy_.idle_timeout_ms > 0 &&
+        now - model_last_used_[model] >= timeout;
+    if (!over_budget() && !timed_out) {
+      ++it;
+      continue;
+    }
+    const auto stats = model->GraphCacheStats();
+    released_graph_cache_stats_.hits += stats.hits;
+    released_graph_cache_stats_.updates += stats.updates;
+    released_graph_cache_stats_.misses += stats.misses;
+    released_graph_cache_stats_.evictions += stats.evictions;
+    released_graph_capture_us_.Add(model->GraphCaptureTimes());
+    it = available_models_.erase(it);
+    model_last_used_.erase(model);
+    auto model_it = std::find_if(
+        models_.begin(), models_.end(), [model](const auto& owned) {
+          return owned.get() == model;
+        });
+    models_.erase(model_it);
+    ++num_released;
+  }
+  if (num_released > 0) {
+    LOG(INFO) << "Released " << num_released << " idle runtimes; "
+              << models_.size() << " runtimes remain";
+  }
+  return num_released;
+}
+
+size_t ModelContainer::GetNumRuntimes() {
+  std::lock_guard lk(models_mutex_);
+  return models_.size();
+}
+
+AITemplateMemoryUsage ModelContainer::GetMemoryUsage() {
+  AITemplateMemoryUsage usage{};
+  usage.constants_bytes = constants_size_;
+  {
+    // Double buffered updates allocate constants_secondary_ lazily.
+    std::shared_lock lk(constants_double_buffer_mutex_);
+    usage.secondary_constants_bytes =
+        constants_secondary_ == nullptr ? 0 : constants_size_;
+  }
+  usage.constant_folder_bytes = constant_folder_->MemoryFootprintBytes();
+  for (const auto& runtime : GetRuntimeMemoryUsage()) {
+    usage.runtime_blob_bytes += runtime.blob_bytes;
+    usage.runtime_workspace_bytes += runtime.workspace_bytes;
+    ++usage.num_runtimes;
+  }
+  size_t staging_bytes = 0;
+  for (size_t i = 0; i < num_outputs_; ++i) {
+    staging_bytes += MaxOutputStorageBytes(i);
+  }
+  usage.host_output_staging_device_bytes =
+      num_host_output_staging_ * staging_bytes;
+  usage.host_output_staging_pinned_bytes =
+      usage.host_output_staging_device_bytes;
+  usage.total_device_bytes = usage.constants_bytes +
+      usage.secondary_constants_bytes + usage.constant_folder_bytes +
+      usage.runtime_blob_bytes + usage.runtime_workspace_bytes +
+      usage.host_output_staging_device_bytes;
+  return usage;
+}
+
+std::vector<AITemplateRuntimeMemoryUsage>
+ModelContainer::GetRuntimeMemoryUsage() {
+  std::lock_guard lk(models_mutex_);
+  std::vector<AITemplateRuntimeMemoryUsage> usage;
+  usage.reserve(models_.size());
+  for (const auto& model : models_) {
+    usage.push_back(model->MemoryUsage());
+    usage.back().busy =
+        std::find(
+            available_models_.begin(), available_models_.end(), model.get()) ==
+        available_models_.end();
+  }
+  return usage;
+}
+
+void ModelContainer::PrewarmRuntimes(bool wait) {
+  std::lock_guard lk(prewarm_mutex_);
+  if (!prewarm_.valid() ||
+      prewarm_.wait_for(std::chrono::seconds(0)) ==
+          std::future_status::ready) {
+    prewarm_ =
+        std::async(std::launch::async, [this]() { PrewarmRuntimesImpl(); });
+  }
+  if (wait) {
+    prewarm_.wait();
+  }
+}
+
+void ModelContainer::PrewarmRuntimesImpl() {
+  const auto start = std::chrono::steady_clock::now();
+  size_t num_created = 0;
+  size_t num_runtimes = 0;
+  while (!stop_prewarm_) {
+    // Like Run(), hold constants_sync_mutex_ shared while touching the pool,
+    // so that constant updates wait for each model to be created and wired
+    // up. It's released between models so that they don't starve.
+    std::shared_lock constants_lk(constants_sync_mutex_);
+    std::unique_lock lk(models_mutex_);
+    if (models_.size() + num_models_in_creation_ >=
+            pool_policy_.min_runtimes ||
+        !CanGrowRuntimePool()) {
+      break;
+    }
+    // Like GrowRuntimePool(), create the model without holding models_mutex_.
+    ++num_models_in_creation_;
+    auto* constants_ptr = GetActiveConstantsBuffer();
+    lk.unlock();
+    std::unique_ptr<Model> model;
+    try {
+      model = Model::Create(allocator_, constants_ptr);
+    } catch (std::exception& e) {
+      LOG(WARNING) << "Failed to pre-warm a runtime: " << e.what();
+    }
+    lk.lock();
+    --num_models_in_creation_;
+    if (model == nullptr) {
+      break;
+    }
+    // Re-reads the active constants buffer, which may have been swapped
+    // while models_mutex_ was released.
+    WireUpRuntimeConstants(model.get());
+    // The front of available_models_ is handed out last, which leaves the
+    // models that already ran (and e.g. captured graphs) in use.
+    available_models_.insert(available_models_.begin(), model.get());
+    model_last_used_[model.get()] = std::chrono::steady_clock::now();
+    models_.push_back(std::move(model));
+    num_runtimes = models_.size();
+    ++num_created;
+    pending_models_available_.notify_all();
+  }
+  if (num_created > 0) {
+    LOG(INFO) << "Pre-warmed " << num_created << " runtimes in "
+              << MicrosecondsSince(start) / 1000 << " ms; " << num_runtimes
+              << " runtimes available";
+  }
+}
+
+void ModelContainer::SetRuntimePoolPolicy(
+    const AITemplateRuntimePoolPolicy& policy) {
+  if (policy.min_runtimes == 0) {
+    throw std::runtime_error("min_runtimes must be positive");
+  }
+  if (policy.max_runtimes < policy.min_runtimes) {
+    throw std::runtime_error(
+        "max_runtimes (" + std::to_string(policy.max_runtimes) +
+        ") must not be less than min_runtimes (" +
+        std::to_string(policy.min_runtimes) + ")");
+  }
+  if (policy.memory_budget_bytes != 0 &&
+      policy.min_runtimes * model_footprint_bytes_ >
+          policy.memory_budget_bytes) {
+    throw std::runtime_error(
+        "memory_budget_bytes cannot hold min_runtimes runtimes of " +
+        std::to_string(model_footprint_bytes_) + " bytes each");
+  }
+
+  // Like Run(), keep constant updates (and WaitForAllModels()) out while
+  // the pool is being resized.
+  std::shared_lock constants_lk(constants_sync_mutex_);
+  std::unique_lock lk(models_mutex_);
+  pool_policy_ = policy;
+  // Top up to min_runtimes eagerly; this is a configuration call, so it's
+  // fine to hold the lock while allocating.
+  const auto now = std::chrono::steady_clock::now();
+  while (models_.size() + num_models_in_creation_ < pool_policy_.min_runtimes) {
+    models_.push_back(Model::Create(allocator_, GetActiveConstantsBuffer()));
+    WireUpRuntimeConstants(models_.back().get());
+    available_models_.push_back(models_.back().get());
+    model_last_used_[models_.back().get()] = now;
+  }
+  // Shrink if the new limits are lower than what we currently have. Busy
+  // models will be released later once they become idle.
+  ReclaimFinishedModels(lk, /*block=*/false);
+  ReleaseIdleRuntimesImpl();
+}
+
+AITemplateRuntimePoolPolicy ModelContainer::GetRuntimePoolPolicy() {
+  std::lock_guard lk(models_mutex_);
+  return pool_policy_;
+}
+
+size_t ModelContainer::ReleaseIdleRuntimes() {
+  FreeIdleHostOutputStaging();
+  std::shared_lock constants_lk(constants_sync_mutex_);
+  std::unique_lock lk(models_mutex_);
+  ReclaimFinishedModels(lk, /*block=*/false);
+  return ReleaseIdleRuntimesImpl();
+}
+
+void ModelContainer::ReclaimFinishedRuntimes() {
+  std::shared_lock constants_lk(constants_sync_mutex_);
+  std::unique_lock lk(models_mutex_);
+  ReclaimFinishedModels(lk, /*block=*/false);
+}
+
+AITemplateGraphCacheStats ModelContainer::GetGraphCacheStats() {
+  std::lock_guard lk(models_mutex_);
+  auto total = released_graph_cache_stats_;
+  for (const auto& model : models_) {
+    const auto stats = model->GraphCacheStats();
+    total.hits += stats.hits;
+    total.updates += stats.updates;
+    total.misses += stats.misses;
+    total.evictions += stats.evictions;
+  }
+  return total;
+}
+
+std::string ModelContainer::GetMetrics(bool json) {
+  MetricsSnapshot snapshot;
+  LatencyHistogram graph_capture_us;
+  size_t num_runtimes = 0;
+  {
+    // Reclaiming touches pending_models_, see ReleaseIdleRuntimes().
+    std::shared_lock constants_lk(constants_sync_mutex_);
+    std::unique_lock lk(models_mutex_);
+    // Pick up device times of runs that have finished in the meantime.
+    ReclaimFinishedModels(lk, /*block=*/false);
+    graph_capture_us.Add(released_graph_capture_us_.Take());
+    for (const auto& model : models_) {
+      graph_capture_us.Add(model->GraphCaptureTimes());
+    }
+    num_runtimes = models_.size();
+  }
+  const auto graph_cache_stats = GetGraphCacheStats();
+
+  snapshot.counters = {
+      {"runs", num_runs_.load(std::memory_order_relaxed)},
+      {"failed_runs", num_failed_runs_.load(std::memory_order_relaxed)},
+      {"runtimes", num_runtimes},
+      {"graph_cache_hits", graph_cache_stats.hits},
+      {"graph_cache_updates", graph_cache_stats.updates},
+      {"graph_cache_misses", graph_cache_stats.misses},
+      {"graph_cache_evictions", graph_cache_stats.evictions}};
+  snapshot.histograms = {
+      {"run_us", run_us_.Take()},
+      {"constants_wait_us", constants_wait_us_.Take()},
+      {"queue_wait_us", queue_wait_us_.Take()},
+      {"launch_us", launch_us_.Take()},
+      {"device_run_us", device_run_us_.Take()},
+      {"graph_capture_us", graph_capture_us.Take()},
+      {"constant_folding_us", constant_folding_us_.Take()},
+      {"constant_swap_us", constant_swap_us_.Take()}};
+  return json ? snapshot.ToJson() : snapshot.ToText();
+}
+
+void ModelContainer::ResetMetrics() {
+  for (auto* histogram :
+       {&run_us_,
+        &constants_wait_us_,
+        &queue_wait_us_,
+        &launch_us_,
+        &device_run_us_,
+        &constant_folding_us_,
+        &constant_swap_us_}) {
+    histogram->Reset();
+  }
+  num_runs_ = 0;
+  num_failed_runs_ = 0;
+  std::lock_guard lk(models_mutex_);
+  released_graph_capture_us_.Reset();
+  for (const auto& model : models_) {
+    model->ResetGraphCaptureTimes();
+  }
+}
+
 void ModelContainer::ValidateParamDtype(AITemplateDtype dtype, size_t idx)
     const {
   CHECK_VECTOR_ACCESS(param_dtypes_, idx)
@@ -13,8 +13,11 @@
 //  limitations under the License.
 //
 #include "model_interface.h"
+#include <algorithm>
 #include <iostream>
 #include <unordered_map>
+#include "caching_allocator.h"
+#include "dynamic_batcher.h"
 #include "model-generated.h"
 #include "model_container.h"
 
@@ -71,6 +74,71 @@ class TrackingAllocator : public DefaultAllocator {
   size_t num_bytes_ = 0;
 };
 
+// Binds CachingAllocatorImpl to the real device.
+struct DeviceForCaching {
+  using StreamType = ait::StreamType;
+  using EventType = ait::EventType;
+
+  void* Malloc(size_t num_bytes) {
+    void* result;
+    if (DeviceMalloc(&result, num_bytes) != GetDeviceSuccess()) {
+      // Clear the error so that it isn't reported by a later call.
+      GetLastError();
+      return nullptr;
+    }
+    return result;
+  }
+
+  void Free(void* ptr) {
+    DEVICE_CHECK(FreeDeviceMemory(ptr));
+  }
+
+  EventType RecordEvent(StreamType stream) {
+    EventType event;
+    DEVICE_CHECK(CreateEvent(&event, /*measure_time=*/false));
+    DEVICE_CHECK(EventRecord(event, stream));
+    return event;
+  }
+
+  bool EventDone(EventType event) {
+    return QueryEvent(event) == GetDeviceSuccess();
+  }
+
+  void DestroyEvent(EventType event) {
+    DEVICE_CHECK(ait::DestroyEvent(event));
+  }
+};
+
+class CachingAllocator : public AITemplateAllocator {
+ public:
+  explicit CachingAllocator(size_t max_reserved_bytes)
+      : impl_(DeviceForCaching{}, max_reserved_bytes) {}
+
+  void* Allocate(size_t n_bytes) override {
+    return impl_.Allocate(n_bytes);
+  }
+
+  void Free(void* ptr) override {
+    impl_.Free(ptr);
+  }
+
+  bool RecordStream(void* ptr, AITemplateStreamHandle stream) override {
+    impl_.RecordStream(ptr, reinterpret_cast<StreamType>(stream));
+    return true;
+  }
+
+  void EmptyCache() {
+    impl_.EmptyCache();
+  }
+
+  AITemplateCachingAllocatorStats GetStats() {
+    return impl_.GetStats();
+  }
+
+ private:
+  CachingAllocatorImpl<DeviceForCaching> impl_;
+};
+
 DefaultAllocator default_allocator;
 } // namespace
 } // namespace ait
@@ -231,6 +299,74 @@ AITemplateError AITemplateModelContainerRun(
   })
 }
 
+AITemplateError AITemplateModelContainerRunAsync(
+    AITemplateModelHandle handle,
+    const AITData* inputs,
+    size_t num_inputs,
+    AITData* outputs,
+    size_t num_outputs,
+    AITemplateStreamHandle stream_handle,
+    bool graph_mode,
+    int64_t** output_shapes_out,
+    AITemplateRunCallback callback,
+    void* user_data,
+    AITemplateRunHandle* run_handle_out) {
+  RETURN_ERROR_IF_NULL(handle)
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  auto stream = reinterpret_cast<ait::StreamType>(stream_handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE({
+    auto state = m->RunAsync(
+        inputs,
+        num_inputs,
+        outputs,
+        num_outputs,
+        stream,
+        graph_mode,
+        output_shapes_out,
+        callback,
+        user_data);
+    if (run_handle_out != nullptr) {
+      *run_handle_out = reinterpret_cast<AITemplateRunHandle>(
+          new std::shared_ptr<ait::AsyncRunState>(std::move(state)));
+    }
+  })
+}
+
+AITemplateError AITemplateRunHandlePoll(
+    AITemplateRunHandle run_handle,
+    bool* done_out,
+    AITemplateError* status_out) {
+  RETURN_ERROR_IF_NULL(run_handle)
+  RETURN_ERROR_IF_NULL(done_out)
+  auto& state =
+      *reinterpret_cast<std::shared_ptr<ait::AsyncRunState>*>(run_handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE({
+    *done_out = state->IsDone();
+    if (*done_out && status_out != nullptr) {
+      *status_out = state->Status();
+    }
+  })
+}
+
+AITemplateError AITemplateRunHandleWait(AITemplateRunHandle run_handle) {
+  RETURN_ERROR_IF_NULL(run_handle)
+  auto& state =
+      *reinterpret_cast<std::shared_ptr<ait::AsyncRunState>*>(run_handle);
+  try {
+    return state->Wait();
+  } catch (const std::exception& e) {
+    LOG(ERROR) << "Error: " << e.what();
+    return AITemplateError::AITemplateFailure;
+  }
+}
+
+AITemplateError AITemplateRunHandleDelete(AITemplateRunHandle run_handle) {
+  RETURN_ERROR_IF_NULL(run_handle)
+  CONVERT_EXCEPTION_TO_ERROR_CODE({
+    delete reinterpret_cast<std::shared_ptr<ait::AsyncRunState>*>(run_handle);
+  });
+}
+
 AITemplateError AITemplateModelContainerRunWithOutputsOnHost(
     AITemplateModelHandle handle,
     const AITData* inputs,
@@ -387,6 +523,14 @@ AITemplateError AITemplateModelContainerGetOutputDtype(
   CONVERT_EXCEPTION_TO_ERROR_CODE({ *dtype_out = m->OutputDtype(output_idx); })
 }
 
+AITemplateError AITemplateModelContainerPrewarmRuntimes(
+    AITemplateModelHandle handle,
+    bool wait) {
+  RETURN_ERROR_IF_NULL(handle)
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE({ m->PrewarmRuntimes(wait); })
+}
+
 AITemplateError AITemplateModelContainerGetNumRuntimes(
     AITemplateModelHandle handle,
     size_t* num_runtimes_out) {
@@ -395,6 +539,135 @@ AITemplateError AITemplateModelContainerGetNumRuntimes(
   CONVERT_EXCEPTION_TO_ERROR_CODE({ *num_runtimes_out = m->GetNumRuntimes(); })
 }
 
+AITemplateError AITemplateModelContainerSetRuntimePoolPolicy(
+    AITemplateModelHandle handle,
+    const AITemplateRuntimePoolPolicy* policy) {
+  RETURN_ERROR_IF_NULL(handle)
+  RETURN_ERROR_IF_NULL(policy)
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE({ m->SetRuntimePoolPolicy(*policy); })
+}
+
+AITemplateError AITemplateModelContainerGetRuntimePoolPolicy(
+    AITemplateModelHandle handle,
+    AITemplateRuntimePoolPolicy* policy_out) {
+  RETURN_ERROR_IF_NULL(handle)
+  RETURN_ERROR_IF_NULL(policy_out)
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE({ *policy_out = m->GetRuntimePoolPolicy(); })
+}
+
+AITemplateError AITemplateModelContainerReleaseIdleRuntimes(
+    AITemplateModelHandle handle,
+    size_t* num_released_out) {
+  RETURN_ERROR_IF_NULL(handle)
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE({
+    auto num_released = m->ReleaseIdleRuntimes();
+    if (num_released_out != nullptr) {
+      *num_released_out = num_released;
+    }
+  })
+}
+
+AITemplateError AITemplateModelContainerGetGraphCacheStats(
+    AITemplateModelHandle handle,
+    AITemplateGraphCacheStats* stats_out) {
+  RETURN_ERROR_IF_NULL(handle)
+  RETURN_ERROR_IF_NULL(stats_out)
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE({ *stats_out = m->GetGraphCacheStats(); })
+}
+
+AITemplateError AITemplateModelContainerGetMemoryUsage(
+    AITemplateModelHandle handle,
+    AITemplateMemoryUsage* usage_out) {
+  RETURN_ERROR_IF_NULL(handle)
+  RETURN_ERROR_IF_NULL(usage_out)
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE({ *usage_out = m->GetMemoryUsage(); })
+}
+
+AITemplateError AITemplateModelContainerGetRuntimeMemoryUsage(
+    AITemplateModelHandle handle,
+    AITemplateRuntimeMemoryUsage* usage_out,
+    size_t max_runtimes,
+    size_t* num_runtimes_out) {
+  RETURN_ERROR_IF_NULL(handle)
+  RETURN_ERROR_IF_NULL(num_runtimes_out)
+  if (max_runtimes > 0) {
+    RETURN_ERROR_IF_NULL(usage_out)
+  }
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE({
+    const auto usage = m->GetRuntimeMemoryUsage();
+    std::copy_n(
+        usage.begin(), std::min(max_runtimes, usage.size()), usage_out);
+    *num_runtimes_out = usage.size();
+  })
+}
+
+AITemplateError AITemplateModelContainerGetTensorLifetimes(
+    AITemplateModelHandle handle,
+    const AITemplateTensorLifetime** lifetimes_out,
+    size_t* num_tensors_out) {
+  RETURN_ERROR_IF_NULL(handle)
+  RETURN_ERROR_IF_NULL(lifetimes_out)
+  RETURN_ERROR_IF_NULL(num_tensors_out)
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE({
+    const auto& lifetimes = m->GetTensorLifetimes();
+    *lifetimes_out = lifetimes.data();
+    *num_tensors_out = lifetimes.size();
+  })
+}
+
+AITemplateError AITemplateModelContainerSetOpTraceSampling(
+    AITemplateModelHandle handle,
+    size_t sample_every,
+    size_t max_records) {
+  RETURN_ERROR_IF_NULL(handle)
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE(
+      { m->SetOpTraceSampling(sample_every, max_records); })
+}
+
+AITemplateError AITemplateModelContainerWriteOpTrace(
+    AITemplateModelHandle handle,
+    const char* filename) {
+  RETURN_ERROR_IF_NULL(handle)
+  RETURN_ERROR_IF_NULL(filename)
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE({ m->WriteOpTrace(filename); })
+}
+
+AITemplateError AITemplateModelContainerGetMetrics(
+    AITemplateModelHandle handle,
+    bool json,
+    char* buffer,
+    size_t buffer_size,
+    size_t* size_out) {
+  RETURN_ERROR_IF_NULL(handle)
+  RETURN_ERROR_IF_NULL(size_out)
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE({
+    const auto metrics = m->GetMetrics(json);
+    *size_out = metrics.size();
+    if (buffer != nullptr && buffer_size > 0) {
+      const size_t num_chars = std::min(metrics.size(), buffer_size - 1);
+      std::memcpy(buffer, metrics.data(), num_chars);
+      buffer[num_chars] = '\0';
+    }
+  })
+}
+
+AITemplateError AITemplateModelContainerResetMetrics(
+    AITemplateModelHandle handle) {
+  RETURN_ERROR_IF_NULL(handle)
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE({ m->ResetMetrics(); })
+}
+
 AITemplateError AITemplateModelContainerFoldConstants(
     AITemplateModelHandle handle,
     AITemplateStreamHandle stream_handle,
@@ -422,6 +695,106 @@ AITemplateError AITemplateModelContainerSwapConstants(
   CONVERT_EXCEPTION_TO_ERROR_CODE({ m->SwapConstants(); })
 }
 
+AITemplateError AITemplateModelContainerUpdateConstantsDelta(
+    AITemplateModelHandle handle,
+    const char** names,
+    const AITData* tensors,
+    size_t num_tensors) {
+  RETURN_ERROR_IF_NULL(handle)
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE(
+      { m->UpdateConstantsDelta(names, tensors, num_tensors); })
+}
+
+AITemplateError AITemplateModelContainerFinishConstantsDeltaUpdate(
+    AITemplateModelHandle handle,
+    bool swap,
+    uint64_t* version_out) {
+  RETURN_ERROR_IF_NULL(handle)
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE({
+    const uint64_t version = m->FinishConstantsDeltaUpdate(swap);
+    if (version_out != nullptr) {
+      *version_out = version;
+    }
+  })
+}
+
+AITemplateError AITemplateModelContainerGetConstantsVersion(
+    AITemplateModelHandle handle,
+    uint64_t* version_out) {
+  RETURN_ERROR_IF_NULL(handle)
+  RETURN_ERROR_IF_NULL(version_out)
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE(
+      { *version_out = m->GetConstantsVersion(); })
+}
+
+AITemplateError AITemplateModelContainerSaveFoldedConstants(
+    AITemplateModelHandle handle,
+    const char* path,
+    uint64_t inputs_key,
+    AITemplateStreamHandle stream_handle) {
+  RETURN_ERROR_IF_NULL(handle)
+  RETURN_ERROR_IF_NULL(path)
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  auto stream = reinterpret_cast<ait::StreamType>(stream_handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE(
+      { m->SaveFoldedConstants(path, inputs_key, stream); })
+}
+
+AITemplateError AITemplateModelContainerLoadFoldedConstants(
+    AITemplateModelHandle handle,
+    const char* path,
+    uint64_t inputs_key,
+    AITemplateStreamHandle stream_handle,
+    bool* loaded_out) {
+  RETURN_ERROR_IF_NULL(handle)
+  RETURN_ERROR_IF_NULL(path)
+  RETURN_ERROR_IF_NULL(loaded_out)
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  auto stream = reinterpret_cast<ait::StreamType>(stream_handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE(
+      { *loaded_out = m->LoadFoldedConstants(path, inputs_key, stream); })
+}
+
+AITemplateError AITemplateDynamicBatcherCreate(
+    AITemplateDynamicBatcherHandle* ret,
+    AITemplateModelHandle handle,
+    const AITemplateDynamicBatcherOptions* options) {
+  RETURN_ERROR_IF_NULL(ret)
+  RETURN_ERROR_IF_NULL(handle)
+  RETURN_ERROR_IF_NULL(options)
+  auto* m = reinterpret_cast<ait::ModelContainer*>(handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE({
+    auto* batcher = new ait::DynamicBatcher(*m, *options);
+    *ret = reinterpret_cast<AITemplateDynamicBatcherHandle>(batcher);
+  })
+}
+
+AITemplateError AITemplateDynamicBatcherDelete(
+    AITemplateDynamicBatcherHandle batcher_handle) {
+  RETURN_ERROR_IF_NULL(batcher_handle)
+  CONVERT_EXCEPTION_TO_ERROR_CODE({
+    auto* batcher = reinterpret_cast<ait::DynamicBatcher*>(batcher_handle);
+    delete batcher;
+  });
+}
+
+AITemplateError AITemplateDynamicBatcherRun(
+    AITemplateDynamicBatcherHandle batcher_handle,
+    const AITData* inputs,
+    size_t num_inputs,
+    AITData* outputs,
+    size_t num_outputs,
+    int64_t** output_shapes_out) {
+  RETURN_ERROR_IF_NULL(batcher_handle)
+  auto* batcher = reinterpret_cast<ait::DynamicBatcher*>(batcher_handle);
+  CONVERT_EXCEPTION_TO_ERROR_CODE({
+    batcher->Run(inputs, num_inputs, outputs, num_outputs, output_shapes_out);
+  })
+}
+
 AITemplateError AITemplateAllocatorCreate(
     AITemplateAllocator** allocator_out,
     AITemplateAllocatorType allocator_type) {
@@ -434,6 +807,9 @@ AITemplateError AITemplateAllocatorCreate(
       case AITemplateAllocatorType::kTracking:
         *allocator_out = new ait::TrackingAllocator();
         break;
+      case AITemplateAllocatorType::kCaching:
+        *allocator_out = new ait::CachingAllocator(/*max_reserved_bytes=*/0);
+        break;
       default:
         throw std::runtime_error("Unrecognized allocator type");
     }
@@ -460,4 +836,53 @@ AITemplateError AITemplateTrackingAllocatorGetNumBytes(
   });
 }
 
+namespace {
+ait::CachingAllocator& AsCachingAllocator(AITemplateAllocator* allocator) {
+  auto* caching_allocator = dynamic_cast<ait::CachingAllocator*>(allocator);
+  if (caching_allocator == nullptr) {
+    throw std::runtime_error("Allocator was not a caching allocator!");
+  }
+  return *caching_allocator;
+}
+} // namespace
+
+AITemplateError AITemplateCachingAllocatorCreate(
+    AITemplateAllocator** allocator_out,
+    size_t max_reserved_bytes) {
+  RETURN_ERROR_IF_NULL(allocator_out);
+  CONVERT_EXCEPTION_TO_ERROR_CODE(
+      { *allocator_out = new ait::CachingAllocator(max_reserved_bytes); });
+}
+
+AITemplateError AITemplateCachingAllocatorGetStats(
+    AITemplateAllocator* allocator,
+    AITemplateCachingAllocatorStats* stats_out) {
+  RETURN_ERROR_IF_NULL(allocator);
+  RETURN_ERROR_IF_NULL(stats_out);
+  CONVERT_EXCEPTION_TO_ERROR_CODE(
+      { *stats_out = AsCachingAllocator(allocator).GetStats(); });
+}
+
+AITemplateError AITemplateCachingAllocatorEmptyCache(
+    AITemplateAllocator* allocator) {
+  RETURN_ERROR_IF_NULL(allocator);
+  CONVERT_EXCEPTION_TO_ERROR_CODE(
+      { AsCachingAllocator(allocator).EmptyCache(); });
+}
+
+AITemplateError AITemplateAllocatorRecordStream(
+    AITemplateAllocator* allocator,
+    void* ptr,
+    AITemplateStreamHandle stream,
+    bool* deferred_out) {
+  RETURN_ERROR_IF_NULL(allocator);
+  RETURN_ERROR_IF_NULL(ptr);
+  CONVERT_EXCEPTION_TO_ERROR_CODE({
+    const bool deferred = allocator->RecordStream(ptr, stream);
+    if (deferred_out != nullptr) {
+      *deferred_out = deferred;
+    }
+  });
+}
+
 } // extern "C"
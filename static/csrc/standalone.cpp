@@ -27,17 +27,34 @@
 // ./tmp/test_gemm_rcr) along with other files, users are free to make any
 // changes to the code. We do not try to predict users' actions.
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <functional>
+#include <iomanip>
 #include <iostream>
 #include <map>
 #include <random>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "loadtest_stats.h"
 #include "macros.h"
 #include "model_interface.h"
 #include "raii_wrapper.h"
@@ -273,15 +290,260 @@ static AITemplateError run(
       ait_output_shapes_out.data());
 }
 
+// A read-only view of a whole file. Testcase files can be gigabytes, so
+// they are memory mapped: inputs are copied to the device straight from the
+// mapping, and expected outputs are compared in place.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+    std::ifstream fh(path, std::ios::binary | std::ios::ate);
+    if (!fh) {
+      throw std::runtime_error("Could not open file " + path);
+    }
+    size_ = static_cast<size_t>(fh.tellg());
+    fallback_.resize(size_);
+    fh.seekg(0);
+    fh.read(fallback_.data(), size_);
+    if (fh.fail()) {
+      throw std::runtime_error("Failed to read " + path);
+    }
+    data_ = reinterpret_cast<const uint8_t*>(fallback_.data());
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Could not open file " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      throw std::runtime_error("Could not stat file " + path);
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+      void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("Could not mmap file " + path);
+      }
+      // The file is read front to back once.
+      madvise(data, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const uint8_t*>(data);
+    }
+    close(fd);
+#endif
+  }
+
+  ~MappedFile() {
+#ifndef _WIN32
+    if (data_ != nullptr) {
+      munmap(const_cast<uint8_t*>(data_), size_);
+    }
+#endif
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const uint8_t* data() const {
+    return data_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  std::vector<char> fallback_;
+#endif
+};
+
+// Bounds-checked sequential reads from a MappedFile.
+class TestcaseReader {
+ public:
+  explicit TestcaseReader(const MappedFile& file) : file_(file) {}
+
+  template <typename T>
+  T read() {
+    T elem;
+    std::memcpy(&elem, bytes(sizeof(T)), sizeof(T));
+    return elem;
+  }
+
+  // Returns a pointer to the next num_bytes bytes and skips them.
+  const uint8_t* bytes(size_t num_bytes) {
+    if (num_bytes > file_.size() - offset_) {
+      throw std::runtime_error("Testcase file is truncated.");
+    }
+    const uint8_t* result = file_.data() + offset_;
+    offset_ += num_bytes;
+    return result;
+  }
+
+  // Skips padding up to the next multiple of alignment.
+  void align(size_t alignment) {
+    bytes((alignment - offset_ % alignment) % alignment);
+  }
+
+  bool at_end() const {
+    return offset_ == file_.size();
+  }
+
+  bool starts_with(const char* magic, size_t size) const {
+    return file_.size() >= size && std::memcmp(file_.data(), magic, size) == 0;
+  }
+
+ private:
+  const MappedFile& file_;
+  size_t offset_ = 0;
+};
+
+// Testcase file layout, as written by Model.write_standalone_testcase_data:
+//   version >= 2: kTestcaseMagic, uint32 version, uint32 reserved
+//   float atol, float rtol
+//   for each input, then (optionally) each expected output:
+//     uint32 dtype, uint32 sizeof(dtype), uint32 ndims, size_t dims[ndims],
+//     size_t num_bytes, [version >= 2: zero padding up to a multiple of
+//     kTestcaseAlignment], raw data
+// Version 1 files have no header (they start with atol) and no padding.
+static constexpr char kTestcaseMagic[8] = {'A', 'I', 'T', 'T', 'C', 'A', 'S', 'E'};
+static constexpr uint32_t kTestcaseVersion = 2;
+static constexpr size_t kTestcaseAlignment = 64;
+
+// Multiples of the tolerance (atol + rtol * |expected|) that the comparison
+// error histogram is bucketed by.
+static constexpr double kErrorHistogramThresholds[] = {0, 0.01, 0.1, 1, 10, 100};
+static constexpr size_t kNumErrorHistogramThresholds =
+    sizeof(kErrorHistogramThresholds) / sizeof(kErrorHistogramThresholds[0]);
+// Index of the threshold beyond which an element violates the tolerance.
+static constexpr size_t kToleranceThresholdIdx = 3;
+
+struct ComparisonStats {
+  size_t numel = 0;
+  size_t nan_count = 0;
+  size_t worst_idx = 0;
+  double worst_abs_diff = 0.0;
+  double max_rel_diff = 0.0;
+  // num_above[k]: elements whose error exceeds kErrorHistogramThresholds[k]
+  // times the tolerance.
+  std::array<size_t, kNumErrorHistogramThresholds> num_above{};
+
+  size_t violations() const {
+    return num_above[kToleranceThresholdIdx] + nan_count;
+  }
+
+  void merge(const ComparisonStats& other) {
+    numel += other.numel;
+    nan_count += other.nan_count;
+    if (other.worst_abs_diff > worst_abs_diff) {
+      worst_abs_diff = other.worst_abs_diff;
+      worst_idx = other.worst_idx;
+    }
+    max_rel_diff = std::max(max_rel_diff, other.max_rel_diff);
+    for (size_t k = 0; k < kNumErrorHistogramThresholds; ++k) {
+      num_above[k] += other.num_above[k];
+    }
+  }
+};
+
+// Compares elements [begin, end). Elements are converted to double a block
+// at a time, so that the comparison loop itself is branch free and can be
+// vectorized by the compiler.
 template <typename T>
-void read_element(std::ifstream& fh, T& elem) {
-  if (!fh.good()) {
-    throw std::runtime_error("Input stream is not in good state.");
+static ComparisonStats compare_range(
+    const T* data,
+    const T* expected_data,
+    size_t begin,
+    size_t end,
+    double atol,
+    double rtol) {
+  constexpr size_t kBlockSize = 1024;
+  double actual[kBlockSize];
+  double expected[kBlockSize];
+  ComparisonStats stats;
+  stats.numel = end - begin;
+  for (size_t block_begin = begin; block_begin < end;
+       block_begin += kBlockSize) {
+    const size_t n = std::min(kBlockSize, end - block_begin);
+    for (size_t i = 0; i < n; ++i) {
+      actual[i] = static_cast<double>(data[block_begin + i]);
+      expected[i] = static_cast<double>(expected_data[block_begin + i]);
+    }
+    double block_max_abs_diff = 0.0;
+    double block_max_rel_diff = 0.0;
+    size_t nan_count = 0;
+    size_t num_above[kNumErrorHistogramThresholds] = {};
+    for (size_t i = 0; i < n; ++i) {
+      const double diff = std::abs(actual[i] - expected[i]);
+      const double abs_expected = std::abs(expected[i]);
+      // as defined by torch.testing.assert_close
+      const double tolerated_diff = atol + rtol * abs_expected;
+      nan_count += diff != diff;
+      block_max_abs_diff = std::max(block_max_abs_diff, diff);
+      block_max_rel_diff = std::max(
+          block_max_rel_diff, abs_expected > 0 ? diff / abs_expected : 0.0);
+      for (size_t k = 0; k < kNumErrorHistogramThresholds; ++k) {
+        num_above[k] += diff > kErrorHistogramThresholds[k] * tolerated_diff;
+      }
+    }
+    if (block_max_abs_diff > stats.worst_abs_diff) {
+      stats.worst_abs_diff = block_max_abs_diff;
+      for (size_t i = 0; i < n; ++i) {
+        if (std::abs(actual[i] - expected[i]) == block_max_abs_diff) {
+          stats.worst_idx = block_begin + i;
+          break;
+        }
+      }
+    }
+    stats.max_rel_diff = std::max(stats.max_rel_diff, block_max_rel_diff);
+    stats.nan_count += nan_count;
+    for (size_t k = 0; k < kNumErrorHistogramThresholds; ++k) {
+      stats.num_above[k] += num_above[k];
+    }
   }
-  fh.read(reinterpret_cast<char*>(&elem), sizeof(T));
-  if (fh.fail()) {
-    throw std::runtime_error("Failed to read binary data");
+  return stats;
+}
+
+// Splits the comparison of large outputs across threads.
+template <typename T>
+static ComparisonStats compare_parallel(
+    const T* data,
+    const T* expected_data,
+    size_t numel,
+    double atol,
+    double rtol) {
+  constexpr size_t kMinElementsPerThread = 1 << 18;
+  const size_t num_threads = std::max<size_t>(
+      1,
+      std::min<size_t>(
+          std::thread::hardware_concurrency(),
+          numel / kMinElementsPerThread));
+  std::vector<ComparisonStats> partial(num_threads);
+  std::vector<std::thread> threads;
+  const size_t chunk = (numel + num_threads - 1) / num_threads;
+  for (size_t t = 0; t < num_threads; ++t) {
+    const size_t begin = std::min(numel, t * chunk);
+    const size_t end = std::min(numel, begin + chunk);
+    auto work = [&, t, begin, end]() {
+      partial[t] = compare_range(data, expected_data, begin, end, atol, rtol);
+    };
+    if (t + 1 == num_threads) {
+      work();
+    } else {
+      threads.emplace_back(work);
+    }
+  }
+  for (auto& thread : threads) {
+    thread.join();
   }
+  ComparisonStats stats;
+  for (const auto& part : partial) {
+    stats.merge(part);
+  }
+  return stats;
 }
 
 struct AITStandaloneTestcase {
@@ -295,11 +557,15 @@ struct AITStandaloneTestcase {
       inputs; // this will be filled the AITData instances for the inputs
 
   std::vector<int64_t> shape_data_owner;
+  std::vector<std::vector<int64_t>> output_shapes_owner;
   std::vector<GPUPtr> gpu_data_owner;
+  std::vector<OutputDataPtr> host_data_owner;
 
   const std::string test_data_path; // path to test data file
   AITemplateModelHandle& handle;
   AITemplateAllocator& allocator;
+  MappedFile testcase_file;
+  uint32_t version = 1;
 
   float atol;
   float rtol;
@@ -308,32 +574,103 @@ struct AITStandaloneTestcase {
       const char* test_data_path_,
       AITemplateModelHandle& handle_, // model handle
       AITemplateAllocator& allocator_)
-      : handle(handle_),
+      : test_data_path(test_data_path_),
+        handle(handle_),
         allocator(allocator_),
-        test_data_path(test_data_path_) {
+        testcase_file(test_data_path) {
     _load();
   }
 
-  void _load() { // relative error tolerance
+  // Reads and validates a tensor's metadata against the model's dtype and
+  // maximum shape. Returns the actual shape (backed by shape_data_owner) and
+  // a pointer to the tensor data in the mapped file.
+  const uint8_t* _read_tensor(
+      TestcaseReader& reader,
+      AITemplateDtype dtype,
+      AITemplateParamShape& shape) {
+    const size_t dtype_size = AITemplateDtypeSizeBytes(dtype);
+    const auto read_dtype = reader.read<unsigned int>();
+    std::cout << ", dtype=" << read_dtype;
+    const auto read_dtype_size = reader.read<unsigned int>();
+    std::cout << ", sizeof(dtype)=" << read_dtype_size;
+    const auto read_ndims = reader.read<unsigned int>();
+    std::cout << ", ndims=" << read_ndims;
+
+    if (static_cast<AITemplateDtype>(read_dtype) != dtype) {
+      throw std::runtime_error(
+          "Mismatch between dtype of tensor in testcase data and in model");
+    }
+    if (dtype_size != static_cast<size_t>(read_dtype_size)) {
+      throw std::runtime_error(
+          "Mismatch between sizeof(dtype) in testcase data and in model");
+    }
+    // Obtain maximum shape from model and verify the testcase data has valid
+    // shape
+    if (read_ndims != shape.size) {
+      throw std::runtime_error(
+          "Mismatch between number of tensor dimensions in testcase data and in model");
+    }
+    const size_t shape_offset = shape_data_owner.size();
+    std::cout << ", shape=(";
+    for (unsigned j = 0; j < read_ndims; j++) {
+      const auto dim = reader.read<size_t>();
+      shape_data_owner.push_back(dim);
+      std::cout << dim << ", ";
+      if (static_cast<int64_t>(dim) > shape.shape_data[j]) {
+        throw std::runtime_error(
+            "Shape in testcase data exceeds maximum shape.");
+      }
+    }
+    std::cout << ")";
+    // Set the shape to the actual, and not the maximum shape. The previous
+    // shape.shape_data may not be deleted as it's owned by the model.
+    // shape_data_owner has been reserved up front, so this stays valid.
+    shape.shape_data = shape_data_owner.data() + shape_offset;
+
+    // total number of bytes of tensor raw data
+    const auto read_total_tensor_bytes = reader.read<size_t>();
+    const size_t num_bytes = shape.Numel() * dtype_size;
+    std::cout << ", total_tensor_bytes=" << read_total_tensor_bytes
+              << " - model expects " << num_bytes << "\n";
+    if (num_bytes != read_total_tensor_bytes) {
+      throw std::runtime_error("Tensor data total size mismatch.");
+    }
+    if (version >= 2) {
+      reader.align(kTestcaseAlignment);
+    }
+    return reader.bytes(num_bytes);
+  }
+
+  void* _malloc_host(size_t num_bytes) {
+    void* h_data;
+    DEVICE_CHECK(DeviceMallocHost(&h_data, num_bytes));
+    host_data_owner.emplace_back(
+        h_data, [](void* data) { FreeDeviceHostMemory(data); });
+    return h_data;
+  }
+
+  void _load() {
     size_t num_outputs = 0;
     size_t num_inputs = 0;
     AITemplateModelContainerGetNumInputs(handle, &num_inputs);
     AITemplateModelContainerGetNumOutputs(handle, &num_outputs);
-    ait_output_shapes_out.reserve(num_outputs);
-    expected_outputs.reserve(num_outputs);
-    host_outputs.reserve(num_outputs);
-    gpu_outputs.reserve(num_outputs);
-    std::ifstream fh(test_data_path);
-    read_element(fh, atol); // absolute error tolerance
-    read_element(fh, rtol); // relative error tolerance
 
-    gpu_data_owner.reserve(num_inputs + num_outputs);
-    ait_output_shapes_out.reserve(num_outputs);
+    TestcaseReader reader(testcase_file);
+    if (reader.starts_with(kTestcaseMagic, sizeof(kTestcaseMagic))) {
+      reader.bytes(sizeof(kTestcaseMagic));
+      version = reader.read<uint32_t>();
+      reader.read<uint32_t>(); // reserved
+      if (version < 2 || version > kTestcaseVersion) {
+        throw std::runtime_error(
+            "Unsupported testcase file version " + std::to_string(version));
+      }
+    }
+    atol = reader.read<float>(); // absolute error tolerance
+    rtol = reader.read<float>(); // relative error tolerance
 
-    std::map<std::string, unsigned> input_name_to_index;
-    size_t total_dim_count =
-        0; // the sum of shape.ndims for all input and output tensors
-    // calculate total_dim_count
+    // This vector owns the memory for the shape.shape_data values, so it
+    // must not reallocate.
+    size_t total_dim_count = 0;
     for (unsigned i = 0; i < num_inputs; i++) {
       AITemplateParamShape shape;
       AITemplateModelContainerGetMaximumInputShape(handle, i, &shape);
@@ -342,201 +679,76 @@ struct AITStandaloneTestcase {
     for (unsigned i = 0; i < num_outputs; i++) {
       AITemplateParamShape shape;
       AITemplateModelContainerGetMaximumOutputShape(handle, i, &shape);
-      total_dim_count += shape.size * 2; // allocation required twice
+      total_dim_count += shape.size;
     }
-    // this is just a vector that owns the memory for the shape.shape_data
-    // values
     shape_data_owner.reserve(total_dim_count);
-    size_t shape_offset = 0; // offset into the shape_data_owner array
+    gpu_data_owner.reserve(num_inputs + num_outputs);
+
     for (unsigned i = 0; i < num_inputs; i++) {
       // for each input tensor
       const char* name;
       AITemplateModelContainerGetInputName(handle, i, &name);
       AITemplateDtype dtype;
       AITemplateModelContainerGetInputDtype(handle, i, &dtype);
-      size_t dtype_size = AITemplateDtypeSizeBytes(dtype);
       AITemplateParamShape shape;
       AITemplateModelContainerGetMaximumInputShape(handle, i, &shape);
 
-      input_name_to_index.insert({name, i});
       std::cout << "Loading input: " << name << ", at idx: " << i;
-
-      // Read metadata for test case
-      unsigned int read_dtype;
-      unsigned int read_dtype_size;
-      unsigned int read_ndims;
-      size_t read_total_tensor_bytes;
-      read_element(fh, read_dtype);
-      std::cout << ", dtype=" << read_dtype;
-      read_element(fh, read_dtype_size);
-      std::cout << ", sizeof(dtype)=" << read_dtype_size;
-      read_element(fh, read_ndims);
-      std::cout << ", ndims=" << read_ndims;
-
-      if (static_cast<AITemplateDtype>(read_dtype) != dtype) {
-        throw std::runtime_error(
-            "Mismatch between dtype of input in testcase data and in model");
-      }
-
-      if (dtype_size != static_cast<size_t>(read_dtype_size)) {
-        throw std::runtime_error(
-            "Mismatch between sizeof(dtype) in testcase data and in model");
-      }
-
-      // Obtain maximum shape from model and verify the testcase data has valid
-      // shape
-      if (read_ndims != shape.size) {
-        throw std::runtime_error(
-            "Mismatch between number of input dimensions in testcase data and in model");
-      }
-      std::cout << ", shape=(";
-      for (unsigned j = 0; j < read_ndims; j++) {
-        size_t dim;
-        read_element(fh, dim);
-        shape_data_owner.push_back(dim);
-        std::cout << dim << ", ";
-        if (dim > shape.shape_data[j]) {
-          throw std::runtime_error(
-              "Shape in testcase data exceeds maximum shape.");
-        }
-      }
-      std::cout << ")";
-
-      // Set the shape of the input to the actual, and not the maximum shape.
-      // the previous shape.shape_data may not be deleted as it's owned by the
-      // model.
-      shape.shape_data = shape_data_owner.data() + shape_offset;
-      shape_offset += read_ndims; // move offset to the next unused space
-
-      // total number of bytes of tensor raw data
-      read_element(fh, read_total_tensor_bytes);
-
-      size_t numel = shape.Numel();
-      size_t num_bytes = numel * AITemplateDtypeSizeBytes(dtype);
-      std::cout << ", total_tensor_bytes=" << read_total_tensor_bytes
-                << " - model expects " << num_bytes << "\n";
-      if (num_bytes != read_total_tensor_bytes) {
-        throw std::runtime_error("Tensor data total size mismatch.");
-      }
-      // allocate memory for tensor raw data on host
-      void* h_data;
-      DEVICE_CHECK(DeviceMallocHost(&h_data, num_bytes));
-      // read tensor raw data from file
-      fh.read(reinterpret_cast<char*>(h_data), read_total_tensor_bytes);
-      // Allocate corresponding device memory and copy tensor raw data to device
+      const uint8_t* h_data = _read_tensor(reader, dtype, shape);
+      const size_t num_bytes = shape.Numel() * AITemplateDtypeSizeBytes(dtype);
+      // Copy straight from the mapped file to the device.
       gpu_data_owner.emplace_back(RAII_DeviceMalloc(num_bytes, allocator));
       DEVICE_CHECK(
           CopyToDevice(gpu_data_owner.back().get(), h_data, num_bytes));
-
-      // free host memory for tensor
-      DEVICE_CHECK(FreeDeviceHostMemory(h_data));
-
       inputs.push_back(AITData(gpu_data_owner.back().get(), shape, dtype));
     }
     std::cout << "Finished loading testcase inputs." << "\n";
-    if (fh.peek() == std::ifstream::traits_type::eof()) {
+    if (reader.at_end()) {
       std::cout << "No expected outputs in testcase." << "\n";
       return;
     }
-    if (inputs.size() != num_inputs) {
-      throw std::runtime_error("Number of inputs mismatches with expected.");
-    }
-    // read expected outputs from file
+
+    expected_outputs.reserve(num_outputs);
+    host_outputs.reserve(num_outputs);
+    gpu_outputs.reserve(num_outputs);
+    output_shapes_owner.resize(num_outputs);
+    ait_output_shapes_out.reserve(num_outputs);
     for (unsigned i = 0; i < num_outputs; i++) {
-      // for each input tensor
       const char* name;
       AITemplateModelContainerGetOutputName(handle, i, &name);
       AITemplateDtype dtype;
       AITemplateModelContainerGetOutputDtype(handle, i, &dtype);
-      size_t dtype_size = AITemplateDtypeSizeBytes(dtype);
-      AITemplateParamShape shape;
-      AITemplateModelContainerGetMaximumOutputShape(handle, i, &shape);
       AITemplateParamShape max_shape;
       AITemplateModelContainerGetMaximumOutputShape(handle, i, &max_shape);
-
-      size_t max_numel = shape.Numel();
-      size_t max_num_bytes = max_numel * AITemplateDtypeSizeBytes(dtype);
+      const size_t max_num_bytes =
+          max_shape.Numel() * AITemplateDtypeSizeBytes(dtype);
 
       gpu_data_owner.emplace_back(RAII_DeviceMalloc(max_num_bytes, allocator));
       gpu_outputs.push_back(
           AITData(gpu_data_owner.back().get(), max_shape, dtype));
 
       std::cout << "Loading expected output: " << name << ", at idx: " << i;
-
-      // Read metadata for test case
-      unsigned int read_dtype;
-      unsigned int read_dtype_size;
-      unsigned int read_ndims;
-      size_t read_total_tensor_bytes;
-      read_element(fh, read_dtype);
-      std::cout << ", dtype=" << read_dtype;
-      read_element(fh, read_dtype_size);
-      std::cout << ", sizeof(dtype)=" << read_dtype_size;
-      read_element(fh, read_ndims);
-      std::cout << ", ndims=" << read_ndims;
-
-      if (static_cast<AITemplateDtype>(read_dtype) != dtype) {
-        throw std::runtime_error(
-            "Mismatch between dtype of input in testcase data and in model");
-      }
-
-      if (dtype_size != static_cast<size_t>(read_dtype_size)) {
-        throw std::runtime_error(
-            "Mismatch between sizeof(dtype) in testcase data and in model");
-      }
-
-      // Obtain maximum shape from model and verify the testcase data has valid
-      // shape
-      if (read_ndims != shape.size) {
-        throw std::runtime_error(
-            "Mismatch between number of input dimensions in testcase data and in model");
-      }
-      std::cout << ", shape=(";
-      for (unsigned j = 0; j < read_ndims; j++) {
-        size_t dim;
-        read_element(fh, dim);
-        shape_data_owner.push_back(dim);
-        std::cout << dim << ", ";
-        if (dim > shape.shape_data[j]) {
-          throw std::runtime_error(
-              "Shape in testcase data exceeds maximum shape.");
-        }
-      }
-      std::cout << ")";
-
-      // Set the shape of the input to the actual, and not the maximum shape.
-      // the previous shape.shape_data may not be deleted as it's owned by the
-      // model.
-      shape.shape_data = shape_data_owner.data() + shape_offset;
-      shape_offset += read_ndims; // move offset to the next unused space
-
-      // total number of bytes of tensor raw data
-      read_element(fh, read_total_tensor_bytes);
-
-      size_t numel = shape.Numel();
-      size_t num_bytes = numel * AITemplateDtypeSizeBytes(dtype);
-      std::cout << ", total_tensor_bytes=" << read_total_tensor_bytes
-                << " - model expects " << num_bytes << "\n";
-      if (num_bytes != read_total_tensor_bytes) {
-        throw std::runtime_error("Tensor data total size mismatch.");
+      AITemplateParamShape shape = max_shape;
+      const uint8_t* expected_data = _read_tensor(reader, dtype, shape);
+      const size_t num_bytes = shape.Numel() * AITemplateDtypeSizeBytes(dtype);
+      if (reinterpret_cast<uintptr_t>(expected_data) % kTestcaseAlignment !=
+          0) {
+        // Version 1 files don't align tensor data; copy it out so that it
+        // can be accessed as an array of its dtype.
+        void* aligned = _malloc_host(num_bytes);
+        std::memcpy(aligned, expected_data, num_bytes);
+        expected_data = static_cast<const uint8_t*>(aligned);
       }
-      // allocate memory for tensor raw data on host
-      void* h_data_expected;
-      void* h_data;
-      DEVICE_CHECK(
-          DeviceMallocHost(&h_data, max_num_bytes)); // max size required here
-      DEVICE_CHECK(DeviceMallocHost(&h_data_expected, num_bytes));
 
-      // read tensor raw data from file
-      fh.read(
-          reinterpret_cast<char*>(h_data_expected), read_total_tensor_bytes);
-
-      // ---
-      // Memory to place output tensors on host
-      host_outputs.emplace_back(h_data, shape, dtype);
-      ait_output_shapes_out.push_back(shape_data_owner.data());
-      shape_offset += read_ndims;
-      expected_outputs.emplace_back(h_data_expected, shape, dtype);
+      // Memory to place output tensors on host; max size required here.
+      host_outputs.emplace_back(_malloc_host(max_num_bytes), shape, dtype);
+      output_shapes_owner[i].resize(max_shape.size);
+      ait_output_shapes_out.push_back(output_shapes_owner[i].data());
+      expected_outputs.emplace_back(
+          const_cast<uint8_t*>(expected_data), shape, dtype);
+    }
+    if (!reader.at_end()) {
+      throw std::runtime_error("Unexpected trailing data in testcase file.");
     }
   }
 
@@ -637,32 +849,39 @@ struct AITStandaloneTestcase {
         return false;
       }
     }
-    size_t numel = host_outputs[output_idx].shape.Numel();
-    T* data = reinterpret_cast<T*>(host_outputs[output_idx].ptr);
-    T* expected_data = reinterpret_cast<T*>(expected_outputs[output_idx].ptr);
-    size_t violations = 0;
-    int worst_idx = -1;
-    double worst_abs_diff = 0.0;
-
-    for (size_t i = 0; i < numel; ++i) {
-      double val = static_cast<double>(data[i]);
-      double expected = static_cast<double>(expected_data[i]);
-      double actual_diff = std::abs(val - expected);
-      double tolerated_diff = atol +
-          rtol * std::abs(expected); // as defined by torch.testing.assert_close
-      if (actual_diff > worst_abs_diff) {
-        worst_abs_diff = actual_diff;
-      }
-      if (actual_diff > tolerated_diff) {
-        violations++;
-      }
+    const size_t numel = host_outputs[output_idx].shape.Numel();
+    const T* data = reinterpret_cast<const T*>(host_outputs[output_idx].ptr);
+    const T* expected_data =
+        reinterpret_cast<const T*>(expected_outputs[output_idx].ptr);
+    const auto stats = compare_parallel(data, expected_data, numel, atol, rtol);
+
+    std::cout << "Output #" << output_idx << ": max abs error "
+              << stats.worst_abs_diff << " at index " << stats.worst_idx;
+    if (numel > 0) {
+      std::cout << " (actual " << static_cast<double>(data[stats.worst_idx])
+                << ", expected "
+                << static_cast<double>(expected_data[stats.worst_idx]) << ")";
     }
-    if (violations > 0) {
+    std::cout << ", max rel error " << stats.max_rel_diff << "\n";
+    if (stats.violations() > 0) {
       std::cout
           << "Actual output and expected output are not equal for output with index "
-          << output_idx << " of " << numel << " elements, " << violations
+          << output_idx << " of " << numel << " elements, "
+          << stats.violations()
           << " differed by more than the tolerance of atol=" << atol
-          << " and rtol=" << rtol << rtol << "\n";
+          << " and rtol=" << rtol << " (" << stats.nan_count << " NaN)\n";
+      std::cout << "  error histogram, in multiples of the tolerance:";
+      std::cout << " exact: "
+                << numel - stats.nan_count - stats.num_above[0];
+      for (size_t k = 1; k < kNumErrorHistogramThresholds; ++k) {
+        std::cout << ", (" << kErrorHistogramThresholds[k - 1] << ", "
+                  << kErrorHistogramThresholds[k]
+                  << "]: " << stats.num_above[k - 1] - stats.num_above[k];
+      }
+      std::cout << ", >"
+                << kErrorHistogramThresholds[kNumErrorHistogramThresholds - 1]
+                << ": " << stats.num_above[kNumErrorHistogramThresholds - 1]
+                << "\n";
       return false;
     }
     return true;
@@ -710,6 +929,271 @@ int run_testcase(const char* input_file, bool benchmark) {
   return 0;
 }
 
+struct LoadTestOptions {
+  // Offered load, in requests per second.
+  double qps = 100.0;
+  // Exponentially distributed gaps between requests instead of fixed ones.
+  bool poisson = false;
+  // Number of submitting threads, i.e. the maximum number of requests in
+  // flight. Requests that arrive while all threads are busy queue up.
+  size_t num_threads = 4;
+  size_t num_runtimes = 2;
+  double duration_s = 10.0;
+  size_t num_warmup = 10;
+  // If not empty, run once for each of these loads instead of qps.
+  std::vector<double> sweep_qps;
+};
+
+struct LoadTestResult {
+  double offered_qps = 0;
+  double achieved_qps = 0;
+  size_t num_errors = 0;
+  // Sorted.
+  std::vector<double> latencies_ms;
+
+  double percentile(double p) const {
+    return NearestRankPercentile(latencies_ms, p);
+  }
+};
+
+// Device output buffers (of the maximum shapes) for one submitting thread.
+struct LoadTestOutputs {
+  LoadTestOutputs(AITemplateModelHandle handle, AITemplateAllocator& allocator) {
+    size_t num_outputs = 0;
+    AITemplateModelContainerGetNumOutputs(handle, &num_outputs);
+    shapes.resize(num_outputs);
+    for (unsigned i = 0; i < num_outputs; i++) {
+      AITemplateParamShape shape;
+      AITemplateModelContainerGetMaximumOutputShape(handle, i, &shape);
+      AITemplateDtype dtype;
+      AITemplateModelContainerGetOutputDtype(handle, i, &dtype);
+      owner.emplace_back(RAII_DeviceMalloc(
+          shape.Numel() * AITemplateDtypeSizeBytes(dtype), allocator));
+      outputs.emplace_back(owner.back().get(), shape, dtype);
+      shapes[i].resize(shape.size);
+      shape_ptrs.push_back(shapes[i].data());
+    }
+  }
+
+  std::vector<GPUPtr> owner;
+  std::vector<AITData> outputs;
+  std::vector<std::vector<int64_t>> shapes;
+  std::vector<int64_t*> shape_ptrs;
+};
+
+// Runs the testcase inputs open loop: requests are issued at their scheduled
+// arrival time no matter how long earlier ones take, and latencies are
+// measured from that time. Once the model can't keep up, requests queue and
+// the queueing delay shows up in the latencies, as it would for real traffic.
+static LoadTestResult run_load_level(
+    AITemplateModelHandle handle,
+    AITemplateAllocator& allocator,
+    AITStandaloneTestcase& testcase,
+    const LoadTestOptions& options,
+    double qps) {
+  using Clock = std::chrono::steady_clock;
+  const size_t num_requests =
+      std::max<size_t>(1, static_cast<size_t>(qps * options.duration_s));
+  const auto arrival_s = ArrivalTimes(num_requests, qps, options.poisson);
+  std::vector<Clock::duration> arrivals(num_requests);
+  for (size_t i = 0; i < num_requests; i++) {
+    arrivals[i] = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(arrival_s[i]));
+  }
+
+  std::vector<LoadTestOutputs> outputs;
+  outputs.reserve(options.num_threads);
+  for (size_t i = 0; i < options.num_threads; i++) {
+    outputs.emplace_back(handle, allocator);
+  }
+  std::vector<double> latencies_ms(num_requests, -1.0);
+  std::atomic<size_t> next_request{0};
+  std::atomic<size_t> num_errors{0};
+  // Leave the threads some time to start up.
+  const auto start = Clock::now() + std::chrono::milliseconds(10);
+
+  auto submit = [&](size_t thread_idx) {
+    auto stream = RAII_StreamCreate(/*non_blocking=*/true);
+    auto& out = outputs[thread_idx];
+    while (true) {
+      const size_t i = next_request.fetch_add(1);
+      if (i >= num_requests) {
+        break;
+      }
+      const auto scheduled = start + arrivals[i];
+      std::this_thread::sleep_until(scheduled);
+      auto err = AITemplateModelContainerRun(
+          handle,
+          testcase.inputs.data(),
+          testcase.inputs.size(),
+          out.outputs.data(),
+          out.outputs.size(),
+          reinterpret_cast<AITemplateStreamHandle>(stream.get()),
+          /*sync=*/true,
+          /*graph_mode=*/false,
+          out.shape_ptrs.data());
+      if (err != AITemplateError::AITemplateSuccess) {
+        num_errors++;
+        continue;
+      }
+      latencies_ms[i] =
+          std::chrono::duration<double, std::milli>(Clock::now() - scheduled)
+              .count();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < options.num_threads; i++) {
+    threads.emplace_back(submit, i);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const double elapsed_s =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  LoadTestResult result;
+  result.offered_qps = qps;
+  result.num_errors = num_errors;
+  for (double latency_ms : latencies_ms) {
+    if (latency_ms >= 0) {
+      result.latencies_ms.push_back(latency_ms);
+    }
+  }
+  std::sort(result.latencies_ms.begin(), result.latencies_ms.end());
+  result.achieved_qps = result.latencies_ms.size() / elapsed_s;
+  return result;
+}
+
+static void print_load_result(const LoadTestResult& result) {
+  std::cout << std::fixed << std::setprecision(3) << std::setw(12)
+            << result.offered_qps << std::setw(14) << result.achieved_qps
+            << std::setw(10) << result.percentile(0.5) << std::setw(10)
+            << result.percentile(0.9) << std::setw(10)
+            << result.percentile(0.99) << std::setw(10)
+            << result.percentile(0.999) << std::setw(10)
+            << (result.latencies_ms.empty() ? 0.0
+                                            : result.latencies_ms.back())
+            << std::setw(8) << result.num_errors << std::endl;
+}
+
+int run_loadtest(const char* input_file, const LoadTestOptions& options) {
+  AITemplateModelHandle handle;
+  AIT_ERROR_CHECK(
+      AITemplateModelContainerCreate(&handle, options.num_runtimes));
+  // Runtimes are created lazily; don't let that skew the first level.
+  AIT_ERROR_CHECK(AITemplateModelContainerPrewarmRuntimes(handle, true));
+  AITemplateAllocator* allocator;
+  AIT_ERROR_CHECK(
+      AITemplateAllocatorCreate(&allocator, AITemplateAllocatorType::kDefault));
+  size_t num_failed_levels = 0;
+  {
+    AITStandaloneTestcase testcase(input_file, handle, *allocator);
+    {
+      LoadTestOutputs warmup_outputs(handle, *allocator);
+      auto stream = RAII_StreamCreate(/*non_blocking=*/true);
+      for (size_t i = 0; i < options.num_warmup; i++) {
+        AIT_ERROR_CHECK(AITemplateModelContainerRun(
+            handle,
+            testcase.inputs.data(),
+            testcase.inputs.size(),
+            warmup_outputs.outputs.data(),
+            warmup_outputs.outputs.size(),
+            reinterpret_cast<AITemplateStreamHandle>(stream.get()),
+            /*sync=*/true,
+            /*graph_mode=*/false,
+            warmup_outputs.shape_ptrs.data()));
+      }
+    }
+
+    auto levels = options.sweep_qps;
+    if (levels.empty()) {
+      levels.push_back(options.qps);
+    }
+    std::cout << "Load test with " << input_file << ": "
+              << (options.poisson ? "poisson" : "fixed-rate")
+              << " arrivals, threads=" << options.num_threads
+              << ", runtimes=" << options.num_runtimes
+              << ", duration=" << options.duration_s << "s\n";
+    std::cout << std::setw(12) << "offered_qps" << std::setw(14)
+              << "achieved_qps" << std::setw(10) << "p50_ms" << std::setw(10)
+              << "p90_ms" << std::setw(10) << "p99_ms" << std::setw(10)
+              << "p999_ms" << std::setw(10) << "max_ms" << std::setw(8)
+              << "errors" << std::endl;
+    std::vector<LoadTestResult> results;
+    for (double qps : levels) {
+      results.push_back(
+          run_load_level(handle, *allocator, testcase, options, qps));
+      print_load_result(results.back());
+      if (results.back().num_errors > 0) {
+        num_failed_levels++;
+      }
+    }
+
+    if (results.size() > 1) {
+      // The levels are sorted by load, see parse_loadtest_options().
+      std::vector<LoadLevelSummary> summaries;
+      for (const auto& result : results) {
+        summaries.push_back(
+            {result.offered_qps,
+             result.achieved_qps,
+             result.percentile(0.99)});
+      }
+      const int knee = SelectKnee(summaries);
+      if (knee < 0) {
+        std::cout << "Saturated at all loads in the sweep.\n";
+      } else {
+        std::cout << "Saturation knee: ~" << summaries[knee].offered_qps
+                  << " QPS (p99 " << summaries[knee].p99_ms << " ms)\n";
+      }
+    }
+  }
+  AIT_ERROR_CHECK(AITemplateAllocatorDelete(allocator));
+  AITemplateModelContainerDelete(handle);
+  return num_failed_levels == 0 ? 0 : 1;
+}
+
+// Parses --name=value options of the loadtest action.
+static LoadTestOptions parse_loadtest_options(int argc, char* argv[]) {
+  LoadTestOptions options;
+  for (int i = 0; i < argc; i++) {
+    const std::string arg(argv[i]);
+    const auto eq = arg.find('=');
+    const std::string name = arg.substr(0, eq);
+    const std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+    if (name == "--qps") {
+      options.qps = std::stod(value);
+    } else if (name == "--poisson") {
+      options.poisson = true;
+    } else if (name == "--threads") {
+      options.num_threads = std::stoul(value);
+    } else if (name == "--runtimes") {
+      options.num_runtimes = std::stoul(value);
+    } else if (name == "--duration") {
+      options.duration_s = std::stod(value);
+    } else if (name == "--warmup") {
+      options.num_warmup = std::stoul(value);
+    } else if (name == "--sweep") {
+      std::stringstream ss(value);
+      std::string qps;
+      while (std::getline(ss, qps, ',')) {
+        options.sweep_qps.push_back(std::stod(qps));
+      }
+      std::sort(options.sweep_qps.begin(), options.sweep_qps.end());
+    } else {
+      throw std::runtime_error("Unknown loadtest option " + arg);
+    }
+  }
+  if (options.qps <= 0 || options.num_threads == 0 ||
+      options.num_runtimes == 0 || options.duration_s <= 0 ||
+      std::any_of(
+          options.sweep_qps.begin(), options.sweep_qps.end(), [](double qps) {
+            return qps <= 0;
+          })) {
+    throw std::runtime_error("Invalid loadtest options");
+  }
+  return options;
+}
+
 int run_with_random_inputs() {
   AITemplateModelHandle handle;
   AITemplateModelContainerCreate(&handle, /*num_runtimes*/ 1);
@@ -755,7 +1239,21 @@ int main(int argc, char* argv[]) {
                 << " test <testcase-file-1> ... <testcase-file-N>" << std::endl
                 << " run tests and benchmark: " << argv[0]
                 << " benchmark <testcase-file-1> ... <testcase-file-N>"
-                << std::endl;
+                << std::endl
+                << " run a load test:         " << argv[0]
+                << " loadtest <testcase-file> [--qps=100] [--poisson]"
+                << " [--threads=4] [--runtimes=2] [--duration=10]"
+                << " [--warmup=10] [--sweep=<qps-1>,...,<qps-N>]" << std::endl;
+    }
+    if (action == "loadtest") {
+      if (argc < 3) {
+        std::cout
+            << "Invalid number of arguments. Require a test case as argument"
+            << std::endl;
+        return 1;
+      }
+      return run_loadtest(
+          argv[2], parse_loadtest_options(argc - 3, argv + 3));
     }
     if ((action == "test") or (action == "benchmark")) {
       if (argc < 3) {
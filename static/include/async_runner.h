@@ -0,0 +1,122 @@
+//  Copyright (c) Meta Platforms, Inc. and affiliates.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+#pragma once
+
+#include "model_interface.h"
+#include "raii_wrapper.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ait {
+
+class ModelContainer;
+
+// Completion state of a single RunAsync() call. Shared between the
+// AsyncRunner and the AITemplateRunHandle given to the user, so either
+// side may go away first.
+class AsyncRunState {
+ public:
+  bool IsDone();
+  // Blocks until the run has completed and returns its status.
+  AITemplateError Wait();
+  // Only meaningful once IsDone() returns true.
+  AITemplateError Status();
+
+  void Complete(AITemplateError status);
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool done_ = false;
+  AITemplateError status_ = AITemplateError::AITemplateSuccess;
+};
+
+// AsyncRunner implements ModelContainer::RunAsync(). RunAsync() only copies
+// the request and enqueues it. The request then goes through two threads:
+// - The dispatch thread calls ModelContainer::Run() without syncing. It is
+//   the one that blocks when every runtime is busy.
+// - The completion thread polls the stream events of all dispatched runs.
+//   Once a run's event has completed, it returns the runtime to the
+//   container's pool and then invokes the callback and marks the run handle
+//   as done. Runs on different streams therefore complete in the order they
+//   finish on the device, not in the order they were enqueued.
+// Callbacks run on the completion thread, including those of runs that
+// failed to dispatch, and must not block; in particular they must not wait
+// for other async runs on the same container.
+class AsyncRunner {
+ public:
+  explicit AsyncRunner(ModelContainer& container);
+  // Drains all queued runs before returning.
+  ~AsyncRunner();
+
+  AsyncRunner(const AsyncRunner&) = delete;
+  AsyncRunner& operator=(const AsyncRunner&) = delete;
+
+  std::shared_ptr<AsyncRunState> Enqueue(
+      const AITData* inputs,
+      size_t num_inputs,
+      AITData* outputs,
+      size_t num_outputs,
+      StreamType stream,
+      bool graph_mode,
+      int64_t** output_shapes_out,
+      AITemplateRunCallback callback,
+      void* user_data);
+
+ private:
+  struct Request {
+    // Deep copies of the caller's AITData arrays, including shapes.
+    std::vector<AITData> inputs;
+    std::vector<std::vector<int64_t>> input_shapes;
+    std::vector<AITData> outputs;
+    std::vector<std::vector<int64_t>> output_shapes;
+    StreamType stream;
+    bool graph_mode;
+    int64_t** output_shapes_out;
+    AITemplateRunCallback callback;
+    void* user_data;
+    std::shared_ptr<AsyncRunState> state;
+    // Recorded on the request's stream after dispatch.
+    EventPtr finished{nullptr, DestroyEvent};
+    // Set by the dispatch thread if Run() threw; the completion thread then
+    // finishes the request without waiting for finished.
+    AITemplateError dispatch_status = AITemplateError::AITemplateSuccess;
+  };
+
+  void DispatchLoop();
+  void CompletionLoop();
+  void Finish(Request& request, AITemplateError status);
+
+  ModelContainer& container_;
+
+  std::mutex mutex_;
+  std::condition_variable dispatch_cv_;
+  std::condition_variable completion_cv_;
+  std::deque<std::unique_ptr<Request>> dispatch_queue_;
+  std::deque<std::unique_ptr<Request>> completion_queue_;
+  bool stop_ = false;
+  // Set by the dispatch thread once it has drained dispatch_queue_ after
+  // stop_ was set.
+  bool dispatch_done_ = false;
+  std::thread dispatch_thread_;
+  std::thread completion_thread_;
+};
+
+} // namespace ait
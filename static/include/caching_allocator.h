@@ -0,0 +1,271 @@
+//  Copyright (c) Meta Platforms, Inc. and affiliates.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+#pragma once
+
+#include "logging.h"
+#include "model_interface.h"
+
+#include <algorithm>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ait {
+
+// The logic behind AITemplateAllocatorType::kCaching. It only talks to the
+// device through the Device template argument, so it can be tested on the
+// host with a fake device (see
+// tests/unittest/backend/caching_allocator_fake_device.cpp).
+//
+// Device must provide:
+//   using StreamType = ...; using EventType = ...;
+//   void* Malloc(size_t num_bytes);  // nullptr when out of memory
+//   void Free(void* ptr);
+//   EventType RecordEvent(StreamType stream);  // creates and records
+//   bool EventDone(EventType event);
+//   void DestroyEvent(EventType event);
+//
+// Allocations are rounded up to a size class: multiples of kSmallRound bytes
+// below kSmallLimit, multiples of kLargeRound above. Freed blocks are cached
+// by size and handed out again to requests of the same or up to half the
+// size; they are only returned to the device by EmptyCache(), or when a new
+// block would not fit otherwise.
+//
+// Like the default allocator, Free() assumes the device is done with the
+// memory. If work that uses the block may still be queued, call
+// RecordStream() for each stream first: the block is then only reused once
+// all work queued on those streams at Free() time has completed. Model does
+// so when a larger memory plan replaces its blob.
+template <typename Device>
+class CachingAllocatorImpl {
+ public:
+  using StreamType = typename Device::StreamType;
+  using EventType = typename Device::EventType;
+
+  static constexpr size_t kSmallRound = 512;
+  static constexpr size_t kSmallLimit = 1 << 20;
+  static constexpr size_t kLargeRound = 2 << 20;
+
+  // max_reserved_bytes caps the total number of bytes held from the device
+  // (in use or cached). 0 means no cap.
+  explicit CachingAllocatorImpl(Device device, size_t max_reserved_bytes = 0)
+      : device_(std::move(device)), max_reserved_bytes_(max_reserved_bytes) {}
+
+  ~CachingAllocatorImpl() {
+    // Device errors can't be thrown from here; log them and keep releasing
+    // the remaining blocks.
+    for (auto& [ptr, block] : blocks_) {
+      for (auto event : block.events) {
+        LogOnError("destroy an event", [&]() { device_.DestroyEvent(event); });
+      }
+      LogOnError("free a block", [&]() { device_.Free(ptr); });
+    }
+  }
+
+  CachingAllocatorImpl(const CachingAllocatorImpl&) = delete;
+  CachingAllocatorImpl& operator=(const CachingAllocatorImpl&) = delete;
+
+  static size_t RoundSize(size_t num_bytes) {
+    const size_t round = num_bytes < kSmallLimit ? kSmallRound : kLargeRound;
+    return std::max<size_t>(1, (num_bytes + round - 1) / round) * round;
+  }
+
+  void* Allocate(size_t num_bytes) {
+    std::lock_guard lk(mutex_);
+    ProcessPendingFrees();
+    const size_t size = RoundSize(num_bytes);
+
+    void* ptr = TakeCachedBlock(size);
+    if (ptr != nullptr) {
+      ++stats_.num_cache_hits;
+    } else {
+      ptr = MallocBlock(size);
+    }
+    auto& block = blocks_.at(ptr);
+    block.in_use = true;
+    block.requested = num_bytes;
+    stats_.allocated_bytes += block.size;
+    stats_.requested_bytes += num_bytes;
+    stats_.cached_bytes -= block.size;
+    return ptr;
+  }
+
+  void Free(void* ptr) {
+    if (ptr == nullptr) {
+      return;
+    }
+    std::lock_guard lk(mutex_);
+    auto& block = GetInUseBlock(ptr, "Free");
+    block.in_use = false;
+    stats_.allocated_bytes -= block.size;
+    stats_.requested_bytes -= block.requested;
+    stats_.cached_bytes += block.size;
+    if (block.streams.empty()) {
+      free_blocks_.emplace(block.size, ptr);
+      return;
+    }
+    for (auto stream : block.streams) {
+      block.events.push_back(device_.RecordEvent(stream));
+    }
+    block.streams.clear();
+    pending_frees_.push_back(ptr);
+  }
+
+  void RecordStream(void* ptr, StreamType stream) {
+    std::lock_guard lk(mutex_);
+    auto& streams = GetInUseBlock(ptr, "RecordStream").streams;
+    if (std::find(streams.begin(), streams.end(), stream) == streams.end()) {
+      streams.push_back(stream);
+    }
+  }
+
+  // Return all cached blocks that the device is done with.
+  void EmptyCache() {
+    std::lock_guard lk(mutex_);
+    ProcessPendingFrees();
+    ReleaseCachedBlocks();
+  }
+
+  AITemplateCachingAllocatorStats GetStats() {
+    std::lock_guard lk(mutex_);
+    return stats_;
+  }
+
+ private:
+  template <typename Fn>
+  static void LogOnError(const char* what, Fn fn) noexcept {
+    try {
+      fn();
+    } catch (const std::exception& e) {
+      LOG(WARNING) << "CachingAllocator: failed to " << what << ": "
+                   << e.what();
+    } catch (...) {
+      LOG(WARNING) << "CachingAllocator: failed to " << what;
+    }
+  }
+
+  struct Block {
+    size_t size = 0;
+    size_t requested = 0;
+    bool in_use = false;
+    // Streams that may use the block; see RecordStream().
+    std::vector<StreamType> streams;
+    // Recorded on streams at Free(); the block is cached once all are done.
+    std::vector<EventType> events;
+  };
+
+  Block& GetInUseBlock(void* ptr, const char* caller) {
+    auto it = blocks_.find(ptr);
+    if (it == blocks_.end() || !it->second.in_use) {
+      throw std::runtime_error(
+          std::string("CachingAllocator::") + caller +
+          " called on a pointer that is not allocated");
+    }
+    return it->second;
+  }
+
+  void* TakeCachedBlock(size_t size) {
+    // Best fit, but don't waste more than half of a block.
+    auto it = free_blocks_.lower_bound(size);
+    if (it == free_blocks_.end() || it->first > 2 * size) {
+      return nullptr;
+    }
+    void* ptr = it->second;
+    free_blocks_.erase(it);
+    return ptr;
+  }
+
+  void* MallocBlock(size_t size) {
+    if (max_reserved_bytes_ != 0 &&
+        stats_.reserved_bytes + size > max_reserved_bytes_) {
+      ReleaseCachedBlocks();
+      if (stats_.reserved_bytes + size > max_reserved_bytes_) {
+        throw std::runtime_error(
+            "CachingAllocator: allocating " + std::to_string(size) +
+            " bytes would exceed max_reserved_bytes (" +
+            std::to_string(max_reserved_bytes_) + ", " +
+            std::to_string(stats_.reserved_bytes) + " reserved)");
+      }
+    }
+    void* ptr = device_.Malloc(size);
+    if (ptr == nullptr) {
+      // Retry once with everything cached given back to the device.
+      ReleaseCachedBlocks();
+      ptr = device_.Malloc(size);
+      if (ptr == nullptr) {
+        throw std::runtime_error(
+            "CachingAllocator: out of device memory allocating " +
+            std::to_string(size) + " bytes");
+      }
+    }
+    Block block;
+    block.size = size;
+    blocks_.emplace(ptr, std::move(block));
+    ++stats_.num_device_mallocs;
+    stats_.reserved_bytes += size;
+    stats_.cached_bytes += size;
+    stats_.peak_reserved_bytes =
+        std::max(stats_.peak_reserved_bytes, stats_.reserved_bytes);
+    return ptr;
+  }
+
+  void ProcessPendingFrees() {
+    auto done = [this](void* ptr) {
+      auto& block = blocks_.at(ptr);
+      for (auto event : block.events) {
+        if (!device_.EventDone(event)) {
+          return false;
+        }
+      }
+      for (auto event : block.events) {
+        device_.DestroyEvent(event);
+      }
+      block.events.clear();
+      free_blocks_.emplace(block.size, ptr);
+      return true;
+    };
+    pending_frees_.erase(
+        std::remove_if(pending_frees_.begin(), pending_frees_.end(), done),
+        pending_frees_.end());
+  }
+
+  void ReleaseCachedBlocks() {
+    for (auto& [size, ptr] : free_blocks_) {
+      device_.Free(ptr);
+      blocks_.erase(ptr);
+      ++stats_.num_device_frees;
+      stats_.reserved_bytes -= size;
+      stats_.cached_bytes -= size;
+    }
+    free_blocks_.clear();
+  }
+
+  Device device_;
+  const size_t max_reserved_bytes_;
+
+  std::mutex mutex_;
+  std::unordered_map<void*, Block> blocks_;
+  // Cached blocks that can be handed out right away, keyed by size.
+  std::multimap<size_t, void*> free_blocks_;
+  // Freed blocks that still wait for their events.
+  std::vector<void*> pending_frees_;
+  AITemplateCachingAllocatorStats stats_{};
+};
+
+} // namespace ait
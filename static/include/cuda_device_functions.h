@@ -326,6 +326,27 @@ inline DeviceError DeviceToDeviceCopy(
   return cudaMemcpyAsync(dst, src, size, cudaMemcpyDeviceToDevice, stream);
 }
 
+// Copy a height x width bytes rectangle between device buffers with the
+// given row pitches.
+inline DeviceError DeviceToDeviceCopy2D(
+    Handle dst,
+    size_t dst_pitch,
+    const void* src,
+    size_t src_pitch,
+    size_t width,
+    size_t height,
+    StreamType stream = 0) {
+  return cudaMemcpy2DAsync(
+      dst,
+      dst_pitch,
+      src,
+      src_pitch,
+      width,
+      height,
+      cudaMemcpyDeviceToDevice,
+      stream);
+}
+
 inline DeviceError FreeDeviceMemory(Handle src) {
   return cudaFree(src);
 }
@@ -0,0 +1,120 @@
+//  Copyright (c) Meta Platforms, Inc. and affiliates.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+#pragma once
+
+#include "model_container.h"
+#include "model_interface.h"
+#include "raii_wrapper.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ait {
+
+// DynamicBatcher sits in front of a ModelContainer and merges concurrent
+// small requests into a single Run().
+//
+// Every input and output must have a batch dimension at index
+// options.batch_dim. Run() enqueues the request and blocks the calling
+// thread. A worker thread concatenates queued requests along the batch
+// dimension into staging buffers, runs the model once and copies each
+// request's slice of the outputs back to the caller's output pointers. A
+// batch is flushed when it holds max_batch_size rows, or when its oldest
+// request has waited max_delay_us.
+//
+// There is one worker per runtime the container's pool may hold (its
+// max_runtimes when the batcher is created), each with its own stream and
+// staging buffers, so that as many batches can be in flight as there are
+// runtimes to run them. A worker allocates its staging buffers, sized for the
+// model's maximum shapes, the first time it merges a batch.
+//
+// Only requests whose non-batch dims match are batched together. A batch that
+// ends up with a single request is run directly on the caller's buffers, so
+// there is no copy overhead when there is nothing to batch.
+//
+// Inputs must be ready to be read when Run() is called (i.e. any stream that
+// produced them must have been synchronized), since the batcher copies them
+// on its own stream. Outputs are ready when Run() returns.
+//
+// The model's outputs must have total_rows rows along the batch dimension
+// when it is run with total_rows rows of inputs; otherwise the request fails.
+class DynamicBatcher {
+ public:
+  DynamicBatcher(
+      ModelContainer& container,
+      const AITemplateDynamicBatcherOptions& options);
+  ~DynamicBatcher();
+
+  DynamicBatcher(const DynamicBatcher&) = delete;
+  DynamicBatcher& operator=(const DynamicBatcher&) = delete;
+
+  void Run(
+      const AITData* inputs,
+      size_t num_inputs,
+      AITData* outputs,
+      size_t num_outputs,
+      int64_t** output_shapes_out);
+
+ private:
+  struct Request {
+    const AITData* inputs;
+    AITData* outputs;
+    int64_t** output_shapes_out;
+    int64_t rows;
+    // Input shapes with the batch dim zeroed out. Requests are only batched
+    // with requests that have the same signature.
+    std::vector<int64_t> signature;
+    std::chrono::steady_clock::time_point enqueue_time;
+    std::promise<void> done;
+  };
+
+  struct Worker {
+    StreamPtr stream{nullptr, StreamDestroy};
+    // Staging buffers for the concatenated inputs and outputs; empty until
+    // the worker merges its first batch.
+    std::vector<GPUPtr> batched_inputs;
+    std::vector<GPUPtr> batched_outputs;
+    std::thread thread;
+  };
+
+  void WorkerLoop(Worker& worker);
+  int64_t CompatibleQueuedRows(const Request& front) const;
+  std::vector<Request*> TakeBatch();
+  void RunBatch(Worker& worker, const std::vector<Request*>& batch);
+  void RunBatchImpl(Worker& worker, const std::vector<Request*>& batch);
+
+  ModelContainer& container_;
+  AITemplateDynamicBatcherOptions options_;
+  size_t num_inputs_;
+  size_t num_outputs_;
+  int64_t max_batch_size_;
+  // Sizes of the staging buffers.
+  std::vector<size_t> batched_input_bytes_;
+  std::vector<size_t> batched_output_bytes_;
+
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cv_;
+  std::deque<Request*> queue_;
+  bool stop_ = false;
+  std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+} // namespace ait
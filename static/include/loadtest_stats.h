@@ -0,0 +1,94 @@
+//  Copyright (c) Meta Platforms, Inc. and affiliates.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace ait {
+
+// The statistics of the standalone runner's loadtest action (see
+// static/csrc/standalone.cpp). They don't touch the device, so that they can
+// be tested on the host.
+
+// The p-th percentile (0 < p <= 1) of sorted_values by the nearest-rank
+// method, i.e. the smallest value that at least p of the values are not
+// greater than. 0 if there are no values.
+inline double NearestRankPercentile(
+    const std::vector<double>& sorted_values,
+    double p) {
+  if (sorted_values.empty()) {
+    return 0;
+  }
+  size_t idx = static_cast<size_t>(std::ceil(p * sorted_values.size()));
+  idx = std::min(std::max<size_t>(idx, 1), sorted_values.size());
+  return sorted_values[idx - 1];
+}
+
+// Arrival times, in seconds from the start, of num_requests requests offered
+// at qps. The gaps between them are either all 1 / qps, or exponentially
+// distributed with mean 1 / qps (a Poisson process). The random gaps are
+// seeded, so that runs at the same load are comparable.
+inline std::vector<double> ArrivalTimes(
+    size_t num_requests,
+    double qps,
+    bool poisson,
+    uint32_t seed = 1234) {
+  std::vector<double> arrivals(num_requests);
+  std::mt19937 rnd_generator(seed);
+  std::exponential_distribution<> gap_s(qps);
+  double t = 0;
+  for (size_t i = 0; i < num_requests; i++) {
+    arrivals[i] = t;
+    t += poisson ? gap_s(rnd_generator) : 1.0 / qps;
+  }
+  return arrivals;
+}
+
+struct LoadLevelSummary {
+  double offered_qps = 0;
+  double achieved_qps = 0;
+  double p99_ms = 0;
+};
+
+// The fraction of the offered load, and the growth of the p99 latency over
+// the lightest load, up to which a load counts as served on time.
+constexpr double kKneeMinAchievedFraction = 0.95;
+constexpr double kKneeMaxP99Growth = 2.0;
+
+// Index of the saturation knee of a load sweep, levels[0] being the lightest
+// load: the highest load that is still served on time. -1 if no load is.
+inline int SelectKnee(const std::vector<LoadLevelSummary>& levels) {
+  if (levels.empty()) {
+    return -1;
+  }
+  const double base_p99 = levels.front().p99_ms;
+  int knee = -1;
+  for (size_t i = 0; i < levels.size(); i++) {
+    const auto& level = levels[i];
+    if (level.achieved_qps >= kKneeMinAchievedFraction * level.offered_qps &&
+        level.p99_ms <= kKneeMaxP99Growth * base_p99 &&
+        (knee < 0 || level.offered_qps > levels[knee].offered_qps)) {
+      knee = static_cast<int>(i);
+    }
+  }
+  return knee;
+}
+
+} // namespace ait
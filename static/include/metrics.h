@@ -0,0 +1,240 @@
+//  Copyright (c) Meta Platforms, Inc. and affiliates.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ait {
+
+// A lock-free histogram of non-negative integer values (latencies in
+// microseconds), bucketed like HdrHistogram: values below kSubBuckets get
+// a bucket each, and every power of two range [2^k, 2^(k+1)) above is split
+// into kSubBuckets equal buckets. Reported percentiles are thus within
+// 1 / kSubBuckets (12.5%) of the exact value, for any magnitude.
+//
+// Record() is a handful of relaxed atomic adds, so it can be called from
+// any number of threads. Snapshots taken concurrently with Record() may be
+// off by the values being recorded at that moment.
+class LatencyHistogram {
+ public:
+  static constexpr size_t kSubBucketBits = 3;
+  static constexpr size_t kSubBuckets = 1 << kSubBucketBits;
+  static constexpr size_t kNumBuckets =
+      kSubBuckets + (64 - kSubBucketBits) * kSubBuckets;
+
+  struct Snapshot {
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    std::array<uint64_t, kNumBuckets> buckets{};
+
+    // The smallest bucket upper bound that at least a fraction p of the
+    // values are at or below, capped at max.
+    uint64_t Percentile(double p) const {
+      if (count == 0) {
+        return 0;
+      }
+      uint64_t rank = static_cast<uint64_t>(p * count + 0.5);
+      rank = std::min<uint64_t>(std::max<uint64_t>(rank, 1), count);
+      uint64_t seen = 0;
+      for (size_t i = 0; i < kNumBuckets; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+          return std::min(BucketUpperBound(i), max);
+        }
+      }
+      return max;
+    }
+
+    double Mean() const {
+      return count == 0 ? 0.0 : static_cast<double>(sum) / count;
+    }
+  };
+
+  void Record(uint64_t value) {
+    buckets_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (value > max &&
+           !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+  }
+
+  void Add(const Snapshot& other) {
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+      if (other.buckets[i] != 0) {
+        buckets_[i].fetch_add(other.buckets[i], std::memory_order_relaxed);
+      }
+    }
+    count_.fetch_add(other.count, std::memory_order_relaxed);
+    sum_.fetch_add(other.sum, std::memory_order_relaxed);
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (other.max > max &&
+           !max_.compare_exchange_weak(
+               max, other.max, std::memory_order_relaxed)) {
+    }
+  }
+
+  Snapshot Take() const {
+    Snapshot snapshot;
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+      snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    }
+    snapshot.count = count_.load(std::memory_order_relaxed);
+    snapshot.sum = sum_.load(std::memory_order_relaxed);
+    snapshot.max = max_.load(std::memory_order_relaxed);
+    return snapshot;
+  }
+
+  void Reset() {
+    for (auto& bucket : buckets_) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+  }
+
+  static size_t BucketIndex(uint64_t value) {
+    if (value < kSubBuckets) {
+      return value;
+    }
+    const size_t magnitude = FloorLog2(value);
+    const size_t shift = magnitude - kSubBucketBits;
+    const size_t sub_bucket = (value >> shift) - kSubBuckets;
+    return kSubBuckets + shift * kSubBuckets + sub_bucket;
+  }
+
+  static uint64_t BucketUpperBound(size_t idx) {
+    if (idx < kSubBuckets) {
+      return idx;
+    }
+    const size_t shift = (idx - kSubBuckets) / kSubBuckets;
+    const uint64_t sub_bucket = (idx - kSubBuckets) % kSubBuckets;
+    const uint64_t lower = (kSubBuckets + sub_bucket) << shift;
+    return lower + ((uint64_t(1) << shift) - 1);
+  }
+
+ private:
+  static size_t FloorLog2(uint64_t value) {
+    size_t result = 0;
+    for (size_t bits = 32; bits > 0; bits /= 2) {
+      if (value >> bits) {
+        value >>= bits;
+        result += bits;
+      }
+    }
+    return result;
+  }
+
+  std::array<std::atomic<uint64_t>, kNumBuckets> buckets_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_{0};
+  std::atomic<uint64_t> max_{0};
+};
+
+inline uint64_t MicrosecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Named histograms and counters, formatted for
+// AITemplateModelContainerGetMetrics.
+struct MetricsSnapshot {
+  std::vector<std::pair<const char*, LatencyHistogram::Snapshot>> histograms;
+  std::vector<std::pair<const char*, uint64_t>> counters;
+
+  // One "name value" line per counter and per histogram statistic, with
+  // percentiles as name{quantile="0.99"}, much like the Prometheus text
+  // format.
+  std::string ToText() const {
+    std::ostringstream os;
+    for (const auto& [name, value] : counters) {
+      os << name << " " << value << "\n";
+    }
+    for (const auto& [name, histogram] : histograms) {
+      os << name << "_count " << histogram.count << "\n";
+      os << name << "_sum " << histogram.sum << "\n";
+      os << name << "_max " << histogram.max << "\n";
+      for (const auto& quantile : kQuantiles) {
+        os << name << "{quantile=\"" << quantile.label << "\"} "
+           << histogram.Percentile(quantile.p) << "\n";
+      }
+    }
+    return os.str();
+  }
+
+  // {"counters": {name: value}, "histograms": {name: {"count", "sum",
+  // "mean", "max", "p50", ..., "buckets": [[upper_bound, count], ...]}}},
+  // where only the non-empty buckets are listed.
+  std::string ToJson() const {
+    std::ostringstream os;
+    os << "{\"counters\": {";
+    const char* sep = "";
+    for (const auto& [name, value] : counters) {
+      os << sep << "\"" << name << "\": " << value;
+      sep = ", ";
+    }
+    os << "}, \"histograms\": {";
+    sep = "";
+    for (const auto& [name, histogram] : histograms) {
+      os << sep << "\"" << name << "\": {\"count\": " << histogram.count
+         << ", \"sum\": " << histogram.sum
+         << ", \"mean\": " << histogram.Mean()
+         << ", \"max\": " << histogram.max;
+      for (const auto& quantile : kQuantiles) {
+        os << ", \"" << quantile.json_key
+           << "\": " << histogram.Percentile(quantile.p);
+      }
+      os << ", \"buckets\": [";
+      const char* bucket_sep = "";
+      for (size_t i = 0; i < LatencyHistogram::kNumBuckets; ++i) {
+        if (histogram.buckets[i] != 0) {
+          os << bucket_sep << "[" << LatencyHistogram::BucketUpperBound(i)
+             << ", " << histogram.buckets[i] << "]";
+          bucket_sep = ", ";
+        }
+      }
+      os << "]}";
+      sep = ", ";
+    }
+    os << "}}";
+    return os.str();
+  }
+
+ private:
+  struct Quantile {
+    const char* label;
+    const char* json_key;
+    double p;
+  };
+  static constexpr Quantile kQuantiles[] = {
+      {"0.5", "p50", 0.5},
+      {"0.9", "p90", 0.9},
+      {"0.99", "p99", 0.99},
+      {"0.999", "p999", 0.999}};
+};
+
+} // namespace ait
@@ -14,8 +14,17 @@
 //
 #pragma once
 
+#include "metrics.h"
+#include "op_trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <list>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace ait {
 
@@ -42,6 +51,19 @@ inline void DeviceCheckLastError(const char* file, int line) {
 //                           sizes
 // - DeviceToDeviceCopies(): Called at the end of infernece, copy views of
 //                           inputs/constants to the provided output pointer.
+// - GetDims()/SetDims():    Save/restore the values of all dynamic dims, so
+//                           that a cached graph can be replayed without
+//                           re-running the host-side shape inference.
+// - kNumTracedOps/TracedOps(): The ops in RunImpl, which brackets each op
+//                           with RecordOpTraceEvent() calls.
+//
+// Models compiled with memory plan buckets (kNumMemoryPlans > 1) also
+// implement:
+// - SelectMemoryPlan():     Index of the smallest memory plan that fits the
+//                           current input shapes.
+// - MemoryPlanBlobSize(i):  Blob size required by memory plan i.
+// - SetUpBlobTensors(blob, i): Point intermediate tensors into the blob
+//                           using memory plan i's offsets.
 //
 // In practice, inheriting classes are generated via MODEL_TEMPLATE in
 // python/aitemplate/backend/main_templates.py.
@@ -62,15 +84,18 @@ class ModelBase {
       : blob_(RAII_DeviceMalloc(blob_size, allocator)),
         workspace_(RAII_DeviceMalloc(workspace_size, allocator)),
         params_(num_inputs + num_outputs + num_unbound_constants),
+        blob_size_{blob_size},
         workspace_size_{workspace_size},
         unique_workspace_size_{unique_workspace_size},
         num_inputs_(num_inputs),
         num_outputs_(num_outputs),
-        constants_(constants) {
+        constants_(constants),
+        allocator_(allocator) {
     global_workspace_ =
         static_cast<uint8_t*>(workspace_.get()) + unique_workspace_size;
     unique_workspace_ = static_cast<uint8_t*>(workspace_.get());
     DEVICE_CHECK(GetDevice(&device_idx_))
+    DEVICE_CHECK(CreateEvent(&run_started_));
     DEVICE_CHECK(CreateEvent(&run_finished_));
 #if defined(__NVCC__) || (defined(__clang__) && defined(__CUDA__))
     DEVICE_CHECK(cudaDeviceGetAttribute(
@@ -78,18 +103,28 @@ class ModelBase {
 #endif
     DEVICE_CHECK(GetDeviceProperties(&device_properties_, device_idx_));
     DEVICE_CHECK(StreamCreate(&graph_capture_stream_, /*non_blocking=*/true));
+    if (auto var = std::getenv("AIT_GRAPH_CACHE_SIZE")) {
+      graph_cache_capacity_ =
+          std::max<size_t>(std::strtoull(var, nullptr, 10), 1);
+    }
   }
 
  public:
   virtual ~ModelBase() {
+    if (run_started_ != nullptr) {
+      DestroyEvent(run_started_);
+    }
     if (run_finished_ != nullptr) {
       DestroyEvent(run_finished_);
     }
     if (graph_capture_stream_ != nullptr) {
       StreamDestroy(graph_capture_stream_);
     }
-    if (graph_exec_ != nullptr) {
-      GraphExecDestroy(graph_exec_);
+    for (auto& entry : graph_cache_) {
+      GraphExecDestroy(entry.graph_exec);
+    }
+    for (auto event : op_trace_events_) {
+      DestroyEvent(event);
     }
   }
 
@@ -100,18 +135,90 @@ class ModelBase {
 
   void Run(StreamType stream, bool graph_mode) {
     auto* model = static_cast<ModelType*>(this);
+    run_timed_ = false;
+    DEVICE_CHECK(EventRecord(run_started_, stream));
+    if constexpr (ModelType::kNumMemoryPlans > 1) {
+      UseMemoryPlan(model->SelectMemoryPlan(), stream);
+    }
     model->SetUpInputsOutputs();
+    // Graph replays can't be timed per op, so only eager runs are traced.
+    tracing_run_ = trace_next_run_ && !(target_has_graph_mode && graph_mode);
+    trace_next_run_ = false;
+    trace_pending_ = false;
+    if (tracing_run_) {
+      BeginOpTrace(stream);
+    }
     if (target_has_graph_mode && graph_mode) {
       RunAsGraph(stream);
     } else {
       model->RunImpl(stream);
     }
+    trace_pending_ = tracing_run_;
+    tracing_run_ = false;
     model->DeviceToDeviceCopies(stream);
     DEVICE_CHECK(EventRecord(run_finished_, stream));
+    run_timed_ = true;
+  }
+
+  // Device time of the last Run(), in microseconds. Returns false if there
+  // is none (or it was already taken). Must only be called once that run has
+  // finished.
+  bool TakeLastRunDeviceTime(uint64_t* micros) {
+    if (!run_timed_) {
+      return false;
+    }
+    run_timed_ = false;
+    float ms = 0;
+    if (EventElapsedTime(&ms, run_started_, run_finished_) !=
+        GetDeviceSuccess()) {
+      GetLastError();
+      return false;
+    }
+    *micros = static_cast<uint64_t>(ms * 1000.0);
+    return true;
+  }
+
+  // Time every op of the next Run() (unless it runs in graph mode).
+  void SetTraceNextRun(bool trace) {
+    trace_next_run_ = trace;
+  }
+
+  // If the last Run() was traced, add its per-op timings to buffer. Must
+  // only be called once that run has finished.
+  void CollectOpTrace(OpTraceBuffer& buffer) {
+    if (!trace_pending_) {
+      return;
+    }
+    trace_pending_ = false;
+    const auto* ops = ModelType::TracedOps();
+    const uint64_t run_id = buffer.NextRunId();
+    for (size_t i = 0; i < ModelType::kNumTracedOps; ++i) {
+      float begin_ms = 0, end_ms = 0;
+      // Ops that did not run (e.g. because of an exception) have no events.
+      if (EventElapsedTime(
+              &begin_ms, op_trace_events_[0], op_trace_events_[2 * i + 1]) !=
+              GetDeviceSuccess() ||
+          EventElapsedTime(
+              &end_ms, op_trace_events_[0], op_trace_events_[2 * i + 2]) !=
+              GetDeviceSuccess()) {
+        GetLastError();
+        continue;
+      }
+      buffer.Add(OpTraceRecord{
+          run_id,
+          &ops[i],
+          op_trace_streams_[i],
+          device_idx_,
+          trace_start_us_ + begin_ms * 1000.0,
+          (end_ms - begin_ms) * 1000.0});
+    }
   }
 
   void Profile(StreamType stream, size_t iters, const std::string& filename) {
     auto* model = static_cast<ModelType*>(this);
+    if constexpr (ModelType::kNumMemoryPlans > 1) {
+      UseMemoryPlan(model->SelectMemoryPlan(), stream);
+    }
     model->SetUpInputsOutputs();
     model->ProfileImpl(stream, iters, filename);
   }
@@ -178,6 +285,35 @@ class ModelBase {
     }
   }
 
+  // Number of device bytes owned by this runtime (intermediate tensors
+  // and scratch space). Constants are shared and not included.
+  size_t MemoryFootprintBytes() const {
+    return blob_size_ + workspace_size_;
+  }
+
+  // MemoryFootprintBytes() once the blob has grown to fit the largest
+  // memory plan, see UseMemoryPlan().
+  size_t MaxMemoryFootprintBytes() const {
+    size_t blob_size = blob_size_;
+    if constexpr (ModelType::kNumMemoryPlans > 1) {
+      for (size_t i = 0; i < ModelType::kNumMemoryPlans; ++i) {
+        blob_size = std::max(blob_size, ModelType::MemoryPlanBlobSize(i));
+      }
+    }
+    return blob_size + workspace_size_;
+  }
+
+  // Breakdown of MemoryFootprintBytes(). Safe to call while the model runs;
+  // busy is left for ModelContainer to fill in.
+  AITemplateRuntimeMemoryUsage MemoryUsage() const {
+    AITemplateRuntimeMemoryUsage usage{};
+    usage.blob_bytes = blob_size_;
+    usage.workspace_bytes = workspace_size_;
+    usage.unique_workspace_bytes = unique_workspace_size_;
+    usage.memory_plan_idx = memory_plan_idx_;
+    return usage;
+  }
+
   void SetConstant(const char* name, const void* src) {
     auto it = constant_name_to_ptr_.find(name);
     if (it == constant_name_to_ptr_.end()) {
@@ -185,9 +321,52 @@ class ModelBase {
     }
     const void** ptr = it->second;
     *ptr = src;
+    ++constants_version_;
+  }
+
+  AITemplateGraphCacheStats GraphCacheStats() const {
+    AITemplateGraphCacheStats stats;
+    stats.hits = graph_cache_hits_.load(std::memory_order_relaxed);
+    stats.updates = graph_cache_updates_.load(std::memory_order_relaxed);
+    stats.misses = graph_cache_misses_.load(std::memory_order_relaxed);
+    stats.evictions = graph_cache_evictions_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+  // Host time spent capturing and instantiating (or updating) graphs.
+  LatencyHistogram::Snapshot GraphCaptureTimes() const {
+    return graph_capture_us_.Take();
+  }
+
+  void ResetGraphCaptureTimes() {
+    graph_capture_us_.Reset();
+  }
+
+ protected:
+  // Called around every op in RunImpl; only records while tracing a run.
+  void RecordOpTraceEvent(size_t op_idx, bool end, StreamType stream) {
+    if (tracing_run_) {
+      op_trace_streams_[op_idx] = stream;
+      DEVICE_CHECK(EventRecord(op_trace_events_[2 * op_idx + 1 + end], stream));
+    }
   }
 
  private:
+  void BeginOpTrace(StreamType stream) {
+    if (op_trace_events_.empty()) {
+      // One reference event, then a begin and an end event per op.
+      op_trace_events_.resize(2 * ModelType::kNumTracedOps + 1);
+      for (auto& event : op_trace_events_) {
+        DEVICE_CHECK(CreateEvent(&event));
+      }
+      op_trace_streams_.resize(ModelType::kNumTracedOps);
+    }
+    trace_start_us_ = std::chrono::duration<double, std::micro>(
+                          std::chrono::steady_clock::now().time_since_epoch())
+                          .count();
+    DEVICE_CHECK(EventRecord(op_trace_events_[0], stream));
+  }
+
   void SetInputShape(const AITemplateParamShape& shape, size_t idx) {
     auto& param = params_[idx];
     if (shape.size != param.shape_ptrs.size()) {
@@ -202,6 +381,31 @@ class ModelBase {
     }
   }
 
+  // Switch the intermediate tensors over to the given memory plan. The blob
+  // only ever grows: once a large input has been seen, smaller plans keep
+  // using the (larger) existing blob, so steady-state runs don't reallocate.
+  void UseMemoryPlan(size_t plan_idx, StreamType stream) {
+    if (plan_idx == memory_plan_idx_) {
+      return;
+    }
+    auto* model = static_cast<ModelType*>(this);
+    const size_t required_blob_size = model->MemoryPlanBlobSize(plan_idx);
+    if (required_blob_size > blob_size_) {
+      // The previous run on this model may still be reading the old blob.
+      // Order the free after it on stream, so that a stream-aware allocator
+      // can hold the blob back instead of blocking here.
+      DEVICE_CHECK(StreamWaitEvent(stream, run_finished_));
+      if (!allocator_.RecordStream(
+              blob_.get(), reinterpret_cast<AITemplateStreamHandle>(stream))) {
+        WaitForCompletion();
+      }
+      blob_ = RAII_DeviceMalloc(required_blob_size, allocator_);
+      blob_size_ = required_blob_size;
+    }
+    model->SetUpBlobTensors(static_cast<uint8_t*>(blob_.get()), plan_idx);
+    memory_plan_idx_ = plan_idx;
+  }
+
   DeviceError EndCapture(GraphType* graph_ptr) {
     auto err = StreamEndCapture(graph_capture_stream_, graph_ptr);
     if (err != GetDeviceSuccess()) {
@@ -216,7 +420,7 @@ class ModelBase {
     return GetDeviceSuccess();
   }
 
-  void RunAsGraph(StreamType stream) {
+  GraphPtr CaptureGraph() {
     DEVICE_CHECK(StreamBeginCapture(graph_capture_stream_, /*global=*/false));
     try {
       static_cast<ModelType*>(this)->RunImpl(graph_capture_stream_);
@@ -234,31 +438,110 @@ class ModelBase {
     // The following function ends the capture and creates a graph
     // inside a unique_ptr that cleans up it when it goes out of scope.
     // Note that it throws an exception if EndCapture fails.
-    auto graph = RAII_EndCaptureAndCreateGraph(
+    return RAII_EndCaptureAndCreateGraph(
         [this](GraphType* graph_ptr) { return EndCapture(graph_ptr); });
+  }
 
-    if (graph_exec_ == nullptr) {
-      DEVICE_CHECK(GraphInstantiate(&graph_exec_, graph.get()));
-    } else if (
-        GraphExecUpdate(graph_exec_, graph.get()) != GetDeviceSuccess()) {
-      // Consume the last cuda error, which may affect the next GraphExecLaunch
-      // call.
-      GetLastError();
-      DEVICE_CHECK(GraphExecDestroy(graph_exec_));
-      DEVICE_CHECK(GraphInstantiate(&graph_exec_, graph.get()));
+  // Every pointer that may be baked into the captured kernels' arguments
+  // and can change between runs. Constants are tracked by
+  // constants_version_ instead.
+  std::vector<void*> GraphPointers() const {
+    std::vector<void*> ptrs;
+    ptrs.reserve(params_.size() + 1);
+    for (const auto& param : params_) {
+      ptrs.push_back(param.ptr);
+    }
+    ptrs.push_back(blob_.get());
+    return ptrs;
+  }
+
+  // Graph mode caches up to graph_cache_capacity_ instantiated graphs in LRU
+  // order, keyed by the input shapes they were captured with:
+  // - Same shapes and pointers: launch the cached graph without capturing.
+  // - Same shapes, different I/O or constant pointers: capture again and
+  //   patch the cached graph's node parameters with GraphExecUpdate, which
+  //   is much cheaper than instantiating a new graph.
+  // - Unseen shapes: capture and instantiate a new graph, evicting the least
+  //   recently used one if the cache is full.
+  void RunAsGraph(StreamType stream) {
+    auto* model = static_cast<ModelType*>(this);
+    std::vector<int64_t> input_dims;
+    for (size_t i = 0; i < num_inputs_; ++i) {
+      for (const auto& dim : params_[i].shape_ptrs) {
+        input_dims.push_back(dim.GetValue());
+      }
+    }
+    auto ptrs = GraphPointers();
+    const uint64_t constants_version = constants_version_;
+
+    auto it = std::find_if(
+        graph_cache_.begin(), graph_cache_.end(), [&](const auto& entry) {
+          return entry.input_dims == input_dims;
+        });
+    if (it != graph_cache_.end()) {
+      graph_cache_.splice(graph_cache_.begin(), graph_cache_, it);
+      auto& entry = graph_cache_.front();
+      if (entry.ptrs == ptrs && entry.constants_version == constants_version) {
+        ++graph_cache_hits_;
+        // RunImpl is skipped, so restore its shape inference results (e.g.
+        // output shapes) from the run that captured the graph.
+        model->SetDims(entry.dims.data());
+        DEVICE_CHECK(GraphExecLaunch(entry.graph_exec, stream));
+        return;
+      }
+
+      ++graph_cache_updates_;
+      const auto capture_start = std::chrono::steady_clock::now();
+      auto graph = CaptureGraph();
+      if (GraphExecUpdate(entry.graph_exec, graph.get()) !=
+          GetDeviceSuccess()) {
+        // Consume the last cuda error, which may affect the next
+        // GraphExecLaunch call.
+        GetLastError();
+        DEVICE_CHECK(GraphExecDestroy(entry.graph_exec));
+        entry.graph_exec = nullptr;
+        DEVICE_CHECK(GraphInstantiate(&entry.graph_exec, graph.get()));
+      }
+      entry.ptrs = std::move(ptrs);
+      entry.constants_version = constants_version;
+      model->GetDims(entry.dims.data());
+      graph_capture_us_.Record(MicrosecondsSince(capture_start));
+      DEVICE_CHECK(GraphExecLaunch(entry.graph_exec, stream));
+      return;
     }
 
-    DEVICE_CHECK(GraphExecLaunch(graph_exec_, stream));
+    ++graph_cache_misses_;
+    const auto capture_start = std::chrono::steady_clock::now();
+    auto graph = CaptureGraph();
+    GraphCacheEntry entry;
+    entry.input_dims = std::move(input_dims);
+    entry.ptrs = std::move(ptrs);
+    entry.constants_version = constants_version;
+    entry.dims.resize(ModelType::kNumDims);
+    model->GetDims(entry.dims.data());
+    DEVICE_CHECK(GraphInstantiate(&entry.graph_exec, graph.get()));
+    graph_capture_us_.Record(MicrosecondsSince(capture_start));
+    graph_cache_.push_front(std::move(entry));
+    if (graph_cache_.size() > graph_cache_capacity_) {
+      DEVICE_CHECK(GraphExecDestroy(graph_cache_.back().graph_exec));
+      graph_cache_.pop_back();
+      ++graph_cache_evictions_;
+    }
+
+    DEVICE_CHECK(GraphExecLaunch(graph_cache_.front().graph_exec, stream));
   }
 
  protected:
   int device_idx_;
   int max_smem_size_{0};
   DevicePropertyType device_properties_;
+  // Recorded at the start of Run(), to time it on the device.
+  EventType run_started_;
   // This event tracks when the inference is finished
   // so that this Model may be reclaimed by its owning
   // ModelContainer.
   EventType run_finished_;
+  bool run_timed_{false};
   // A blob of memory used for storing intermediate tensors.
   GPUPtr blob_;
   // Memory for constants that were folded into the *.so. Unowned by Model,
@@ -269,6 +552,13 @@ class ModelBase {
   size_t num_inputs_;
   size_t num_outputs_;
 
+  // Atomic so that MemoryUsage() can be called while the model runs.
+  std::atomic<size_t> blob_size_;
+  // The memory plan that the intermediate tensors currently point into.
+  // Models are constructed with plan 0, the one with the smallest blob.
+  std::atomic<size_t> memory_plan_idx_{0};
+  // Used to grow blob_ when switching to a larger memory plan.
+  AITemplateAllocator& allocator_;
   // These values are preserved for multi-stream needs.
   size_t workspace_size_;
   size_t unique_workspace_size_;
@@ -316,9 +606,37 @@ class ModelBase {
   // Constants are not included.
   std::vector<ParamInfo> params_;
 
-  GraphExecType graph_exec_ = nullptr;
   StreamType graph_capture_stream_;
 
+  struct GraphCacheEntry {
+    std::vector<int64_t> input_dims;
+    std::vector<void*> ptrs;
+    uint64_t constants_version;
+    // Values of all dims right after capture.
+    std::vector<int64_t> dims;
+    GraphExecType graph_exec = nullptr;
+  };
+  // Most recently used first.
+  std::list<GraphCacheEntry> graph_cache_;
+  size_t graph_cache_capacity_{8};
+  // Bumped whenever a constant pointer changes, which invalidates the
+  // pointers baked into cached graphs.
+  std::atomic<uint64_t> constants_version_{0};
+  std::atomic<size_t> graph_cache_hits_{0};
+  std::atomic<size_t> graph_cache_updates_{0};
+  std::atomic<size_t> graph_cache_misses_{0};
+  std::atomic<size_t> graph_cache_evictions_{0};
+  LatencyHistogram graph_capture_us_;
+
+  // Sampled per-op tracing; see SetTraceNextRun() and CollectOpTrace().
+  bool trace_next_run_{false};
+  bool tracing_run_{false};
+  bool trace_pending_{false};
+  // Created on the first traced run.
+  std::vector<EventType> op_trace_events_;
+  std::vector<StreamType> op_trace_streams_;
+  double trace_start_us_{0};
+
   std::unordered_map<std::string, const void**> constant_name_to_ptr_;
 };
 
@@ -14,16 +14,21 @@
 //
 #pragma once
 
+#include "async_runner.h"
 #include "constant_folder-generated.h"
 #include "model-generated.h"
 #include "model_interface.h"
 #include "raii_wrapper.h"
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstring>
 #include <future>
 #include <mutex>
 #include <numeric>
+#include <set>
 #include <shared_mutex>
 #include <unordered_map>
 #include <unordered_set>
@@ -73,6 +78,7 @@ class ModelContainerBase {
   // of constant folding. The indices are guaranteed to map to the correct
   // indices in constant_folder_.
   std::vector<size_t> constant_folding_outputs_offsets_;
+  std::vector<size_t> constant_folding_outputs_sizes_;
   // Offsets here correspond to the offsets of constants for bounded constants.
   std::vector<size_t> bound_constant_offsets_;
 
@@ -109,6 +115,14 @@ class ModelContainerBase {
   // Mapping of constant names to their original names, i.e. before making
   // constant names AIT friendly.
   std::unordered_map<std::string, std::string> constant_name_to_original_name_;
+
+  // Lifetimes of the intermediate tensors in the blob, from memory planning.
+  // The names point to static strings.
+  std::vector<AITemplateTensorLifetime> tensor_lifetimes_;
+
+  // Hash of the bound constants and the constant folding graph, computed at
+  // codegen time. Files written by SaveFoldedConstants() are tagged with it.
+  uint64_t model_fingerprint_ = 0;
 };
 
 // This creates a new ModelContainer; its implementation is also
@@ -145,6 +159,24 @@ ModelContainer* CreateModelContainer(
 // Note that if there are no models available for inference, Run() will block
 // until one becomes available.
 //
+// Models are created lazily: the constructor only creates one, and Run()
+// creates the others (up to num_models) when all existing ones are busy.
+// PrewarmRuntimes() creates them on a background thread instead, before any
+// traffic arrives; setting AIT_PREWARM_RUNTIMES=1 calls it on construction.
+//
+// Constants are folded before the first run unless FoldConstants() or
+// LoadFoldedConstants() was called. If AIT_FOLDED_CONSTANTS_CACHE_DIR is set,
+// that first fold is instead restored from (or, failing that, saved to) a
+// file in that directory named after the model fingerprint.
+//
+// The pool of models is elastic; see AITemplateRuntimePoolPolicy. By default
+// the pool grows to num_models models and never shrinks. If
+// max_runtimes is raised, Run() creates a new Model instead of blocking when
+// all existing models are busy. Idle models above min_runtimes are released
+// once they exceed idle_timeout_ms or the memory budget. Models are only ever
+// destroyed while they sit in available_models_, i.e. when no inference is
+// in flight on them.
+//
 // ModelContainer optionally takes an allocator argument, which it will use to
 // allocate the space for the buffers used for intermediate tensors and
 // constants. If it is nullptr, the default allocator will be used (e.g. just
@@ -161,6 +193,7 @@ class ModelContainer : ModelContainerBase {
       size_t num_unbound_constants,
       size_t params_size,
       AITemplateAllocator& allocator);
+  ~ModelContainer();
 
   void Run(
       const AITData* inputs,
@@ -172,6 +205,18 @@ class ModelContainer : ModelContainerBase {
       bool graph_mode,
       int64_t** output_shapes_out);
 
+  // See AITemplateModelContainerRunAsync.
+  std::shared_ptr<AsyncRunState> RunAsync(
+      const AITData* inputs,
+      size_t num_inputs,
+      AITData* outputs,
+      size_t num_outputs,
+      StreamType stream,
+      bool graph_mode,
+      int64_t** output_shapes_out,
+      AITemplateRunCallback callback,
+      void* user_data);
+
   void RunWithOutputsOnHost(
       const AITData* inputs,
       size_t num_inputs,
@@ -233,13 +278,87 @@ class ModelContainer : ModelContainerBase {
 
   size_t MaxOutputStorageBytes(size_t output_idx) const;
 
-  size_t GetNumRuntimes() const {
-    return models_.size();
+  size_t GetNumRuntimes();
+  AITemplateMemoryUsage GetMemoryUsage();
+  std::vector<AITemplateRuntimeMemoryUsage> GetRuntimeMemoryUsage();
+  const std::vector<AITemplateTensorLifetime>& GetTensorLifetimes() const {
+    return tensor_lifetimes_;
+  }
+
+  // Create runtimes up to min_runtimes on a background thread, if that isn't
+  // already happening. If wait, block until they are created.
+  void PrewarmRuntimes(bool wait);
+
+  void SetRuntimePoolPolicy(const AITemplateRuntimePoolPolicy& policy);
+  AITemplateRuntimePoolPolicy GetRuntimePoolPolicy();
+  size_t ReleaseIdleRuntimes();
+
+  AITemplateGraphCacheStats GetGraphCacheStats();
+
+  // Trace every op of 1 in sample_every runs (0 disables tracing), keeping
+  // the last max_records op timings. Resets the recorded trace.
+  void SetOpTraceSampling(size_t sample_every, size_t max_records);
+  // Write the recorded op timings as a Chrome trace JSON file.
+  void WriteOpTrace(const char* filename);
+
+  // Snapshot of the runtime metrics (latency histograms in microseconds and
+  // counters), as JSON or as text. See AITemplateModelContainerGetMetrics.
+  std::string GetMetrics(bool json);
+  // Clear the latency histograms and run counters. The graph cache counters
+  // are left alone, like GetGraphCacheStats().
+  void ResetMetrics();
+
+  // Return runtimes whose runs have finished to the pool without blocking.
+  void ReclaimFinishedRuntimes();
+
+  AITemplateAllocator& GetAllocator() {
+    return allocator_;
   }
 
   void FoldConstants(StreamType stream, bool sync, bool double_buffer = false);
   void SwapConstants();
 
+  // Stage new values for a subset of the constants in the inactive buffer,
+  // on a background thread and stream, and return right away. Unlike
+  // SetManyDoubleBufferConstants + FoldConstants, bound constants that are
+  // not part of the delta are carried over from the active buffer (only
+  // those that differ), and constant folding only reruns if one of its
+  // inputs changed. The tensors must stay valid until
+  // FinishConstantsDeltaUpdate() returns. Waits for the previous delta
+  // update first, if any.
+  void UpdateConstantsDelta(
+      const char** names,
+      const AITData* tensors,
+      size_t num_tensors);
+  // Wait for the staged delta update (rethrowing its error, if any) and, if
+  // swap, swap it in. Returns GetConstantsVersion().
+  uint64_t FinishConstantsDeltaUpdate(bool swap);
+  // Number of times the constants buffers have been swapped.
+  uint64_t GetConstantsVersion() const {
+    return constants_version_;
+  }
+
+  // Write the outputs of constant folding in the active constants buffer to
+  // path, folding first if that has not happened yet. The file is tagged
+  // with the model's fingerprint and with inputs_key, which stands for the
+  // values of the constant folding inputs that were set at runtime: the
+  // container cannot hash those itself, so it's up to the caller (e.g. a
+  // checkpoint version). 0 is fine if none were set.
+  void SaveFoldedConstants(
+      const char* path,
+      uint64_t inputs_key,
+      StreamType stream);
+  // Restore a file written by SaveFoldedConstants() into the active
+  // constants buffer, so that constants don't need to be folded before the
+  // first run. Returns false, leaving the constants untouched, if there is
+  // no such file, or it was written by another model, with another
+  // inputs_key, or with another set of constant folding inputs set at
+  // runtime.
+  bool LoadFoldedConstants(
+      const char* path,
+      uint64_t inputs_key,
+      StreamType stream);
+
   size_t GetNumConstants(bool unbound_constants_only = true) const;
   size_t GetNumConstantFoldingInputs(bool unbound_constants_only = true) const;
 
@@ -259,6 +378,21 @@ class ModelContainer : ModelContainerBase {
  private:
   void WaitForAllModels(bool include_constant_folder = false);
   void FoldConstantsImpl(StreamType stream, bool double_buffer = false);
+  // The implicit constant folding before the first run, which goes through
+  // AIT_FOLDED_CONSTANTS_CACHE_DIR if set. These three expect
+  // constants_sync_mutex_ to be held in unique mode.
+  void FoldConstantsForFirstRun(StreamType stream);
+  void SaveFoldedConstantsImpl(
+      const std::string& path,
+      uint64_t inputs_key,
+      StreamType stream);
+  bool LoadFoldedConstantsImpl(
+      const std::string& path,
+      uint64_t inputs_key,
+      StreamType stream);
+  // inputs_key combined with the names in runtime_constant_folding_inputs_.
+  uint64_t FoldedConstantsInputsKey(uint64_t inputs_key);
+  void ValidateConstant(const char* name, const AITData& tensor) const;
   void SetConstantImpl(
       const char* name,
       const AITData& tensor,
@@ -266,6 +400,18 @@ class ModelContainer : ModelContainerBase {
       StreamType stream = 0);
   void SwapConstantFolderBuffer();
 
+  // Index of the active constants buffer in the per-buffer bookkeeping below:
+  // 0 for constants_primary_, 1 for constants_secondary_.
+  size_t ActiveConstantsBufferIdx() const {
+    return use_constants_primary_buffer_ ? 0 : 1;
+  }
+  struct ConstantsDelta {
+    std::vector<std::string> names;
+    std::vector<std::vector<int64_t>> shapes;
+    std::vector<AITData> tensors;
+  };
+  void UpdateConstantsDeltaImpl(const ConstantsDelta& delta);
+
   void PrepareForRun(
       Model* model,
       const AITData* inputs,
@@ -274,10 +420,33 @@ class ModelContainer : ModelContainerBase {
       size_t num_outputs);
 
   Model* GetAvailableModel();
-  void ReclaimFinishedModels(std::unique_lock<std::mutex>& lk);
+  void ReclaimFinishedModels(std::unique_lock<std::mutex>& lk, bool block);
+  // Expects models_mutex_ to be held and model's last run to be finished.
+  void MakeModelAvailable(Model* model);
+
+  // Runtime pool management. All of these expect models_mutex_ to be held.
+  uint8_t* GetActiveConstantsBuffer();
+  bool CanGrowRuntimePool() const;
+  Model* GrowRuntimePool(std::unique_lock<std::mutex>& lk);
+  void WireUpRuntimeConstants(Model* model);
+  size_t ReleaseIdleRuntimesImpl();
+  void PrewarmRuntimesImpl();
   void ValidateParamDtype(AITemplateDtype dtype, size_t idx) const;
   void ValidateBoundConstantDtype(AITemplateDtype dtype, size_t idx) const;
 
+  // Device outputs and pinned host staging buffers used by
+  // RunWithOutputsOnHost(), sized for the maximum output shapes.
+  struct HostOutputStaging {
+    std::vector<GPUPtr> device_outputs;
+    std::vector<PinnedHostPtr> host_outputs;
+    std::vector<std::vector<int64_t>> shapes;
+    std::vector<int64_t*> shape_ptrs;
+  };
+  std::unique_ptr<HostOutputStaging> AcquireHostOutputStaging();
+  void ReleaseHostOutputStaging(std::unique_ptr<HostOutputStaging> staging);
+  // Free the staging buffers that no RunWithOutputsOnHost() call is using.
+  void FreeIdleHostOutputStaging();
+
   float BenchmarkImpl(
       const AITData* inputs,
       size_t num_inputs,
@@ -295,9 +464,56 @@ class ModelContainer : ModelContainerBase {
   std::vector<Model*> available_models_;
   std::deque<Model*> pending_models_;
 
-  // Guards accesses to available/pending models.
+  AITemplateRuntimePoolPolicy pool_policy_;
+  // Number of models that are currently being created outside of
+  // models_mutex_ by GrowRuntimePool() or PrewarmRuntimesImpl().
+  size_t num_models_in_creation_ = 0;
+  // Blob + workspace bytes of a single Model, with its blob grown to the
+  // largest memory plan.
+  size_t model_footprint_bytes_ = 0;
+  // When each model was last handed out by GetAvailableModel().
+  std::unordered_map<Model*, std::chrono::steady_clock::time_point>
+      model_last_used_;
+  // Constant pointers that were set directly on the models (as opposed to
+  // living in the constants buffer). Replayed on models created later on.
+  // Guarded by models_mutex_.
+  std::unordered_map<std::string, const void*> model_constant_values_;
+  // Graph cache counters of runtimes that have been released.
+  AITemplateGraphCacheStats released_graph_cache_stats_{0, 0, 0, 0};
+
+  // Sampled per-op tracing, see SetOpTraceSampling(). op_trace_ is guarded
+  // by models_mutex_; traced runs are collected when their model is
+  // reclaimed.
+  std::atomic<size_t> op_trace_sample_every_{0};
+  std::atomic<uint64_t> op_trace_num_runs_{0};
+  OpTraceBuffer op_trace_;
+
+  // Runtime metrics, see GetMetrics(). Histograms and counters are lock
+  // free, so runs only pay for a few relaxed atomic adds.
+  // Run(): waiting for a free runtime.
+  LatencyHistogram queue_wait_us_;
+  // Run(): acquiring the constants lock, including the implicit first fold.
+  LatencyHistogram constants_wait_us_;
+  // Run(): setting up the runtime and launching its kernels (or graph).
+  LatencyHistogram launch_us_;
+  // Run(): the whole call, including the stream sync if requested.
+  LatencyHistogram run_us_;
+  // Device time of runs, collected when their runtime is reclaimed.
+  LatencyHistogram device_run_us_;
+  LatencyHistogram constant_folding_us_;
+  LatencyHistogram constant_swap_us_;
+  // Graph capture times of runtimes that have been released. Guarded by
+  // models_mutex_.
+  LatencyHistogram released_graph_capture_us_;
+  // Runs that were launched, and runs whose launch threw.
+  std::atomic<uint64_t> num_runs_{0};
+  std::atomic<uint64_t> num_failed_runs_{0};
+
+  // Guards accesses to available/pending models, as well as growing or
+  // shrinking models_.
   std::mutex models_mutex_;
-  // Notified whenever a model is put into pending_models_.
+  // Notified whenever a model is put into pending_models_, or a pre-warmed
+  // model into available_models_.
   std::condition_variable pending_models_available_;
   // Prevents constant folding or SetConstants on main models from starting
   // while there are ongoing inferences (and vice versa). FoldConstants() and
@@ -306,7 +522,10 @@ class ModelContainer : ModelContainerBase {
   //
   // Since constants_sync_mutex_ is acquired in shared mode for the entire
   // duration of Run()/Benchmark(), there is no need to acquire models_mutex_
-  // while constants_sync_mutex_ is acquired in unique mode.
+  // while constants_sync_mutex_ is acquired in unique mode. Everything else
+  // that touches the Model vectors (the runtime pool management entry points,
+  // e.g. SetRuntimePoolPolicy()) must acquire it in shared mode too, before
+  // models_mutex_.
   // Why complicate things with two locks? The system is designed with the
   // assumption that concurrent inferences are common. We don't want to acquire
   // models_mutex_ uniquely for the entire duration of Run(), because that
@@ -320,7 +539,53 @@ class ModelContainer : ModelContainerBase {
   size_t num_inputs_;
   size_t num_outputs_;
 
-  bool constant_folded_once_ = false;
+  // Atomic since double buffered folds set it without holding
+  // constants_sync_mutex_ in unique mode.
+  std::atomic<bool> constant_folded_once_{false};
+
+  // Bookkeeping for delta updates, guarded by constants_double_buffer_mutex_.
+  // Every write of a bound constant (or of all constant folding outputs) into
+  // a buffer gets a new generation; regions whose generations match hold the
+  // same data in both buffers and need not be copied over.
+  static constexpr uint64_t kStaleGeneration = ~uint64_t(0);
+  uint64_t constants_generation_ = 0;
+  std::array<std::vector<uint64_t>, 2> bound_constant_generations_;
+  std::array<uint64_t, 2> folded_constants_generations_{
+      kStaleGeneration,
+      kStaleGeneration};
+  // The buffer that constant_folder_ writes its outputs to.
+  size_t constant_folder_buffer_idx_ = 0;
+  std::atomic<uint64_t> constants_version_{0};
+
+  // Constant folding inputs that were set at runtime, i.e. whose values the
+  // model fingerprint does not account for. Has its own mutex since
+  // SetConstantImpl() runs under either of the constants mutexes.
+  std::mutex runtime_constant_folding_inputs_mutex_;
+  std::set<std::string> runtime_constant_folding_inputs_;
+
+  // In-flight UpdateConstantsDelta(), if any. Declared after everything it
+  // uses: destroying it waits for the update to finish.
+  std::mutex constants_update_mutex_;
+  StreamPtr constants_update_stream_{nullptr, StreamDestroy};
+  std::future<void> pending_constants_update_;
+
+  // Background PrewarmRuntimes() thread, if any.
+  std::mutex prewarm_mutex_;
+  std::future<void> prewarm_;
+  std::atomic<bool> stop_prewarm_{false};
+
+  // Idle RunWithOutputsOnHost() staging buffers. There is one per concurrent
+  // RunWithOutputsOnHost() call at most, and they are kept for reuse until
+  // ReleaseIdleRuntimes() frees them.
+  std::mutex host_output_staging_mutex_;
+  std::vector<std::unique_ptr<HostOutputStaging>> free_host_output_staging_;
+  // Staging buffers that currently exist, idle or in use.
+  std::atomic<size_t> num_host_output_staging_{0};
+
+  // Created on the first RunAsync(). Declared last so that it is destroyed
+  // (draining all queued runs) before anything it uses.
+  std::mutex async_runner_mutex_;
+  std::unique_ptr<AsyncRunner> async_runner_;
 };
 
 } // namespace ait
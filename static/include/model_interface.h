@@ -113,9 +113,67 @@ inline size_t AITemplateDtypeSizeBytes(AITemplateDtype dtype) {
   throw std::runtime_error("dtype handling is not implemented!");
 }
 
+// Controls how many runtimes a ModelContainer keeps around. The container
+// starts with a single runtime and creates more on demand: when every runtime
+// is busy, Run() creates a new one (up to max_runtimes) instead of blocking.
+// By default, min_runtimes = max_runtimes = num_runtimes. Runtimes that have been
+// idle for idle_timeout_ms are released again, but the pool never shrinks
+// below min_runtimes. See model_container.h for details.
+struct AITemplateRuntimePoolPolicy {
+  // The pool never shrinks below this many runtimes. Must be positive.
+  size_t min_runtimes;
+  // Upper bound on the number of runtimes. Must be >= min_runtimes.
+  size_t max_runtimes;
+  // Release runtimes that have been idle for this long. 0 disables release
+  // on timeout.
+  size_t idle_timeout_ms;
+  // Upper bound on the intermediate tensor + workspace memory held by all
+  // runtimes combined, counting each runtime with the blob of its largest
+  // memory plan. 0 means no limit.
+  size_t memory_budget_bytes;
+};
+
+// Counters of the per-runtime cache of instantiated graphs used by graph
+// mode. Graphs are cached by the input shapes they were captured with.
+struct AITemplateGraphCacheStats {
+  // Runs that launched a cached graph as is, skipping capture entirely.
+  size_t hits;
+  // Runs that found a graph for their shapes, but had to re-capture to
+  // update it with new input/output or constant pointers.
+  size_t updates;
+  // Runs that had to capture and instantiate a new graph.
+  size_t misses;
+  // Graphs that were dropped to keep the cache within its capacity.
+  size_t evictions;
+};
+
+// Options for the dynamic batcher; see dynamic_batcher.h.
+struct AITemplateDynamicBatcherOptions {
+  // Index of the batch dimension. The same for all inputs and outputs.
+  size_t batch_dim;
+  // Flush a batch once it has this many rows. 0 means the model's maximum
+  // batch size (from MaxInputShape).
+  size_t max_batch_size;
+  // Flush a batch that isn't full once its oldest request has waited this
+  // long.
+  size_t max_delay_us;
+  // Run batches in graph mode.
+  bool graph_mode;
+};
+
+struct AITemplateDynamicBatcherOpaque {};
+using AITemplateDynamicBatcherHandle = AITemplateDynamicBatcherOpaque*;
+
 struct AITemplateStreamOpaque {};
 using AITemplateStreamHandle = AITemplateStreamOpaque*;
 
+// Invoked once an async run's outputs are ready and its runtime has been
+// returned to the pool. Runs on an internal thread and must not block.
+using AITemplateRunCallback = void (*)(void* user_data, AITemplateError status);
+
+struct AITemplateRunOpaque {};
+using AITemplateRunHandle = AITemplateRunOpaque*;
+
 // Allocator to use for GPU mallocs and frees. Allocations will only happen
 // when the ModelContainer is created.
 class AITemplateAllocator {
@@ -124,6 +182,16 @@ class AITemplateAllocator {
   virtual void Free(void* ptr) = 0;
 
   virtual ~AITemplateAllocator() = default;
+
+  // Tells the allocator that work queued on stream may still use ptr when it
+  // is freed. Returns true if the allocator then holds ptr back until that
+  // work is done; otherwise (the default) the caller has to wait for the
+  // work itself before calling Free(). Appended last so that the existing
+  // vtable slots keep their positions; allocators built against a header
+  // without it must still be rebuilt.
+  virtual bool RecordStream(void* /*ptr*/, AITemplateStreamHandle /*stream*/) {
+    return false;
+  }
 };
 
 // Some custom allocators are provided. They can be created by passing
@@ -134,6 +202,78 @@ enum class AITemplateAllocatorType {
   // The tracking allocator is like the default allocator, but it keeps
   // track of how many bytes it has allocated. Mainly used for testing.
   kTracking,
+  // The caching allocator keeps freed blocks and reuses them for later
+  // allocations of a similar size. See caching_allocator.h.
+  kCaching,
+};
+
+// Counters of a kCaching allocator. All sizes are in bytes.
+struct AITemplateCachingAllocatorStats {
+  // Held from the device: allocated_bytes + cached_bytes.
+  size_t reserved_bytes;
+  // Blocks currently handed out (after rounding to size classes).
+  size_t allocated_bytes;
+  // Bytes actually requested by the live allocations.
+  // allocated_bytes - requested_bytes is internal fragmentation.
+  size_t requested_bytes;
+  // Freed blocks kept for reuse.
+  size_t cached_bytes;
+  size_t peak_reserved_bytes;
+  size_t num_device_mallocs;
+  size_t num_device_frees;
+  size_t num_cache_hits;
+};
+
+// Device memory held by a ModelContainer, by category. All sizes are in
+// bytes.
+struct AITemplateMemoryUsage {
+  // Bound constants and constant folding outputs.
+  size_t constants_bytes;
+  // The second constants buffer, allocated on the first double buffered
+  // constant update. 0 until then.
+  size_t secondary_constants_bytes;
+  // Intermediate tensors and workspace of the constant folding graph.
+  size_t constant_folder_bytes;
+  // Summed over all runtimes; see AITemplateRuntimeMemoryUsage.
+  size_t runtime_blob_bytes;
+  size_t runtime_workspace_bytes;
+  size_t num_runtimes;
+  // Output buffers of RunWithOutputsOnHost, on the device and in pinned
+  // host memory (not included in total_device_bytes).
+  size_t host_output_staging_device_bytes;
+  size_t host_output_staging_pinned_bytes;
+  // Sum of the device categories above.
+  size_t total_device_bytes;
+};
+
+// Device memory held by a single runtime. All sizes are in bytes.
+struct AITemplateRuntimeMemoryUsage {
+  // Intermediate tensors. Grows if the runtime switched to a larger memory
+  // plan.
+  size_t blob_bytes;
+  // Scratch space of the ops, including unique_workspace_bytes that are
+  // reserved for ops running on separate streams.
+  size_t workspace_bytes;
+  size_t unique_workspace_bytes;
+  // The memory plan the intermediate tensors currently use. Always 0 for
+  // models compiled without memory plan buckets.
+  size_t memory_plan_idx;
+  // Whether an inference may be in flight on the runtime.
+  bool busy;
+};
+
+// When an intermediate tensor is live in the blob, as planned by memory
+// planning for the upper bounds of all dynamic dims: it occupies
+// [offset, offset + size_bytes) from op first_op_idx through op last_op_idx
+// (indices into the ops in execution order).
+struct AITemplateTensorLifetime {
+  const char* name;
+  size_t offset;
+  size_t size_bytes;
+  size_t first_op_idx;
+  size_t last_op_idx;
+  const char* first_op;
+  const char* last_op;
 };
 
 extern "C" {
@@ -208,10 +348,10 @@ AIT_EXPORT AITemplateError AITemplateModelContainerRun(
     bool graph_mode,
     int64_t** output_shapes_out);
 
-// Like AITemplateModelContainerRun, but expects outputs to be allocated on the
-// host. Does an extra sync/copy at the end to copy them over. Warning: don't
-// use this! It's not optimal with respect to performance. It's here for use if
-// you need it for debugging.
+// Like AITemplateModelContainerRun, but outputs point to host memory. The
+// model runs into device buffers owned by the container and the results are
+// copied out through pinned staging memory. Both are reused across calls.
+// Always synchronizes the stream.
 AIT_EXPORT AITemplateError AITemplateModelContainerRunWithOutputsOnHost(
     AITemplateModelHandle handle,
     const AITData* inputs,
@@ -222,6 +362,41 @@ AIT_EXPORT AITemplateError AITemplateModelContainerRunWithOutputsOnHost(
     bool graph_mode,
     int64_t** output_shapes_out);
 
+// Like AITemplateModelContainerRun with sync=false, but never blocks the
+// calling thread: the run is queued and dispatched on an internal thread
+// once a runtime is available. The inputs/outputs arrays are copied, but the
+// memory they point to, as well as output_shapes_out, must stay valid until
+// the run completes.
+// Completion is signaled through callback (if not null) and through
+// run_handle_out (if not null), which can be polled or waited on and must be
+// freed with AITemplateRunHandleDelete.
+AIT_EXPORT AITemplateError AITemplateModelContainerRunAsync(
+    AITemplateModelHandle handle,
+    const AITData* inputs,
+    size_t num_inputs,
+    AITData* outputs,
+    size_t num_outputs,
+    AITemplateStreamHandle stream_handle,
+    bool graph_mode,
+    int64_t** output_shapes_out,
+    AITemplateRunCallback callback,
+    void* user_data,
+    AITemplateRunHandle* run_handle_out);
+
+// Sets *done_out to whether the run has completed. If it has, *status_out
+// (if not null) is set to the run's status.
+AIT_EXPORT AITemplateError AITemplateRunHandlePoll(
+    AITemplateRunHandle run_handle,
+    bool* done_out,
+    AITemplateError* status_out);
+
+// Blocks until the run has completed and returns its status.
+AIT_EXPORT AITemplateError AITemplateRunHandleWait(AITemplateRunHandle run_handle);
+
+// Frees the handle. Does not cancel or wait for the run.
+AIT_EXPORT AITemplateError
+AITemplateRunHandleDelete(AITemplateRunHandle run_handle);
+
 /// Do per op profile and write the profiling report to file.
 AIT_EXPORT AITemplateError AITemplateModelContainerProfile(
     AITemplateModelHandle handle,
@@ -285,10 +460,96 @@ AIT_EXPORT AITemplateError AITemplateModelContainerGetOutputDtype(
     size_t output_idx,
     AITemplateDtype* out);
 
+// Create runtimes up to the pool's min_runtimes on a background thread, so
+// that the first concurrent runs don't pay for it. If wait, returns once they
+// are created.
+AIT_EXPORT AITemplateError AITemplateModelContainerPrewarmRuntimes(
+    AITemplateModelHandle handle,
+    bool wait);
+
 AIT_EXPORT AITemplateError AITemplateModelContainerGetNumRuntimes(
     AITemplateModelHandle handle,
     size_t* num_runtimes_out);
 
+AIT_EXPORT AITemplateError AITemplateModelContainerSetRuntimePoolPolicy(
+    AITemplateModelHandle handle,
+    const AITemplateRuntimePoolPolicy* policy);
+
+AIT_EXPORT AITemplateError AITemplateModelContainerGetRuntimePoolPolicy(
+    AITemplateModelHandle handle,
+    AITemplateRuntimePoolPolicy* policy_out);
+
+// Release idle runtimes that exceed the pool policy (idle timeout or memory
+// budget). Runtimes with in-flight inferences are never released. Also frees
+// the idle staging buffers of AITemplateModelContainerRunWithOutputsOnHost.
+AIT_EXPORT AITemplateError AITemplateModelContainerReleaseIdleRuntimes(
+    AITemplateModelHandle handle,
+    size_t* num_released_out);
+
+// Sum of the graph cache counters of all runtimes, including ones that have
+// been released already.
+AIT_EXPORT AITemplateError AITemplateModelContainerGetGraphCacheStats(
+    AITemplateModelHandle handle,
+    AITemplateGraphCacheStats* stats_out);
+
+AIT_EXPORT AITemplateError AITemplateModelContainerGetMemoryUsage(
+    AITemplateModelHandle handle,
+    AITemplateMemoryUsage* usage_out);
+
+// Fills usage_out with the memory usage of up to max_runtimes runtimes and
+// sets *num_runtimes_out to the number of runtimes. Call with max_runtimes
+// = 0 to query the count.
+AIT_EXPORT AITemplateError AITemplateModelContainerGetRuntimeMemoryUsage(
+    AITemplateModelHandle handle,
+    AITemplateRuntimeMemoryUsage* usage_out,
+    size_t max_runtimes,
+    size_t* num_runtimes_out);
+
+// Sets *lifetimes_out to the intermediate tensors of the memory plan,
+// ordered by first_op_idx, and *num_tensors_out to their number. The array
+// lives as long as the container.
+AIT_EXPORT AITemplateError AITemplateModelContainerGetTensorLifetimes(
+    AITemplateModelHandle handle,
+    const AITemplateTensorLifetime** lifetimes_out,
+    size_t* num_tensors_out);
+
+// Record device timings around every op of 1 in sample_every runs (0
+// disables sampling), in a ring buffer of the last max_records op timings.
+// Runs in graph mode are not traced. Clears the recorded trace. Sampling
+// can also be enabled with the AIT_OP_TRACE_SAMPLE_EVERY environment
+// variable.
+AIT_EXPORT AITemplateError AITemplateModelContainerSetOpTraceSampling(
+    AITemplateModelHandle handle,
+    size_t sample_every,
+    size_t max_records);
+
+// Write the recorded op timings to filename in the Chrome trace event
+// format (loadable in chrome://tracing or Perfetto). Runs that are still in
+// flight are not included.
+AIT_EXPORT AITemplateError AITemplateModelContainerWriteOpTrace(
+    AITemplateModelHandle handle,
+    const char* filename);
+
+// Snapshot of the runtime metrics, as JSON (json=true) or as text:
+// - latency histograms, in microseconds: run_us (whole Run() calls),
+//   constants_wait_us, queue_wait_us (waiting for a free runtime),
+//   launch_us, device_run_us, graph_capture_us, constant_folding_us and
+//   constant_swap_us, each with count, sum, max and p50/p90/p99/p999;
+// - counters: runs, failed_runs, runtimes and the graph cache counters.
+// Writes at most buffer_size bytes (including the NUL terminator) to
+// buffer, and the full length of the snapshot (excluding the terminator) to
+// *size_out. Pass buffer=nullptr to query the size.
+AIT_EXPORT AITemplateError AITemplateModelContainerGetMetrics(
+    AITemplateModelHandle handle,
+    bool json,
+    char* buffer,
+    size_t buffer_size,
+    size_t* size_out);
+
+// Clear the latency histograms and run counters.
+AIT_EXPORT AITemplateError
+AITemplateModelContainerResetMetrics(AITemplateModelHandle handle);
+
 AIT_EXPORT AITemplateError AITemplateModelContainerFoldConstants(
     AITemplateModelHandle handle,
     AITemplateStreamHandle stream_handle,
@@ -302,6 +563,75 @@ AIT_EXPORT AITemplateError AITemplateModelContainerFoldConstantsInDoubleBuffer(
 AIT_EXPORT AITemplateError
 AITemplateModelContainerSwapConstants(AITemplateModelHandle handle);
 
+// Stage new values for the given constants in the inactive constants buffer
+// on a background thread, carrying over everything else from the active
+// buffer and rerunning constant folding only if one of its inputs changed.
+// Returns once the tensors are validated; the memory they point to must stay
+// valid until AITemplateModelContainerFinishConstantsDeltaUpdate returns.
+AIT_EXPORT AITemplateError AITemplateModelContainerUpdateConstantsDelta(
+    AITemplateModelHandle handle,
+    const char** names,
+    const AITData* tensors,
+    size_t num_tensors);
+
+// Wait for the staged delta update and, if swap, make it active. Errors from
+// the background update are returned here. *version_out (if not null) is set
+// to the constants version afterwards.
+AIT_EXPORT AITemplateError AITemplateModelContainerFinishConstantsDeltaUpdate(
+    AITemplateModelHandle handle,
+    bool swap,
+    uint64_t* version_out);
+
+// The number of times the constants buffers have been swapped.
+AIT_EXPORT AITemplateError AITemplateModelContainerGetConstantsVersion(
+    AITemplateModelHandle handle,
+    uint64_t* version_out);
+
+// Write the folded constants to path, so that a later process can restore
+// them with AITemplateModelContainerLoadFoldedConstants instead of folding
+// constants again. Constants are folded first if they haven't been yet.
+// inputs_key identifies the values of the constant folding inputs set with
+// SetConstant (the bound ones are covered by the model itself); pass the same
+// key when loading.
+AIT_EXPORT AITemplateError AITemplateModelContainerSaveFoldedConstants(
+    AITemplateModelHandle handle,
+    const char* path,
+    uint64_t inputs_key,
+    AITemplateStreamHandle stream_handle);
+
+// Restore folded constants saved by
+// AITemplateModelContainerSaveFoldedConstants. *loaded_out is set to false,
+// and nothing changes, if the file is missing or doesn't match this model,
+// inputs_key and the set of constant folding inputs set so far.
+AIT_EXPORT AITemplateError AITemplateModelContainerLoadFoldedConstants(
+    AITemplateModelHandle handle,
+    const char* path,
+    uint64_t inputs_key,
+    AITemplateStreamHandle stream_handle,
+    bool* loaded_out);
+
+// Create a dynamic batcher in front of the given ModelContainer. The
+// container must outlive the batcher.
+AIT_EXPORT AITemplateError AITemplateDynamicBatcherCreate(
+    AITemplateDynamicBatcherHandle* ret,
+    AITemplateModelHandle handle,
+    const AITemplateDynamicBatcherOptions* options);
+
+// Waits for all queued requests to finish.
+AIT_EXPORT AITemplateError
+AITemplateDynamicBatcherDelete(AITemplateDynamicBatcherHandle batcher_handle);
+
+// Like AITemplateModelContainerRun, but the request may be merged with
+// concurrent requests into a single run. Blocks until the outputs are ready.
+// Inputs must be ready to be read when this is called.
+AIT_EXPORT AITemplateError AITemplateDynamicBatcherRun(
+    AITemplateDynamicBatcherHandle batcher_handle,
+    const AITData* inputs,
+    size_t num_inputs,
+    AITData* outputs,
+    size_t num_outputs,
+    int64_t** output_shapes_out);
+
 AIT_EXPORT AITemplateError AITemplateAllocatorCreate(
     AITemplateAllocator** allocator_out,
     AITemplateAllocatorType allocator_type);
@@ -314,4 +644,28 @@ AIT_EXPORT AITemplateError AITemplateTrackingAllocatorGetNumBytes(
     AITemplateAllocator* allocator,
     size_t* num_bytes_out);
 
-} // extern "C"
\ No newline at end of file
+// Create a kCaching allocator that never holds more than max_reserved_bytes
+// of device memory (0 = no cap). Allocations beyond the cap fail once all
+// cached blocks have been released.
+AIT_EXPORT AITemplateError AITemplateCachingAllocatorCreate(
+    AITemplateAllocator** allocator_out,
+    size_t max_reserved_bytes);
+
+AIT_EXPORT AITemplateError AITemplateCachingAllocatorGetStats(
+    AITemplateAllocator* allocator,
+    AITemplateCachingAllocatorStats* stats_out);
+
+// Return all cached blocks to the device.
+AIT_EXPORT AITemplateError
+AITemplateCachingAllocatorEmptyCache(AITemplateAllocator* allocator);
+
+// See AITemplateAllocator::RecordStream(). deferred_out (optional) is set to
+// whether the allocator holds ptr back until the work queued on stream is
+// done.
+AIT_EXPORT AITemplateError AITemplateAllocatorRecordStream(
+    AITemplateAllocator* allocator,
+    void* ptr,
+    AITemplateStreamHandle stream,
+    bool* deferred_out);
+
+} // extern "C"
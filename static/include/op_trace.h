@@ -0,0 +1,116 @@
+//  Copyright (c) Meta Platforms, Inc. and affiliates.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+namespace ait {
+
+// Static description of an op in the generated RunImpl. input_sizes and
+// output_sizes are JSON arrays of the (symbolic) shapes, as in the per op
+// profiler output.
+struct OpTraceInfo {
+  const char* name;
+  const char* input_sizes;
+  const char* output_sizes;
+};
+
+// Timing of one op in one sampled run.
+struct OpTraceRecord {
+  uint64_t run_id;
+  const OpTraceInfo* op;
+  const void* stream;
+  int device;
+  // Host steady clock, in microseconds.
+  double ts_us;
+  double dur_us;
+};
+
+// Fixed-capacity ring buffer of OpTraceRecords. Once full, the oldest
+// records are overwritten. Not thread safe; ModelContainer guards it with
+// models_mutex_.
+class OpTraceBuffer {
+ public:
+  explicit OpTraceBuffer(size_t capacity = 0) {
+    Reset(capacity);
+  }
+
+  // Drop all records and preallocate room for capacity records.
+  void Reset(size_t capacity) {
+    records_.clear();
+    records_.resize(capacity);
+    next_ = 0;
+    size_ = 0;
+    next_run_id_ = 0;
+  }
+
+  uint64_t NextRunId() {
+    return next_run_id_++;
+  }
+
+  void Add(const OpTraceRecord& record) {
+    if (records_.empty()) {
+      return;
+    }
+    records_[next_] = record;
+    next_ = (next_ + 1) % records_.size();
+    size_ = std::min(size_ + 1, records_.size());
+  }
+
+  size_t Size() const {
+    return size_;
+  }
+
+  // Write the records (oldest first) in the Chrome trace event format, which
+  // chrome://tracing and Perfetto can load. Every stream gets its own track.
+  void WriteChromeTrace(std::ostream& os) const {
+    std::unordered_map<const void*, size_t> stream_ids;
+    os << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    const char* sep = "\n";
+    const size_t first = size_ < records_.size() ? 0 : next_;
+    for (size_t i = 0; i < size_; ++i) {
+      const auto& record = records_[(first + i) % records_.size()];
+      auto [it, inserted] =
+          stream_ids.emplace(record.stream, stream_ids.size());
+      if (inserted) {
+        os << sep << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": "
+           << record.device << ", \"tid\": " << it->second
+           << ", \"args\": {\"name\": \"stream " << record.stream << "\"}}";
+        sep = ",\n";
+      }
+      os << sep << "{\"name\": \"" << record.op->name
+         << "\", \"cat\": \"op\", \"ph\": \"X\", \"ts\": " << std::fixed
+         << record.ts_us << ", \"dur\": " << record.dur_us
+         << ", \"pid\": " << record.device << ", \"tid\": " << it->second
+         << ", \"args\": {\"run\": " << record.run_id
+         << ", \"input_sizes\": " << record.op->input_sizes
+         << ", \"output_sizes\": " << record.op->output_sizes << "}}";
+      sep = ",\n";
+    }
+    os << "\n]}\n";
+  }
+
+ private:
+  std::vector<OpTraceRecord> records_;
+  size_t next_ = 0;
+  size_t size_ = 0;
+  uint64_t next_run_id_ = 0;
+};
+
+} // namespace ait
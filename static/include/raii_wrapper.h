@@ -27,6 +27,10 @@ namespace ait {
 // to malloc/free are synchronous for simplicity.
 using GPUPtr = std::unique_ptr<void, std::function<void(void*)>>;
 
+// RAII wrapper for page-locked host memory.
+using PinnedHostPtr =
+    std::unique_ptr<void, decltype(&FreeDeviceHostMemory)>;
+
 using StreamPtr = std::
     unique_ptr<std::remove_pointer<StreamType>::type, decltype(&StreamDestroy)>;
 
@@ -45,6 +49,12 @@ inline GPUPtr RAII_DeviceMalloc(
   return GPUPtr(output, deleter);
 }
 
+inline PinnedHostPtr RAII_PinnedHostMalloc(size_t num_bytes) {
+  void* output;
+  DEVICE_CHECK(DeviceMallocHost(&output, num_bytes));
+  return PinnedHostPtr(output, FreeDeviceHostMemory);
+}
+
 inline StreamPtr RAII_StreamCreate(bool non_blocking = false) {
   StreamType stream;
   DEVICE_CHECK(StreamCreate(&stream, non_blocking));
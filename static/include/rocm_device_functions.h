@@ -236,6 +236,27 @@ inline DeviceError DeviceToDeviceCopy(
   return hipMemcpyAsync(dst, src, size, hipMemcpyDeviceToDevice, stream);
 }
 
+// Copy a height x width bytes rectangle between device buffers with the
+// given row pitches.
+inline DeviceError DeviceToDeviceCopy2D(
+    Handle dst,
+    size_t dst_pitch,
+    const void* src,
+    size_t src_pitch,
+    size_t width,
+    size_t height,
+    StreamType stream = 0) {
+  return hipMemcpy2DAsync(
+      dst,
+      dst_pitch,
+      src,
+      src_pitch,
+      width,
+      height,
+      hipMemcpyDeviceToDevice,
+      stream);
+}
+
 inline DeviceError FreeDeviceMemory(Handle src) {
   return hipFree(src);
 }
@@ -0,0 +1,272 @@
+//  Copyright (c) Meta Platforms, Inc. and affiliates.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+// Exercises CachingAllocatorImpl on the host, without a GPU. Built and run
+// by test_caching_allocator.py.
+#include "caching_allocator.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A fake device with host memory and streams whose work completes only when
+// the test says so.
+struct FakeDeviceState {
+  size_t capacity = 0; // 0 = unlimited
+  size_t used = 0;
+  std::map<void*, size_t> allocations;
+  // Per stream: number of work items queued and completed.
+  std::map<int, std::pair<size_t, size_t>> streams;
+  // Event -> (stream, queued work count when recorded).
+  std::map<int, std::pair<int, size_t>> events;
+  int next_event = 0;
+  // Make Free() and DestroyEvent() throw, like DEVICE_CHECK on an error.
+  bool fail_releases = false;
+
+  void Enqueue(int stream) {
+    ++streams[stream].first;
+  }
+
+  void CompleteAll(int stream) {
+    streams[stream].second = streams[stream].first;
+  }
+};
+
+struct FakeDevice {
+  using StreamType = int;
+  using EventType = int;
+
+  std::shared_ptr<FakeDeviceState> state;
+
+  void* Malloc(size_t num_bytes) {
+    if (state->capacity != 0 && state->used + num_bytes > state->capacity) {
+      return nullptr;
+    }
+    void* ptr = std::malloc(num_bytes);
+    state->allocations[ptr] = num_bytes;
+    state->used += num_bytes;
+    return ptr;
+  }
+
+  void Free(void* ptr) {
+    if (state->fail_releases) {
+      throw std::runtime_error("fake device error");
+    }
+    state->used -= state->allocations.at(ptr);
+    state->allocations.erase(ptr);
+    std::free(ptr);
+  }
+
+  EventType RecordEvent(StreamType stream) {
+    const int event = state->next_event++;
+    state->events[event] = {stream, state->streams[stream].first};
+    return event;
+  }
+
+  bool EventDone(EventType event) {
+    auto [stream, queued] = state->events.at(event);
+    return state->streams[stream].second >= queued;
+  }
+
+  void DestroyEvent(EventType event) {
+    if (state->fail_releases) {
+      throw std::runtime_error("fake device error");
+    }
+    state->events.erase(event);
+  }
+};
+
+using Allocator = ait::CachingAllocatorImpl<FakeDevice>;
+
+int num_failures = 0;
+
+#define EXPECT(cond)                                                   \
+  if (!(cond)) {                                                       \
+    std::cerr << __FILE__ << ":" << __LINE__ << ": expected " << #cond \
+              << std::endl;                                            \
+    ++num_failures;                                                    \
+  }
+
+template <typename Fn>
+bool Throws(Fn fn) {
+  try {
+    fn();
+  } catch (const std::runtime_error&) {
+    return true;
+  }
+  return false;
+}
+
+void TestSizeClasses() {
+  EXPECT(Allocator::RoundSize(0) == 512);
+  EXPECT(Allocator::RoundSize(1) == 512);
+  EXPECT(Allocator::RoundSize(513) == 1024);
+  EXPECT(Allocator::RoundSize(1 << 20) == 2 << 20);
+  EXPECT(Allocator::RoundSize((2 << 20) + 1) == 4 << 20);
+}
+
+void TestReuse() {
+  auto state = std::make_shared<FakeDeviceState>();
+  {
+    Allocator allocator(FakeDevice{state});
+    void* a = allocator.Allocate(1000);
+    allocator.Free(a);
+    // Same size class: reused without a device malloc.
+    void* b = allocator.Allocate(900);
+    EXPECT(a == b);
+    auto stats = allocator.GetStats();
+    EXPECT(stats.num_device_mallocs == 1);
+    EXPECT(stats.num_cache_hits == 1);
+    EXPECT(stats.allocated_bytes == 1024);
+    EXPECT(stats.requested_bytes == 900);
+    EXPECT(stats.reserved_bytes == 1024);
+    EXPECT(stats.cached_bytes == 0);
+
+    // A cached block at most twice as large is reused; a larger one is not.
+    allocator.Free(b);
+    void* c = allocator.Allocate(512);
+    EXPECT(c == b);
+    allocator.Free(c);
+    void* big = allocator.Allocate(4000);
+    allocator.Free(big);
+    void* d = allocator.Allocate(1500);
+    EXPECT(d != big);
+    stats = allocator.GetStats();
+    EXPECT(stats.num_device_mallocs == 3);
+    EXPECT(stats.cached_bytes == 1024 + 4096);
+    EXPECT(stats.reserved_bytes == 1024 + 4096 + 1536);
+
+    allocator.EmptyCache();
+    stats = allocator.GetStats();
+    EXPECT(stats.num_device_frees == 2);
+    EXPECT(stats.reserved_bytes == 1536);
+    EXPECT(stats.peak_reserved_bytes == 1024 + 4096 + 1536);
+    EXPECT(state->used == 1536);
+
+    EXPECT(Throws([&]() { allocator.Free(c); }));
+    allocator.Free(d);
+  }
+  // Everything goes back to the device on destruction.
+  EXPECT(state->used == 0);
+  EXPECT(state->allocations.empty());
+}
+
+void TestStreamOrderedReuse() {
+  auto state = std::make_shared<FakeDeviceState>();
+  Allocator allocator(FakeDevice{state});
+  void* a = allocator.Allocate(1000);
+  allocator.RecordStream(a, 1);
+  state->Enqueue(1);
+  allocator.Free(a);
+
+  // Work queued on stream 1 may still use a, so it isn't reused.
+  void* b = allocator.Allocate(1000);
+  EXPECT(b != a);
+  EXPECT(state->events.size() == 1);
+
+  state->CompleteAll(1);
+  void* c = allocator.Allocate(1000);
+  EXPECT(c == a);
+  EXPECT(state->events.empty());
+
+  // Blocks used by several streams wait for all of them.
+  allocator.RecordStream(c, 1);
+  allocator.RecordStream(c, 2);
+  state->Enqueue(1);
+  state->Enqueue(2);
+  allocator.Free(c);
+  state->CompleteAll(1);
+  void* d = allocator.Allocate(1000);
+  EXPECT(d != c);
+  state->CompleteAll(2);
+  allocator.Free(b);
+  allocator.Free(d);
+  allocator.EmptyCache();
+  EXPECT(allocator.GetStats().reserved_bytes == 0);
+  EXPECT(state->used == 0);
+}
+
+void TestReservedCap() {
+  auto state = std::make_shared<FakeDeviceState>();
+  Allocator allocator(FakeDevice{state}, /*max_reserved_bytes=*/4096);
+  void* a = allocator.Allocate(2048);
+  void* b = allocator.Allocate(1024);
+  allocator.Free(b);
+  // Doesn't fit next to a and the cached b: b is released to make room.
+  void* c = allocator.Allocate(2048);
+  auto stats = allocator.GetStats();
+  EXPECT(stats.num_device_frees == 1);
+  EXPECT(stats.reserved_bytes == 4096);
+  EXPECT(Throws([&]() { allocator.Allocate(1); }));
+  allocator.Free(a);
+  allocator.Free(c);
+}
+
+void TestOutOfMemoryRetry() {
+  auto state = std::make_shared<FakeDeviceState>();
+  state->capacity = 4096;
+  Allocator allocator(FakeDevice{state});
+  void* a = allocator.Allocate(4096);
+  allocator.Free(a);
+  // The device is full of cached memory (too large to reuse for b), which
+  // is released before retrying.
+  void* b = allocator.Allocate(1000);
+  EXPECT(b != nullptr);
+  EXPECT(allocator.GetStats().num_device_frees == 1);
+  EXPECT(Throws([&]() { allocator.Allocate(4000); }));
+  allocator.Free(b);
+}
+
+void TestDestructorIgnoresDeviceErrors() {
+  auto state = std::make_shared<FakeDeviceState>();
+  bool threw = false;
+  try {
+    Allocator allocator(FakeDevice{state});
+    allocator.Allocate(1000);
+    void* b = allocator.Allocate(1000);
+    allocator.RecordStream(b, 1);
+    state->Enqueue(1);
+    allocator.Free(b);
+    state->fail_releases = true;
+  } catch (...) {
+    threw = true;
+  }
+  EXPECT(!threw);
+  for (auto& [ptr, num_bytes] : state->allocations) {
+    std::free(ptr);
+  }
+}
+
+} // namespace
+
+int main() {
+  TestSizeClasses();
+  TestReuse();
+  TestStreamOrderedReuse();
+  TestReservedCap();
+  TestOutOfMemoryRetry();
+  TestDestructorIgnoresDeviceErrors();
+  if (num_failures != 0) {
+    std::cerr << num_failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "OK" << std::endl;
+  return 0;
+}
@@ -0,0 +1,121 @@
+//  Copyright (c) Meta Platforms, Inc. and affiliates.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+// Exercises the loadtest statistics of the standalone runner on the host.
+// Built and run by test_loadtest_stats.py.
+#include "loadtest_stats.h"
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+using namespace ait;
+
+int num_failures = 0;
+
+#define EXPECT(cond)                                                   \
+  if (!(cond)) {                                                       \
+    std::cerr << __FILE__ << ":" << __LINE__ << ": expected " << #cond \
+              << std::endl;                                            \
+    ++num_failures;                                                    \
+  }
+
+void TestPercentiles() {
+  EXPECT(NearestRankPercentile({}, 0.5) == 0);
+  EXPECT(NearestRankPercentile({7}, 0.001) == 7);
+  EXPECT(NearestRankPercentile({7}, 1) == 7);
+
+  std::vector<double> values;
+  for (int i = 1; i <= 1000; i++) {
+    values.push_back(i);
+  }
+  EXPECT(NearestRankPercentile(values, 0.5) == 500);
+  EXPECT(NearestRankPercentile(values, 0.9) == 900);
+  EXPECT(NearestRankPercentile(values, 0.99) == 990);
+  EXPECT(NearestRankPercentile(values, 0.999) == 999);
+  EXPECT(NearestRankPercentile(values, 1) == 1000);
+  // Ranks are rounded up: 0.25 * 10 = 2.5 -> the 3rd value.
+  std::vector<double> ten(values.begin(), values.begin() + 10);
+  EXPECT(NearestRankPercentile(ten, 0.25) == 3);
+  EXPECT(NearestRankPercentile(ten, 0) == 1);
+}
+
+void TestArrivalTimes() {
+  const auto fixed = ArrivalTimes(5, 4.0, /*poisson=*/false);
+  EXPECT(fixed.size() == 5);
+  for (size_t i = 0; i < fixed.size(); i++) {
+    EXPECT(std::abs(fixed[i] - 0.25 * i) < 1e-12);
+  }
+
+  const size_t num_requests = 100000;
+  const double qps = 500.0;
+  const auto poisson = ArrivalTimes(num_requests, qps, /*poisson=*/true);
+  EXPECT(poisson.front() == 0);
+  double sum_sq_gaps = 0;
+  for (size_t i = 1; i < num_requests; i++) {
+    const double gap = poisson[i] - poisson[i - 1];
+    EXPECT(gap >= 0);
+    sum_sq_gaps += gap * gap;
+  }
+  // Exponential gaps: the mean is 1 / qps, and so is the standard
+  // deviation (the second moment is 2 / qps^2).
+  const double mean_gap = poisson.back() / (num_requests - 1);
+  EXPECT(std::abs(mean_gap * qps - 1) < 0.02);
+  const double second_moment = sum_sq_gaps / (num_requests - 1);
+  EXPECT(std::abs(second_moment * qps * qps - 2) < 0.1);
+  // Seeded, so reproducible.
+  EXPECT(ArrivalTimes(num_requests, qps, true) == poisson);
+  EXPECT(ArrivalTimes(num_requests, qps, true, /*seed=*/1) != poisson);
+}
+
+void TestSelectKnee() {
+  EXPECT(SelectKnee({}) == -1);
+  // Served on time up to 400 QPS; at 800 QPS only 600 get through, and the
+  // p99 latency explodes at 1600 QPS.
+  std::vector<LoadLevelSummary> levels = {
+      {100, 100, 2.0},
+      {200, 199, 2.1},
+      {400, 390, 3.9},
+      {800, 600, 3.0},
+      {1600, 1550, 50.0},
+  };
+  EXPECT(SelectKnee(levels) == 2);
+  // The p99 latency may at most double.
+  levels[2].p99_ms = 4.1;
+  EXPECT(SelectKnee(levels) == 1);
+  // 95% of the offered load must get through.
+  levels[1].achieved_qps = 189;
+  EXPECT(SelectKnee(levels) == 0);
+  // The lightest load is the baseline, so it is served on time unless it
+  // doesn't get through.
+  levels[0].achieved_qps = 50;
+  EXPECT(SelectKnee(levels) == -1);
+  EXPECT(SelectKnee({{100, 100, 2.0}}) == 0);
+}
+
+} // namespace
+
+int main() {
+  TestPercentiles();
+  TestArrivalTimes();
+  TestSelectKnee();
+  if (num_failures != 0) {
+    std::cerr << num_failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "OK" << std::endl;
+  return 0;
+}
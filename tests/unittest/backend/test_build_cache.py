@@ -26,6 +26,7 @@ from aitemplate.backend.build_cache_base import (
     create_dir_hash,
     FileBasedBuildCache,
     is_source,
+    ObjectCache,
     SkipBuildCache,
 )
 
@@ -128,6 +129,70 @@ class BuildCacheTestCase(unittest.TestCase):
                     == Path(os.path.join(build_dir_2, "test.so")).read_bytes()
                 )
 
+    def test_object_cache(self):
+        with patch(
+            "aitemplate.backend.build_cache_base.should_skip_build_cache"
+        ) as should_skip_build_cache_mock:
+            should_skip_build_cache_mock.return_value = False
+            with tempfile.TemporaryDirectory() as parent_dir:
+                cache = ObjectCache(os.path.join(parent_dir, "object_cache"))
+                build_dirs = [
+                    os.path.join(parent_dir, f"build_{i}") for i in range(2)
+                ]
+                for build_dir in build_dirs:
+                    bp = Path(build_dir)
+                    os.makedirs(build_dir)
+                    (bp / "model-generated.h").write_text("int x = 1;")
+                    (bp / "model.cu").write_text('#include "model-generated.h"')
+                    (bp / "op.cu").write_text("#include <cuda.h>")
+                    (bp / "nvcc.version").write_text("V12")
+
+                def _file_pairs(build_dir):
+                    return [
+                        (
+                            os.path.join(build_dir, f"{name}.cu"),
+                            os.path.join(build_dir, f"{name}.obj"),
+                        )
+                        for name in ["model", "op"]
+                    ]
+
+                compile_cmd = "nvcc -O3 -c -o {target} {src}"
+                misses = cache.restore_objects(
+                    build_dirs[0], _file_pairs(build_dirs[0]), compile_cmd
+                )
+                self.assertEqual(len(misses), 2)
+                for _, obj in _file_pairs(build_dirs[0]):
+                    Path(obj).write_bytes(obj.encode("utf-8"))
+                cache.store_objects(misses)
+
+                # Objects are shared across build directories...
+                misses = cache.restore_objects(
+                    build_dirs[1], _file_pairs(build_dirs[1]), compile_cmd
+                )
+                self.assertEqual(misses, {})
+                self.assertEqual(
+                    Path(build_dirs[1], "model.obj").read_bytes(),
+                    Path(build_dirs[0], "model.obj").read_bytes(),
+                )
+                # ...but not if an included header, the compile command or
+                # the compiler changes.
+                Path(build_dirs[1], "model-generated.h").write_text("int x = 2;")
+                misses = cache.restore_objects(
+                    build_dirs[1], _file_pairs(build_dirs[1]), compile_cmd
+                )
+                self.assertEqual(
+                    list(misses), [os.path.join(build_dirs[1], "model.obj")]
+                )
+                misses = cache.restore_objects(
+                    build_dirs[0], _file_pairs(build_dirs[0]), "nvcc -O2 -c -o {target} {src}"
+                )
+                self.assertEqual(len(misses), 2)
+                Path(build_dirs[0], "nvcc.version").write_text("V13")
+                misses = cache.restore_objects(
+                    build_dirs[0], _file_pairs(build_dirs[0]), compile_cmd
+                )
+                self.assertEqual(len(misses), 2)
+
     def test_deterministic_codegen(self, dtype="float32"):
         with SkipBuildCache():
             # Tests, whether repeated invocation of compilation results in identical generated source files
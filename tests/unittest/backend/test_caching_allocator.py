@@ -0,0 +1,33 @@
+#  Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+import unittest
+from pathlib import Path
+
+from aitemplate.testing.host_cpp import run_host_cpp_test
+
+
+class CachingAllocatorFakeDeviceTestCase(unittest.TestCase):
+    """
+    Builds caching_allocator_fake_device.cpp with the host compiler and runs
+    it. This covers the caching allocator's logic without a GPU.
+    """
+
+    def test_fake_device(self):
+        src = Path(__file__).parent / "caching_allocator_fake_device.cpp"
+        run_host_cpp_test(self, src)
+
+
+if __name__ == "__main__":
+    unittest.main()
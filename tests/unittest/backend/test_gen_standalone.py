@@ -12,9 +12,11 @@
 #  See the License for the specific language governing permissions and
 #  limitations under the License.
 #
+import io
 import logging
 import os
 import re
+import struct
 import subprocess
 import unittest
 
@@ -31,15 +33,124 @@ from aitemplate.testing.test_utils import (
 )
 from aitemplate.utils.debug_settings import AITDebugSettings
 from aitemplate.utils.misc import is_windows
+from aitemplate.utils.torch_utils import write_tensor_binary
 
 _LOGGER = logging.getLogger(__name__)
 
 
+def _read_testcase_tensor_offsets(filename, num_tensors):
+    """
+    Parses a testcase file written by Model.write_standalone_testcase_data.
+    Returns the format version and the file offsets of the tensors' data.
+    """
+    with open(filename, "rb") as f:
+        data = f.read()
+    offset = 0
+    version = 1
+    if data.startswith(b"AITTCASE"):
+        version, _ = struct.unpack_from("II", data, 8)
+        offset = 16
+    offset += struct.calcsize("ff")
+    data_offsets = []
+    for _ in range(num_tensors):
+        _, _, ndims = struct.unpack_from("@III", data, offset)
+        offset += struct.calcsize("@III") + ndims * struct.calcsize("@N")
+        (num_bytes,) = struct.unpack_from("@N", data, offset)
+        offset += struct.calcsize("@N")
+        if version >= 2:
+            offset += -offset % 64
+        data_offsets.append(offset)
+        offset += num_bytes
+    if offset != len(data):
+        raise ValueError(f"{filename} has {len(data) - offset} trailing bytes")
+    return version, data_offsets
+
+
 class StridedOpCatPatternTestCase(unittest.TestCase):
     @classmethod
     def setUpClass(cls) -> None:
         torch.manual_seed(0)
 
+    def _run_exe(self, workdir, args):
+        working_env = os.environ.copy()
+        if "LD_LIBRARY_PATH" in working_env:
+            working_env["LD_LIBRARY_PATH"] = (
+                working_env["LD_LIBRARY_PATH"] + ":" + workdir
+            )
+        else:
+            working_env["LD_LIBRARY_PATH"] = workdir
+        exe_name = "test.exe" if is_windows() else "./test"
+        result = subprocess.run(
+            " ".join([exe_name] + args),
+            shell=True,
+            cwd=workdir,
+            env=working_env,
+            capture_output=True,
+            text=True,
+            timeout=10,
+        )
+        _LOGGER.info(f"stdout:\n\n{result.stdout}")
+        _LOGGER.info(f"stderr:\n\n{result.stderr}")
+        return result.returncode, result.stdout
+
+    def _test_standalone_testcases(self, module, workdir, inputs, y_pt):
+        # Version 2: aligned tensor data.
+        testcase = os.path.join(workdir, "testcase_v2.bin")
+        module.write_standalone_testcase_data(testcase, inputs, [y_pt])
+        version, data_offsets = _read_testcase_tensor_offsets(
+            testcase, len(inputs) + 1
+        )
+        self.assertEqual(version, 2)
+        for offset in data_offsets:
+            self.assertEqual(offset % 64, 0)
+        returncode, stdout = self._run_exe(workdir, ["test", testcase])
+        self.assertEqual(returncode, 0)
+        self.assertIn("Test succeeded.", stdout)
+        self.assertRegex(stdout, "Output #0: max abs error .* max rel error")
+
+        # Version 1: no header and no padding, as written by older versions.
+        testcase_v1 = os.path.join(workdir, "testcase_v1.bin")
+        with open(testcase_v1, "wb") as f:
+            f.write(struct.pack("ff", 1e-2, 1e-2))
+            index_map = module.get_input_name_to_index_map()
+            for name in sorted(inputs, key=index_map.get):
+                write_tensor_binary(inputs[name], f)
+            write_tensor_binary(y_pt, f)
+        version, _ = _read_testcase_tensor_offsets(testcase_v1, len(inputs) + 1)
+        self.assertEqual(version, 1)
+        returncode, stdout = self._run_exe(workdir, ["test", testcase_v1])
+        self.assertEqual(returncode, 0)
+        self.assertIn("Test succeeded.", stdout)
+
+        # A mismatch is reported with its location and an error histogram.
+        y_bad = y_pt.clone()
+        y_bad[1, 2] += 10
+        testcase_bad = os.path.join(workdir, "testcase_bad.bin")
+        module.write_standalone_testcase_data(testcase_bad, inputs, [y_bad])
+        returncode, stdout = self._run_exe(workdir, ["test", testcase_bad])
+        self.assertEqual(returncode, 1)
+        numel = y_pt.numel()
+        self.assertRegex(
+            stdout, rf"max abs error \S+ at index {y_pt.shape[1] + 2} "
+        )
+        self.assertIn(
+            f"not equal for output with index 0 of {numel} elements, 1 differed",
+            stdout,
+        )
+        self.assertIn("error histogram, in multiples of the tolerance", stdout)
+        self.assertIn("Failed tests: 1 of 1", stdout)
+
+    def test_write_tensor_binary_alignment(self):
+        tensor = torch.arange(6, dtype=torch.float16).reshape(2, 3)
+        for alignment, padding in ((None, 0), (64, 64 - 3 * 4 - 3 * 8)):
+            f = io.BytesIO()
+            write_tensor_binary(tensor, f, alignment=alignment)
+            data = f.getvalue()
+            header_size = 3 * 4 + 3 * 8
+            self.assertEqual(len(data), header_size + padding + 12)
+            self.assertEqual(data[header_size : header_size + padding], bytes(padding))
+            self.assertEqual(data[header_size + padding :], tensor.numpy().tobytes())
+
     def _test_gen_standalone(self, test_name, dtype):
         M = 8
         N = 16
@@ -163,6 +274,13 @@ class StridedOpCatPatternTestCase(unittest.TestCase):
                     self.assertTrue(int(shape[0]) == 8)
                     self.assertTrue(int(shape[1]) == 32)
 
+        self._test_standalone_testcases(
+            module,
+            workdir,
+            {"X1": x1_pt, "W1": w1_pt, "B1": b1_pt, "X2": x2_pt, "X3": x3_pt},
+            y_pt,
+        )
+
     def test_gen_standalone_f16(self):
         self._test_gen_standalone("gen_standalone_f16", "float16")
 
@@ -0,0 +1,98 @@
+#  Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+import os
+import unittest
+
+import torch
+
+from aitemplate.compiler import compile_model, ops
+from aitemplate.frontend import Tensor
+from aitemplate.testing import detect_target
+from aitemplate.testing.test_utils import (
+    env_variables,
+    get_random_torch_tensor,
+    get_torch_empty_tensor,
+)
+
+
+class KernelInstancesTestCase(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls) -> None:
+        torch.manual_seed(0)
+
+    def _compile_and_run(self, test_name, share):
+        # Three gemms of two shapes, so that ops share kernel instances.
+        m, k = 64, 128
+        dtype = "float16"
+        X = Tensor(shape=[m, k], dtype=dtype, name="input_0", is_input=True)
+        Ws = [
+            Tensor(shape=[k, k], dtype=dtype, name=f"w_{i}", is_input=True)
+            for i in range(3)
+        ]
+        Y0 = ops.gemm_rcr()(X, Ws[0])
+        Y1 = ops.gemm_rcr()(Y0, Ws[1])
+        B = Tensor(shape=[k], dtype=dtype, name="bias", is_input=True)
+        Y = ops.gemm_rcr_bias()(Y1, Ws[2], B)
+        Y._attrs["name"] = "output_0"
+        Y._attrs["is_output"] = True
+        with env_variables(AIT_SHARE_KERNEL_INSTANCES="1" if share else "0"):
+            module = compile_model(Y, detect_target(), "./tmp", test_name)
+
+        x_pt = get_random_torch_tensor([m, k], dtype)
+        ws_pt = [get_random_torch_tensor([k, k], dtype) for _ in range(3)]
+        y_pt = torch.nn.functional.linear(x_pt, ws_pt[0])
+        y_pt = torch.nn.functional.linear(y_pt, ws_pt[1])
+        b_pt = get_random_torch_tensor([k], dtype)
+        y_pt = torch.nn.functional.linear(y_pt, ws_pt[2], b_pt)
+        inputs = {"input_0": x_pt, "bias": b_pt}
+        inputs.update({f"w_{i}": w for i, w in enumerate(ws_pt)})
+        y = get_torch_empty_tensor([m, k], dtype)
+        module.run_with_tensors(inputs, [y])
+        torch.testing.assert_close(y, y_pt, atol=1e-1, rtol=1e-1)
+
+        workdir = os.path.join("./tmp", test_name)
+        gemm_srcs = [
+            f
+            for f in os.listdir(workdir)
+            if f.startswith("gemm_") and f.endswith(".cu")
+        ]
+        instance_srcs = [
+            f for f in os.listdir(workdir) if f.startswith("kernel_instance_")
+        ]
+        return workdir, gemm_srcs, instance_srcs
+
+    def test_shared_kernel_instances(self):
+        workdir, gemm_srcs, instance_srcs = self._compile_and_run(
+            "test_shared_kernel_instances", share=True
+        )
+        self.assertGreater(len(gemm_srcs), 0)
+        self.assertGreater(len(instance_srcs), 0)
+        self.assertLessEqual(len(instance_srcs), len(gemm_srcs))
+        for src in gemm_srcs:
+            with open(os.path.join(workdir, src)) as f:
+                code = f.read()
+            self.assertIn("extern template", code)
+            self.assertNotIn("gemm_op(stream)", code)
+
+    def test_inline_kernel_instances(self):
+        _, gemm_srcs, instance_srcs = self._compile_and_run(
+            "test_inline_kernel_instances", share=False
+        )
+        self.assertGreater(len(gemm_srcs), 0)
+        self.assertEqual(len(instance_srcs), 0)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,33 @@
+#  Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+import unittest
+from pathlib import Path
+
+from aitemplate.testing.host_cpp import run_host_cpp_test
+
+
+class LoadtestStatsTestCase(unittest.TestCase):
+    """
+    Builds loadtest_stats_host.cpp with the host compiler and runs it. This
+    covers the statistics of the standalone runner's loadtest action
+    (percentiles, arrival schedules and knee selection) without a GPU.
+    """
+
+    def test_loadtest_stats(self):
+        run_host_cpp_test(self, Path(__file__).parent / "loadtest_stats_host.cpp")
+
+
+if __name__ == "__main__":
+    unittest.main()
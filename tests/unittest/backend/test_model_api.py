@@ -12,12 +12,14 @@
 #  See the License for the specific language governing permissions and
 #  limitations under the License.
 #
+import concurrent.futures
 import contextlib
 import ctypes
 import itertools
 import json
 import os
 import tempfile
+import time
 import unittest
 from typing import Callable, Optional, Tuple
 
@@ -39,7 +41,10 @@ from aitemplate.compiler.model import (
     AITData,
     AITemplateAllocatorKind,
     AITemplateMemcpyKind,
+    DynamicBatcherOptions,
+    GraphCacheStats,
     Model,
+    RuntimePoolPolicy,
     torch_to_ait_data,
 )
 from aitemplate.compiler.ops.common.epilogue import FuncEnum
@@ -1363,8 +1368,349 @@ class ModelAPITestCase(unittest.TestCase):
             "test_get_num_runtimes_compile_module_custom",
             num_runtimes=2,
         ) as module:
+            # Runtimes are created lazily.
+            self.assertEqual(module.get_num_runtimes(), 1)
+            module.prewarm_runtimes()
+            self.assertEqual(module.get_num_runtimes(), 2)
+            # Nothing left to create.
+            module.prewarm_runtimes()
             self.assertEqual(module.get_num_runtimes(), 2)
 
+    def test_elastic_runtime_pool(self):
+        module, (in0, in1), (out_pt, out_ait) = self._get_simple_graph_and_output(
+            "test_elastic_runtime_pool"
+        )
+        self.assertEqual(
+            module.get_runtime_pool_policy(), RuntimePoolPolicy(1, 1, 0, 0)
+        )
+        with self.assertRaises(RuntimeError):
+            module.set_runtime_pool_policy(RuntimePoolPolicy(2, 1))
+
+        module.set_runtime_pool_policy(RuntimePoolPolicy(1, 4, idle_timeout_ms=0))
+        module.benchmark_with_tensors(
+            [in0, in1],
+            [out_ait],
+            num_threads=8,
+            count=100,
+            use_unique_stream_per_thread=True,
+        )
+        self.assertGreaterEqual(module.get_num_runtimes(), 1)
+        self.assertLessEqual(module.get_num_runtimes(), 4)
+        self.assertTrue(torch.equal(out_ait, out_pt))
+
+        # Shrinking max_runtimes releases the idle runtimes right away.
+        module.set_runtime_pool_policy(RuntimePoolPolicy(1, 1))
+        self.assertEqual(module.get_num_runtimes(), 1)
+        module.run_with_tensors([in0, in1], [out_ait])
+        self.assertTrue(torch.equal(out_ait, out_pt))
+
+        # min_runtimes tops the pool up eagerly.
+        module.set_runtime_pool_policy(RuntimePoolPolicy(3, 3))
+        self.assertEqual(module.get_num_runtimes(), 3)
+        module.set_runtime_pool_policy(RuntimePoolPolicy(1, 3, idle_timeout_ms=1))
+        time.sleep(0.01)
+        module.release_idle_runtimes()
+        self.assertEqual(module.get_num_runtimes(), 1)
+
+    def test_graph_cache(self):
+        target = detect_target()
+        if target.name() == "rocm":
+            self.skipTest("graph mode is not supported on ROCm")
+        batch = IntVar([1, 8], name="batch")
+        input_0 = Tensor(shape=[batch, 4], dtype="float16", name="x", is_input=True)
+        output = ops.elementwise(FuncEnum.ADD)(input_0, input_0)
+        output._attrs["name"] = "output"
+        output._attrs["is_output"] = True
+        module = compile_model(output, target, "./tmp", "test_graph_cache")
+
+        def run(x, out):
+            outputs = module.run_with_tensors([x], [out], graph_mode=True)
+            self.assertEqual(list(outputs["output"].shape), list(x.shape))
+            self.assertTrue(torch.equal(out, x + x))
+
+        x2 = torch.randn([2, 4]).cuda().half()
+        out2 = torch.empty([2, 4]).cuda().half()
+        run(x2, out2)
+        self.assertEqual(module.get_graph_cache_stats(), GraphCacheStats(0, 0, 1, 0))
+        run(x2, out2)
+        self.assertEqual(module.get_graph_cache_stats(), GraphCacheStats(1, 0, 1, 0))
+
+        # Same shapes, new output pointer: the cached graph is updated.
+        out2_other = torch.empty([2, 4]).cuda().half()
+        run(x2, out2_other)
+        self.assertEqual(module.get_graph_cache_stats(), GraphCacheStats(1, 1, 1, 0))
+
+        # New shapes get their own graph; going back to the old shapes hits
+        # and restores the old output shape.
+        x5 = torch.randn([5, 4]).cuda().half()
+        out5 = torch.empty([5, 4]).cuda().half()
+        run(x5, out5)
+        run(x2, out2_other)
+        self.assertEqual(module.get_graph_cache_stats(), GraphCacheStats(2, 1, 2, 0))
+
+    def test_dynamic_batcher(self):
+        target = detect_target()
+        batch = IntVar([1, 16], name="batch")
+        input_0 = Tensor(shape=[batch, 4], dtype="float16", name="x", is_input=True)
+        input_1 = Tensor(shape=[batch, 4], dtype="float16", name="y", is_input=True)
+        output = ops.elementwise(FuncEnum.MUL)(input_0, input_1)
+        output._attrs["name"] = "output"
+        output._attrs["is_output"] = True
+        module = compile_model(output, target, "./tmp", "test_dynamic_batcher")
+
+        with self.assertRaises(RuntimeError):
+            module.run_batched_with_tensors([], [])
+
+        module.start_dynamic_batcher(
+            DynamicBatcherOptions(max_batch_size=8, max_delay_us=100000)
+        )
+        requests = []
+        for rows in (1, 2, 1, 3, 1, 1, 4, 2):
+            x = torch.randn([rows, 4]).cuda().half()
+            y = torch.randn([rows, 4]).cuda().half()
+            requests.append((x, y, torch.empty([rows, 4]).cuda().half()))
+        torch.cuda.synchronize()
+
+        def run(request):
+            x, y, out = request
+            outputs = module.run_batched_with_tensors({"x": x, "y": y}, [out])
+            return list(outputs["output"].shape)
+
+        with concurrent.futures.ThreadPoolExecutor(len(requests)) as executor:
+            shapes = list(executor.map(run, requests))
+        for (x, y, out), shape in zip(requests, shapes):
+            self.assertEqual(shape, list(x.shape))
+            self.assertTrue(torch.equal(out, x * y))
+
+        # Mismatched batch sizes within a request are rejected.
+        with self.assertRaises(RuntimeError):
+            x, y, out = requests[1]
+            module.run_batched_with_tensors([x, y[:1]], [out])
+        module.stop_dynamic_batcher()
+        module.close()
+
+    def test_run_async(self):
+        target = detect_target()
+        batch = IntVar([1, 8], name="batch")
+        input_0 = Tensor(shape=[batch, 4], dtype="float16", name="x", is_input=True)
+        output = ops.elementwise(FuncEnum.ADD)(input_0, input_0)
+        output._attrs["name"] = "output"
+        output._attrs["is_output"] = True
+        module = compile_model(
+            output, target, "./tmp", "test_run_async", num_runtimes=2
+        )
+        module.prewarm_runtimes()
+
+        completed = []
+        runs = []
+        requests = []
+        for rows in range(1, 9):
+            x = torch.randn([rows, 4]).cuda().half()
+            out = torch.empty([8, 4]).cuda().half()
+            requests.append((x, out))
+        torch.cuda.synchronize()
+        for x, out in requests:
+            runs.append(
+                module.run_async(
+                    [torch_to_ait_data(x)],
+                    [torch_to_ait_data(out)],
+                    callback=completed.append,
+                )
+            )
+
+        for run, (x, out) in zip(runs, requests):
+            outputs = run.wait()
+            self.assertTrue(run.poll())
+            self.assertEqual(list(outputs["output"].shape), list(x.shape))
+            self.assertTrue(torch.equal(out[: x.shape[0]], x + x))
+        self.assertEqual(len(completed), len(runs))
+        self.assertEqual(set(map(id, completed)), set(map(id, runs)))
+        # Every runtime has been handed back by the time its run completes.
+        self.assertEqual(module.get_num_runtimes(), 2)
+
+        # Failures are reported through the handle.
+        bad_input = torch.randn([9, 4]).cuda().half()
+        run = module.run_async(
+            [torch_to_ait_data(bad_input)], [torch_to_ait_data(requests[0][1])]
+        )
+        with self.assertRaises(RuntimeError):
+            run.wait()
+        module.close()
+
+    def test_op_trace(self):
+        target = detect_target()
+        input_0 = Tensor(shape=[2, 4], dtype="float16", name="x", is_input=True)
+        y = ops.elementwise(FuncEnum.ADD)(input_0, input_0)
+        z = ops.softmax()(y, -1)
+        z._attrs["name"] = "output"
+        z._attrs["is_output"] = True
+        module = compile_model(z, target, "./tmp", "test_op_trace")
+        x = torch.randn([2, 4]).cuda().half()
+        out = torch.empty([2, 4]).cuda().half()
+
+        def read_trace():
+            with tempfile.TemporaryDirectory() as tmp_dir:
+                filename = os.path.join(tmp_dir, "trace.json")
+                module.write_op_trace(filename)
+                with open(filename) as f:
+                    events = json.load(f)["traceEvents"]
+            return [event for event in events if event["ph"] == "X"]
+
+        # Tracing is off by default.
+        module.run_with_tensors([x], [out])
+        self.assertEqual(read_trace(), [])
+
+        module.set_op_trace_sampling(sample_every=2)
+        for _ in range(4):
+            module.run_with_tensors([x], [out])
+        events = read_trace()
+        runs = {event["args"]["run"] for event in events}
+        self.assertEqual(len(runs), 2)
+        num_ops = len(events) // len(runs)
+        self.assertGreaterEqual(num_ops, 1)
+        for event in events:
+            self.assertGreaterEqual(event["dur"], 0)
+            self.assertIn("input_sizes", event["args"])
+            self.assertIn("output_sizes", event["args"])
+
+        # The ring buffer keeps only the latest records.
+        module.set_op_trace_sampling(sample_every=1, max_records=num_ops)
+        for _ in range(3):
+            module.run_with_tensors([x], [out])
+        events = read_trace()
+        self.assertEqual(len(events), num_ops)
+        self.assertEqual({event["args"]["run"] for event in events}, {2})
+        module.close()
+
+    def test_metrics(self):
+        target = detect_target()
+        input_0 = Tensor(shape=[2, 4], dtype="float16", name="x", is_input=True)
+        output = ops.elementwise(FuncEnum.ADD)(input_0, input_0)
+        output._attrs["name"] = "output"
+        output._attrs["is_output"] = True
+        module = compile_model(output, target, "./tmp", "test_metrics")
+        x = torch.randn([2, 4]).cuda().half()
+        out = torch.empty([2, 4]).cuda().half()
+
+        for _ in range(3):
+            module.run_with_tensors([x], [out])
+        module.run_with_tensors([x], [out], graph_mode=True)
+        metrics = module.get_metrics()
+        counters = metrics["counters"]
+        histograms = metrics["histograms"]
+        self.assertEqual(counters["runs"], 4)
+        self.assertEqual(counters["failed_runs"], 0)
+        self.assertEqual(counters["graph_cache_misses"], 1)
+        for name in ("run_us", "constants_wait_us", "queue_wait_us", "launch_us"):
+            self.assertEqual(histograms[name]["count"], 4)
+        # All runs have finished (run_with_tensors syncs).
+        self.assertEqual(histograms["device_run_us"]["count"], 4)
+        self.assertEqual(histograms["graph_capture_us"]["count"], 1)
+        self.assertEqual(histograms["constant_folding_us"]["count"], 1)
+        run_us = histograms["run_us"]
+        self.assertLessEqual(run_us["p50"], run_us["p99"])
+        self.assertLessEqual(run_us["p99"], run_us["max"])
+        self.assertEqual(sum(count for _, count in run_us["buckets"]), 4)
+
+        text = module.get_metrics(as_json=False)
+        self.assertIn("runs 4\n", text)
+        self.assertIn('run_us{quantile="0.99"}', text)
+
+        module.reset_metrics()
+        metrics = module.get_metrics()
+        self.assertEqual(metrics["counters"]["runs"], 0)
+        self.assertEqual(metrics["histograms"]["run_us"]["count"], 0)
+        self.assertEqual(metrics["histograms"]["graph_capture_us"]["count"], 0)
+        # Graph cache counters are not reset.
+        self.assertEqual(metrics["counters"]["graph_cache_misses"], 1)
+        module.close()
+
+    def test_memory_usage(self):
+        target = detect_target()
+        input_0 = Tensor(shape=[64, 64], dtype="float16", name="x", is_input=True)
+        weight = Tensor(shape=[64, 64], dtype="float16", name="weight")
+        y = ops.elementwise(FuncEnum.ADD)(input_0, weight)
+        y._attrs["name"] = "y"
+        output = ops.reduce_sum(dim=1)(y)
+        output._attrs["name"] = "output"
+        output._attrs["is_output"] = True
+        module = compile_model(
+            output,
+            target,
+            "./tmp",
+            "test_memory_usage",
+            num_runtimes=2,
+            constants={"weight": torch.randn([64, 64]).cuda().half()},
+        )
+
+        usage = module.get_memory_usage()
+        self.assertGreaterEqual(usage.constants_bytes, 64 * 64 * 2)
+        self.assertEqual(usage.secondary_constants_bytes, 0)
+        self.assertEqual(usage.num_runtimes, 1)
+        self.assertEqual(usage.host_output_staging_device_bytes, 0)
+        self.assertEqual(
+            usage.total_device_bytes,
+            usage.constants_bytes
+            + usage.constant_folder_bytes
+            + usage.runtime_blob_bytes
+            + usage.runtime_workspace_bytes,
+        )
+
+        module.prewarm_runtimes()
+        runtimes = module.get_runtime_memory_usage()
+        self.assertEqual(len(runtimes), 2)
+        for runtime in runtimes:
+            self.assertFalse(runtime.busy)
+            self.assertEqual(runtime.memory_plan_idx, 0)
+            self.assertGreaterEqual(runtime.blob_bytes, 64 * 64 * 2)
+        usage = module.get_memory_usage()
+        self.assertEqual(usage.num_runtimes, 2)
+        self.assertEqual(
+            usage.runtime_blob_bytes, sum(runtime.blob_bytes for runtime in runtimes)
+        )
+
+        # y is live from the op that writes it through the one that reads it.
+        lifetimes = {
+            lifetime.name: lifetime for lifetime in module.get_tensor_lifetimes()
+        }
+        self.assertIn("y", lifetimes)
+        y_lifetime = lifetimes["y"]
+        self.assertEqual(y_lifetime.size_bytes, 64 * 64 * 2)
+        self.assertLess(y_lifetime.first_op_idx, y_lifetime.last_op_idx)
+        self.assertNotEqual(y_lifetime.first_op, y_lifetime.last_op)
+        self.assertLessEqual(
+            y_lifetime.offset + y_lifetime.size_bytes, runtimes[0].blob_bytes
+        )
+        module.close()
+
+    def test_run_with_outputs_on_host(self):
+        target = detect_target()
+        batch = IntVar([1, 8], name="batch")
+        input_0 = Tensor(shape=[batch, 4], dtype="float16", name="x", is_input=True)
+        output = ops.elementwise(FuncEnum.ADD)(input_0, input_0)
+        output._attrs["name"] = "output"
+        output._attrs["is_output"] = True
+        module = compile_model(
+            output, target, "./tmp", "test_run_with_outputs_on_host", num_runtimes=2
+        )
+
+        def run(rows):
+            x = torch.randn([rows, 4]).cuda().half()
+            out = torch.zeros([8, 4]).half()
+            outputs = module._run_with_tensors_outputs_on_host([x], [out])
+            self.assertEqual(list(outputs["output"].shape), [rows, 4])
+            self.assertTrue(torch.equal(outputs["output"], (x + x).cpu()))
+            # Rows beyond the actual output shape are left untouched.
+            self.assertTrue(torch.equal(out[rows:], torch.zeros([8 - rows, 4]).half()))
+
+        # The staging buffers are reused across calls with different shapes
+        # and across threads.
+        for rows in (8, 1, 5):
+            run(rows)
+        with concurrent.futures.ThreadPoolExecutor(4) as executor:
+            list(executor.map(run, [1, 2, 3, 4, 5, 6, 7, 8] * 4))
+        module.close()
+
     def test_ait_data_numpy_conversions(self):
         x = Tensor([1], dtype="float16", is_input=True, is_output=True)
         with compile_model(
@@ -1436,6 +1782,40 @@ class ModelAPITestCase(unittest.TestCase):
                 module.run_with_tensors([x_pt], [z_ait])
                 self.assertTrue(z_ait.equal(z_pt))
 
+    def test_caching_allocator(self):
+        x = Tensor([1], dtype="float16", is_input=True, name="x")
+        y = x * x
+        y._attrs["is_output"] = True
+        y._attrs["name"] = "y"
+        with compile_model(
+            y,
+            detect_target(),
+            "./tmp",
+            "test_caching_allocator",
+            allocator_kind=AITemplateAllocatorKind.CACHING,
+        ) as module:
+            stats = module.get_caching_allocator_stats()
+            self.assertGreater(stats.reserved_bytes, 0)
+            self.assertGreaterEqual(stats.allocated_bytes, stats.requested_bytes)
+
+            x_pt = torch.randn(1).half().cuda()
+            y_ait = torch.empty_like(x_pt)
+            # Benchmarking with several threads clones the outputs per thread;
+            # the second round reuses the blocks freed by the first.
+            for _ in range(2):
+                module.benchmark_with_tensors(
+                    [x_pt], [y_ait], count=2, num_threads=2
+                )
+            stats = module.get_caching_allocator_stats()
+            self.assertGreater(stats.num_cache_hits, 0)
+            self.assertGreater(stats.cached_bytes, 0)
+            self.assertTrue(y_ait.equal(x_pt * x_pt))
+
+            module.empty_allocator_cache()
+            stats = module.get_caching_allocator_stats()
+            self.assertEqual(stats.cached_bytes, 0)
+            self.assertEqual(stats.reserved_bytes, stats.allocated_bytes)
+
     def test_get_constant_names(self):
         target = detect_target()
 
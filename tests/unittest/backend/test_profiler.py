@@ -17,7 +17,12 @@ from random import randrange
 from time import sleep
 from unittest.mock import patch
 
-from aitemplate.backend.profiler_runner import ProfilerRunner
+from aitemplate.backend.profiler_runner import (
+    extract_profile_result,
+    ProfileResult,
+    ProfilerRunner,
+    ProfileStats,
+)
 
 
 def dice():
@@ -66,6 +71,36 @@ class ProfilerTestCase(unittest.TestCase):
 
             pr.join()
 
+    def test_extract_profile_result(self):
+        stdout = (
+            "OP:gemm_a,TIME:0.25,WS:0,P90:0.3,MEAN:0.26,CI:0.002,"
+            "ITERS:40,DISCARDED:0\n"
+            "OP:gemm_b,TIME:0.5,WS:16,P90:0.6,MEAN:0.52,CI:0.01,"
+            "ITERS:10,DISCARDED:1\n"
+        )
+        result, failed = extract_profile_result(stdout)
+        self.assertFalse(failed)
+        self.assertEqual(
+            result,
+            ProfileResult(
+                op_config="gemm_a",
+                duration=0.25,
+                workspace=0,
+                stats=ProfileStats(
+                    p90=0.3, mean=0.26, ci=0.002, iterations=40, discarded=False
+                ),
+            ),
+        )
+        results, _ = extract_profile_result(stdout, return_ops=["gemm_b"])
+        self.assertEqual(len(results), 1)
+        self.assertTrue(results[0].stats.discarded)
+
+        # Profilers without timing statistics.
+        result, failed = extract_profile_result("OP:gemm_a,TIME:0.25,WS:0\n")
+        self.assertFalse(failed)
+        self.assertEqual(result, ProfileResult("gemm_a", 0.25, 0))
+        self.assertIsNone(result.stats)
+
 
 if __name__ == "__main__":
     unittest.main()
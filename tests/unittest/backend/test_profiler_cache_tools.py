@@ -0,0 +1,225 @@
+#  Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+import functools
+import json
+import os
+import sqlite3
+import tempfile
+import threading
+import unittest
+from hashlib import sha1
+from http.server import SimpleHTTPRequestHandler, ThreadingHTTPServer
+from unittest.mock import patch
+
+from aitemplate.backend.profiler_cache import GEMM_STATS_COLUMNS, ProfileCacheDB
+from aitemplate.backend.profiler_cache_tools import (
+    export_profile_cache,
+    merge_profile_caches,
+    prune_profile_cache,
+)
+
+
+def _gemm_record(m, algo, duration):
+    exec_entry = f"M == {m} && N == 8 && K == 128"
+    return {
+        "exec_entry": exec_entry,
+        "exec_entry_sha1": sha1(exec_entry.encode()).hexdigest(),
+        "dtype_a": 1,
+        "dtype_b": 1,
+        "dtype_c": 1,
+        "dtype_acc": 2,
+        "major_a": 0,
+        "major_b": 1,
+        "major_c": 0,
+        "op_type": "gemm_rcr",
+        "device": "80",
+        "epilogue": 1,
+        "pshape": "",
+        "algo": algo,
+        "workspace": 0,
+        "split_k": 1,
+        "duration": duration,
+    }
+
+
+class _FileServerHandler(SimpleHTTPRequestHandler):
+    """A file server stand-in for a remote profile cache store."""
+
+    def do_PUT(self):
+        path = self.translate_path(self.path)
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        with open(path, "wb") as f:
+            f.write(self.rfile.read(int(self.headers["Content-Length"])))
+        self.send_response(201)
+        self.end_headers()
+
+    def log_message(self, *args):
+        pass
+
+
+class ProfilerCacheToolsTestCase(unittest.TestCase):
+    def _make_cache(self, path, records):
+        db = ProfileCacheDB("CUDA", path=path)
+        for record in records:
+            db.insert_gemm(record)
+        del db
+
+    def test_merge_keeps_fastest(self):
+        with tempfile.TemporaryDirectory() as tmp_dirname:
+            cache_a = os.path.join(tmp_dirname, "a.db")
+            cache_b = os.path.join(tmp_dirname, "b.db")
+            self._make_cache(
+                cache_a,
+                [_gemm_record(4, "algo_a", 2.0), _gemm_record(8, "algo_a", 1.0)],
+            )
+            self._make_cache(
+                cache_b,
+                [_gemm_record(4, "algo_b", 1.5), _gemm_record(8, "algo_b", 3.0)],
+            )
+            export_a = os.path.join(tmp_dirname, "a.json")
+            export_profile_cache(cache_a, export_a, source="host_a")
+            with open(export_a) as f:
+                exported = json.load(f)
+            self.assertEqual(len(exported["targets"]["CUDA"]["gemm"]["entries"]), 2)
+
+            merged = os.path.join(tmp_dirname, "merged.db")
+            stats = merge_profile_caches(merged, [export_a, cache_b])
+            self.assertEqual(
+                stats["CUDA"], {"added": 2, "replaced": 1, "kept": 1, "stale": 0}
+            )
+
+            db = ProfileCacheDB("CUDA", path=merged)
+            query = _gemm_record(4, None, None)
+            self.assertEqual(db.query_gemm(query), ("algo_b", 0, 1))
+            query = _gemm_record(8, None, None)
+            self.assertEqual(db.query_gemm(query), ("algo_a", 0, 1))
+            provenance = db.provenance_entries()
+            self.assertEqual(
+                [(p["source"], p["algo"], p["replaced_algo"]) for p in provenance],
+                [
+                    ("host_a", "algo_a", None),
+                    ("host_a", "algo_a", None),
+                    (cache_b, "algo_b", "algo_a"),
+                ],
+            )
+
+    def test_timing_stats(self):
+        with tempfile.TemporaryDirectory() as tmp_dirname:
+            cache = os.path.join(tmp_dirname, "cache.db")
+            db = ProfileCacheDB("CUDA", path=cache)
+            db.insert_gemm(_gemm_record(4, "algo_a", 1.0))
+            table_name = f"CUDA_gemm_{db.gemm_cache_version}"
+            del db
+            # A cache created before the timing statistics columns.
+            con = sqlite3.connect(cache)
+            for column in GEMM_STATS_COLUMNS:
+                con.execute(f"ALTER TABLE {table_name} DROP COLUMN {column};")
+            con.commit()
+            con.close()
+
+            record = _gemm_record(8, "algo_b", 1.0)
+            record.update(
+                duration_p90=1.2, duration_mean=1.1, duration_ci=0.01, iterations=40
+            )
+            self._make_cache(cache, [record])
+            export = os.path.join(tmp_dirname, "cache.json")
+            export_profile_cache(cache, export)
+            with open(export) as f:
+                entries = json.load(f)["targets"]["CUDA"]["gemm"]["entries"]
+            stats = {
+                entry["algo"]: (entry["duration_p90"], entry["iterations"])
+                for entry in entries
+            }
+            self.assertEqual(stats, {"algo_a": (-1, 0), "algo_b": (1.2, 40)})
+
+    def test_merge_skips_stale_versions(self):
+        with tempfile.TemporaryDirectory() as tmp_dirname:
+            cache = os.path.join(tmp_dirname, "old.db")
+            with patch.object(
+                target=ProfileCacheDB,
+                attribute="gemm_cache_version",
+                new=1,  # version
+            ):
+                self._make_cache(cache, [_gemm_record(4, "algo_a", 1.0)])
+            stats = merge_profile_caches(os.path.join(tmp_dirname, "new.db"), [cache])
+            self.assertEqual(stats["CUDA"]["stale"], 1)
+            self.assertEqual(stats["CUDA"]["added"], 0)
+
+    def test_prune_stale_tables(self):
+        with tempfile.TemporaryDirectory() as tmp_dirname:
+            cache = os.path.join(tmp_dirname, "cache.db")
+            with patch.object(
+                target=ProfileCacheDB,
+                attribute="gemm_cache_version",
+                new=1,  # version
+            ):
+                self._make_cache(cache, [_gemm_record(4, "algo_a", 1.0)])
+            self._make_cache(cache, [_gemm_record(4, "algo_b", 1.0)])
+            self.assertEqual(
+                sorted(prune_profile_cache(cache)),
+                ["CUDA_gemm_1", "CUDA_gemm_approx_1"],
+            )
+            self.assertEqual(prune_profile_cache(cache), [])
+            db = ProfileCacheDB("CUDA", path=cache)
+            query = _gemm_record(4, None, None)
+            self.assertEqual(db.query_gemm(query), ("algo_b", 0, 1))
+
+    def _test_remote(self, uri):
+        record = _gemm_record(4, "algo_a", 1.0)
+        db = ProfileCacheDB("CUDA", uri=uri)
+        self.assertIsNone(db.query_gemm(record))
+        db.insert_gemm(record)
+        db.sync_remote()
+
+        other_db = ProfileCacheDB("CUDA", uri=uri)
+        self.assertEqual(other_db.query_gemm(record), ("algo_a", 0, 1))
+        # Entries of both machines are kept.
+        other_record = _gemm_record(8, "algo_b", 1.0)
+        other_db.insert_gemm(other_record)
+        other_db.sync_remote()
+        db.sync_remote()
+        self.assertEqual(db.query_gemm(other_record), ("algo_b", 0, 1))
+
+    def test_remote_push_on_close(self):
+        with tempfile.TemporaryDirectory() as tmp_dirname:
+            uri = f"file://{tmp_dirname}/remote"
+            record = _gemm_record(4, "algo_a", 1.0)
+            db = ProfileCacheDB("CUDA", uri=uri)
+            db.insert_gemm(record)
+            db.close()
+            db.close()
+            other_db = ProfileCacheDB("CUDA", uri=uri)
+            self.assertEqual(other_db.query_gemm(record), ("algo_a", 0, 1))
+            other_db.close()
+
+    def test_remote_file_store(self):
+        with tempfile.TemporaryDirectory() as tmp_dirname:
+            self._test_remote(f"file://{tmp_dirname}/remote")
+
+    def test_remote_http_store(self):
+        with tempfile.TemporaryDirectory() as tmp_dirname:
+            handler = functools.partial(_FileServerHandler, directory=tmp_dirname)
+            server = ThreadingHTTPServer(("127.0.0.1", 0), handler)
+            thread = threading.Thread(target=server.serve_forever, daemon=True)
+            thread.start()
+            try:
+                self._test_remote(f"http://127.0.0.1:{server.server_port}/remote")
+            finally:
+                server.shutdown()
+                server.server_close()
+
+
+if __name__ == "__main__":
+    unittest.main()
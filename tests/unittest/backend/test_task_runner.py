@@ -0,0 +1,106 @@
+#  Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+import json
+import os
+import sys
+import tempfile
+import time
+import unittest
+from unittest.mock import patch
+
+from aitemplate.backend.task_runner import BaseRunner, Task, TaskTimeStats
+
+
+class _Runner(BaseRunner):
+    def __init__(self, devs, timeout=10):
+        super().__init__(devs, "test", timeout)
+        # Don't read or update the timings of earlier runs.
+        self._stats = TaskTimeStats(None)
+
+    def push(self, idx, cmd):
+        self._queue.append(Task(idx, cmd, self._tag, shell=True, key=str(idx)))
+
+
+def _sleep_cmd(seconds):
+    return f"sleep {seconds}"
+
+
+class TaskRunnerTestCase(unittest.TestCase):
+    def test_large_output(self):
+        runner = _Runner([0])
+        runner.push(0, f"{sys.executable} -c \"print('x' * 1000000)\"")
+        runner.join()
+        task = runner._queue[0]
+        self.assertFalse(task.is_timeout())
+        task.pull(lambda _: None)
+        self.assertEqual(len(task._stdout), 1000001)
+
+    def test_longest_expected_first(self):
+        runner = _Runner([0])
+        for idx, expected_ms in enumerate([10, 30, 20]):
+            runner._stats.record(str(idx), expected_ms)
+            runner.push(idx, _sleep_cmd(0))
+        runner.join()
+        order = sorted(runner._queue, key=lambda task: task._timestamp)
+        self.assertEqual([task._idx for task in order], [1, 2, 0])
+
+    def test_work_stealing(self):
+        runner = _Runner([0, 1])
+        # The first task takes much longer than expected, the idle device
+        # steals the task queued behind it.
+        for idx, seconds in enumerate([1, 0.1, 0.1, 0.1]):
+            runner._stats.record(str(idx), 100)
+            runner.push(idx, _sleep_cmd(seconds))
+        start = time.time()
+        runner.join()
+        self.assertLess(time.time() - start, 1.5)
+        devs = {task._idx: task.assigned_dev() for task in runner._queue}
+        self.assertEqual(devs[0], 0)
+        self.assertEqual({devs[1], devs[2], devs[3]}, {1})
+        self.assertGreaterEqual(runner._devs._num_steals, 1)
+        for idx in range(4):
+            self.assertIsNotNone(runner._stats.expected_ms(str(idx)))
+
+    def test_timeout(self):
+        runner = _Runner([0], timeout=0.5)
+        runner.push(0, _sleep_cmd(10))
+        start = time.time()
+        runner.join()
+        self.assertLess(time.time() - start, 5)
+        self.assertTrue(runner._queue[0].is_timeout())
+
+    def test_deadline(self):
+        runner = _Runner([0])
+        for idx in range(3):
+            runner.push(idx, _sleep_cmd(0.5))
+        cancelled = runner.join(deadline=time.time() + 0.2)
+        self.assertEqual(len(cancelled), 2)
+
+    def test_export_timings(self):
+        with tempfile.TemporaryDirectory() as tmp_dirname:
+            with patch.dict(os.environ, {"AIT_TASK_TIMINGS_DIR": tmp_dirname}):
+                runner = _Runner([0, 1])
+                for idx in range(3):
+                    runner.push(idx, _sleep_cmd(0))
+                runner.join()
+            (trace_file,) = os.listdir(tmp_dirname)
+            with open(os.path.join(tmp_dirname, trace_file)) as f:
+                events = json.load(f)["traceEvents"]
+            self.assertEqual(sorted(event["name"] for event in events), ["0", "1", "2"])
+            self.assertTrue(all(event["dur"] >= 0 for event in events))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,106 @@
+#  Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+import os
+import tempfile
+import unittest
+
+from aitemplate.backend.unity_build import (
+    COMPILE_TIMES_FILE,
+    CompileTimeStats,
+    include_block,
+    UNITY_FAILURES_FILE,
+    UnityBuild,
+)
+
+
+class UnityBuildTestCase(unittest.TestCase):
+    def _write_sources(self, build_dir, names, includes):
+        pairs = []
+        for name in names:
+            src = os.path.join(build_dir, name + ".cu")
+            with open(src, "w") as f:
+                f.write("".join(f"#include {inc}\n" for inc in includes))
+                f.write(f"void {name}() {{}}\n")
+            pairs.append((src, os.path.join(build_dir, name + ".obj")))
+        return pairs
+
+    def test_include_block(self):
+        with tempfile.TemporaryDirectory() as build_dir:
+            src = os.path.join(build_dir, "a.cu")
+            with open(src, "w") as f:
+                f.write("// comment\n#include <vector>\n\n")
+                f.write('#include "cutlass/cutlass.h"\n')
+                f.write('using bfloat16 = nv_bfloat16;\n#include "late.h"\n')
+            self.assertEqual(include_block(src), ("<vector>", '"cutlass/cutlass.h"'))
+
+    def test_plan_groups_by_include_set(self):
+        with tempfile.TemporaryDirectory() as build_dir:
+            gemms = self._write_sources(
+                build_dir, ["gemm_0", "gemm_1", "gemm_2"], ['"cutlass/cutlass.h"']
+            )
+            convs = self._write_sources(
+                build_dir, ["conv_0", "conv_1"], ['"cutlass/conv.h"']
+            )
+            others = self._write_sources(build_dir, ["model_container"], ["<vector>"])
+            unity_build = UnityBuild(build_dir, CompileTimeStats(None))
+            planned = unity_build.plan(gemms + convs + others, num_jobs=2)
+
+            self.assertIn(others[0], planned)
+            unity_srcs = [src for src, _ in planned if "unity_" in src]
+            self.assertEqual(len(unity_srcs), 2)
+            members = []
+            for src in unity_srcs:
+                with open(src) as f:
+                    lines = f.read().splitlines()
+                self.assertTrue(lines[0].startswith('#include "unity_prefix_'))
+                members.append(sorted(lines[1:]))
+            self.assertIn(['#include "conv_0.cu"', '#include "conv_1.cu"'], members)
+            rules = unity_build.gen_makefile_rules("cc -c {src} -o {target}")
+            self.assertIn("ld -r -o $@", rules)
+
+    def test_stats_feed_back(self):
+        with tempfile.TemporaryDirectory() as build_dir:
+            stats_path = os.path.join(build_dir, "stats", "compile_times.json")
+            pairs = self._write_sources(
+                build_dir, ["gemm_0", "gemm_1"], ['"cutlass/cutlass.h"']
+            )
+            unity_build = UnityBuild(build_dir, CompileTimeStats(stats_path))
+            planned = unity_build.plan(pairs, num_jobs=1)
+            (unity_src, unity_obj) = planned[0]
+            obj = os.path.basename(unity_obj)
+            # The unity TU failed, the members were compiled separately.
+            with open(os.path.join(build_dir, COMPILE_TIMES_FILE), "w") as f:
+                f.write("gemm_0.obj 100\ngemm_1.obj 300\n")
+            with open(os.path.join(build_dir, UNITY_FAILURES_FILE), "w") as f:
+                f.write(f"{obj}\n")
+            unity_build.update_stats(planned)
+
+            # Next build: the sources are no longer grouped.
+            unity_build = UnityBuild(build_dir, CompileTimeStats(stats_path))
+            self.assertEqual(sorted(unity_build.plan(pairs, num_jobs=1)), sorted(pairs))
+
+    def test_stats_save_failure_is_logged(self):
+        with tempfile.TemporaryDirectory() as build_dir:
+            # The stats directory can't be created under a regular file.
+            not_a_dir = os.path.join(build_dir, "file")
+            open(not_a_dir, "w").close()
+            stats = CompileTimeStats(os.path.join(not_a_dir, "compile_times.json"))
+            stats.record("key", ms=100)
+            with self.assertLogs("aitemplate.backend.timing_stats", "WARNING"):
+                stats.save()
+
+
+if __name__ == "__main__":
+    unittest.main()
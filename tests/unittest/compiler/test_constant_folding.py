@@ -13,6 +13,7 @@
 #  limitations under the License.
 #
 import itertools
+import os
 import unittest
 
 import torch
@@ -664,6 +665,108 @@ class ConstantFoldingTestCase(unittest.TestCase):
         output_pt = _get_output(new_bound_constants, new_unbound_constants)
         self.assertTrue(torch.equal(output_pt, output_ait))
 
+    def test_constant_folding_delta_update(self):
+        input_0 = Tensor(shape=[1, 2], dtype="float16", name="input_0", is_input=True)
+        constants = {
+            f"constant_{i}": get_random_torch_tensor((1, 2), "float16")
+            for i in range(4)
+        }
+        tensors = {
+            name: Tensor(shape=[1, 2], dtype="float16", name=name)
+            for name in constants
+        }
+        # constant_0/1 are used by the model directly, constant_2/3 are folded.
+        x = ops.elementwise(FuncEnum.MUL)(input_0, tensors["constant_0"])
+        x1 = ops.elementwise(FuncEnum.ADD)(x, tensors["constant_1"])
+        y = ops.elementwise(FuncEnum.MUL)(tensors["constant_2"], tensors["constant_3"])
+        output = ops.elementwise(FuncEnum.MUL)(x1, y)
+        output._attrs["name"] = "output"
+        output._attrs["is_output"] = True
+        mod = compile_model(
+            output,
+            detect_target(),
+            "./tmp",
+            "test_constant_folding_delta_update",
+            constants=constants,
+        )
+
+        inp0_pt = get_random_torch_tensor((1, 2), "float16")
+        output_ait = torch.empty_like(inp0_pt)
+
+        def _check():
+            c = constants
+            output_pt = (inp0_pt * c["constant_0"] + c["constant_1"]) * (
+                c["constant_2"] * c["constant_3"]
+            )
+            mod.run_with_tensors({"input_0": inp0_pt}, {"output": output_ait})
+            self.assertTrue(torch.equal(output_pt, output_ait))
+
+        _check()
+        self.assertEqual(mod.get_constants_version(), 0)
+        # Each update only touches some constants: the others must be carried
+        # over, both between buffers and across several swaps.
+        for version, names in enumerate(
+            [["constant_0"], ["constant_2"], ["constant_1"], [], ["constant_3"]],
+            start=1,
+        ):
+            delta = {
+                name: get_random_torch_tensor((1, 2), "float16") for name in names
+            }
+            mod.update_constants_delta_with_tensors(delta)
+            # The active constants are untouched until the swap.
+            _check()
+            constants.update(delta)
+            self.assertEqual(mod.finish_constants_delta_update(), version)
+            _check()
+
+        # Errors are reported right away.
+        with self.assertRaises(RuntimeError):
+            mod.update_constants_delta_with_tensors(
+                {"constant_0": get_random_torch_tensor((2, 2), "float16")}
+            )
+
+    def test_constant_folding_save_and_load(self):
+        input_0 = Tensor(shape=[1, 2], dtype="float16", name="input_0", is_input=True)
+        constant_0 = Tensor(shape=[1, 2], dtype="float16", name="constant_0")
+        constant_1 = Tensor(shape=[1, 2], dtype="float16", name="constant_1")
+        x = ops.elementwise(FuncEnum.MUL)(constant_0, constant_1)
+        output = ops.elementwise(FuncEnum.ADD)(input_0, x)
+        output._attrs["name"] = "output"
+        output._attrs["is_output"] = True
+        constant_0_pt = get_random_torch_tensor((1, 2), "float16")
+        constant_1_pt = get_random_torch_tensor((1, 2), "float16")
+        test_name = "test_constant_folding_save_and_load"
+        # constant_0 is bound, constant_1 is set at runtime.
+        mod = compile_model(
+            output,
+            detect_target(),
+            "./tmp",
+            test_name,
+            constants={"constant_0": constant_0_pt},
+        )
+        inp0_pt = get_random_torch_tensor((1, 2), "float16")
+        output_pt = inp0_pt + constant_0_pt * constant_1_pt
+        output_ait = torch.empty_like(inp0_pt)
+
+        path = os.path.join("./tmp", test_name, "folded_constants.bin")
+        mod.set_constant_with_tensor("constant_1", constant_1_pt)
+        mod.save_folded_constants(path, inputs_key=1)
+        mod.run_with_tensors({"input_0": inp0_pt}, {"output": output_ait})
+        self.assertTrue(torch.equal(output_pt, output_ait))
+
+        with Model(os.path.join("./tmp", test_name, "test.so")) as new_mod:
+            self.assertFalse(new_mod.load_folded_constants(path + ".missing"))
+            # constant_1 was set when saving.
+            self.assertFalse(new_mod.load_folded_constants(path, inputs_key=1))
+            # Setting it again is cheap, folding is what gets skipped.
+            new_mod.set_constant_with_tensor("constant_1", constant_1_pt)
+            self.assertFalse(new_mod.load_folded_constants(path, inputs_key=2))
+            self.assertTrue(new_mod.load_folded_constants(path, inputs_key=1))
+            output_ait.zero_()
+            new_mod.run_with_tensors({"input_0": inp0_pt}, {"output": output_ait})
+            self.assertTrue(torch.equal(output_pt, output_ait))
+
+
 
 if __name__ == "__main__":
     torch.manual_seed(0)
@@ -12,6 +12,7 @@
 #  See the License for the specific language governing permissions and
 #  limitations under the License.
 #
+import bisect
 import random
 import unittest
 
@@ -20,7 +21,12 @@ from aitemplate import compiler
 
 from aitemplate.compiler import compile_model, ops
 from aitemplate.compiler.base import Operator
-from aitemplate.frontend import IntImm, nn, Tensor
+from aitemplate.frontend import IntImm, IntVar, nn, Tensor
+from aitemplate.compiler.transform.memory_planning import (
+    _assign_offsets_greedy_by_size,
+    compare_memory_planning,
+    TensorUsageRecord,
+)
 from aitemplate.testing import detect_target
 from aitemplate.testing.test_utils import (
     get_random_torch_tensor,
@@ -128,6 +134,176 @@ class MemoryPlanningTestCase(unittest.TestCase):
         self.assertEqual(workspace.shared_size, shared_workspace_expected_size)
         self.assertEqual(workspace.unique_size, unique_workspace_expected_size)
 
+    def test_bucketed_memory_planning(self):
+        target = detect_target()
+        batch_size = IntVar(values=[1, 256], name="batch_size")
+        hidden = 128
+        X = Tensor(
+            shape=[batch_size, hidden],
+            dtype="float16",
+            name="input_0",
+            is_input=True,
+        )
+        T0 = ops.elementwise(ops.common.FuncEnum.TANH)(X)
+        T1 = ops.elementwise(ops.common.FuncEnum.ADD)(T0, X)
+        T2 = ops.elementwise(ops.common.FuncEnum.MUL)(T1, T0)
+        OUT = ops.elementwise(ops.common.FuncEnum.SIGMOID)(T2)
+        OUT._attrs["name"] = "output_0"
+        OUT._attrs["is_output"] = True
+
+        with target:
+            graph = compiler.transform.toposort(OUT)
+            compiler.transform.name_graph(graph)
+            compiler.transform.mark_param_tensor(graph)
+            max_blob, _, _ = compiler.transform.memory_planning(graph)
+            plans = compiler.transform.bucketed_memory_planning(
+                graph, [{"batch_size": 64}, {"batch_size": 8}, {"batch_size": 256}]
+            )
+        # The bucket at the upper bound doesn't save anything and is dropped.
+        self.assertEqual(len(plans), 3)
+        self.assertEqual(plans[0].dim_bounds, {"batch_size": 8})
+        self.assertEqual(plans[1].dim_bounds, {"batch_size": 64})
+        self.assertEqual(plans[2].dim_bounds, {})
+        self.assertEqual(plans[2].blob_size, max_blob)
+        self.assertLess(plans[0].blob_size, plans[1].blob_size)
+        self.assertLess(plans[1].blob_size, plans[2].blob_size)
+        self.assertEqual(plans[0].blob_size * 8, plans[1].blob_size)
+
+        with self.assertRaises(ValueError):
+            compiler.transform.bucketed_memory_planning(graph, [{"seq_len": 8}])
+        with self.assertRaises(ValueError):
+            compiler.transform.bucketed_memory_planning(
+                graph, [{"batch_size": 512}]
+            )
+
+        X = Tensor(
+            shape=[batch_size, hidden],
+            dtype="float16",
+            name="input_0",
+            is_input=True,
+        )
+        T0 = ops.elementwise(ops.common.FuncEnum.TANH)(X)
+        T1 = ops.elementwise(ops.common.FuncEnum.ADD)(T0, X)
+        T2 = ops.elementwise(ops.common.FuncEnum.MUL)(T1, T0)
+        OUT = ops.elementwise(ops.common.FuncEnum.SIGMOID)(T2)
+        OUT._attrs["name"] = "output_0"
+        OUT._attrs["is_output"] = True
+        module = compile_model(
+            OUT,
+            target,
+            "./tmp",
+            "bucketed_memory_planning",
+            memory_plan_buckets=[{"batch_size": 8}, {"batch_size": 64}],
+        )
+        # Switch between plans in both directions, growing the blob as needed.
+        for b in (4, 64, 256, 8, 1):
+            x_pt = get_random_torch_tensor([b, hidden], "float16")
+            t0_pt = torch.tanh(x_pt)
+            out_pt = torch.sigmoid((t0_pt + x_pt) * t0_pt)
+            out = get_torch_empty_tensor([b, hidden], "float16")
+            module.run_with_tensors([x_pt], [out])
+            self.assertTrue(torch.allclose(out_pt, out, atol=1e-2, rtol=1e-2))
+
+    def test_greedy_by_size_lifetime_tree(self):
+        def assign_offsets_quadratic(records):
+            # The original O(n^2) greedy-by-size placement.
+            max_blob = 0
+            offsets = {}
+            assigned = []
+            for tensor, first_op_idx, last_op_idx, size in sorted(
+                records, key=lambda r: r.size, reverse=True
+            ):
+                prev_offset = 0
+                best_offset = None
+                smallest_gap = pow(2, 63) - 1
+                for a_offset, a_first_op_idx, a_last_op_idx, a_size in assigned:
+                    if max(first_op_idx, a_first_op_idx) <= min(
+                        last_op_idx, a_last_op_idx
+                    ):
+                        gap = a_offset - prev_offset
+                        if size <= gap < smallest_gap:
+                            smallest_gap = gap
+                            best_offset = prev_offset
+                        prev_offset = max(prev_offset, a_offset + a_size)
+                if best_offset is None:
+                    best_offset = prev_offset
+                offsets[tensor._attrs["name"]] = best_offset
+                max_blob = max(max_blob, best_offset + size)
+                bisect.insort_right(
+                    assigned, (best_offset, first_op_idx, last_op_idx, size)
+                )
+            return max_blob, offsets
+
+        rnd = random.Random(0)
+        for _ in range(20):
+            records = []
+            for idx in range(300):
+                first_op_idx = rnd.randrange(200)
+                last_op_idx = min(199, first_op_idx + rnd.randrange(30))
+                records.append(
+                    TensorUsageRecord(
+                        tensor=Tensor(shape=[1], name=f"t{idx}"),
+                        first_op_idx=first_op_idx,
+                        last_op_idx=last_op_idx,
+                        size=64 * rnd.randint(1, 64),
+                    )
+                )
+            self.assertEqual(
+                _assign_offsets_greedy_by_size(records),
+                assign_offsets_quadratic(records),
+            )
+
+    def test_in_place_memory_planning(self):
+        target = detect_target()
+        batch_size = IntVar(values=[1, 256], name="batch_size")
+        hidden = 128
+
+        def build_graph():
+            X = Tensor(
+                shape=[batch_size, hidden],
+                dtype="float16",
+                name="input_0",
+                is_input=True,
+            )
+            T0 = ops.softmax()(X, -1)
+            T1 = ops.softmax()(T0, -1)
+            # T1 dies here, so the sum can be written in place.
+            T2 = ops.elementwise(ops.common.FuncEnum.ADD)(T0, T1)
+            OUT = ops.softmax()(T2, -1)
+            OUT._attrs["name"] = "output_0"
+            OUT._attrs["is_output"] = True
+            return T1, T2, OUT
+
+        T1, T2, OUT = build_graph()
+        with target:
+            graph = compiler.transform.toposort(OUT)
+            compiler.transform.name_graph(graph)
+            compiler.transform.mark_param_tensor(graph)
+            graph = compiler.transform.optimize_graph(graph, "./tmp")
+            blob_sizes = compare_memory_planning(graph)
+            max_blob, _, _ = compiler.transform.memory_planning(graph)
+        tensor_size = 256 * hidden * 2
+        self.assertEqual(
+            blob_sizes,
+            {
+                "naive": 5 * tensor_size,
+                "greedy_by_size": 3 * tensor_size,
+                "greedy_by_size_in_place": 2 * tensor_size,
+            },
+        )
+        self.assertEqual(max_blob, 2 * tensor_size)
+        self.assertEqual(T2._attrs["offset"], T1._attrs["offset"])
+
+        _, _, OUT = build_graph()
+        module = compile_model(OUT, target, "./tmp", "in_place_memory_planning")
+        for b in (1, 37, 256):
+            x_pt = get_random_torch_tensor([b, hidden], "float16")
+            t0_pt = torch.softmax(x_pt, -1)
+            out_pt = torch.softmax(t0_pt + torch.softmax(t0_pt, -1), -1)
+            out = get_torch_empty_tensor([b, hidden], "float16")
+            module.run_with_tensors([x_pt], [out])
+            self.assertTrue(torch.allclose(out_pt, out, atol=1e-2, rtol=1e-2))
+
 
 if __name__ == "__main__":
     unittest.main()
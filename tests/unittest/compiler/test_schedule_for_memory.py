@@ -0,0 +1,91 @@
+#  Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+import os
+import unittest
+from unittest.mock import patch
+
+import torch
+from aitemplate import compiler
+
+from aitemplate.compiler import compile_model, ops
+from aitemplate.frontend import IntVar, Tensor
+from aitemplate.testing import detect_target
+from aitemplate.testing.test_utils import (
+    get_random_torch_tensor,
+    get_torch_empty_tensor,
+)
+
+
+class ScheduleForMemoryTestCase(unittest.TestCase):
+    def _build_graph(self, num_branches):
+        batch_size = IntVar(values=[1, 256], name="batch_size")
+        X = Tensor(
+            shape=[batch_size, 128], dtype="float16", name="input_0", is_input=True
+        )
+        # The toposort runs the large concats first, so that all of them are
+        # live at the same time.
+        sums = []
+        for _ in range(num_branches):
+            T = ops.concatenate()([X, X, X, X], dim=1)
+            sums.append(ops.reduce_sum(1)(T))
+        OUT = sums[0]
+        for T in sums[1:]:
+            OUT = ops.elementwise(ops.common.FuncEnum.ADD)(OUT, T)
+        OUT._attrs["name"] = "output_0"
+        OUT._attrs["is_output"] = True
+        return OUT
+
+    def test_schedule_for_memory(self):
+        OUT = self._build_graph(num_branches=3)
+        graph = compiler.transform.toposort(OUT)
+        compiler.transform.name_graph(graph)
+        compiler.transform.mark_param_tensor(graph)
+
+        new_graph = compiler.transform.schedule_for_memory(graph, time_budget=1)
+        self.assertCountEqual(new_graph, graph)
+        self.assertEqual(new_graph[0]._attrs["name"], "input_0")
+        positions = {tensor: idx for idx, tensor in enumerate(new_graph)}
+        for tensor in new_graph:
+            for op in tensor.src_ops():
+                for input_tensor in op._attrs["inputs"]:
+                    self.assertLess(positions[input_tensor], positions[tensor])
+
+        max_blob, _, _ = compiler.transform.memory_planning(graph)
+        new_max_blob, _, _ = compiler.transform.memory_planning(new_graph)
+        concat_size = 256 * 512 * 2
+        self.assertGreaterEqual(max_blob, 3 * concat_size)
+        self.assertLess(new_max_blob, 2 * concat_size)
+
+        # A graph that can't be improved is kept as is.
+        graph = compiler.transform.toposort(self._build_graph(num_branches=1))
+        compiler.transform.name_graph(graph)
+        compiler.transform.mark_param_tensor(graph)
+        self.assertIs(compiler.transform.schedule_for_memory(graph, 1), graph)
+
+    def test_schedule_for_memory_compile(self):
+        target = detect_target()
+        OUT = self._build_graph(num_branches=3)
+        with patch.dict(os.environ, {"AIT_MEMORY_SCHEDULE_TIME_BUDGET": "1"}):
+            module = compile_model(OUT, target, "./tmp", "schedule_for_memory")
+        for b in (1, 64, 256):
+            x_pt = get_random_torch_tensor([b, 128], "float16")
+            out_pt = torch.sum(torch.cat([x_pt] * 4, dim=1), dim=1) * 3
+            out = get_torch_empty_tensor([b], "float16")
+            module.run_with_tensors([x_pt], [out])
+            self.assertTrue(torch.allclose(out_pt, out, atol=1e-1, rtol=1e-2))
+
+
+if __name__ == "__main__":
+    unittest.main()
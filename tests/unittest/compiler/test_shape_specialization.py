@@ -0,0 +1,121 @@
+#  Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+import glob
+import os
+import unittest
+
+import torch
+from aitemplate import compiler
+
+from aitemplate.compiler import compile_model, ops
+from aitemplate.compiler.base import IntImm
+from aitemplate.frontend import IntVar, Tensor
+from aitemplate.testing import detect_target
+from aitemplate.testing.test_utils import (
+    get_random_torch_tensor,
+    get_torch_empty_tensor,
+)
+
+
+class ShapeSpecializationTestCase(unittest.TestCase):
+    def _build_graph(self, batch_size):
+        X = Tensor(shape=[batch_size, 64], name="input_0", is_input=True)
+        W = Tensor(shape=[32, 64], name="input_1", is_input=True)
+        T0 = ops.gemm_rcr()(X, W)  # [b, 32]
+        T1 = ops.elementwise(ops.common.FuncEnum.TANH)(T0)
+        OUT = ops.reshape()(T1, [-1])  # [b * 32]
+        OUT._attrs["name"] = "output_0"
+        OUT._attrs["is_output"] = True
+        return OUT
+
+    def test_specialize_shapes(self):
+        batch_size = IntVar(values=[1, 128], name="batch_size")
+        X = Tensor(shape=[batch_size, 64], name="input_0", is_input=True)
+        T0 = ops.elementwise(ops.common.FuncEnum.TANH)(X)
+        OUT = ops.reshape()(T0, [-1])
+        OUT._attrs["name"] = "output_0"
+        OUT._attrs["is_output"] = True
+        graph = compiler.transform.toposort(OUT)
+        compiler.transform.name_graph(graph)
+        compiler.transform.mark_param_tensor(graph)
+
+        specializations = compiler.transform.specialize_shapes(
+            graph, {"batch_size": [8, 1, 8]}
+        )
+        self.assertEqual(
+            [spec.dim_values for spec in specializations],
+            [{"batch_size": 1}, {"batch_size": 8}],
+        )
+        for spec in specializations:
+            value = spec.dim_values["batch_size"]
+            self.assertEqual(spec.suffix, f"spec_batch_size_{value}")
+            (out_dim,) = spec.sorted_graph[-1]._attrs["shape"]
+            self.assertEqual(spec.derived_dims, {out_dim._attrs["name"]: value * 64})
+            for tensor in spec.sorted_graph:
+                for dim in tensor._attrs["shape"]:
+                    self.assertIsInstance(dim, IntImm)
+            # The copies keep the names of the graph's tensors.
+            self.assertEqual(
+                [tensor._attrs["name"] for tensor in spec.sorted_graph],
+                [tensor._attrs["name"] for tensor in graph],
+            )
+        # The graph itself is unchanged.
+        self.assertIs(graph[0]._attrs["shape"][0], batch_size)
+        self.assertEqual(len(graph[0].dst_ops()), 1)
+
+        with self.assertRaises(ValueError):
+            compiler.transform.specialize_shapes(graph, {"seq_len": [1]})
+        with self.assertRaises(ValueError):
+            compiler.transform.specialize_shapes(graph, {"batch_size": [256]})
+
+    def test_shape_specialization(self):
+        target = detect_target()
+        batch_size = IntVar(values=[1, 64], name="batch_size")
+        OUT = self._build_graph(batch_size)
+        module = compile_model(
+            OUT,
+            target,
+            "./tmp",
+            "shape_specialization",
+            shape_specializations={"batch_size": [1, 8]},
+        )
+
+        # RunImpl dispatches to a static-shape variant per specialization,
+        # which calls its own gemm.
+        workdir = os.path.join("./tmp", "shape_specialization")
+        with open(os.path.join(workdir, "model-generated.h")) as f:
+            model_src = f.read()
+        for value in [1, 8]:
+            suffix = f"spec_batch_size_{value}"
+            self.assertIn(f"RunImpl_{suffix}(stream);", model_src)
+            self.assertIn(f"void RunImpl_{suffix}(StreamType stream)", model_src)
+            gemm_srcs = glob.glob(
+                os.path.join(workdir, f"gemm_rcr*_{suffix}*{target.src_extension()}")
+            )
+            self.assertEqual(len(gemm_srcs), 1, gemm_srcs)
+            gemm_name = os.path.splitext(os.path.basename(gemm_srcs[0]))[0]
+            self.assertIn(f"{gemm_name}(", model_src)
+
+        for b in [1, 5, 8, 64]:
+            x = get_random_torch_tensor([b, 64], "float16")
+            w = get_random_torch_tensor([32, 64], "float16")
+            y_pt = torch.tanh(torch.nn.functional.linear(x, w)).reshape(-1)
+            y = get_torch_empty_tensor([b * 32], "float16")
+            module.run_with_tensors({"input_0": x, "input_1": w}, [y])
+            self.assertTrue(torch.allclose(y, y_pt, atol=1e-2, rtol=1e-2))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -13,8 +13,10 @@
 #  limitations under the License.
 #
 import logging
+import os
 import tempfile
 import unittest
+from hashlib import sha1
 from unittest.mock import patch
 
 from aitemplate.backend.profiler_cache import ProfileCacheDB
@@ -219,5 +221,98 @@ class GemmProfilerCacheTestCase(unittest.TestCase):
                     )
 
 
+    def test_gemm_profiler_cache_nearest_db(self):
+        args = {
+            "dtype_a": 1,
+            "dtype_b": 1,
+            "dtype_c": 1,
+            "dtype_acc": 2,
+            "major_a": 0,
+            "major_b": 1,
+            "major_c": 0,
+            "op_type": "gemm_rcr",
+            "device": "80",
+            "epilogue": 1,
+            "pshape": "",
+        }
+
+        def exec_entry(m):
+            entry = f"M == {m} && N == 8 && K == 128"
+            return entry, sha1(entry.encode()).hexdigest()
+
+        with tempfile.TemporaryDirectory() as tmp_dirname:
+            db = ProfileCacheDB("CUDA", path=os.path.join(tmp_dirname, "cache.db"))
+            for m, algo in ((4, "algo_a"), (6, "algo_a"), (16, "algo_b")):
+                entry, entry_sha1 = exec_entry(m)
+                db.insert_gemm(
+                    {
+                        **args,
+                        "exec_entry": entry,
+                        "exec_entry_sha1": entry_sha1,
+                        "algo": algo,
+                        "workspace": m,
+                        "split_k": 1,
+                    }
+                )
+
+            entry, entry_sha1 = exec_entry(5)
+            query = {**args, "exec_entry_sha1": entry_sha1}
+            self.assertIsNone(db.query_gemm(query))
+            self.assertIsNone(db.query_gemm_nearest(query, entry, 0.1))
+            # M=4 and M=6 are within 2x of M=5 and agree.
+            self.assertEqual(
+                db.query_gemm_nearest(query, entry, 1.0), ("algo_a", 6, 1, True)
+            )
+            # M=16 is within 4x of M=5 but outvoted.
+            self.assertEqual(
+                db.query_gemm_nearest(query, entry, 2.0), ("algo_a", 6, 1, False)
+            )
+            self.assertEqual(
+                db.query_gemm_nearest(
+                    query, entry, 2.0, is_valid_algo=lambda algo: algo == "algo_b"
+                ),
+                ("algo_b", 16, 1, False),
+            )
+            approx = db.approximate_gemm_entries()
+            self.assertEqual(len(approx), 1)
+            self.assertEqual(approx[0]["exec_entry"], entry)
+
+            # Profiling the workload replaces the approximate result.
+            db.insert_gemm(
+                {
+                    **query,
+                    "exec_entry": entry,
+                    "algo": "algo_c",
+                    "workspace": 0,
+                    "split_k": 1,
+                }
+            )
+            self.assertEqual(db.query_gemm(query), ("algo_c", 0, 1))
+            self.assertEqual(db.approximate_gemm_entries(), [])
+
+    def test_gemm_profiler_cache_nearest(self):
+        test_name = "gemm_rcr_profiler_cache_nearest"
+        logger = "aitemplate.compiler.transform.profile"
+
+        _LOGGER.info(f"running {test_name=}")
+        with tempfile.TemporaryDirectory() as tmp_dirname:
+            run1_logs = self._run_test(
+                first_dim=IntImm(4),
+                test_name=test_name,
+                logger=logger,
+                cache_dir=tmp_dirname,
+            )
+            self.assertIn("generated 1 profilers", run1_logs)
+
+            with env_variables(AIT_PROFILE_CACHE_NEAREST_DISTANCE="1"):
+                run2_logs = self._run_test(
+                    first_dim=IntImm(5),
+                    test_name=test_name,
+                    logger=logger,
+                    cache_dir=tmp_dirname,
+                )
+            self.assertIn("generated 0 profilers", run2_logs)
+
+
 if __name__ == "__main__":
     unittest.main()